@@ -0,0 +1,487 @@
+//microbenchmarks for the cpu side operations of Mesh, Frame and LabelMngr that the data pipelines call on every sample. Runs without a gl context
+//every benchmark runs at a few sizes, counted in elements: vertices for the meshes, pixels for the frames and labels for the LabelMngr. Like google benchmark, each one is repeated until it ran for at least --min-time seconds and we report the time per iteration, the elements per second and the heap allocations per iteration
+//the allocations are counted by replacing operator new, in all its variants, so they are the ones of the c++ containers and objects. Eigen and OpenCV allocate their buffers with malloc directly and those are not counted
+//
+//  ./bench_cpu_ops [--filter substring] [--sizes 10000,100000] [--min-time 0.5] [--json out.json] [--list]
+
+//c++
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <streambuf>
+#include <filesystem>
+#include <unistd.h>
+
+//my stuff
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/Frame.h"
+#include "easy_pbr/LabelMngr.h"
+
+#include <igl/writeOFF.h>
+#include <igl/writeSTL.h>
+
+using namespace easy_pbr;
+namespace fs = std::filesystem;
+
+
+
+//allocations made while a benchmark is being timed
+namespace alloc_counter{
+    std::atomic<bool> enabled{false};
+    std::atomic<unsigned long long> nr_allocs{0};
+    std::atomic<unsigned long long> nr_bytes{0};
+
+    inline void count(const size_t size){
+        if(enabled.load(std::memory_order_relaxed)){
+            nr_allocs.fetch_add(1, std::memory_order_relaxed);
+            nr_bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+} //namespace alloc_counter
+
+//the replaceable allocation functions, the other ones of the standard library end up calling these
+static void* counted_alloc(const size_t size, const size_t alignment){
+    alloc_counter::count(size);
+    if(alignment<=alignof(std::max_align_t)){
+        return std::malloc(size==0 ? 1 : size);
+    }
+    //aligned_alloc wants the size to be a multiple of the alignment, and a size of 0 may give back null which new can't return
+    size_t aligned_size=size==0 ? alignment : ((size+alignment-1)/alignment)*alignment;
+    return std::aligned_alloc(alignment, aligned_size);
+}
+static void* counted_alloc_or_throw(const size_t size, const size_t alignment){
+    if(void* ptr=counted_alloc(size, alignment)){
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size){ return counted_alloc_or_throw(size, 0); }
+void* operator new[](size_t size){ return counted_alloc_or_throw(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept{ return counted_alloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{ return counted_alloc(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment){ return counted_alloc_or_throw(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment){ return counted_alloc_or_throw(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{ return counted_alloc(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{ return counted_alloc(size, (size_t)alignment); }
+
+void operator delete(void* ptr) noexcept{ std::free(ptr); }
+void operator delete[](void* ptr) noexcept{ std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept{ std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept{ std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept{ std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept{ std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept{ std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept{ std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept{ std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept{ std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept{ std::free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept{ std::free(ptr); }
+
+
+//LabelMngr prints to std::cout, which would interleave with the table and make the timing depend on the terminal. While this is alive, whatever goes to std::cout is discarded
+class SilenceCout{
+public:
+    SilenceCout(): m_prev_buf(std::cout.rdbuf(&m_null_buf)) {}
+    ~SilenceCout(){ std::cout.rdbuf(m_prev_buf); }
+private:
+    class NullBuf: public std::streambuf{
+    protected:
+        int overflow(int c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    };
+    NullBuf m_null_buf;
+    std::streambuf* m_prev_buf;
+};
+
+
+
+//passed to each benchmark, which does its setup and then loops with while(state.keep_running()). Work that shouldn't be measured, like restoring the input, goes between pause_timing() and resume_timing()
+class BenchState{
+public:
+    BenchState(const int size, const long long max_iterations): m_nr_iterations(0), m_items_processed(0), m_elapsed_ns(0), m_nr_allocs(0), m_nr_bytes_allocated(0), m_size(size), m_max_iterations(max_iterations), m_running(false) {}
+
+    int size() const { return m_size; }
+
+    bool keep_running(){
+        if(m_running){
+            pause_timing();
+        }
+        if(m_nr_iterations>=m_max_iterations){
+            return false;
+        }
+        m_nr_iterations++;
+        resume_timing();
+        return true;
+    }
+    void pause_timing(){
+        alloc_counter::enabled=false;
+        m_elapsed_ns+=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-m_start).count();
+        m_nr_allocs+=alloc_counter::nr_allocs-m_allocs_at_start;
+        m_nr_bytes_allocated+=alloc_counter::nr_bytes-m_bytes_at_start;
+        m_running=false;
+    }
+    void resume_timing(){
+        m_running=true;
+        m_allocs_at_start=alloc_counter::nr_allocs;
+        m_bytes_at_start=alloc_counter::nr_bytes;
+        m_start=std::chrono::steady_clock::now();
+        alloc_counter::enabled=true;
+    }
+    void set_items_processed(const long long nr_items){ m_items_processed=nr_items; }
+
+    long long m_nr_iterations;
+    long long m_items_processed; //over all iterations
+    long long m_elapsed_ns;
+    unsigned long long m_nr_allocs;
+    unsigned long long m_nr_bytes_allocated;
+
+private:
+    int m_size;
+    long long m_max_iterations;
+    bool m_running;
+    std::chrono::steady_clock::time_point m_start;
+    unsigned long long m_allocs_at_start;
+    unsigned long long m_bytes_at_start;
+};
+
+struct Benchmark{
+    std::string name;
+    std::vector<int> sizes;
+    std::function<void(BenchState&)> func;
+};
+
+
+
+//a wavy grid with uvs, about size vertices. Nothing sits at the origin since saving a mesh drops the vertices at zero
+struct GridMesh{
+    Eigen::MatrixXd V;
+    Eigen::MatrixXi F;
+    Eigen::MatrixXd UV;
+};
+
+GridMesh create_grid_mesh(const int nr_vertices){
+    int side=std::max(2, (int)std::sqrt((double)nr_vertices));
+    GridMesh grid;
+    grid.V.resize(side*side, 3);
+    grid.UV.resize(side*side, 2);
+    for(int y = 0; y < side; y++){
+        for(int x = 0; x < side; x++){
+            double u=x/(side-1.0);
+            double v=y/(side-1.0);
+            grid.V.row(y*side+x) << u, 0.05*std::sin(u*20.0)*std::cos(v*20.0), v+1.0;
+            grid.UV.row(y*side+x) << u, v;
+        }
+    }
+    grid.F.resize(2*(side-1)*(side-1), 3);
+    int f=0;
+    for(int y = 0; y < side-1; y++){
+        for(int x = 0; x < side-1; x++){
+            int idx=y*side+x;
+            grid.F.row(f++) << idx, idx+side, idx+1;
+            grid.F.row(f++) << idx+1, idx+side, idx+side+1;
+        }
+    }
+    return grid;
+}
+
+std::shared_ptr<Mesh> create_mesh(const GridMesh& grid){
+    std::shared_ptr<Mesh> mesh=Mesh::create();
+    mesh->V=grid.V;
+    mesh->F=grid.F;
+    mesh->UV=grid.UV;
+    return mesh;
+}
+
+//a frame looking at a bumpy wall with roughly 4:3 pixels
+Frame create_frame(const int nr_pixels){
+    Frame frame;
+    frame.width=std::max(1, (int)std::sqrt(nr_pixels*4.0/3.0));
+    frame.height=std::max(1, nr_pixels/frame.width);
+    frame.K << frame.width, 0, frame.width/2.0,
+               0, frame.width, frame.height/2.0,
+               0, 0, 1;
+    frame.depth=cv::Mat(frame.height, frame.width, CV_32FC1);
+    frame.rgb_8u=cv::Mat(frame.height, frame.width, CV_8UC3);
+    cv::randu(frame.rgb_8u, cv::Scalar::all(0), cv::Scalar::all(255));
+    for(int y = 0; y < frame.height; y++){
+        for(int x = 0; x < frame.width; x++){
+            //some pixels have no depth like in real sensors
+            frame.depth.at<float>(y, x)= (x*7+y*13)%17==0 ? 0.0 : 2.0+0.2*std::sin(x*0.05)*std::cos(y*0.05);
+        }
+    }
+    frame.tf_cam_world.translation() << 0.1, 0.2, 0.3;
+    return frame;
+}
+
+
+
+std::string tmp_dir(){
+    static std::string dir;
+    if(dir.empty()){
+        dir=(fs::temp_directory_path()/("bench_cpu_ops_"+std::to_string(getpid()))).string();
+        fs::create_directories(dir);
+    }
+    return dir;
+}
+
+Benchmark load_benchmark(const std::string& ext){
+    return { "Mesh::load_from_file/"+ext, {10000, 100000, 1000000}, [ext](BenchState& state){
+        GridMesh grid=create_grid_mesh(state.size());
+        std::string path=tmp_dir()+"/mesh_"+std::to_string(state.size())+"."+ext;
+        if(ext=="off"){
+            igl::writeOFF(path, grid.V, grid.F);
+        }else if(ext=="stl"){
+            igl::writeSTL(path, grid.V, grid.F);
+        }else{
+            create_mesh(grid)->save_to_file(path);
+        }
+        while(state.keep_running()){
+            std::shared_ptr<Mesh> mesh=Mesh::create();
+            mesh->load_from_file(path);
+        }
+        state.set_items_processed(state.m_nr_iterations*grid.V.rows());
+    }};
+}
+
+std::vector<Benchmark> all_benchmarks(){
+    std::vector<Benchmark> benchmarks;
+
+    benchmarks.push_back( load_benchmark("obj") );
+    benchmarks.push_back( load_benchmark("ply") );
+    benchmarks.push_back( load_benchmark("off") );
+    benchmarks.push_back( load_benchmark("stl") );
+
+    benchmarks.push_back({ "Mesh::remove_marked_vertices", {10000, 100000, 1000000}, [](BenchState& state){
+        GridMesh grid=create_grid_mesh(state.size());
+        std::shared_ptr<Mesh> mesh=create_mesh(grid);
+        std::vector<bool> mask(grid.V.rows());
+        for(size_t i = 0; i < mask.size(); i++){
+            mask[i]= (i%3)!=0;
+        }
+        while(state.keep_running()){
+            mesh->remove_marked_vertices(mask, true);
+            state.pause_timing();
+            mesh->V=grid.V;
+            mesh->F=grid.F;
+            mesh->UV=grid.UV;
+            state.resume_timing();
+        }
+        state.set_items_processed(state.m_nr_iterations*grid.V.rows());
+    }});
+
+    benchmarks.push_back({ "Mesh::recalculate_normals", {10000, 100000, 1000000}, [](BenchState& state){
+        GridMesh grid=create_grid_mesh(state.size());
+        std::shared_ptr<Mesh> mesh=create_mesh(grid);
+        while(state.keep_running()){
+            mesh->recalculate_normals();
+        }
+        state.set_items_processed(state.m_nr_iterations*grid.V.rows());
+    }});
+
+    benchmarks.push_back({ "Mesh::compute_tangents", {10000, 100000, 1000000}, [](BenchState& state){
+        GridMesh grid=create_grid_mesh(state.size());
+        std::shared_ptr<Mesh> mesh=create_mesh(grid);
+        mesh->recalculate_normals();
+        while(state.keep_running()){
+            mesh->compute_tangents();
+        }
+        state.set_items_processed(state.m_nr_iterations*grid.V.rows());
+    }});
+
+    benchmarks.push_back({ "Mesh::decimate", {10000, 100000}, [](BenchState& state){
+        GridMesh grid=create_grid_mesh(state.size());
+        std::shared_ptr<Mesh> mesh=create_mesh(grid);
+        while(state.keep_running()){
+            mesh->decimate(grid.F.rows()/10);
+            state.pause_timing();
+            mesh->V=grid.V;
+            mesh->F=grid.F;
+            mesh->UV=grid.UV;
+            state.resume_timing();
+        }
+        state.set_items_processed(state.m_nr_iterations*grid.V.rows());
+    }});
+
+    benchmarks.push_back({ "Frame::depth2world_xyz_mat", {640*480, 1280*720, 1920*1080}, [](BenchState& state){
+        Frame frame=create_frame(state.size());
+        while(state.keep_running()){
+            cv::Mat xyz=frame.depth2world_xyz_mat();
+        }
+        state.set_items_processed(state.m_nr_iterations*frame.width*frame.height);
+    }});
+
+    benchmarks.push_back({ "Frame::assign_color", {640*480, 1280*720, 1920*1080}, [](BenchState& state){
+        Frame frame=create_frame(state.size());
+        //the points seen by the frame itself, so they all land inside of the image
+        cv::Mat xyz=frame.depth2world_xyz_mat();
+        std::shared_ptr<Mesh> cloud=Mesh::create();
+        cloud->V.resize(xyz.rows*xyz.cols, 3);
+        for(int y = 0; y < xyz.rows; y++){
+            for(int x = 0; x < xyz.cols; x++){
+                cv::Vec3f p=xyz.at<cv::Vec3f>(y, x);
+                cloud->V.row(y*xyz.cols+x) << p[0], p[1], p[2];
+            }
+        }
+        while(state.keep_running()){
+            frame.assign_color(cloud);
+        }
+        state.set_items_processed(state.m_nr_iterations*cloud->V.rows());
+    }});
+
+    benchmarks.push_back({ "LabelMngr::reindex_into_compacted_labels", {100000, 1000000, 10000000}, [](BenchState& state){
+        SilenceCout silence_cout;
+        const int nr_classes=20;
+        LabelMngr label_mngr(nr_classes, 0);
+        label_mngr.compact("class_5");
+        Eigen::MatrixXi labels_original(state.size(), 1);
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<int> class_distrib(0, nr_classes-1);
+        for(int i = 0; i < labels_original.rows(); i++){
+            labels_original(i)=class_distrib(gen);
+        }
+        Eigen::MatrixXi labels=labels_original;
+        while(state.keep_running()){
+            label_mngr.reindex_into_compacted_labels(labels);
+            state.pause_timing();
+            labels=labels_original;
+            state.resume_timing();
+        }
+        state.set_items_processed(state.m_nr_iterations*labels.rows());
+    }});
+
+    return benchmarks;
+}
+
+
+
+struct BenchResult{
+    std::string name;
+    int size;
+    long long nr_iterations;
+    double ns_per_iter;
+    double items_per_s;
+    double allocs_per_iter;
+    double bytes_allocated_per_iter;
+};
+
+//runs it with more and more iterations until it takes at least min_time_s, the same as google benchmark does
+BenchResult run(const Benchmark& benchmark, const int size, const double min_time_s){
+    long long nr_iterations=1;
+    while(true){
+        BenchState state(size, nr_iterations);
+        benchmark.func(state);
+        double elapsed_s=state.m_elapsed_ns/1e9;
+        if(elapsed_s>=min_time_s || nr_iterations>=1000000000){
+            BenchResult result;
+            result.name=benchmark.name;
+            result.size=size;
+            result.nr_iterations=state.m_nr_iterations;
+            result.ns_per_iter=(double)state.m_elapsed_ns/state.m_nr_iterations;
+            result.items_per_s= elapsed_s>0 ? state.m_items_processed/elapsed_s : 0.0;
+            result.allocs_per_iter=(double)state.m_nr_allocs/state.m_nr_iterations;
+            result.bytes_allocated_per_iter=(double)state.m_nr_bytes_allocated/state.m_nr_iterations;
+            return result;
+        }
+        //aim a bit above the min time so we don't need many more rounds
+        double multiplier= elapsed_s>0 ? std::min(10.0, 1.4*min_time_s/elapsed_s) : 10.0;
+        nr_iterations=std::max(nr_iterations+1, (long long)(nr_iterations*multiplier));
+    }
+}
+
+std::string human_readable(const double value){
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    if(value>=1e9){ ss << value/1e9 << "G"; }
+    else if(value>=1e6){ ss << value/1e6 << "M"; }
+    else if(value>=1e3){ ss << value/1e3 << "k"; }
+    else{ ss << value; }
+    return ss.str();
+}
+
+int main(int argc, char *argv[]) {
+    std::string filter;
+    std::vector<int> sizes;
+    double min_time_s=0.5;
+    std::string json_path;
+    bool list=false;
+    for(int i = 1; i < argc; i++){
+        std::string arg=argv[i];
+        bool has_value=i+1<argc;
+        if(arg=="--filter" && has_value){ filter=argv[++i]; }
+        else if(arg=="--min-time" && has_value){ min_time_s=std::stod(argv[++i]); }
+        else if(arg=="--json" && has_value){ json_path=argv[++i]; }
+        else if(arg=="--list"){ list=true; }
+        else if(arg=="--sizes" && has_value){
+            std::stringstream ss(argv[++i]);
+            std::string size;
+            while(std::getline(ss, size, ',')){
+                sizes.push_back(std::stoi(size));
+            }
+        }
+        else{
+            std::cerr << "Unknown argument " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--filter substring] [--sizes 10000,100000] [--min-time 0.5] [--json out.json] [--list]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Benchmark> benchmarks;
+    for(const Benchmark& benchmark : all_benchmarks()){
+        if(benchmark.name.find(filter)!=std::string::npos){
+            benchmarks.push_back(benchmark);
+        }
+    }
+    if(list){
+        for(const Benchmark& benchmark : benchmarks){
+            std::cout << benchmark.name << std::endl;
+        }
+        return 0;
+    }
+
+    std::cout << std::left << std::setw(52) << "Benchmark" << std::right << std::setw(14) << "Time" << std::setw(12) << "Iterations"
+              << std::setw(14) << "items/s" << std::setw(14) << "allocs/iter" << std::setw(14) << "bytes/iter" << std::endl;
+    std::cout << std::string(120, '-') << std::endl;
+    std::vector<BenchResult> results;
+    for(const Benchmark& benchmark : benchmarks){
+        for(int size : (sizes.empty() ? benchmark.sizes : sizes)){
+            BenchResult r=run(benchmark, size, min_time_s);
+            results.push_back(r);
+            std::stringstream time;
+            time << std::fixed << std::setprecision(3) << r.ns_per_iter/1e6 << " ms";
+            std::cout << std::left << std::setw(52) << (r.name+"/"+std::to_string(r.size)) << std::right << std::setw(14) << time.str() << std::setw(12) << r.nr_iterations
+                      << std::setw(14) << human_readable(r.items_per_s) << std::setw(14) << human_readable(r.allocs_per_iter) << std::setw(14) << human_readable(r.bytes_allocated_per_iter) << std::endl;
+        }
+    }
+    fs::remove_all(tmp_dir());
+
+    if(!json_path.empty()){
+        std::ofstream file(json_path);
+        if(!file.is_open()){
+            std::cerr << "Could not open " << json_path << std::endl;
+            return 1;
+        }
+        file << std::fixed << std::setprecision(3);
+        file << "{\n  \"benchmarks\": [";
+        for(size_t i = 0; i < results.size(); i++){
+            const BenchResult& r=results[i];
+            file << (i==0 ? "\n" : ",\n");
+            file << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size << ", \"iterations\": " << r.nr_iterations << ", \"ns_per_iter\": " << r.ns_per_iter
+                 << ", \"items_per_second\": " << r.items_per_s << ", \"allocs_per_iter\": " << r.allocs_per_iter << ", \"bytes_allocated_per_iter\": " << r.bytes_allocated_per_iter << "}";
+        }
+        file << "\n  ]\n}\n";
+    }
+
+    return 0;
+}
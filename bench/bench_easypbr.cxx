@@ -0,0 +1,534 @@
+//renders a set of standard scenes without a window along a fixed camera path and writes per pass and per frame times, bytes uploaded to the gpu and draw calls as json, so that two commits can be compared on the same machine
+//the scenes are the presets in config/ drawn over the same reference content (the head and a grid of pbr spheres) and synthetic scenes that scale one thing at a time: meshes, points, surfels, lights and the ssao, bloom and ibl passes
+//each scene runs in its own process so that the static scene, the tracer and the gl context of one scene don't leak into the next
+//
+//  ./bench_easypbr [--backend egl|osmesa] [--frames 200] [--warmup 20] [--width 1280] [--height 720] [--out bench_easypbr.json] [--scenes spec;spec;...] [--list]
+//
+//a scene spec is either "preset:<name of a config without .cfg>" or "synthetic:" followed by comma separated key=value pairs out of
+//meshes, points, lights, surfels (0/1), ssao (0/1), bloom (0/1), ibl (0/1). Keys that are left out take the defaults of synthetic_defaults()
+//the frame times include a glFinish so they are the time until the frame is done on the gpu, the pass times come from the Tracer and have a cpu and a gpu entry each
+
+//c++
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <unistd.h>
+
+//my stuff
+#include "easy_pbr/Viewer.h"
+#include "easy_pbr/Scene.h"
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/Camera.h"
+#include "easy_pbr/Tracer.h"
+
+#include <glad/glad.h>
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+//configuru
+#define CONFIGURU_WITH_EIGEN 1
+#define CONFIGURU_IMPLICIT_CONVERSIONS 1
+#include <configuru.hpp>
+
+using namespace easy_pbr;
+namespace fs = std::filesystem;
+
+
+struct BenchOptions{
+    std::string backend="egl";
+    int nr_frames=200;
+    int nr_warmup_frames=20;
+    int width=1280;
+    int height=720;
+    std::string out_path="bench_easypbr.json";
+    std::vector<std::string> scenes;
+    bool list=false;
+    std::string run_scene; //set when this process is the child that renders a single scene
+};
+
+struct SyntheticParams{
+    int nr_meshes;
+    int nr_points;
+    int nr_lights;
+    bool surfels;
+    bool ssao;
+    bool bloom;
+    bool ibl;
+};
+
+SyntheticParams synthetic_defaults(){
+    SyntheticParams params;
+    params.nr_meshes=100;
+    params.nr_points=0;
+    params.nr_lights=3;
+    params.surfels=false;
+    params.ssao=true;
+    params.bloom=false;
+    params.ibl=true;
+    return params;
+}
+
+std::vector<std::string> default_scenes(){
+    std::vector<std::string> scenes;
+    //every preset except the defaults, which the synthetic scenes already use
+    std::vector<std::string> presets;
+    for(const fs::directory_entry& entry : fs::directory_iterator( fs::path(DEFAULT_CONFIG).parent_path() )){
+        if(entry.path().extension()==".cfg" && entry.path().stem()!="default_params"){
+            presets.push_back(entry.path().stem().string());
+        }
+    }
+    std::sort(presets.begin(), presets.end());
+    for(const std::string& preset : presets){
+        scenes.push_back("preset:"+preset);
+    }
+
+    scenes.push_back("synthetic:meshes=100");
+    scenes.push_back("synthetic:meshes=2000");
+    scenes.push_back("synthetic:meshes=10,points=1000000");
+    scenes.push_back("synthetic:meshes=10,points=200000,surfels=1");
+    scenes.push_back("synthetic:meshes=100,lights=0");
+    scenes.push_back("synthetic:meshes=100,lights=8");
+    scenes.push_back("synthetic:meshes=100,ssao=0,bloom=0,ibl=0");
+    scenes.push_back("synthetic:meshes=100,ssao=1,bloom=1,ibl=1");
+    return scenes;
+}
+
+SyntheticParams parse_synthetic(const std::string& spec){
+    SyntheticParams params=synthetic_defaults();
+    std::stringstream ss( spec.substr(std::string("synthetic:").size()) );
+    std::string pair;
+    while(std::getline(ss, pair, ',')){
+        if(pair.empty()){
+            continue;
+        }
+        size_t eq=pair.find('=');
+        CHECK(eq!=std::string::npos) << "Expected key=value in " << spec << " but got " << pair;
+        std::string key=pair.substr(0, eq);
+        int value=std::stoi(pair.substr(eq+1));
+        if(key=="meshes"){ params.nr_meshes=value; }
+        else if(key=="points"){ params.nr_points=value; }
+        else if(key=="lights"){ params.nr_lights=value; }
+        else if(key=="surfels"){ params.surfels=value; }
+        else if(key=="ssao"){ params.ssao=value; }
+        else if(key=="bloom"){ params.bloom=value; }
+        else if(key=="ibl"){ params.ibl=value; }
+        else{ LOG(FATAL) << "Unknown key " << key << " in " << spec; }
+    }
+    return params;
+}
+
+
+
+//counts the draw calls and the bytes that go to the gpu by wrapping the function pointers that glad loaded. Installed after the viewer is created so the precomputation of the ibl and the like is not included
+namespace counters{
+    unsigned long long nr_draw_calls=0;
+    unsigned long long nr_dispatches=0;
+    unsigned long long nr_bytes_uploaded=0;
+    GLuint bound_unpack_buffer=0; //with a pixel unpack buffer bound the pointer of glTexImage is an offset and the bytes were already counted when filling the buffer
+
+    PFNGLDRAWARRAYSPROC draw_arrays;
+    PFNGLDRAWELEMENTSPROC draw_elements;
+    PFNGLDRAWARRAYSINSTANCEDPROC draw_arrays_instanced;
+    PFNGLDRAWELEMENTSINSTANCEDPROC draw_elements_instanced;
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC multi_draw_elements_indirect;
+    PFNGLDISPATCHCOMPUTEPROC dispatch_compute;
+    PFNGLBINDBUFFERPROC bind_buffer;
+    PFNGLBUFFERDATAPROC buffer_data;
+    PFNGLBUFFERSUBDATAPROC buffer_sub_data;
+    PFNGLMAPBUFFERRANGEPROC map_buffer_range;
+    PFNGLTEXIMAGE2DPROC tex_image_2d;
+    PFNGLTEXSUBIMAGE2DPROC tex_sub_image_2d;
+
+    size_t bytes_per_pixel(const GLenum format, const GLenum type){
+        int nr_channels=4;
+        switch(format){
+            case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: nr_channels=1; break;
+            case GL_RG: case GL_RG_INTEGER: nr_channels=2; break;
+            case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: nr_channels=3; break;
+        }
+        size_t channel_size=4;
+        switch(type){
+            case GL_UNSIGNED_BYTE: case GL_BYTE: channel_size=1; break;
+            case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: channel_size=2; break;
+        }
+        return nr_channels*channel_size;
+    }
+
+    void APIENTRY count_draw_arrays(GLenum mode, GLint first, GLsizei count){ nr_draw_calls++; draw_arrays(mode, first, count); }
+    void APIENTRY count_draw_elements(GLenum mode, GLsizei count, GLenum type, const void* indices){ nr_draw_calls++; draw_elements(mode, count, type, indices); }
+    void APIENTRY count_draw_arrays_instanced(GLenum mode, GLint first, GLsizei count, GLsizei nr_instances){ nr_draw_calls++; draw_arrays_instanced(mode, first, count, nr_instances); }
+    void APIENTRY count_draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei nr_instances){ nr_draw_calls++; draw_elements_instanced(mode, count, type, indices, nr_instances); }
+    void APIENTRY count_multi_draw_elements_indirect(GLenum mode, GLenum type, const void* indirect, GLsizei draw_count, GLsizei stride){ nr_draw_calls++; multi_draw_elements_indirect(mode, type, indirect, draw_count, stride); }
+    void APIENTRY count_dispatch_compute(GLuint x, GLuint y, GLuint z){ nr_dispatches++; dispatch_compute(x, y, z); }
+    void APIENTRY count_bind_buffer(GLenum target, GLuint buffer){
+        if(target==GL_PIXEL_UNPACK_BUFFER){
+            bound_unpack_buffer=buffer;
+        }
+        bind_buffer(target, buffer);
+    }
+    void APIENTRY count_buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage){
+        if(data){ //a null pointer only allocates
+            nr_bytes_uploaded+=size;
+        }
+        buffer_data(target, size, data, usage);
+    }
+    void APIENTRY count_buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void* data){ nr_bytes_uploaded+=size; buffer_sub_data(target, offset, size, data); }
+    void* APIENTRY count_map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access){
+        if(access&GL_MAP_WRITE_BIT){
+            nr_bytes_uploaded+=length;
+        }
+        return map_buffer_range(target, offset, length, access);
+    }
+    void APIENTRY count_tex_image_2d(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels){
+        if(pixels && !bound_unpack_buffer){
+            nr_bytes_uploaded+=(size_t)width*height*bytes_per_pixel(format, type);
+        }
+        tex_image_2d(target, level, internal_format, width, height, border, format, type, pixels);
+    }
+    void APIENTRY count_tex_sub_image_2d(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels){
+        if(pixels && !bound_unpack_buffer){
+            nr_bytes_uploaded+=(size_t)width*height*bytes_per_pixel(format, type);
+        }
+        tex_sub_image_2d(target, level, x, y, width, height, format, type, pixels);
+    }
+
+    void install(){
+        draw_arrays=glad_glDrawArrays; glad_glDrawArrays=count_draw_arrays;
+        draw_elements=glad_glDrawElements; glad_glDrawElements=count_draw_elements;
+        draw_arrays_instanced=glad_glDrawArraysInstanced; glad_glDrawArraysInstanced=count_draw_arrays_instanced;
+        draw_elements_instanced=glad_glDrawElementsInstanced; glad_glDrawElementsInstanced=count_draw_elements_instanced;
+        multi_draw_elements_indirect=glad_glMultiDrawElementsIndirect; glad_glMultiDrawElementsIndirect=count_multi_draw_elements_indirect;
+        dispatch_compute=glad_glDispatchCompute; glad_glDispatchCompute=count_dispatch_compute;
+        bind_buffer=glad_glBindBuffer; glad_glBindBuffer=count_bind_buffer;
+        buffer_data=glad_glBufferData; glad_glBufferData=count_buffer_data;
+        buffer_sub_data=glad_glBufferSubData; glad_glBufferSubData=count_buffer_sub_data;
+        map_buffer_range=glad_glMapBufferRange; glad_glMapBufferRange=count_map_buffer_range;
+        tex_image_2d=glad_glTexImage2D; glad_glTexImage2D=count_tex_image_2d;
+        tex_sub_image_2d=glad_glTexSubImage2D; glad_glTexSubImage2D=count_tex_sub_image_2d;
+    }
+} //namespace counters
+
+
+
+//the config of the scene is the preset or the defaults with the backend, the resolution and the options of the synthetic scene on top
+std::string write_config(const std::string& spec, const BenchOptions& options, const std::string& tmp_dir){
+    bool is_preset=spec.rfind("preset:", 0)==0;
+    fs::path config_dir=fs::path(DEFAULT_CONFIG).parent_path();
+    std::string base_config= is_preset ? (config_dir/(spec.substr(7)+".cfg")).string() : std::string(DEFAULT_CONFIG);
+    CHECK(fs::exists(base_config)) << "No config for " << spec << " at " << base_config;
+
+    configuru::Config cfg=configuru::parse_file(base_config, configuru::CFG);
+    cfg["core"]["context"]=options.backend;
+    cfg["core"]["headless_width"]=options.width;
+    cfg["core"]["headless_height"]=options.height;
+    cfg["visualization"]["show_gui"]=false;
+
+    if(!is_preset){
+        SyntheticParams params=parse_synthetic(spec);
+        cfg["visualization"]["ssao"]["enable_ssao"]=params.ssao;
+        cfg["visualization"]["ssao"]["auto_settings"]=false; //otherwise it gets turned on or off depending on the scene
+        cfg["visualization"]["bloom"]["enable_bloom"]=params.bloom;
+        cfg["visualization"]["ibl"]["enable_ibl"]=params.ibl;
+        cfg["visualization"]["lights"]["nr_spot_lights"]=params.nr_lights;
+        for(int i = 0; i < params.nr_lights; i++){
+            std::string name="spot_light_"+std::to_string(i);
+            if(!cfg["visualization"]["lights"].has_key(name)){
+                cfg["visualization"]["lights"][name]=configuru::Config::object({ {"power", "auto"}, {"color", "auto"}, {"create_shadow", true}, {"shadow_map_resolution", 1024} });
+            }
+        }
+    }
+
+    std::string path=tmp_dir+"/scene.cfg";
+    configuru::dump_file(path, cfg, configuru::CFG);
+    return path;
+}
+
+void add_reference_scene(){
+    MeshSharedPtr head=Mesh::create(std::string(EASYPBR_DATA_DIR)+"/head.obj");
+    Scene::show(head, "head");
+    float spacing=head->get_scale()*0.3;
+    const int grid_size=5;
+    for(int x = 0; x < grid_size; x++){
+        for(int y = 0; y < grid_size; y++){
+            MeshSharedPtr ball=Mesh::create(std::string(EASYPBR_DATA_DIR)+"/sphere.obj");
+            ball->V*=spacing*0.4/ball->get_scale();
+            ball->invalidate_bounds();
+            ball->translate_model_matrix( Eigen::Vector3d( head->get_scale()*0.8+x*spacing, y*spacing, 0.0 ) );
+            ball->m_vis.m_metalness=x/(grid_size-1.0);
+            ball->m_vis.m_roughness=y/(grid_size-1.0);
+            Scene::add_mesh(ball, "ball_"+std::to_string(x)+"_"+std::to_string(y));
+        }
+    }
+}
+
+void add_synthetic_scene(const SyntheticParams& params){
+    //a field of boxes of different sizes
+    int grid_size=std::max(1, (int)std::ceil(std::sqrt((double)params.nr_meshes)));
+    for(int i = 0; i < params.nr_meshes; i++){
+        MeshSharedPtr mesh=Mesh::create();
+        float size=0.3+0.7*((i*7)%11)/11.0;
+        mesh->create_box(size, size*2, size);
+        mesh->translate_model_matrix( Eigen::Vector3d( (i%grid_size)*1.2, size, (i/grid_size)*1.2 ) );
+        Scene::add_mesh(mesh, "box_"+std::to_string(i));
+    }
+
+    //a noisy sphere of points floating over the middle of the field
+    if(params.nr_points>0){
+        std::mt19937 gen(0);
+        std::normal_distribution<double> normal(0.0, 1.0);
+        std::uniform_real_distribution<double> noise(-0.02, 0.02);
+        double radius=std::max(1.0, grid_size*0.3);
+        MeshSharedPtr cloud=Mesh::create();
+        cloud->V.resize(params.nr_points, 3);
+        cloud->NV.resize(params.nr_points, 3);
+        for(int i = 0; i < params.nr_points; i++){
+            Eigen::Vector3d dir(normal(gen), normal(gen), normal(gen));
+            dir.normalize();
+            cloud->NV.row(i)=dir;
+            cloud->V.row(i)=dir*radius*(1.0+noise(gen));
+        }
+        cloud->translate_model_matrix( Eigen::Vector3d( grid_size*0.6, radius*1.5, grid_size*0.6 ) );
+        cloud->m_vis.m_show_mesh=false;
+        if(params.surfels){
+            cloud->compute_tangents( 2.5*radius/std::sqrt((double)params.nr_points) ); //about the spacing of the points so that the surfels close the surface
+            cloud->m_vis.m_show_surfels=true;
+        }else{
+            cloud->m_vis.m_show_points=true;
+        }
+        Scene::add_mesh(cloud, "cloud");
+    }
+}
+
+
+
+struct Summary{
+    double mean, p50, p90, p99, max;
+};
+
+Summary summarize(std::vector<double> values){
+    Summary s={0,0,0,0,0};
+    if(values.empty()){
+        return s;
+    }
+    std::sort(values.begin(), values.end());
+    for(double v : values){
+        s.mean+=v;
+    }
+    s.mean/=values.size();
+    auto percentile=[&values](const double p){ return values[ (size_t)std::round(p*(values.size()-1)) ]; };
+    s.p50=percentile(0.5);
+    s.p90=percentile(0.9);
+    s.p99=percentile(0.99);
+    s.max=values.back();
+    return s;
+}
+
+std::string to_json(const Summary& s){
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(4);
+    ss << "{\"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+    return ss.str();
+}
+
+std::string escape_json(const std::string& str){
+    std::string escaped;
+    for(char c : str){
+        if(c=='"' || c=='\\'){
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+//renders one scene and writes its json object to out_path
+int run_scene(const BenchOptions& options){
+    const std::string& spec=options.run_scene;
+    std::string tmp_dir=fs::path(options.out_path).parent_path().string();
+    std::shared_ptr<Viewer> view = Viewer::create( write_config(spec, options, tmp_dir) );
+    CHECK(view->is_headless()) << "The benchmark needs a headless context but " << options.backend << " did not give one";
+    counters::install();
+
+    if(spec.rfind("preset:", 0)==0){
+        add_reference_scene();
+    }else{
+        add_synthetic_scene( parse_synthetic(spec) );
+    }
+
+    //the first frames upload the meshes and stream the textures
+    auto setup_start=std::chrono::steady_clock::now();
+    for(int i = 0; i < options.nr_warmup_frames; i++){
+        view->draw();
+        glFinish();
+    }
+    double setup_ms=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-setup_start).count();
+    unsigned long long setup_bytes=counters::nr_bytes_uploaded;
+
+    //orbit around what the camera looks at after the automatic placement, moving in and out so that the culled meshes change
+    std::shared_ptr<Camera> cam=view->m_camera;
+    Eigen::Vector3f center=cam->lookat();
+    float radius=(cam->position()-center).norm();
+
+    Tracer::set_enabled(true);
+    Tracer::clear();
+    std::vector<double> submit_ms, frame_ms, draw_calls, dispatches, upload_bytes, meshes_drawn, triangles_drawn;
+    for(int i = 0; i < options.nr_frames; i++){
+        float angle=2.0*M_PI*i/options.nr_frames;
+        float dist=radius*(1.0+0.3*std::sin(2.0*angle));
+        cam->set_position(center+Eigen::Vector3f(dist*std::cos(angle), dist*0.5, dist*std::sin(angle)));
+        cam->set_lookat(center);
+
+        unsigned long long draw_calls_before=counters::nr_draw_calls;
+        unsigned long long dispatches_before=counters::nr_dispatches;
+        unsigned long long bytes_before=counters::nr_bytes_uploaded;
+        auto start=std::chrono::steady_clock::now();
+        view->draw();
+        auto submitted=std::chrono::steady_clock::now();
+        glFinish();
+        auto done=std::chrono::steady_clock::now();
+
+        submit_ms.push_back( std::chrono::duration<double, std::milli>(submitted-start).count() );
+        frame_ms.push_back( std::chrono::duration<double, std::milli>(done-start).count() );
+        draw_calls.push_back( counters::nr_draw_calls-draw_calls_before );
+        dispatches.push_back( counters::nr_dispatches-dispatches_before );
+        upload_bytes.push_back( counters::nr_bytes_uploaded-bytes_before );
+        meshes_drawn.push_back( view->m_nr_meshes_drawn );
+        triangles_drawn.push_back( view->m_nr_triangles_drawn );
+    }
+    Tracer::new_frame(); //collects the gpu times of the last frame
+    Tracer::set_enabled(false);
+
+    std::vector<TraceStats> passes=Tracer::stats();
+    std::sort(passes.begin(), passes.end(), [](const TraceStats& a, const TraceStats& b){ return a.mean_ms*a.count > b.mean_ms*b.count; });
+
+    std::ofstream file(options.out_path);
+    CHECK(file.is_open()) << "Could not open " << options.out_path;
+    file << std::fixed << std::setprecision(4);
+    file << "    {\n";
+    file << "      \"scene\": \"" << escape_json(spec) << "\",\n";
+    file << "      \"renderer\": \"" << escape_json((const char*)glGetString(GL_RENDERER)) << "\",\n";
+    file << "      \"nr_meshes\": " << Scene::nr_meshes() << ", \"nr_vertices\": " << Scene::nr_vertices() << ", \"nr_faces\": " << Scene::nr_faces() << ",\n";
+    file << "      \"setup\": {\"frames\": " << options.nr_warmup_frames << ", \"ms\": " << setup_ms << ", \"upload_bytes\": " << setup_bytes << "},\n";
+    file << "      \"frame_ms\": " << to_json(summarize(frame_ms)) << ",\n";
+    file << "      \"submit_ms\": " << to_json(summarize(submit_ms)) << ",\n";
+    file << "      \"draw_calls\": " << to_json(summarize(draw_calls)) << ",\n";
+    file << "      \"compute_dispatches\": " << to_json(summarize(dispatches)) << ",\n";
+    file << "      \"upload_bytes\": " << to_json(summarize(upload_bytes)) << ",\n";
+    file << "      \"meshes_drawn\": " << to_json(summarize(meshes_drawn)) << ",\n";
+    file << "      \"triangles_drawn\": " << to_json(summarize(triangles_drawn)) << ",\n";
+    file << "      \"passes\": [";
+    for(size_t i = 0; i < passes.size(); i++){
+        const TraceStats& p=passes[i];
+        file << (i==0 ? "\n" : ",\n");
+        file << "        {\"name\": \"" << escape_json(p.name) << "\", \"device\": \"" << (p.is_gpu ? "gpu" : "cpu") << "\", \"count\": " << p.count
+             << ", \"mean_ms\": " << p.mean_ms << ", \"p50_ms\": " << p.p50_ms << ", \"p90_ms\": " << p.p90_ms << ", \"p99_ms\": " << p.p99_ms << ", \"max_ms\": " << p.max_ms << "}";
+    }
+    file << "\n      ]\n";
+    file << "    }";
+
+    std::cerr << std::left << std::setw(48) << spec << std::right << std::fixed << std::setprecision(2)
+              << " frame p50 " << summarize(frame_ms).p50 << " ms  p99 " << summarize(frame_ms).p99 << " ms  draw calls " << summarize(draw_calls).mean << std::endl;
+    return 0;
+}
+
+
+
+BenchOptions parse_args(int argc, char *argv[]){
+    BenchOptions options;
+    for(int i = 1; i < argc; i++){
+        std::string arg=argv[i];
+        auto value=[&](){
+            CHECK(i+1<argc) << "Missing value for " << arg;
+            return std::string(argv[++i]);
+        };
+        if(arg=="--backend"){ options.backend=value(); }
+        else if(arg=="--frames"){ options.nr_frames=std::stoi(value()); }
+        else if(arg=="--warmup"){ options.nr_warmup_frames=std::stoi(value()); }
+        else if(arg=="--width"){ options.width=std::stoi(value()); }
+        else if(arg=="--height"){ options.height=std::stoi(value()); }
+        else if(arg=="--out"){ options.out_path=value(); }
+        else if(arg=="--run-scene"){ options.run_scene=value(); }
+        else if(arg=="--list"){ options.list=true; }
+        else if(arg=="--scenes"){
+            std::stringstream ss(value());
+            std::string spec;
+            while(std::getline(ss, spec, ';')){
+                if(!spec.empty()){
+                    options.scenes.push_back(spec);
+                }
+            }
+        }
+        else{ LOG(FATAL) << "Unknown argument " << arg; }
+    }
+    CHECK(options.nr_frames>0) << "Need at least one frame";
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options=parse_args(argc, argv);
+    if(!options.run_scene.empty()){
+        return run_scene(options);
+    }
+    if(options.scenes.empty()){
+        options.scenes=default_scenes();
+    }
+    if(options.list){
+        for(const std::string& spec : options.scenes){
+            std::cout << spec << std::endl;
+        }
+        return 0;
+    }
+
+    fs::path tmp_dir=fs::temp_directory_path()/("bench_easypbr_"+std::to_string(getpid()));
+    fs::create_directories(tmp_dir);
+
+    std::vector<std::string> results;
+    for(size_t i = 0; i < options.scenes.size(); i++){
+        const std::string& spec=options.scenes[i];
+        fs::path scene_dir=tmp_dir/std::to_string(i);
+        fs::create_directories(scene_dir);
+        fs::path scene_out=scene_dir/"result.json";
+        std::string cmd="'"+std::string(argv[0])+"' --run-scene '"+spec+"' --out '"+scene_out.string()+"'"
+                        +" --backend "+options.backend+" --frames "+std::to_string(options.nr_frames)+" --warmup "+std::to_string(options.nr_warmup_frames)
+                        +" --width "+std::to_string(options.width)+" --height "+std::to_string(options.height);
+        int status=std::system(cmd.c_str());
+
+        std::ifstream scene_file(scene_out);
+        if(status!=0 || !scene_file.is_open()){
+            LOG(WARNING) << "Scene " << spec << " failed with status " << status;
+            results.push_back("    {\"scene\": \""+escape_json(spec)+"\", \"error\": \"exit status "+std::to_string(status)+"\"}");
+            continue;
+        }
+        std::stringstream buffer;
+        buffer << scene_file.rdbuf();
+        results.push_back(buffer.str());
+    }
+    fs::remove_all(tmp_dir);
+
+    std::ofstream file(options.out_path);
+    CHECK(file.is_open()) << "Could not open " << options.out_path;
+    file << "{\n";
+    file << "  \"backend\": \"" << options.backend << "\", \"width\": " << options.width << ", \"height\": " << options.height
+         << ", \"frames\": " << options.nr_frames << ", \"warmup_frames\": " << options.nr_warmup_frames << ",\n";
+    file << "  \"scenes\": [\n";
+    for(size_t i = 0; i < results.size(); i++){
+        file << results[i] << (i+1<results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n";
+    file << "}\n";
+    std::cout << "Wrote " << options.out_path << std::endl;
+
+    return 0;
+}
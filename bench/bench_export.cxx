@@ -0,0 +1,106 @@
+//measures how many frames per second we can sustain at 1080p while exporting the gbuffer of every frame for a dataset, with the writers blocking the render loop when they fall behind
+//the time includes waiting at the end for the last frames to be on disk so it's the rate at which a long recording would run
+//run it with core.context set to "egl" or "osmesa" in the config to measure it without a window
+
+//c++
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+
+//my stuff
+#include "easy_pbr/Viewer.h"
+#include "easy_pbr/Scene.h"
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/Camera.h"
+#include "easy_pbr/Recorder.h"
+
+#include <glad/glad.h>
+
+using namespace easy_pbr;
+
+struct ExportSetup{
+    std::string name;
+    std::string format;
+    bool record_color_png;
+    bool color, depth, normals_world, normals_camera, mesh_id;
+};
+
+double run(const std::shared_ptr<Viewer>& view, const ExportSetup& setup, const int nr_frames, const std::string& out_path){
+    std::shared_ptr<Recorder> recorder=view->m_recorder;
+    recorder->m_export_format=RecorderFormat::_from_string(setup.format.c_str());
+    recorder->m_export_color=setup.color;
+    recorder->m_export_depth=setup.depth;
+    recorder->m_export_normals_world=setup.normals_world;
+    recorder->m_export_normals_camera=setup.normals_camera;
+    recorder->m_export_mesh_id=setup.mesh_id;
+    std::string path=out_path+"/"+setup.name;
+
+    std::shared_ptr<Camera> cam=view->m_camera;
+    Eigen::Vector3f center=cam->lookat();
+    float radius=(cam->position()-center).norm();
+
+    auto start=std::chrono::steady_clock::now();
+    for(int i = 0; i < nr_frames; i++){
+        float angle=2.0*M_PI*i/nr_frames;
+        cam->set_position(center+Eigen::Vector3f(radius*std::cos(angle), radius*0.5, radius*std::sin(angle)));
+        cam->set_lookat(center);
+        view->draw();
+
+        std::string name=std::to_string(i)+".png";
+        if(setup.record_color_png){
+            recorder->record(view->m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex"), name, path);
+        }
+        recorder->export_frame(name, path);
+        recorder->update();
+    }
+    recorder->flush();
+    double elapsed_s=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return nr_frames/elapsed_s;
+}
+
+int main(int argc, char *argv[]) {
+    const int nr_frames= argc>1 ? std::stoi(argv[1]) : 300;
+    const std::string out_path= argc>2 ? argv[2] : std::string("./bench_export_out");
+    const std::string config_file= argc>3 ? argv[3] : std::string(DEFAULT_CONFIG);
+
+    std::shared_ptr<Viewer> view = Viewer::create(config_file);
+    view->m_viewport_size=Eigen::Vector2f(1920, 1080);
+
+    //a field of boxes on a floor
+    const int grid_size=20;
+    for(int i = 0; i < grid_size*grid_size; i++){
+        MeshSharedPtr mesh=Mesh::create();
+        float size=0.3+0.7*((i*7)%11)/11.0;
+        mesh->create_box(size, size*2, size);
+        mesh->translate_model_matrix( Eigen::Vector3d( (i%grid_size)*1.2, size, (i/grid_size)*1.2 ) );
+        Scene::add_mesh(mesh, "box_"+std::to_string(i));
+    }
+    MeshSharedPtr floor=Mesh::create();
+    floor->create_floor(0.0, grid_size*1.5);
+    Scene::add_mesh(floor, "floor");
+    view->draw(); //sets the auto params of the camera for this scene
+
+    const std::vector<ExportSetup> setups={
+        {"png_color_only", "Npy", true, false, false, false, false, false },
+        {"npy_color_depth", "Npy", false, true, true, false, false, false },
+        {"npy_all", "Npy", false, true, true, true, true, true },
+        {"exr_all", "Exr", false, true, true, true, true, true },
+    };
+
+    std::cout << "frames: " << nr_frames << " headless: " << view->is_headless() << " renderer: " << glGetString(GL_RENDERER)
+              << " writers: " << view->m_recorder->m_nr_writer_threads << " output: " << out_path << std::endl;
+    for(const ExportSetup& setup : setups){
+        RecorderStats stats_before=view->m_recorder->stats();
+        double fps=run(view, setup, nr_frames, out_path);
+        RecorderStats stats=view->m_recorder->stats();
+        //the stats are accumulated since the start so we take only the part of this run
+        int nr_written=stats.nr_written-stats_before.nr_written;
+        double encode_ms= nr_written>0 ? (stats.avg_encode_ms*stats.nr_written - stats_before.avg_encode_ms*stats_before.nr_written)/nr_written : 0.0;
+        std::cout << std::left << std::setw(18) << setup.name << std::right << std::fixed << std::setprecision(1)
+                  << fps << " fps  files " << nr_written << "  encode avg " << encode_ms << " ms" << std::endl;
+    }
+
+    return 0;
+}
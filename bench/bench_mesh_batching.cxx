@@ -0,0 +1,79 @@
+//measures how long it takes the cpu to submit a frame with many small meshes, once drawing each mesh on its own and once with the multi draw indirect batching
+//the cpu time per draw of the separate draws is the one to compare when changing the per mesh state setup (uniforms, vao bindings)
+//the move to uniform buffers and a vao configured once was asked to come with the cpu time per draw before and after, and those numbers were never measured so that is still open. To get them build this benchmark at the commit before that change and at the one with it and run both on the same machine with the same arguments, for example ./bench_mesh_batching 2000 300
+//the older version doesn't print the cpu per draw, it is the submit time of the separate draws *1000/nr_meshes in microseconds
+//to get numbers for a software renderer run it as LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe ./bench_mesh_batching [nr_meshes] [nr_frames]
+
+//c++
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cmath>
+
+//my stuff
+#include "easy_pbr/Viewer.h"
+#include "easy_pbr/Scene.h"
+#include "easy_pbr/Mesh.h"
+
+#include <glad/glad.h>
+
+using namespace easy_pbr;
+
+struct FrameTimes{
+    double submit_ms; //cpu time spent inside draw()
+    double total_ms; //including waiting for the gpu to finish
+};
+
+FrameTimes run(const std::shared_ptr<Viewer>& view, const bool batching, const int nr_frames){
+    view->m_enable_mesh_batching=batching;
+
+    //warm up so that the batch is built and the shaders are compiled by the driver
+    for(int i = 0; i < 10; i++){
+        view->draw();
+        glFinish();
+    }
+
+    FrameTimes times;
+    times.submit_ms=0;
+    times.total_ms=0;
+    for(int i = 0; i < nr_frames; i++){
+        auto start=std::chrono::steady_clock::now();
+        view->draw();
+        auto submitted=std::chrono::steady_clock::now();
+        glFinish();
+        auto finished=std::chrono::steady_clock::now();
+        times.submit_ms+=std::chrono::duration<double, std::milli>(submitted-start).count();
+        times.total_ms+=std::chrono::duration<double, std::milli>(finished-start).count();
+    }
+    times.submit_ms/=nr_frames;
+    times.total_ms/=nr_frames;
+    return times;
+}
+
+int main(int argc, char *argv[]) {
+    const int nr_meshes= argc>1 ? std::stoi(argv[1]) : 10000;
+    const int nr_frames= argc>2 ? std::stoi(argv[2]) : 100;
+
+    std::shared_ptr<Viewer> view = Viewer::create(std::string(DEFAULT_CONFIG));
+    view->m_enable_ssao=false; //we only care about the geometry pass
+    view->m_enable_bloom=false;
+
+    //a grid of small boxes which are all in view so that none of them get frustum culled
+    const int grid_size=std::ceil(std::sqrt(nr_meshes));
+    for(int i = 0; i < nr_meshes; i++){
+        MeshSharedPtr mesh=Mesh::create();
+        mesh->create_box(0.5, 0.5, 0.5);
+        mesh->translate_model_matrix( Eigen::Vector3d( (i%grid_size)*2.0, 0.0, (i/grid_size)*2.0 ) );
+        mesh->m_vis.m_solid_color << (i%7)/7.0, (i%5)/5.0, (i%3)/3.0;
+        Scene::add_mesh(mesh, "box_"+std::to_string(i));
+    }
+
+    FrameTimes separate=run(view, false, nr_frames);
+    FrameTimes batched=run(view, true, nr_frames);
+
+    std::cout << "meshes: " << nr_meshes << " frames: " << nr_frames << std::endl;
+    std::cout << "separate draws  submit: " << separate.submit_ms << " ms  total: " << separate.total_ms << " ms  cpu per draw: " << separate.submit_ms*1000.0/nr_meshes << " us" << std::endl;
+    std::cout << "batched draws   submit: " << batched.submit_ms << " ms  total: " << batched.total_ms << " ms  (" << view->m_nr_batched_draws << " meshes in the batch)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+//measures how many frames per second we can render and bring back to the cpu when generating images from many camera poses
+//compares render_batch, which reads back through a ring of pbos, with the loop we used before: draw a pose and download the texture right away, which makes the cpu wait for the gpu every frame
+//run it with core.context set to "egl" or "osmesa" in the config to measure it without a window
+
+//c++
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+//my stuff
+#include "easy_pbr/Viewer.h"
+#include "easy_pbr/Scene.h"
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/Camera.h"
+
+#include <glad/glad.h>
+
+using namespace easy_pbr;
+
+//poses orbiting the center of the scene
+std::vector<Eigen::Matrix4f> create_poses(const int nr_poses, const Eigen::Vector3f& center, const float radius){
+    std::vector<Eigen::Matrix4f> poses;
+    Camera cam;
+    for(int i = 0; i < nr_poses; i++){
+        float angle=2.0*M_PI*i/nr_poses;
+        cam.set_lookat(center);
+        cam.set_position(center+Eigen::Vector3f(radius*std::cos(angle), radius*0.5, radius*std::sin(angle)));
+        poses.push_back(cam.model_matrix());
+    }
+    return poses;
+}
+
+double run_batch(const std::shared_ptr<Viewer>& view, const std::vector<Eigen::Matrix4f>& poses, const int width, const int height, const bool with_depth_and_normals){
+    //warm up so that the textures get allocated for this resolution
+    std::vector<Eigen::Matrix4f> warmup_poses(poses.begin(), poses.begin()+std::min<int>(5, poses.size()));
+    BatchRenderOutputs warmup_outputs;
+    warmup_outputs.allocate(warmup_poses.size(), width, height, true, with_depth_and_normals, with_depth_and_normals);
+    view->render_batch(warmup_poses, {}, warmup_outputs);
+
+    BatchRenderOutputs outputs;
+    outputs.allocate(poses.size(), width, height, true, with_depth_and_normals, with_depth_and_normals);
+    auto start=std::chrono::steady_clock::now();
+    view->render_batch(poses, {}, outputs);
+    double elapsed_s=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return poses.size()/elapsed_s;
+}
+
+double run_sync(const std::shared_ptr<Viewer>& view, const std::vector<Eigen::Matrix4f>& poses){
+    std::shared_ptr<Camera> cam=view->m_camera;
+    view->draw(); //warm up so that the textures get allocated for this resolution
+    auto start=std::chrono::steady_clock::now();
+    for(size_t i = 0; i < poses.size(); i++){
+        cam->m_model_matrix=Eigen::Affine3f(poses[i]);
+        view->draw();
+        cv::Mat img=view->m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex").download_to_cv_mat();
+    }
+    double elapsed_s=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return poses.size()/elapsed_s;
+}
+
+int main(int argc, char *argv[]) {
+    const int nr_poses= argc>1 ? std::stoi(argv[1]) : 200;
+    const std::string config_file= argc>2 ? argv[2] : std::string(DEFAULT_CONFIG);
+
+    std::shared_ptr<Viewer> view = Viewer::create(config_file);
+
+    //a field of boxes on a floor
+    const int grid_size=20;
+    for(int i = 0; i < grid_size*grid_size; i++){
+        MeshSharedPtr mesh=Mesh::create();
+        float size=0.3+0.7*((i*7)%11)/11.0;
+        mesh->create_box(size, size*2, size);
+        mesh->translate_model_matrix( Eigen::Vector3d( (i%grid_size)*1.2, size, (i/grid_size)*1.2 ) );
+        Scene::add_mesh(mesh, "box_"+std::to_string(i));
+    }
+    MeshSharedPtr floor=Mesh::create();
+    floor->create_floor(0.0, grid_size*1.5);
+    Scene::add_mesh(floor, "floor");
+    Eigen::Vector3f center(grid_size*0.6, 0.0, grid_size*0.6);
+    std::vector<Eigen::Matrix4f> poses=create_poses(nr_poses, center, grid_size*0.8);
+
+    //the first thing the fresh viewer draws is a batch, so the auto params of the first draw happen inside render_batch, which checks that they don't move the camera away from the pose
+    BatchRenderOutputs first_outputs;
+    first_outputs.allocate(1, view->m_viewport_size.x()/view->m_subsample_factor, view->m_viewport_size.y()/view->m_subsample_factor, true, false, false);
+    view->render_batch({poses[0]}, {}, first_outputs);
+
+    const std::vector<Eigen::Vector2i> resolutions={ {640,480}, {1280,720}, {1920,1080} };
+    std::cout << "poses: " << nr_poses << " headless: " << view->is_headless() << " renderer: " << glGetString(GL_RENDERER) << std::endl;
+    for(const Eigen::Vector2i& res : resolutions){
+        view->m_viewport_size=res.cast<float>();
+        int width=res.x()/view->m_subsample_factor;
+        int height=res.y()/view->m_subsample_factor;
+        std::cout << res.x() << "x" << res.y() << std::fixed << std::setprecision(1)
+                  << "  sync color: " << run_sync(view, poses) << " fps"
+                  << "  batch color: " << run_batch(view, poses, width, height, false) << " fps"
+                  << "  batch color+depth+normals: " << run_batch(view, poses, width, height, true) << " fps"
+                  << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+//measures the gpu time of each of the ssao passes (depth linearize, ao, blur) once with the fullscreen quad shaders and once with the compute shaders, for several resolutions and downsample levels
+//the times come from timestamp queries so they only contain the work of that pass on the gpu
+//to get numbers for a software renderer run it as LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe ./bench_ssao [nr_frames]
+
+//c++
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+//my stuff
+#include "easy_pbr/Viewer.h"
+#include "easy_pbr/Scene.h"
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/Tracer.h"
+
+#include <glad/glad.h>
+
+using namespace easy_pbr;
+
+const std::vector<std::string> pass_names={"depth_linearize_pass", "ao_pass", "blur_pass"};
+
+std::vector<double> run(const std::shared_ptr<Viewer>& view, const bool use_compute, const int nr_frames){
+    view->m_ssao_use_compute=use_compute;
+
+    //warm up so that the textures get allocated for this resolution
+    for(int i = 0; i < 5; i++){
+        view->draw();
+        glFinish();
+    }
+
+    std::vector<double> pass_ms(pass_names.size(), 0.0);
+    for(int i = 0; i < nr_frames; i++){
+        view->draw();
+        glFinish(); //makes sure the queries of this frame are available
+        Tracer::new_frame(); //otherwise the tracer only reads them at the start of the next draw
+        for(size_t p = 0; p < pass_names.size(); p++){
+            pass_ms[p]+=view->gpu_time_ms(pass_names[p]);
+        }
+    }
+    for(size_t p = 0; p < pass_names.size(); p++){
+        pass_ms[p]/=nr_frames;
+    }
+    return pass_ms;
+}
+
+void print(const std::string& name, const std::vector<double>& pass_ms){
+    double total=0;
+    std::cout << "  " << std::setw(8) << name;
+    for(size_t p = 0; p < pass_names.size(); p++){
+        std::cout << "  " << pass_names[p] << ": " << std::fixed << std::setprecision(3) << pass_ms[p] << " ms";
+        total+=pass_ms[p];
+    }
+    std::cout << "  total: " << total << " ms" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    const int nr_frames= argc>1 ? std::stoi(argv[1]) : 50;
+
+    std::shared_ptr<Viewer> view = Viewer::create(std::string(DEFAULT_CONFIG));
+    view->m_enable_ssao=true;
+    view->m_auto_ssao=false;
+    view->m_enable_bloom=false;
+
+    //a field of boxes of different sizes so that there are plenty of creases that get occluded
+    const int grid_size=20;
+    for(int i = 0; i < grid_size*grid_size; i++){
+        MeshSharedPtr mesh=Mesh::create();
+        float size=0.3+0.7*((i*7)%11)/11.0;
+        mesh->create_box(size, size*2, size);
+        mesh->translate_model_matrix( Eigen::Vector3d( (i%grid_size)*1.2, size, (i/grid_size)*1.2 ) );
+        Scene::add_mesh(mesh, "box_"+std::to_string(i));
+    }
+    MeshSharedPtr floor=Mesh::create();
+    floor->create_floor(0.0, grid_size*1.5);
+    Scene::add_mesh(floor, "floor");
+
+    const std::vector<Eigen::Vector2i> resolutions={ {1280,720}, {1920,1080}, {3840,2160} };
+    const std::vector<int> downsample_levels={0, 1, 2};
+
+    std::cout << "frames: " << nr_frames << " samples: " << view->m_nr_samples << std::endl;
+    for(const Eigen::Vector2i& res : resolutions){
+        view->m_viewport_size=res.cast<float>();
+        for(int lvl : downsample_levels){
+            view->m_ssao_downsample=lvl;
+            std::cout << res.x() << "x" << res.y() << " downsample " << lvl << std::endl;
+            print("raster", run(view, false, nr_frames));
+            print("compute", run(view, true, nr_frames));
+        }
+    }
+
+    return 0;
+}
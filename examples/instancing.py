@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+
+config_file="./config/balls.cfg"
+
+view=Viewer.create(config_file) 
+
+#the sphere is uploaded once and drawn on a grid of 20x20 with one draw call
+mesh=Mesh("./data/sphere.obj")
+transforms=[]
+colors=[]
+for x in range(20):
+    for z in range(20):
+        tf=np.identity(4)
+        tf[0,3]=(x-10)*2.5
+        tf[2,3]=(z-10)*2.5
+        transforms.append(tf)
+        colors.append([x/20.0, 0.5, z/20.0])
+Scene.add_instances(mesh, "balls", transforms, np.array(colors) )
+
+#hide the gird floor
+Scene.set_floor_visible(False)
+
+while True:
+    view.update()
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include <glad/glad.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "Texture2D.h"
+
+namespace easy_pbr{
+
+//copies textures into cpu memory through a ring of pixel buffer objects. read() only queues the copy on the gpu and puts a fence after it, the data is copied into the destination once that fence is signaled, either in process_ready() or when the ring wraps around and the buffer is needed again.
+//This way the gpu keeps working on the next frames instead of waiting for the cpu to map the buffer of the frame it just rendered
+class AsyncReadback: public std::enable_shared_from_this<AsyncReadback>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<AsyncReadback> create( Args&& ...args ){
+        return std::shared_ptr<AsyncReadback>( new AsyncReadback(std::forward<Args>(args)...) );
+    }
+    ~AsyncReadback();
+
+    //queues the copy of the first level of tex into dst. dst has to be allocated already with the size of the texture and a type that matches format and type. It keeps a reference to the data of dst until the copy is done.
+    //Rows are flipped so that the first row of dst is the top of the image, like opencv expects. on_done is called with dst right after it was filled, from whichever call completed the read
+    void read(gl::Texture2D& tex, const GLenum format, const GLenum type, cv::Mat& dst, const bool flip_y=true, std::function<void(const cv::Mat&)> on_done=nullptr);
+    int process_ready(); //copies into their destination the reads that the gpu finished already, without waiting for any of the others. Returns how many were copied
+    void finish(); //waits for all the pending reads
+
+    int nr_pending() const;
+    int nr_buffers() const;
+    int nr_stalls() const; //how many times read() had to wait for the gpu because all buffers were busy, if it's high the ring needs more buffers
+
+private:
+    AsyncReadback(const int nr_buffers=3);
+
+    struct PendingRead{
+        GLuint pbo_id;
+        size_t capacity; //bytes allocated for the pbo
+        GLsync fence; //null if the buffer is free
+        cv::Mat dst;
+        bool flip_y;
+        std::function<void(const cv::Mat&)> on_done;
+    };
+
+    bool complete(PendingRead& read, const bool wait); //returns false if it would have to wait and wait is false
+
+    std::vector<PendingRead> m_reads;
+    int m_next_idx; //the buffer used by the next read
+    int m_nr_pending;
+    int m_nr_stalls;
+};
+
+} //namespace easy_pbr
@@ -4,6 +4,8 @@
 
 #include <Eigen/Geometry>
 
+#include "easy_pbr/Frustum.h"
+
 //to his the fact that Spotlight derives this and both inherit from enabled_shared_from https://www.codeproject.com/Articles/286304/Solution-for-multiple-enable-shared-from-this-in-i
 #include "shared_ptr/EnableSharedFromThis.h"
 #include "shared_ptr/SmartPtrBuilder.h"
@@ -41,6 +43,7 @@ public:
     Eigen::Matrix4f proj_matrix(const Eigen::Vector2f viewport_size);
     Eigen::Matrix4f proj_matrix(const float viewport_width, const float viewport_height); //convenience function that takes the size as two separate arguments
     Eigen::Matrix3f intrinsics(const float viewport_width, const float viewport_height);
+    Frustum frustum(const Eigen::Vector2f viewport_size); //planes of the view frustum in world coordinates, used for culling
     Eigen::Vector3f position(); //position of the center of the camera (the eye)
     Eigen::Vector3f lookat(); //target point around which the camera can rotate
     Eigen::Vector3f direction(); // normalized direction towards which the camera looks
@@ -54,6 +57,8 @@ public:
     void set_position(const Eigen::Vector3f& pos); //updates the orientation according to the up vector so that it keeps pointing towards lookat
     void set_up(const Eigen::Vector3f& up);
     void set_dist_to_lookat(const float dist); //sets the lookat at a certain distance along the negative z axis
+    void set_intrinsics(const Eigen::Matrix3f& K, const int width, const int height); //the projection comes from K instead of the fov. K refers to an image of width x height and gets scaled if the viewport has another size
+    void clear_intrinsics(); //goes back to the projection from the fov
 
 
     //convenience functions
@@ -110,6 +115,11 @@ private:
     bool m_prev_mouse_pos_valid;
     std::shared_ptr<radu::utils::RandGenerator> m_rand_gen;
 
+    //intrinsics that override the fov
+    bool m_has_intrinsics;
+    Eigen::Matrix3f m_K;
+    Eigen::Vector2f m_K_size;
+
 
     void recalculate_orientation();
     Eigen::Matrix4f compute_projection_matrix(const float fov_x, const float aspect, const float znear, const float zfar);
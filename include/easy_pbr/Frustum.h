@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Eigen/Core>
+
+namespace easy_pbr{
+
+//the 6 planes of a view frustum extracted from a view-projection matrix (Gribb and Hartmann). Used for culling bounding volumes on the cpu
+struct Frustum{
+    Eigen::Matrix<float, 6, 4> planes; //each row is a plane (a,b,c,d) with the normal pointing inside the frustum. Order is left, right, bottom, top, near, far
+
+    Frustum(){
+        planes.setZero();
+    }
+
+    explicit Frustum(const Eigen::Matrix4f& view_proj){
+        planes.row(0) = view_proj.row(3) + view_proj.row(0);
+        planes.row(1) = view_proj.row(3) - view_proj.row(0);
+        planes.row(2) = view_proj.row(3) + view_proj.row(1);
+        planes.row(3) = view_proj.row(3) - view_proj.row(1);
+        planes.row(4) = view_proj.row(3) + view_proj.row(2);
+        planes.row(5) = view_proj.row(3) - view_proj.row(2);
+        for(int i = 0; i < 6; i++){
+            float norm=planes.row(i).head<3>().norm();
+            if(norm>0){
+                planes.row(i)/=norm;
+            }
+        }
+    }
+
+    //conservative test, it can say that a box intersects even if it's just outside in the corners of the frustum
+    bool intersects_aabb(const Eigen::Vector3f& min, const Eigen::Vector3f& max) const{
+        for(int i = 0; i < 6; i++){
+            //take the corner of the box that is furthest along the plane normal
+            Eigen::Vector3f p;
+            p.x() = planes(i,0)>=0 ? max.x() : min.x();
+            p.y() = planes(i,1)>=0 ? max.y() : min.y();
+            p.z() = planes(i,2)>=0 ? max.z() : min.z();
+            if( planes.row(i).head<3>().dot(p) + planes(i,3) < 0 ){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool intersects_sphere(const Eigen::Vector3f& center, const float radius) const{
+        for(int i = 0; i < 6; i++){
+            if( planes.row(i).head<3>().dot(center) + planes(i,3) < -radius ){
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} //namespace easy_pbr
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace easy_pbr{
+
+//gpu time of the passes recorded with Tracer::begin_gpu/end_gpu or TRACE_GPU_SCOPE under the same name. The tracer owns the timestamp queries and reads them back a few frames later, so this only looks up the most recent result and never stalls the pipeline.
+//The TIME_START/TIME_END of the profiler only measure the cpu side unless it calls glFinish, so use this one when comparing the cost of render passes
+class GpuTimer: public std::enable_shared_from_this<GpuTimer>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<GpuTimer> create( Args&& ...args ){
+        return std::shared_ptr<GpuTimer>( new GpuTimer(std::forward<Args>(args)...) );
+    }
+
+    const std::string& name() const;
+    float elapsed_ms() const; //time of the most recent pass with this name whose result is already available. Returns -1 if none finished yet
+
+private:
+    GpuTimer(const std::string& name);
+
+    std::string m_name;
+};
+
+} //namespace easy_pbr
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace easy_pbr{
+
+//an OpenGL context that is not attached to any window so that the viewer can run on machines without a display server, like the nodes of a render farm.
+//"egl" creates a surfaceless context on the gpu, or on llvmpipe through the surfaceless platform of mesa if there is no gpu. "osmesa" always renders on the cpu.
+//There is no default framebuffer to present to, the viewer only draws into its own framebuffers and the images are read back from those
+class HeadlessContext: public std::enable_shared_from_this<HeadlessContext>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<HeadlessContext> create( Args&& ...args ){
+        return std::shared_ptr<HeadlessContext>( new HeadlessContext(std::forward<Args>(args)...) );
+    }
+    ~HeadlessContext();
+
+    static bool is_backend_available(const std::string& backend); //whether easy_pbr was compiled with support for "egl" or "osmesa"
+
+    void make_current();
+    GLADloadproc proc_loader() const; //to load the gl functions with glad, they have to come from the same library that created the context
+    std::string backend() const;
+    int width() const;
+    int height() const;
+
+private:
+    HeadlessContext(const std::string& backend, const int width, const int height);
+
+    void init_egl();
+    void init_osmesa();
+
+    std::string m_backend;
+    int m_width; //size of the images rendered by the viewer, the context itself has no surface of this size
+    int m_height;
+
+    //kept as void* so that the egl and osmesa headers don't leak to everything including this one
+    void* m_egl_display;
+    void* m_egl_context;
+    void* m_osmesa_context;
+    std::vector<unsigned char> m_osmesa_buffer; //osmesa needs a buffer to make the context current, it is never drawn into
+};
+
+} //namespace easy_pbr
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <fstream>
+
+#include <glad/glad.h>
+
+#include <Eigen/Core>
+
+#include "Texture2D.h"
+#include "CubeMap.h"
+
+namespace easy_pbr{
+
+//stores the textures that are precomputed for image based lighting (environment cubemap, irradiance, prefiltered mip chain, brdf lut and the spherical harmonics of the irradiance) on disk so that the viewer can skip reading the hdr and running the convolutions the next time it starts with the same environment map.
+//Each entry is a file named after whatever identifies its content, which for the ones derived from an environment map is the hash of the file together with the resolutions
+class IblCache: public std::enable_shared_from_this<IblCache>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<IblCache> create( Args&& ...args ){
+        return std::shared_ptr<IblCache>( new IblCache(std::forward<Args>(args)...) );
+    }
+
+    static std::string hash_file(const std::string& path); //hash of the content of the file, as hex. Empty if the file could not be read
+
+    //the textures need to be already allocated with the same size and format as when they were saved. They return false if there is no entry with this name or it doesn't match the texture
+    bool load_cubemap(gl::CubeMap& tex, const std::string& name, const int resolution, const int nr_levels);
+    bool save_cubemap(gl::CubeMap& tex, const std::string& name, const int resolution, const int nr_levels);
+    bool load_texture(gl::Texture2D& tex, const std::string& name);
+    bool save_texture(gl::Texture2D& tex, const std::string& name);
+    bool load_matrix(Eigen::MatrixXf& mat, const std::string& name, const int rows, const int cols); //for small data like the spherical harmonics coefficients
+    bool save_matrix(const Eigen::MatrixXf& mat, const std::string& name);
+
+    std::string dir() const;
+
+private:
+    IblCache(const std::string& dir); //"auto" uses $XDG_CACHE_HOME/easy_pbr/ibl or ~/.cache/easy_pbr/ibl
+
+    static const int CACHE_VERSION=1; //increase when the shaders that compute the textures change so the old entries are not used
+
+    //at the start of every file
+    struct Header{
+        char magic[8];
+        int version;
+        int width; //of the first level
+        int height;
+        int nr_faces;
+        int nr_levels;
+        int nr_channels;
+    };
+
+    bool load(const GLuint tex_id, const GLenum target, const int width, const int height, const int nr_faces, const int nr_levels, const GLenum format, const int nr_channels, const std::string& name);
+    bool save(const GLuint tex_id, const GLenum target, const int width, const int height, const int nr_faces, const int nr_levels, const GLenum format, const int nr_channels, const std::string& name);
+    std::string path_for(const std::string& name) const;
+    Header make_header(const int width, const int height, const int nr_faces, const int nr_levels, const int nr_channels) const;
+    bool read_header(std::ifstream& file, const Header& expected, const std::string& name) const;
+    bool commit(std::ofstream& file, const std::string& tmp_path, const std::string& name); //closes the temporary file and moves it to the final name
+    std::string tmp_path_for(const std::string& name); //also creates the cache directory
+
+    std::string m_dir;
+};
+
+} //namespace easy_pbr
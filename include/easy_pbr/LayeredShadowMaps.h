@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <Eigen/Core>
+
+#include "Shader.h"
+
+namespace easy_pbr{
+
+class MeshGL;
+
+//the shadow maps of all the spot lights as the layers of one depth texture array. Each mesh is drawn only once and a geometry shader with one invocation per light emits the triangles to the layer of every light that sees it, so the vertices are fetched and transformed to world once instead of once per light.
+//Like the shadow map of each SpotLight, it keeps a static layer with only the static meshes which gets copied into the final one before the dynamic meshes are drawn on top
+class LayeredShadowMaps: public std::enable_shared_from_this<LayeredShadowMaps>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<LayeredShadowMaps> create( Args&& ...args ){
+        return std::shared_ptr<LayeredShadowMaps>( new LayeredShadowMaps(std::forward<Args>(args)...) );
+    }
+    ~LayeredShadowMaps();
+
+    static const int MAX_NR_LAYERS=8; //same as the max nr of spot lights in the compose shader and the invocations of the geometry shader
+
+    bool resize(const int resolution, const int nr_layers); //returns true if the textures had to be allocated again, in which case the content of all layers is lost
+    bool is_initialized() const;
+    int resolution() const;
+    int nr_layers() const;
+
+    void clear_layers(const int layers_mask, const bool static_layer); //bit i of the mask selects the layer i
+    void copy_static_layers(const int layers_mask); //copies the static meshes into the final shadow map of the selected layers
+    void set_light_view_projections(const std::vector<Eigen::Matrix4f>& light_VP); //one per layer
+    void render_mesh(const std::shared_ptr<MeshGL>& mesh, const int layers_mask, const bool static_layer);
+    void render_points(const std::shared_ptr<MeshGL>& mesh, const int layers_mask, const bool static_layer);
+
+    GLuint tex_id() const; //GL_TEXTURE_2D_ARRAY with the final shadow maps
+    void bind(gl::Shader& shader, const std::string& sampler_name); //binds the final shadow maps to the last texture unit, which is reserved for them
+
+private:
+    LayeredShadowMaps();
+
+    void begin_draw(gl::Shader& shader, const std::shared_ptr<MeshGL>& mesh, const int layers_mask, const bool static_layer);
+    void end_draw();
+
+    gl::Shader m_mesh_shader;
+    gl::Shader m_points_shader;
+    GLuint m_tex_id;
+    GLuint m_static_tex_id;
+    GLuint m_fbo_id;
+    int m_resolution;
+    int m_nr_layers;
+    std::vector<Eigen::Matrix4f> m_light_VP;
+    GLint m_texture_unit;
+};
+
+} //namespace easy_pbr
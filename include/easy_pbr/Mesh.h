@@ -2,6 +2,8 @@
 
 #include <memory>
 #include<stdarg.h>
+#include <future>
+#include <functional>
 
 //eigen
 #include <Eigen/Geometry>
@@ -89,7 +91,9 @@ struct VisOptions{
 //when uploading texture from cpu we want a way to say that this is dirty
 struct CvMatCpu {
     cv::Mat mat;
+    std::vector<cv::Mat> mips; //full mip chain down to 1x1 starting with mat itself. Computed on the cpu so that the render thread does not need to generate it
     bool is_dirty=false;
+    std::shared_future< std::vector<cv::Mat> > pending; //valid while the texture is still being decoded on a worker thread, once it finishes the result gets moved into mat and mips
 };
 
 
@@ -125,6 +129,20 @@ public:
     void rotate_model_matrix_local(const Eigen::Vector3d& axis, const float angle_degrees);
     void rotate_model_matrix_local(const Eigen::Quaterniond& q);
     void apply_model_matrix_to_cpu( const bool transform_points_at_zero);
+
+    //bounding volumes used for culling. The local box comes from V and is cached until invalidate_bounds() is called (the viewer does it each time it uploads a dirty mesh). The world one applies the model matrix and is cached until the model matrix changes
+    Eigen::AlignedBox3f local_aabb();
+    Eigen::AlignedBox3f world_aabb(const bool include_children=true); //with include_children it also contains the whole hierarchy of child meshes
+    Eigen::Vector4f world_bounding_sphere(const bool include_children=true); //center in xyz and radius in w
+    float max_surfel_radius(); //biggest extent of the surfels in local coordinates, from V_tangent_u and V_length_v. Cached together with the local box
+    void invalidate_bounds(); //needs to be called if V changes
+
+    //instancing. The geometry is uploaded once and drawn once for every transform in a single draw call. The transforms are applied before the model matrix so moving the mesh moves all the instances together. The colors (nr_instances x 3) are optional and replace the solid color of each instance. Only the triangles (m_show_mesh) are drawn instanced, the viewer skips the points, surfels, lines and wireframe of an instanced mesh and warns about it
+    void set_instances(const std::vector<Eigen::Matrix4d>& transforms, const Eigen::MatrixXd& colors=Eigen::MatrixXd());
+    void clear_instances();
+    int nr_instances() const; //0 if the mesh is not instanced
+    const std::vector<Eigen::Matrix4d>& instance_transforms() const;
+    const Eigen::MatrixXd& instance_colors() const;
     // void set_model_matrix(const Eigen::VectorXd& xyz_q);
     // Eigen::VectorXd model_matrix_as_xyz_and_quaternion();
     // Eigen::VectorXd model_matrix_as_xyz_and_rpy();
@@ -212,13 +230,17 @@ public:
     void set_roughness_tex(const cv::Mat& mat, const int subsample=1);
     void set_gloss_tex(const cv::Mat& mat, const int subsample=1);
     void set_normals_tex(const cv::Mat& mat, const int subsample=1);
-    bool is_any_texture_dirty();
+    bool is_any_texture_dirty(); //also collects the textures that finished decoding on the worker threads
+    bool is_any_texture_pending(); //true if some texture is still being decoded
+    void wait_for_textures(); //blocks until all the textures that were set are decoded
 
 
     friend std::ostream &operator<<(std::ostream&, const Mesh& m);
 
     bool m_is_dirty; // if it's dirty then we need to upload this data to the GPU
     bool m_is_shadowmap_dirty; // if it has moved through the m_model_matrix or if the V matrix or something like that has changed, then we need to update the shadow map
+    bool m_is_dynamic; // meshes that change often are drawn every frame on top of the cached shadow map of the static ones instead of forcing it to be rendered again
+    bool m_is_instances_dirty; // the instance transforms or colors changed and need to be uploaded to the GPU but the rest of the buffers can stay as they are
 
     VisOptions m_vis;
     bool m_force_vis_update; //sometimes we want the m_vis stored in the this MeshCore to go into the MeshGL, sometimes we don't. The default is to not propagate, setting this flag to true will force the update of m_vis inside the MeshGL
@@ -252,7 +274,7 @@ public:
     std::shared_ptr<LabelMngr> m_label_mngr;
     std::shared_ptr<radu::utils::RandGenerator> m_rand_gen;
     std::vector<std::shared_ptr<Mesh>> m_child_meshes;
-    std::function<void( std::shared_ptr<MeshGL> mesh_gl, std::shared_ptr<Viewer> view )> custom_render_func; //use this render the mesh with whatever function we define
+    std::function<void( std::shared_ptr<MeshGL> mesh_gl, std::shared_ptr<Viewer> view )> custom_render_func; //use this render the mesh with whatever function we define. The viewer doesn't set the old MVP uniforms anymore, the camera is in the CameraBlock uniform buffer (see UniformBuffers.h) or the function computes it itself. Binding the attributes by name with mesh_gl->vao.vertex_attribute() keeps working
 
     //oher stuff that may or may not be needed depending on the application
     uint64_t t; //timestamp or scan nr which will be monotonically increasing
@@ -282,9 +304,25 @@ private:
     void write_ply(const std::string file_path);
     void read_obj(const std::string file_path);
 
+    //textures get decoded, subsampled, flipped and mipmapped on a pool of worker threads. The source is only used for the error message if reading fails
+    void set_tex_async(CvMatCpu& tex, std::function<cv::Mat()> read_func, const std::string source, const int subsample, const bool invert);
+    static std::vector<cv::Mat> prepare_tex(const cv::Mat& mat, const int subsample, const bool invert);
+    static bool collect_pending_tex(CvMatCpu& tex);
+
     Eigen::Affine3d m_model_matrix;  //transform from object coordiantes to the world coordinates, esentially putting the model somewhere in the world. 
     Eigen::Affine3d m_cur_pose; 
 
+    //cached bounding volumes
+    Eigen::AlignedBox3f m_local_aabb;
+    float m_max_surfel_radius;
+    bool m_local_aabb_dirty;
+    Eigen::AlignedBox3f m_world_aabb;
+    Eigen::Affine3d m_world_aabb_model_matrix; //model matrix with which m_world_aabb was computed so we know when it needs an update
+    bool m_world_aabb_dirty;
+
+    std::vector<Eigen::Matrix4d> m_instance_transforms;
+    Eigen::MatrixXd m_instance_colors;
+
 
 };
 
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include <glad/glad.h>
+
+#include <Eigen/Core>
+
+namespace easy_pbr{
+
+class MeshGL;
+
+//packs many small meshes into shared vertex and index buffers so that all of them can be drawn into the gbuffer with a single glMultiDrawElementsIndirect. The per mesh data (model matrix, solid color, metalness, roughness etc) goes into a shader storage buffer which gets indexed with the base instance of each draw command.
+//Only meshes that are drawn with the plain mesh shader can be batched: no textures, no instancing, no custom shader and a color type of solid, per vertex color or normal vector. The rest are still drawn one by one by the viewer
+class MeshBatcher: public std::enable_shared_from_this<MeshBatcher>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<MeshBatcher> create( Args&& ...args ){
+        return std::shared_ptr<MeshBatcher>( new MeshBatcher(std::forward<Args>(args)...) );
+    }
+    ~MeshBatcher();
+
+    //attribute locations used by the batched shader
+    static const int POSITION_LOCATION=0;
+    static const int NORMAL_LOCATION=1;
+    static const int COLOR_LOCATION=2;
+    static const int DRAW_IDX_LOCATION=3;
+    static const int DRAW_DATA_BINDING=0; //binding point of the storage buffer
+
+    bool is_batchable(const std::shared_ptr<MeshGL>& mesh) const;
+    void update(const std::vector< std::shared_ptr<MeshGL> >& meshes); //needs to be called after the meshes got uploaded to the gpu. Repacks the shared buffers if a batchable mesh got added, removed or re-uploaded
+    bool contains(const std::shared_ptr<MeshGL>& mesh) const;
+    void add_draw(const std::shared_ptr<MeshGL>& mesh); //queues the mesh to be drawn in the next draw(). The mesh needs to be contained in the batch
+    int draw(); //issues all the queued draws with one call and clears the queue. The shader needs to be already bound. Returns the nr of meshes drawn
+
+    int nr_meshes() const;
+    int nr_vertices() const;
+    int nr_rebuilds() const; //how many times the shared buffers were repacked, useful to check that they are not rebuilt every frame
+
+    int m_max_nr_vertices; //meshes with more vertices than this don't gain much from batching and are left out
+
+private:
+    MeshBatcher(const int max_nr_vertices=10000);
+
+    struct Entry{
+        std::weak_ptr<MeshGL> mesh;
+        const MeshGL* mesh_ptr;
+        unsigned long long buffers_version; //the version of the buffers of the mesh when it was packed
+        GLuint first_index;
+        GLuint nr_indices;
+        GLint base_vertex;
+    };
+
+    //layout as expected by glMultiDrawElementsIndirect
+    struct DrawCommand{
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    //std430 layout of the DrawData struct in mesh_batched_vert.glsl
+    struct DrawData{
+        Eigen::Matrix4f M;
+        Eigen::Vector4f solid_color;
+        Eigen::Vector4f metalness_roughness;
+        Eigen::Vector4i mesh_id_color_type;
+    };
+
+    bool needs_rebuild(const std::vector< std::shared_ptr<MeshGL> >& batchable) const;
+    void rebuild(const std::vector< std::shared_ptr<MeshGL> >& batchable);
+
+    std::vector<Entry> m_entries;
+    std::unordered_map<const MeshGL*, int> m_entry_idx;
+    int m_nr_vertices;
+    int m_nr_rebuilds;
+
+    //queued for the current frame
+    std::vector<DrawCommand> m_commands;
+    std::vector<DrawData> m_draw_data;
+
+    GLuint m_vao_id;
+    GLuint m_V_buf_id;
+    GLuint m_NV_buf_id;
+    GLuint m_C_buf_id;
+    GLuint m_F_buf_id;
+    GLuint m_draw_idx_buf_id; //0,1,2...N read with a divisor of 1 so that the base instance of each command becomes the index into the draw data
+    GLuint m_indirect_buf_id;
+    GLuint m_draw_data_buf_id;
+};
+
+} //namespace easy_pbr
@@ -15,17 +15,21 @@
 #include "Texture2D.h"
 #include "VertexArrayObject.h"
 
+#include "easy_pbr/UniformBuffers.h"
+
 // #include "easy_pbr/Mesh.h"
 
 namespace easy_pbr{
 
 //forward declarations
 class Mesh;
+class TextureUploader;
+struct CvMatCpu;
 
 //in order to dissalow building on the stack and having only ptrs https://stackoverflow.com/a/17135547
 class MeshGL;
 
-class MeshGL {
+class MeshGL: public std::enable_shared_from_this<MeshGL> {
 public:
     // EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     //https://stackoverflow.com/questions/29881107/creating-objects-only-as-shared-pointers-through-a-base-class-create-method
@@ -33,7 +37,7 @@ public:
     static std::shared_ptr<MeshGL> create( Args&& ...args ){
         return std::shared_ptr<MeshGL>( new MeshGL(std::forward<Args>(args)...) );
     }
-    ~MeshGL()=default;
+    ~MeshGL();
 
     void assign_core(std::shared_ptr<Mesh>);
     void create_full_screen_quad();
@@ -41,9 +45,35 @@ public:
 
 
     //GL functions 
-    void upload_to_gpu();
+    void upload_to_gpu(const std::shared_ptr<TextureUploader>& tex_uploader=nullptr); //with a texture uploader the textures get streamed over the next frames, without it they are uploaded right away
 
     bool m_first_core_assignment;
+    const unsigned long long m_uid; //unique for every MeshGL ever created, unlike the address which can be given to a new one after this one is freed
+    unsigned long long m_buffers_version; //incremented every time the vertex buffers get uploaded so whoever keeps a copy of them (like the MeshBatcher) knows when it's stale
+
+    //the vao is configured once after the buffers are uploaded with a fixed attribute location for each buffer. Every shader that draws this mesh has to declare its inputs with these locations, for example layout(location = 0) in vec3 position;
+    //Custom render functions can still bind the attributes by name with vao.vertex_attribute() for their own shader, the viewer calls setup_vao() after them to put back the fixed locations
+    static const int POSITION_LOCATION=0;
+    static const int NORMAL_LOCATION=1;
+    static const int TANGENT_LOCATION=2;
+    static const int COLOR_LOCATION=3;
+    static const int UV_LOCATION=4;
+    static const int LABEL_PRED_LOCATION=5;
+    static const int LABEL_GT_LOCATION=6;
+    static const int INTENSITY_LOCATION=7;
+    static const int LENGTH_V_LOCATION=8;
+
+    //instancing. Each instance has a model matrix and a color interleaved in one buffer which is bound to the vao at fixed attribute locations so that every shader that declares them with the same layout can draw the mesh instanced
+    static const int INSTANCE_MATRIX_LOCATION=10; //a mat4 takes 4 consecutive locations
+    static const int INSTANCE_COLOR_LOCATION=14;
+    int nr_instances() const; //nr of instances currently on the gpu, 0 if the mesh is drawn normally
+    bool has_instance_colors() const;
+
+    //the uniforms of this mesh live in a uniform buffer which is uploaded only when they change. Needs to be called before drawing
+    void update_uniform_buffers();
+    void bind_uniform_buffers();
+    unsigned long long nr_uniform_buffer_uploads() const; //how many times the uniform buffer actually had to be uploaded
+    void setup_vao(); //binds every buffer to its fixed location and the faces as indices
 
     //GL buffers 
     gl::VertexArrayObject vao; 
@@ -74,7 +104,23 @@ public:
     gl::Texture2D m_normals_tex;
 
     std::shared_ptr<Mesh> m_core;
+    int m_instance_id; //written into the instance id buffer of the gbuffer. It's the index of the mesh in the viewer plus one so 0 is left for the background and for what is not a mesh of the scene, like the nodes of an octree
 private:
+    void upload_tex(gl::Texture2D& tex, CvMatCpu& mat, const std::shared_ptr<TextureUploader>& tex_uploader);
+    void upload_instances();
+    void attribute_to_location(gl::Buf& buf, const int location, const int nr_components, const bool is_integer, const bool enable);
+
+    GLuint m_mesh_ubo_id;
+    GLuint m_color_scheme_ubo_id;
+    MeshUniforms m_mesh_uniforms; //what is currently in the mesh ubo
+    Eigen::MatrixXf m_color_scheme; //what is currently in the color scheme ubo
+    bool m_mesh_ubo_valid;
+    unsigned long long m_nr_ubo_uploads;
+
+    GLuint m_instance_buf_id;
+    int m_nr_instances;
+    bool m_has_instance_colors;
+
     MeshGL();  // we put the constructor as private so as to dissalow creating Mesh on the stack because we want to only used shared ptr for it
 
 };
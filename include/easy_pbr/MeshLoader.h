@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <future>
+#include <mutex>
+#include <functional>
+
+namespace easy_pbr{
+
+class Mesh;
+class ThreadPool;
+
+//returned by the MeshLoader for each file that is being loaded. It can be queried for completion without blocking
+struct MeshLoadHandle{
+    std::shared_future< std::shared_ptr<Mesh> > future;
+    std::string file_path;
+    std::string name;
+
+    bool is_ready() const; //true if the mesh finished loading (either successfully or not)
+    std::shared_ptr<Mesh> get() const; //blocks until the mesh is loaded. Returns nullptr if the loading failed
+};
+
+//loads meshes from disk on a pool of worker threads so that the render loop stays interactive. All the post processing of load_from_file (normals, tangents, min max) also runs on the workers.
+//The render thread iterates over the Scene by index so the workers don't add to it. The finished meshes wait in a queue until update() adds them from the render thread. The loader of the viewer is updated every frame, a loader created from python needs update() or wait_all() to be called
+class MeshLoader: public std::enable_shared_from_this<MeshLoader>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<MeshLoader> create( Args&& ...args ){
+        return std::shared_ptr<MeshLoader>( new MeshLoader(std::forward<Args>(args)...) );
+    }
+    ~MeshLoader();
+
+    //if the name is empty we use the filename without extension. on_added is called from update() right after the mesh is added to the scene
+    MeshLoadHandle load(const std::string file_path, const std::string name="", const bool add_to_scene=true, std::function<void(const std::shared_ptr<Mesh>&)> on_added=nullptr);
+    std::vector<MeshLoadHandle> load(const std::vector<std::string>& file_paths, const std::vector<std::string>& names={}, const bool add_to_scene=true);
+    int update(); //adds the meshes that finished loading to the scene. Needs to be called from the thread that draws. Returns how many were added
+    void wait_all(); //blocks until all queued meshes are loaded and adds them to the scene, so it has to be called from the thread that draws
+    int nr_pending(); //nr of meshes that are queued or currently loading
+    int nr_threads();
+
+private:
+    MeshLoader(const int nr_threads=0); //0 means use all hardware threads
+
+    struct FinishedMesh{
+        std::shared_ptr<Mesh> mesh;
+        std::function<void(const std::shared_ptr<Mesh>&)> on_added;
+    };
+
+    std::shared_ptr<Mesh> load_mesh_threaded(const std::string file_path, const std::string name, const bool add_to_scene, std::function<void(const std::shared_ptr<Mesh>&)> on_added);
+
+    std::unique_ptr<ThreadPool> m_pool;
+    std::mutex m_finished_mutex;
+    std::vector<FinishedMesh> m_finished; //loaded meshes that wait for update() to add them to the scene
+};
+
+} //namespace easy_pbr
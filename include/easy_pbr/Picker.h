@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <functional>
+
+#include <Eigen/Core>
+
+#include <opencv2/core/core.hpp>
+
+#include "Shader.h"
+#include "Texture2D.h"
+
+namespace easy_pbr{
+
+class Viewer;
+class AsyncReadback;
+
+//what is under a pixel of the viewer
+struct PickResult{
+    bool hit=false; //false for the background
+    std::string mesh_name;
+    int instance_id=0; //index of the mesh in the viewer plus one
+    int face_idx=-1; //face of the mesh, -1 if the pixel was covered by the points or the surfels of the mesh
+    int vertex_idx=-1; //vertex of the face closest to the position or the point that covers the pixel. -1 for instanced meshes since we don't know which copy got hit
+    int label=-1; //label of the id buffers, -1 if the mesh has no labels
+    Eigen::Vector3d position_world=Eigen::Vector3d::Zero();
+    float depth=0; //linear, along the camera axis
+    Eigen::Vector2i pixel=Eigen::Vector2i::Zero(); //where it was hit, in the same coordinates as the pick was asked, which can be a bit off from the requested one when picking with a radius
+};
+
+//picks what is under a pixel using the instance id, primitive id and depth buffers of the gbuffer. A pass copies only the small region around the pixel into a texture which is downloaded through an AsyncReadback so the cost doesn't depend on the size of the scene or of the viewport.
+//The results are resolved with the camera of the frame in which the pick was asked and the meshes that the viewer has when the download finishes, which is a couple of frames later
+class Picker: public std::enable_shared_from_this<Picker>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<Picker> create( Args&& ...args ){
+        return std::shared_ptr<Picker>( new Picker(std::forward<Args>(args)...) );
+    }
+    ~Picker();
+
+    //x and y are in pixels of the viewport with the origin at the top left, like the cursor. With a radius bigger than 0 it takes the closest hit to the pixel in a square of 2*radius+1, which helps with picking small points.
+    //on_done is called from update() or finish(), so from the thread that draws
+    void pick_async(const int x, const int y, std::function<void(const PickResult&)> on_done, const int radius=0);
+    PickResult pick(const int x, const int y, const int radius=0); //waits for the gpu, use it for scripts and not every frame
+    void update(); //resolves the picks that finished downloading without waiting for the others. Called by the viewer every frame
+    void finish(); //waits for all the pending picks
+
+    int nr_pending() const;
+
+    PickResult m_last_result; //of the last pick that finished, shown in the gui
+
+private:
+    Picker(Viewer* view);
+
+    struct PickRequest{
+        Eigen::Vector2i region_start; //bottom left of the region in pixels of the gbuffer
+        int radius;
+        Eigen::Vector2i center; //in pixels of the gbuffer, from the bottom
+        Eigen::Vector2i gbuffer_size;
+        float subsample_factor;
+        Eigen::Matrix4f V;
+        Eigen::Matrix4f VP_inv;
+        unsigned long long meshes_gl_version; //the instance ids are only valid for the meshes that the viewer had at this version
+        std::function<void(const PickResult&)> on_done;
+    };
+
+    PickResult resolve(const PickRequest& request, const cv::Mat& region);
+
+    Viewer* m_view;
+    gl::Shader m_pick_shader;
+    gl::Texture2D m_region_tex;
+    std::shared_ptr<AsyncReadback> m_readback;
+};
+
+} //namespace easy_pbr
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <future>
+#include <unordered_map>
+
+#include <Eigen/Geometry>
+
+#include "easy_pbr/Mesh.h"
+
+namespace easy_pbr{
+
+class MeshGL;
+class Camera;
+class ThreadPool;
+
+//octree for point clouds that are too big to fit in memory. It is created once offline with convert() which splits the cloud in a hierarchy of tiles on disk. Each node holds a subsample of the points inside its cube and the children refine it, so drawing a node and all its ancestors gives the full density in that region.
+//At runtime only the nodes that have a big enough screen-space error are selected, up to a point budget. The tiles get loaded on background threads and kept in a LRU cache.
+class PointCloudOctree: public std::enable_shared_from_this<PointCloudOctree>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<PointCloudOctree> create( Args&& ...args ){
+        return std::shared_ptr<PointCloudOctree>( new PointCloudOctree(std::forward<Args>(args)...) );
+    }
+    ~PointCloudOctree();
+
+    //reads a ply or pcd and writes the octree into output_dir. Nodes with more than max_points_per_node get subsampled on a grid of grid_resolution^3 cells and the rest of the points are pushed to the children.
+    //The input is streamed in chunks and the points of the nodes that are not processed yet are spilled to output_dir/tmp, so the cloud doesn't need to fit in memory
+    static void convert(const std::string input_path, const std::string output_dir, const int max_points_per_node=20000, const int grid_resolution=128, const int max_depth=20);
+
+    //selects the nodes to draw for this camera, requests the missing ones from disk and uploads at most m_max_uploads_per_frame of the loaded ones to gpu. Needs to run on the render thread
+    void update(const std::shared_ptr<Camera>& cam, const Eigen::Vector2f& viewport_size);
+    std::vector< std::shared_ptr<MeshGL> > visible_nodes(); //the nodes from the last update() that are on the gpu and can be drawn
+
+    int nr_nodes();
+    int nr_nodes_resident(); //loaded in memory
+    int nr_points_visible();
+    Eigen::Vector3f bbox_min();
+    Eigen::Vector3f bbox_max();
+
+    //params
+    std::string name;
+    VisOptions m_vis; //copied into each node so all of them look the same
+    int m_point_budget; //max nr of points drawn per frame
+    float m_min_screen_error; //nodes get refined until the spacing between their points projects to less than this many pixels
+    int m_max_uploads_per_frame;
+    int m_cache_max_points; //once more points than this are loaded, the least recently used nodes not needed by the current view are evicted
+
+private:
+    PointCloudOctree(const std::string octree_dir, const int nr_loader_threads=4);
+
+    struct Node{
+        std::string name; //r followed by the octant index of each level, like r041
+        Eigen::Vector3f min;
+        Eigen::Vector3f max;
+        float spacing; //min distance between the points of this node
+        int nr_points;
+        int parent;
+        int children[8]; //-1 if there is no child
+        std::shared_future< std::shared_ptr<Mesh> > pending; //valid while the tile is being read from disk
+        std::shared_ptr<MeshGL> mesh_gl; //non null if resident on the gpu
+        std::list<int>::iterator lru_it;
+        bool in_lru;
+        bool failed; //the tile could not be read from disk so the node and its children are never drawn
+    };
+
+    void read_hierarchy(const std::string octree_dir);
+    std::shared_ptr<Mesh> read_node(const std::string path); //nullptr if the tile is missing or truncated
+    void touch(const int node_idx);
+    void evict(const std::vector<bool>& is_needed);
+
+    std::string m_octree_dir;
+    bool m_has_color;
+    std::vector<Node> m_nodes; //the root is at index 0
+    std::vector<int> m_visible_nodes;
+    int m_nr_points_visible;
+    std::list<int> m_lru; //most recently used at the front
+    int m_nr_points_resident;
+    std::unique_ptr<ThreadPool> m_loader_pool;
+};
+
+} //namespace easy_pbr
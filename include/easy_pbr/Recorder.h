@@ -5,19 +5,48 @@
 #include <thread>
 #include <memory>
 #include <unordered_map>
+#include <deque>
+#include <condition_variable>
 #include "GBuffer.h"
+#include "Shader.h"
+#include "easy_pbr/AsyncReadback.h"
 
-#include "concurrentqueue.h"
+#include <opencv2/videoio.hpp>
+
+#include <enum.h>
 
 namespace easy_pbr{
 
 class Viewer;
 
+//what record() does when the queue of images waiting to be written is full. Block makes the render thread wait for a writer, Drop skips the frame and Grow queues it anyway. Snapshots are never dropped
+BETTER_ENUM(RecorderQueuePolicy, int, Block = 0, Drop, Grow )
+
+//how record() writes the frames. Png, Npy and Exr write one file per frame, with the extension of the name replaced. Video appends every frame to a single file in the recording path.
+//Npy is the raw pixels with a small header, so it's the fastest to write and it keeps float textures as they are. Exr keeps float textures as well, and Png writes them with 16 bits per channel
+BETTER_ENUM(RecorderFormat, int, Png = 0, Npy, Exr, Video )
+
+struct RecorderStats{
+    int queue_depth; //images waiting to be written right now
+    int max_queue_depth;
+    int nr_written;
+    int nr_dropped;
+    double avg_encode_ms; //encoding and writing one image
+    double max_encode_ms;
+};
 
 //stored a cv mat and the path where it should be written to disk
 struct MatWithFilePath{
-    cv::Mat cv_mat;
+    cv::Mat cv_mat; //already flipped and with the channels in the order in which they are written
     std::string file_path;
+    std::vector<int> imwrite_params;
+    int video_frame_idx=-1; //frames of a video have to be written in order, -1 for images
+};
+
+//the channels of one exported frame, they are queued together once all of them finished downloading so that a full queue drops either the whole frame or nothing
+struct ExportedFrame{
+    std::vector<MatWithFilePath> mats;
+    int nr_channels=0;
 };
 
 class Recorder: public std::enable_shared_from_this<Recorder>
@@ -25,32 +54,75 @@ class Recorder: public std::enable_shared_from_this<Recorder>
 public:
     Recorder(Viewer* view);
     ~Recorder();
-    bool record(gl::Texture2D& tex, const std::string name,  const std::string path); //downloads the tex into a pbo and downlaod from the previous pbo into a cv which is queued for writing
-    void write_without_buffering(gl::Texture2D& tex, const std::string name,  const std::string path); //writes the texture directly, without PBO buffering. useful for taking screenshots
+    bool record(gl::Texture2D& tex, const std::string name,  const std::string path); //downloads the tex into a pbo and downlaod from the previous pbo into a cv which is queued for writing. With m_export_enabled the tex is instead read back together with the exported channels of this same frame and they are all queued as one unit
+    void write_without_buffering(gl::Texture2D& tex, const std::string name,  const std::string path); //writes this exact frame of the texture, useful for taking screenshots. It doesn't wait for the gpu, the download finishes during one of the next update() and then it goes to the writers
     bool record(const std::string name,  const std::string path);
     void snapshot(const std::string name,  const std::string path);
+    void export_frame(const std::string name,  const std::string path); //writes the selected channels of the current gbuffer as <name without extension>_<channel> in the export format. Like the snapshots it reads them back asynchronously
     // void write_viewer_to_png();
     // void record_viewer(); //is called automatically by update() if the m_is_recording is set to true but sometimes I want to call it explicitly from python and record exatly when I want
     // void update();
     // void reset(); //set the m_nr_frames_recorder to zero so that we can start recording again
 
+    void update(); //hands the snapshots that finished downloading to the writers, called once per frame by the viewer
     bool is_recording();
     void start_recording();
     void pause_recording();
     void stop_recording();
     int nr_images_recorded();
+    void flush(); //blocks until every image queued so far is on disk, including the snapshots that are still downloading
+    RecorderStats stats();
 
 
     //objects
     Viewer* m_view;
     // std::shared_ptr<Viewer> m_view;
 
-    //params 
+    //params, the writers are started with these on the first write
+    int m_nr_writer_threads;
+    int m_queue_capacity;
+    RecorderQueuePolicy m_queue_policy;
+    RecorderFormat m_format;
+    int m_png_compression; //0 to 9, the default of opencv is 3 but 1 writes a lot faster for images that are only a bit larger
+    int m_video_fps;
+    std::string m_video_codec; //fourcc of the codec
+    std::string m_video_name; //file name of the video inside the recording path
+
+    //export of the gbuffer of every recorded frame, for generating datasets
+    bool m_export_enabled;
+    RecorderFormat m_export_format; //Npy or Exr since they keep the floats and ints as they are
+    bool m_export_color;
+    bool m_export_depth; //linear, 0 for the background
+    bool m_export_normals_world;
+    bool m_export_normals_camera;
+    bool m_export_mesh_id; //-1 for the background
+    bool m_export_labels; //only if the viewer has the id buffers enabled. -1 for the background and for meshes without labels
+    bool m_export_instance_id; //only if the viewer has the id buffers enabled. 0 for the background
     // std::string m_recording_path;
     // std::string m_snapshot_name;
 
 private:
     void write_to_file_threaded();
+    bool enqueue(MatWithFilePath&& mat_with_file, const bool can_drop); //returns false if the policy dropped it
+    bool enqueue(std::vector<MatWithFilePath>&& mats, const bool can_drop); //all of them or none are queued
+    void prepare_for_readback(gl::Texture2D& tex, gl::Texture2D& dst, const bool swap_red_blue, const bool for_video); //flips the tex and swaps the channels on the gpu into dst so that the writers only have to encode
+    void encode(MatWithFilePath& mat_with_file);
+    void write_video_frame(MatWithFilePath& mat_with_file);
+    void close_video();
+    void read_async(gl::Texture2D& tex, const GLenum format, const GLenum type, const int cv_type, const std::string file_path, const bool can_drop, std::shared_ptr<AsyncReadback>& readback, std::shared_ptr<ExportedFrame> frame=nullptr, const bool is_video_frame=false); //once the download is done it's queued for the writers, or if it's part of a frame once all the channels of the frame are done
+    int nr_export_channels();
+    void queue_export(const std::shared_ptr<ExportedFrame>& frame, const std::string name, const std::string path); //decodes the gbuffer and reads back the selected channels into the frame
+
+    gl::Shader m_readback_shader;
+    gl::Texture2D m_readback_tex; //what record() downloads through the pbos
+    gl::Texture2D m_video_readback_tex;
+    gl::Texture2D m_snapshot_tex;
+    std::shared_ptr<AsyncReadback> m_snapshot_readback;
+    gl::Shader m_export_shader;
+    gl::Shader m_export_ids_shader;
+    gl::GBuffer m_export_fbo;
+    gl::Texture2D m_export_color_tex;
+    std::shared_ptr<AsyncReadback> m_export_readback;
 
 
     // gl::GBuffer m_framebuffer; //framebuffer in which we will draw, then we download it into a opencv mat in order to save it to disk
@@ -65,10 +137,30 @@ private:
 
 
     // //cv mats are buffered here and they await for the thread that writes them to file
-    moodycamel::ConcurrentQueue<MatWithFilePath> m_cv_mats_queue;
+    std::deque<MatWithFilePath> m_queue;
+    std::mutex m_queue_mutex;
+    std::condition_variable m_queue_not_empty_cv; //the writers sleep on this one
+    std::condition_variable m_queue_not_full_cv; //the render thread waits on this one with the Block policy
+    std::condition_variable m_idle_cv; //flush() waits on this one
     // std::unordered_map<std::string, int> m_times_written_for_tex; //how many times we have written a texture with a certain name
     std::vector<std::thread> m_writer_threads; 
     bool m_threads_are_running;
+    int m_nr_writes_in_progress;
+
+    //stats, guarded by the queue mutex
+    int m_max_queue_depth;
+    int m_nr_written;
+    int m_nr_dropped;
+    double m_total_encode_ms;
+    double m_max_encode_ms;
+
+    //video, only one writer at a time appends to it and the frames go in the order in which they were queued
+    cv::VideoWriter m_video_writer;
+    cv::Size m_video_size;
+    std::mutex m_video_mutex;
+    std::condition_variable m_video_cv;
+    int m_nr_video_frames_queued; //guarded by the queue mutex
+    int m_next_video_frame; //guarded by the video mutex
 
     bool m_is_recording;
     int m_nr_images_recorded;
@@ -17,6 +17,7 @@ public:
     static void show(const std::shared_ptr<Mesh> mesh, const std::string name); //adds to the scene and overwrites if it has the same name
     // static void show(const Mesh& mesh, const std::string name); //convenience function. adds to the scene and overwrites if it has the same name
     static void add_mesh(const std::shared_ptr<Mesh> mesh, const std::string name); //adds to the scene even if it has the same name
+    static void add_instances(const std::shared_ptr<Mesh> mesh, const std::string name, const std::vector<Eigen::Matrix4d>& transforms, const Eigen::MatrixXd& colors=Eigen::MatrixXd()); //adds the mesh once and draws it at every transform with hardware instancing. Colors are optional, one row per instance
     static void clear();
     static int nr_meshes();
     static int nr_vertices();
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <opencv2/core/core.hpp>
+
+namespace easy_pbr{
+
+//diffuse irradiance of an environment map as 9 spherical harmonics coefficients per color channel, following "An Efficient Representation for Irradiance Environment Maps" by Ramamoorthi and Hanrahan.
+//The projection runs on the cpu so it doesn't need a gl context and the irradiance for a normal n is then just the sum of the coefficients times the 9 basis functions evaluated at n
+
+//projects an equirectangular radiance map (as read by cv::imread, so BGR float) and returns a 9x3 matrix of RGB coefficients. They are already convolved with the cosine lobe and divided by pi so evaluating them gives the same value as sampling the irradiance cubemap made by radiance2irradiance.
+//The image is first reduced to at most max_width columns, which is plenty for the low frequencies that 9 coefficients can represent, and the rows are split between nr_threads threads (0 means one per core)
+Eigen::MatrixXf irradiance_sh9_from_equirectangular(const cv::Mat& img, const int max_width=512, const int nr_threads=0);
+
+//the 9 real spherical harmonics basis functions evaluated at the direction
+Eigen::Matrix<float,9,1> sh9_basis(const Eigen::Vector3f& dir);
+
+} //namespace easy_pbr
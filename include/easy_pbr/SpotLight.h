@@ -1,6 +1,7 @@
 #pragma once 
 
 #include <memory>
+#include <unordered_set>
 
 #include "Shader.h"
 #include "GBuffer.h"
@@ -30,14 +31,27 @@ public:
 
     // void render_to_shadow_map(const MeshCore& mesh);
     void set_power_for_point(const Eigen::Vector3f& point, const float power);
-    void render_mesh_to_shadow_map(std::shared_ptr<MeshGL>& mesh);
-    void render_points_to_shadow_map(std::shared_ptr<MeshGL>& mesh);
+    void render_mesh_to_shadow_map(std::shared_ptr<MeshGL>& mesh, const bool static_layer=false);
+    void render_points_to_shadow_map(std::shared_ptr<MeshGL>& mesh, const bool static_layer=false);
     void clear_shadow_map();
+
+    //the shadow map is split in a static layer which is cached and rendered again only when one of the static meshes it sees changes, and the dynamic meshes which are drawn on top of a copy of it. Since both are depth maps, drawing on top with depth testing gives the min of the two
+    bool is_static_shadow_map_stale(const std::unordered_set<unsigned long long>& meshes_in_scene); //meshes are identified by their MeshGL::m_uid. True if the light moved, the resolution changed, it was invalidated or one of the meshes in the static layer got removed from the scene
+    bool is_dynamic_shadow_map_stale(const std::unordered_set<unsigned long long>& meshes_in_scene); //true if one of the meshes drawn in the dynamic layer got removed from the scene
+    bool is_in_shadow_map(const MeshGL* mesh, const bool static_layer); //whether the mesh was drawn in the last update of the layer
+    void begin_static_shadow_map(); //clears the static layer so the static meshes can be drawn into it
+    void begin_dynamic_shadow_map(); //copies the static layer into the shadow map so the dynamic meshes can be drawn on top
+    void invalidate_static_shadow_map();
+    //bookkeeping of which meshes are in each layer. Used directly when the shadow map lives in a layer of the LayeredShadowMaps instead of in the fbo of the light
+    void reset_static_layer();
+    void reset_dynamic_layer();
+    void add_to_shadow_map(const MeshGL* mesh, const bool static_layer);
     void set_shadow_map_resolution(const int shadow_map_resolution);
     int shadow_map_resolution();
     bool has_shadow_map();
     gl::Texture2D& get_shadow_map_ref();
     gl::GBuffer& get_shadow_map_fbo_ref();
+    Frustum shadow_map_frustum(); //frustum of the light when rendering the shadow map
 
     void print_ptr();
 
@@ -50,9 +64,17 @@ private:
     void init_params(const configuru::Config& config_file);
     void init_opengl();
 
+    void init_shadow_map_fbo(gl::GBuffer& fbo);
+
     gl::Shader m_shadow_map_shader;
     gl::GBuffer m_shadow_map_fbo; //fbo that contains only depth maps for usage as a shadow map
+    gl::GBuffer m_static_shadow_map_fbo; //only the static meshes
     int m_shadow_map_resolution;
+    bool m_is_static_shadow_map_dirty;
+    int m_static_resolution; //resolution of the shadow map when the static layer was rendered
+    Eigen::Matrix4f m_static_view_proj; //view projection of the light when the static layer was rendered
+    std::unordered_set<unsigned long long> m_static_meshes; //uid of the meshes drawn in the static layer. Not the address because a new mesh can get the one of a removed mesh
+    std::unordered_set<unsigned long long> m_dynamic_meshes; //uid of the meshes drawn on top of it in the shadow map
   
 };
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <deque>
+#include <vector>
+
+//opencv
+#include "opencv2/opencv.hpp"
+
+#include "Texture2D.h"
+
+namespace easy_pbr{
+
+class MeshGL;
+
+//streams textures to the gpu a few rows at a time through a pixel unpack buffer so that big textures don't stall the render thread. The mip chain is uploaded from the coarsest level to the finest one and the base level of the texture gets lowered as each level finishes, so the texture is always complete and just gets sharper over a couple of frames
+class TextureUploader: public std::enable_shared_from_this<TextureUploader>{
+public:
+    template <class ...Args>
+    static std::shared_ptr<TextureUploader> create( Args&& ...args ){
+        return std::shared_ptr<TextureUploader>( new TextureUploader(std::forward<Args>(args)...) );
+    }
+    ~TextureUploader();
+
+    void enqueue(const std::shared_ptr<MeshGL>& owner, gl::Texture2D& tex, const std::vector<cv::Mat>& mips); //replaces any upload that is still pending for the same texture. The owner keeps the texture alive and if it gets destroyed the upload is dropped
+    size_t upload(const size_t budget_bytes); //uploads at most budget_bytes (rounded up to a full row) of the pending textures. Returns the nr of bytes actually uploaded
+    int nr_pending() const;
+    size_t nr_bytes_pending() const;
+
+private:
+    TextureUploader();
+
+    struct UploadJob{
+        std::weak_ptr<MeshGL> owner;
+        gl::Texture2D* tex;
+        std::vector<cv::Mat> mips;
+        int cur_lvl; //level which is being uploaded now, goes from mips.size()-1 down to 0
+        int cur_row;
+        bool storage_allocated;
+    };
+
+    void allocate_storage(UploadJob& job);
+    void upload_rows(UploadJob& job, const int nr_rows);
+
+    std::deque<UploadJob> m_jobs;
+    GLuint m_pbo_id;
+};
+
+} //namespace easy_pbr
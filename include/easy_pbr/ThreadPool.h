@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+
+namespace easy_pbr{
+
+//small fixed size pool of worker threads that sleep on a condition variable until there is a job for them. Used for the things that should not run on the render thread like loading meshes from disk or decoding textures
+class ThreadPool{
+public:
+    ThreadPool(const int nr_threads=std::thread::hardware_concurrency()):
+        m_is_running(true),
+        m_nr_jobs_in_flight(0)
+    {
+        int nr_threads_clamped= nr_threads>0 ? nr_threads : 1; //hardware_concurrency can return 0 if it cannot be determined
+        m_workers.reserve(nr_threads_clamped);
+        for(int i = 0; i < nr_threads_clamped; i++){
+            m_workers.emplace_back( &ThreadPool::worker_loop, this );
+        }
+    }
+
+    ~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_is_running=false;
+        }
+        m_jobs_cv.notify_all();
+        for(size_t i = 0; i < m_workers.size(); i++){
+            m_workers[i].join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&)=delete;
+    ThreadPool& operator=(const ThreadPool&)=delete;
+
+    //queues a function for execution on one of the workers and returns a future with the result of it. Exceptions thrown by the function are stored in the future
+    template <class F>
+    auto enqueue(F&& f) -> std::future< decltype(f()) >{
+        using R=decltype(f());
+        auto task=std::make_shared< std::packaged_task<R()> >( std::forward<F>(f) );
+        std::future<R> fut=task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_jobs.emplace_back( [task](){ (*task)(); } );
+            m_nr_jobs_in_flight++;
+        }
+        m_jobs_cv.notify_one();
+        return fut;
+    }
+
+    //blocks until all the jobs that were queued so far are finished
+    void wait_idle(){
+        std::unique_lock<std::mutex> lock(m_jobs_mutex);
+        m_idle_cv.wait(lock, [this]{ return m_nr_jobs_in_flight==0; });
+    }
+
+    int nr_threads() const { return m_workers.size(); }
+    int nr_jobs_in_flight() const { return m_nr_jobs_in_flight; } //queued or currently running
+
+private:
+    void worker_loop(){
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_jobs_mutex);
+                m_jobs_cv.wait(lock, [this]{ return !m_is_running || !m_jobs.empty(); });
+                if(!m_is_running && m_jobs.empty()){
+                    return; //we finish the jobs that are still queued before shutting down
+                }
+                job=std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                m_nr_jobs_in_flight--;
+            }
+            m_idle_cv.notify_all();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::deque< std::function<void()> > m_jobs;
+    std::mutex m_jobs_mutex;
+    std::condition_variable m_jobs_cv; //workers wait on this one for new jobs
+    std::condition_variable m_idle_cv; //wait_idle() waits on this one for all jobs to finish
+    bool m_is_running;
+    std::atomic<int> m_nr_jobs_in_flight;
+};
+
+} //namespace easy_pbr
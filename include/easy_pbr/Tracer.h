@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace easy_pbr{
+
+//durations of all the recorded scopes with the same name
+struct TraceStats{
+    std::string name;
+    bool is_gpu;
+    int count;
+    double mean_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+};
+
+//records when scopes of code start and end on each thread, and how long the gpu takes for the render passes, so that frames can be inspected in chrome://tracing or perfetto or summarized as percentiles per pass.
+//Everything is static so that any thread (render loop, writers of the recorder, mesh loaders) can record without a pointer to the viewer. While it's disabled a scope costs a single relaxed atomic load.
+//The gpu passes use timestamp queries that are read back a few frames later in new_frame() so the cpu never waits for the gpu. The names are not copied so they have to be string literals or outlive the tracer
+class Tracer{
+public:
+    static void set_enabled(const bool enabled); //disabling drops the gpu scopes that are still open or not read yet, so call it from the thread with the gl context
+    static bool is_enabled(){ return m_enabled.load(std::memory_order_relaxed); }
+    static void set_gpu_timing_enabled(const bool enabled); //issues the queries of the gpu scopes even while tracing is disabled so that gpu_time_ms() stays up to date. No events are recorded for them
+    static bool is_gpu_timing_active(){ return is_enabled() || m_gpu_timing_enabled.load(std::memory_order_relaxed); }
+    static void set_thread_name(const std::string& name); //name of the row of the calling thread in the trace
+    static void set_max_events_per_thread(const int max_events); //once a thread has this many events the new ones are dropped, so that a forgotten trace doesn't use all the memory
+
+    static void begin(const char* name);
+    static void end();
+    //also records a cpu scope with the same name. Needs to be called from the thread with the gl context
+    static void begin_gpu(const char* name);
+    static void end_gpu();
+    static void new_frame(); //reads the gpu queries that finished already, without waiting for the others. The viewer calls it once per frame
+    static float gpu_time_ms(const std::string& name); //duration of the most recent finished gpu scope with this name, -1 if none finished yet
+    static std::vector< std::pair<std::string, float> > gpu_times(); //the most recent duration of each gpu scope, sorted by name
+
+    static void clear(); //drops all the recorded events
+    static void write_chrome_trace(const std::string& path); //json in the trace event format, with a row for each thread and one for the gpu
+    static std::vector<TraceStats> stats();
+    static std::string stats_string(); //the stats as a table, sorted by the total time
+    static int nr_events();
+    static int nr_dropped();
+
+private:
+    static std::atomic<bool> m_enabled;
+    static std::atomic<bool> m_gpu_timing_enabled;
+};
+
+//records a cpu scope from the constructor to the destructor
+class TraceScope{
+public:
+    TraceScope(const char* name): m_active(Tracer::is_enabled()){ if(m_active){ Tracer::begin(name); } }
+    ~TraceScope(){ if(m_active){ Tracer::end(); } }
+private:
+    bool m_active;
+};
+
+//records a gpu pass, together with the cpu scope, from the constructor to the destructor
+class GpuTraceScope{
+public:
+    GpuTraceScope(const char* name): m_active(Tracer::is_gpu_timing_active()){ if(m_active){ Tracer::begin_gpu(name); } }
+    ~GpuTraceScope(){ if(m_active){ Tracer::end_gpu(); } }
+private:
+    bool m_active;
+};
+
+} //namespace easy_pbr
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) easy_pbr::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_GPU_SCOPE(name) easy_pbr::GpuTraceScope TRACE_CONCAT(gpu_trace_scope_, __LINE__)(name)
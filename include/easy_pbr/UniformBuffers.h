@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <Eigen/Core>
+
+namespace easy_pbr{
+
+//layouts of the uniform buffers shared by the shaders that draw meshes into the gbuffer (mesh, points and surfels). They are std140 so they have to match exactly the blocks declared in the shaders and the binding points have to match the layout(binding=...) of each block
+
+const int CAMERA_UBO_BINDING=1;
+const int MESH_UBO_BINDING=2;
+const int COLOR_SCHEME_HEIGHT_UBO_BINDING=3;
+const int COLOR_SCHEME_UBO_BINDING=4;
+const int MAX_NR_CLASSES=255; //same as MAX_NR_CLASSES in the shaders
+
+//updated once per frame by the viewer
+struct CameraUniforms{
+    Eigen::Matrix4f V;
+    Eigen::Matrix4f P;
+    Eigen::Matrix4f VP;
+};
+static_assert(sizeof(CameraUniforms)==3*64, "CameraUniforms does not match the std140 layout of CameraBlock");
+
+//one per mesh, kept in the MeshGL and updated only when the vis options or the model matrix change. The vec3 are followed by a float so they pack into 16 bytes like in std140
+struct MeshUniforms{
+    Eigen::Matrix4f M;
+    Eigen::Vector3f solid_color;
+    float min_y;
+    Eigen::Vector3f point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    int is_instanced;
+    int has_instance_colors;
+    int has_normals;
+    int points_as_circle;
+};
+static_assert(sizeof(MeshUniforms)==128, "MeshUniforms does not match the std140 layout of MeshBlock");
+
+//arrays of vec3 in std140 have a stride of a vec4 so we pad each color
+inline std::vector<Eigen::Vector4f> pack_colors_std140(const Eigen::MatrixXf& colors, const int nr_rows){
+    std::vector<Eigen::Vector4f> packed(nr_rows, Eigen::Vector4f::Zero());
+    for(int i = 0; i < std::min<int>(nr_rows, colors.rows()); i++){
+        packed[i] << colors(i,0), colors(i,1), colors(i,2), 1.0;
+    }
+    return packed;
+}
+
+} //namespace easy_pbr
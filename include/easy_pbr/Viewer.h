@@ -2,6 +2,10 @@
 
 //c++
 #include <memory>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 // #include "imgui.h"
 // #include "imgui_impl_glfw.h"
@@ -12,6 +16,8 @@
 
 #include <Eigen/Geometry>
 
+#include <opencv2/core/core.hpp>
+
 #include "Shader.h"
 #include "GBuffer.h"
 #include "CubeMap.h"
@@ -42,7 +48,38 @@ class MeshGL;
 class Camera;
 class Gui;
 class Recorder;
+class Picker;
+struct PickResult;
 class SpotLight;
+class MeshLoader;
+class TextureUploader;
+class MeshBatcher;
+class LayeredShadowMaps;
+class GpuTimer;
+class IblCache;
+class HeadlessContext;
+class AsyncReadback;
+class PointCloudOctree;
+struct Frustum;
+
+//images filled by Viewer::render_batch, one per pose. A vector that is left empty means that output is not needed
+struct BatchRenderOutputs{
+    void allocate(const int nr_images, const int width, const int height, const bool with_color, const bool with_depth, const bool with_normals);
+    std::vector<cv::Mat> color; //CV_8UC4 in bgra, the final tonemapped image with transparency in the background
+    std::vector<cv::Mat> depth; //CV_32FC1 with the distance along the camera axis, 0 in the background
+    std::vector<cv::Mat> normals; //CV_32FC3 with the xyz of the normal in world coordinates, 0 in the background
+};
+
+//what of a mesh can change the gbuffer or the shadow maps. It's compared with the one of the last frame because the visibility and the model matrix can be changed from python without setting any dirty flag
+struct MeshSceneState{
+    unsigned long long buffers_version;
+    Eigen::Matrix4d model_matrix;
+    unsigned int vis_flags; //is_visible and the show_* flags packed as bits
+    float point_size;
+    bool operator==(const MeshSceneState& other) const{
+        return buffers_version==other.buffers_version && model_matrix==other.model_matrix && vis_flags==other.vis_flags && point_size==other.point_size;
+    }
+};
 
 //in order to dissalow building on the stack and having only ptrs https://stackoverflow.com/a/17135547
 class Viewer;
@@ -60,6 +97,7 @@ public:
     ~Viewer();
 
     
+    std::shared_ptr<HeadlessContext> m_headless_context; //offscreen context used instead of the glfw window when the config asks for a headless backend. Declared before the dummy so that init_context can set it
     bool dummy;  //to initialize the window we provide this dummy variable so we can call initialie context
     bool dummy_glad;
     GLFWwindow* m_window;
@@ -72,9 +110,17 @@ public:
     std::shared_ptr<Camera> m_camera; //just a point to either the default camera or one of the point light so that we render the view from the point of view of the light
     std::shared_ptr<Gui> m_gui;
     std::shared_ptr<Recorder> m_recorder;
+    std::shared_ptr<Picker> m_picker; //reads what is under a pixel from the id buffers, used if m_enable_id_buffers
+    std::shared_ptr<MeshLoader> m_mesh_loader; //loads meshes on worker threads, used for drag and drop so that the viewer stays interactive
+    std::shared_ptr<TextureUploader> m_texture_uploader; //streams the textures of the meshes to gpu over several frames
+    std::shared_ptr<MeshBatcher> m_mesh_batcher; //draws the small meshes with plain materials all at once
+    std::shared_ptr<LayeredShadowMaps> m_layered_shadow_maps; //shadow maps of all the lights in one texture array, used if m_enable_layered_shadow_maps
+    std::shared_ptr<AsyncReadback> m_batch_readback; //reads the images of render_batch
+    std::shared_ptr<IblCache> m_ibl_cache; //precomputed ibl textures stored on disk, null if the cache is disabled in the config
     std::shared_ptr<radu::utils::RandGenerator> m_rand_gen;
     std::vector<std::shared_ptr<SpotLight>> m_spot_lights;
     std::vector<std::shared_ptr<Camera>> m_trajectory;
+    std::vector<std::shared_ptr<PointCloudOctree>> m_point_cloud_octrees; //streamed from disk and drawn into the gbuffer together with the meshes of the scene
 
 
     //params
@@ -82,7 +128,8 @@ public:
     Eigen::Vector3f m_background_color;
 
     void init_params(const std::string config_file);
-    bool init_context();
+    bool init_context(const std::string config_file);
+    bool is_headless() const; //rendering without a window, there is no gui and nothing is presented
     void setup_callbacks_viewer(GLFWwindow* window);
     void setup_callbacks_imgui(GLFWwindow* window);
     void switch_callbacks(GLFWwindow* window);
@@ -92,6 +139,12 @@ public:
     void pre_draw();
     void post_draw();
     void draw(const GLuint fbo_id=0); //draw into a certain framebuffer, by default its the screen (default framebuffer)
+    //renders the scene from each pose (tf_world_cam) back to back without polling events, drawing the gui or swapping. The images are read back through a ring of pbos so the gpu renders the next poses while the previous ones are copied.
+    //intrinsics can be empty to use the fov of the current camera, have one K for all poses or one per pose. The outputs need to be preallocated with the size of the rendered images (viewport size / subsample factor)
+    void render_batch(const std::vector<Eigen::Matrix4f>& poses, const std::vector<Eigen::Matrix3f>& intrinsics, BatchRenderOutputs& outputs);
+    //what is under the pixel x,y of the viewport in the last drawn frame, with the origin at the top left. Needs the id buffers. pick() waits for the gpu while pick_async() calls on_done a couple of frames later from draw()
+    PickResult pick(const int x, const int y, const int radius=0);
+    void pick_async(const int x, const int y, const std::function<void(const PickResult&)> on_done, const int radius=0);
     void clear_framebuffers();
     void compile_shaders();
     void hotload_shaders();
@@ -102,10 +155,15 @@ public:
     void render_lines(const std::shared_ptr<MeshGL> mesh);
     void render_wireframe(const std::shared_ptr<MeshGL> mesh);
     void render_mesh_to_gbuffer(const std::shared_ptr<MeshGL> mesh);
+    void render_batched_meshes_to_gbuffer(); //draws all the meshes that were queued in the m_mesh_batcher during the geometry pass
+    void clear_id_buffers(); //integer attachments are not cleared by glClear so we clear them with glClearBuffer
+    void set_id_buffer_uniforms(gl::Shader& shader, const std::shared_ptr<MeshGL>& mesh); //which label and which instance id the mesh writes into the id buffers
+    void update_camera_ubo(); //uploads the view and projection of the current camera into the uniform buffer read by all the shaders that draw into the gbuffer
     void render_surfels_to_gbuffer(const std::shared_ptr<MeshGL> mesh);
     std::shared_ptr<SpotLight> spotlight_with_idx(const size_t);
     // cv::Mat download_to_cv_mat(); //downloads the last drawn framebuffer into a cv::Mat. It is however sloas it forces a stall of the pipeline. For recording the viewer look into the Recorder class
     void load_environment_map(const std::string path);
+    void add_point_cloud_octree(const std::shared_ptr<PointCloudOctree> octree);
 
     // //for debuggin
     // void print_pointers();
@@ -116,14 +174,23 @@ public:
 
     //rendering passes 
     void ssao_pass();
+    void ssao_pass_compute(); //same result as ssao_pass but with compute shaders that keep the depth of a tile in shared memory and a separable blur
+    bool ssao_needs_update(); //with temporal accumulation the ao stops being computed once it converged for a static camera and scene
+    gl::Texture2D& ssao_temporal_pass(const Eigen::Vector2i& size); //blends the ao of this frame into the reprojected history and returns the texture with the result
     void compose_final_image(const GLuint fbo_id);
 
     //other
     void create_random_samples_hemisphere();
+    std::shared_ptr<GpuTimer> gpu_timer(const std::string& name); //view on the gpu time that the tracer measured for the passes with this name
+    float gpu_time_ms(const std::string& name); //gpu time of the last finished measurement with this name, -1 if there is none
+    Eigen::MatrixXf ssao_samples_for_frame(); //all the random samples, or a different subset of them each frame when the ao is accumulated over time
+    bool has_scene_changed(); //whether any mesh got added, removed, uploaded again, moved or had its visibility changed since the last call. The meshes that moved or changed visibility also get their shadow map marked dirty
 
     //getters 
     gl::Texture2D& rendered_tex_no_gui(const bool with_transparency);
     gl::Texture2D& rendered_tex_with_gui();
+    bool using_fat_gbuffer() const; //whether the normals in the gbuffer are stored as they are instead of encoded into [0,1]
+    unsigned int id_buffers_no_label() const; //value of the label buffer for the background and for meshes without labels. It's the max value of the format
 
     // Callbacks
     void set_callbacks();
@@ -143,23 +210,34 @@ public:
     double m_old_time;
     double m_accumulator_time;
     unsigned long long m_nr_drawn_frames;
+    std::map<std::string, std::shared_ptr<GpuTimer>> m_gpu_timers;
 
     gl::Shader m_draw_points_shader;
     gl::Shader m_draw_lines_shader;
     gl::Shader m_draw_mesh_shader;
+    gl::Shader m_draw_mesh_batched_shader;
+    GLuint m_camera_ubo_id;
+    GLuint m_color_scheme_height_ubo_id; //viridis colormap for the height color type, it never changes so it's uploaded once
     gl::Shader m_draw_wireframe_shader;
     gl::Shader m_draw_surfels_shader;
     gl::Shader m_compose_final_quad_shader;
     gl::Shader m_ssao_ao_pass_shader;
     gl::Shader m_depth_linearize_shader;
     gl::Shader m_bilateral_blur_shader;
+    gl::Shader m_depth_linearize_compute_shader;
+    gl::Shader m_ssao_ao_pass_compute_shader;
+    gl::Shader m_bilateral_blur_compute_shader;
+    gl::Shader m_ssao_temporal_shader;
     gl::Shader m_equirectangular2cubemap_shader;
     gl::Shader m_radiance2irradiance_shader;
     gl::Shader m_prefilter_shader;
     gl::Shader m_integrate_brdf_shader;
     gl::Shader m_blur_shader;
+    gl::Shader m_bloom_downsample_shader;
+    gl::Shader m_bloom_upsample_shader;
     gl::Shader m_apply_postprocess_shader;
     gl::Shader m_decode_gbuffer_debugging;
+    gl::Shader m_batch_outputs_shader; //decodes the normals and linearizes the depth for render_batch
     gl::Shader m_blend_bg_shader;;
 
     gl::GBuffer m_gbuffer; //contains all the textures of a normal gbuffer. So normals, diffuse, depth etc.
@@ -169,11 +247,16 @@ public:
     // gl::Texture2D m_posprocessed_tex; //after adding also any post processing like bloom and tone mapping and gamma correcting. Is in RGBA8
     gl::GBuffer m_final_fbo_no_gui; //after rendering also the lines and edges but before rendering the gui
     gl::GBuffer m_final_fbo_with_gui; //after we also render the gui into it
+    gl::GBuffer m_batch_outputs_fbo; //normals and depth as floats for render_batch
 
     gl::Texture2D m_ao_tex;
     gl::Texture2D m_ao_blurred_tex;
     gl::Texture2D m_rvec_tex;
     gl::Texture2D m_depth_linear_tex;
+    gl::Texture2D m_ao_blur_tmp_tex; //result of the horizontal pass of the separable blur used by the compute ssao
+    gl::Texture2D m_ao_history_tex[2]; //accumulated ao of the previous and the current frame, we alternate between them
+    int m_ao_history_idx; //which of the two has the current frame
+    gl::Texture2D m_depth_linear_prev_tex; //linear depth of the last frame in which the ao was computed, used to detect disocclusions
     gl::Texture2D m_blur_tmp_tex; //stores the blurring temporary results
     gl::Texture2D m_background_tex; //in the case we want an image as the background
     gl::CubeMap m_environment_cubemap_tex; //used for image-based ligthing
@@ -196,13 +279,49 @@ public:
     Eigen::Vector3f m_ambient_color;   
     float m_ambient_color_power;
     bool m_enable_culling;
+    float m_texture_upload_budget_mb; //how many MB of texture data we upload to the gpu each frame at most
+    bool m_enable_frustum_culling; //skips the meshes whose bounding box is outside of the camera frustum or outside of the frustum of the light when rendering shadow maps
+    //culling stats of the last frame, shown in the profiler window
+    int m_nr_meshes_drawn;
+    int m_nr_meshes_culled;
+    int m_nr_triangles_drawn;
+    int m_nr_triangles_culled;
+    int m_nr_shadow_meshes_drawn; //summed over all the lights
+    int m_nr_shadow_meshes_culled;
+    int m_nr_shadow_passes_skipped; //lights whose shadow map was left as it was because nothing they see changed
+    int m_nr_static_shadow_passes; //lights whose cached layer of static meshes had to be rendered again
+    int m_nr_dynamic_shadow_passes; //lights whose dynamic meshes got drawn on top of the static layer
+    int m_nr_shadow_draw_calls;
+    bool m_enable_layered_shadow_maps; //draws each mesh once into the shadow maps of all the lights that see it, using a geometry shader that selects the layer of a texture array. With more than LayeredShadowMaps::MAX_NR_LAYERS lights that cast shadows it falls back to the shadow map of each light
+    int m_layered_shadow_map_max_resolution;
+    bool m_enable_mesh_batching; //packs the small meshes that don't have textures into shared buffers and draws them with one multi draw indirect call
+    int m_mesh_batching_max_nr_vertices; //only meshes with fewer vertices than this are batched
+    int m_nr_batched_draws; //nr of meshes drawn through the batch in the last frame
+    bool m_enable_id_buffers; //adds to the gbuffer a label_gtex with the semantic label of each pixel and an instance_id_gtex with the index of the mesh in the viewer plus one. Only read from the config because the gbuffer is created at startup
+    bool m_id_buffers_32bit; //stores the ids as R32UI instead of R16UI
+    bool m_id_buffers_label_from_gt; //the label buffer gets L_gt of the meshes, otherwise L_pred
     bool m_auto_ssao;
     bool m_enable_ssao;
+    bool m_ssao_use_compute; //runs the ssao with compute shaders instead of fullscreen quads
+    bool m_ssao_temporal; //computes only a few samples each frame and blends them with the reprojected ao of the previous frames
+    int m_ssao_temporal_nr_samples; //samples per frame when accumulating over time
+    int m_ssao_temporal_max_frames; //how many frames the history can contain while the camera or the scene move. Lower means less ghosting but more noise
+    int m_ssao_temporal_max_frames_static; //when nothing moves we keep accumulating up to this many frames and then stop computing the ao until something changes
+    int m_ssao_nr_accumulated_frames; //frames contained in the ao history, shown in the profiler window
+    bool m_ssao_reset_history;
+    bool m_ssao_history_valid;
+    Eigen::Matrix4f m_ssao_prev_V;
+    Eigen::Matrix4f m_ssao_prev_P;
+    Eigen::VectorXf m_ssao_prev_params; //the ssao settings that were used for the history, changing any of them discards it
+    bool m_scene_changed; //set at the start of each frame by has_scene_changed()
+    std::unordered_map<unsigned long long, MeshSceneState> m_scene_states; //state of each mesh in the last frame, by MeshGL::m_uid
     bool m_enable_bloom;
     float m_bloom_threshold;
     int m_bloom_start_mip_map_lvl;
     int m_bloom_max_mip_map_lvl;
     int m_bloom_blur_iters;
+    bool m_bloom_dual_filter; //blurs the bloom with a chain of downsamples and upsamples instead of gaussian blurs on each mip map, which is a lot cheaper for big images
+    float m_bloom_dual_filter_offset; //spread of the samples of the dual filter in texels, higher is wider and smoother but may show some pattern
     // float m_shading_factor; // dicates how much the lights and ambient occlusion influence the final color. If at zero then we only output the diffuse color
     // float m_light_factor; // dicates how much the lights influence the final color. If at zero then we only output the diffuse color but also multipled by ambient occlusion ter
     bool m_auto_edl;
@@ -216,6 +335,9 @@ public:
     bool m_show_prefiltered_environment_map; //show the prefiltered environment which means we can run down the mip maps and show blurred versions of it
     float m_environment_map_blur;
     std::string m_environment_map_path;
+    bool m_use_irradiance_sh; //the diffuse ibl comes from 9 spherical harmonics computed on the cpu instead of the irradiance cubemap. Turning it on only has an effect for the environment maps loaded afterwards, turning it off computes the irradiance cubemap on the next frame
+    Eigen::MatrixXf m_irradiance_sh; //9x3, empty until an environment map is loaded with m_use_irradiance_sh
+    bool m_irradiance_cubemap_is_computed; //false when the environment map was loaded using the spherical harmonics, so the cubemap is computed the first time it's needed
     bool m_lights_follow_camera; //if set to true, the movement and the rotation of the main camera will also influence the lights so that they make the same movements as if they are rigidly anchored to the default_camera
     int m_environment_cubemap_resolution; //environment cubemap have 6 faces each with a resolution of m_environment_cubemap_resolution X m_environment_cubemap_resolution
     int m_irradiance_cubemap_resolution;
@@ -231,6 +353,7 @@ public:
     float m_multichannel_start_x; //the start of the first line, defalt is 0 which means it start on the left
 
     std::vector< std::shared_ptr<MeshGL> > m_meshes_gl; //stored the gl meshes which will get updated if the meshes in the scene are dirty
+    unsigned long long m_meshes_gl_version; //increases when a mesh is removed from m_meshes_gl since the ones after it get another instance id
 
 
     // Eigen::Matrix4f compute_mvp_matrix(const std::shared_ptr<MeshGL>& mesh);
@@ -242,6 +365,8 @@ public:
     bool m_record_gui;
     bool m_record_with_transparency;
 
+    std::string m_chrome_trace_path; //if not empty the trace gets written here when the viewer is destroyed
+
 private:
     Viewer(const std::string config_file=std::string(DEFAULT_CONFIG) ); // we put the constructor as private so as to dissalow creating Viewer on the stack because we want to only used shared ptr for it
     // Eigen::Matrix4f compute_mvp_matrix();
@@ -252,12 +377,28 @@ private:
 
     // float try_float_else_nan(const configuru::Config& cfg); //tries to parse a float and if it fails, returns signaling nan
     void configure_auto_params();
+    void prepare_scene_for_draw(); //adds the meshes that finished loading and, the first time the scene is not empty, sets the params left as "auto". Done at the start of draw() and by render_batch() before it copies the camera
+    bool is_culled(const std::shared_ptr<MeshGL>& mesh, const Frustum& frustum, const std::shared_ptr<Camera>& cam, const int viewport_width); //true if frustum culling is enabled and the mesh is fully outside of the frustum. The camera and width are used to know how far the points stick out of the box of the vertices
+    void update_shadow_maps(); //renders again only the shadow maps of the lights that see a mesh that changed
+    void render_to_shadow_map(const std::shared_ptr<SpotLight>& light, const Frustum& light_frustum, const bool dynamic_meshes); //draws either the static or the dynamic meshes that are inside the frustum of the light
+    void render_layered_shadow_maps(const std::vector<Frustum>& light_frustums, const std::vector<bool>& static_dirty, const std::vector<bool>& dynamic_dirty);
+    bool draws_triangles_in_shadow_map(const std::shared_ptr<MeshGL>& mesh);
+    bool draws_points_in_shadow_map(const std::shared_ptr<MeshGL>& mesh);
+    bool skip_instanced(const std::shared_ptr<MeshGL>& mesh, const std::string mode); //true if the mesh is instanced, because only the triangles are drawn with instancing. Warns once per mesh and mode
+    std::set<std::string> m_warned_instanced; //mesh name and mode of the warnings we already printed
+    bool m_shadow_maps_were_layered; //whether the last update of the shadow maps used the layered ones
+    std::vector<int> m_shadow_map_layer_of_light; //only the lights that cast shadows get a layer, -1 for the others
+    bool m_warned_too_many_shadow_layers;
+    int m_nr_dropped_meshes; //only grows so that the names of the meshes dropped into the window never repeat, even if meshes are removed or still loading
+    void find_id_buffers_attachments(); //the gbuffer has to be bound for drawing
+    std::vector<GLenum> m_id_buffers_attachments; //color attachments of the label_gtex and instance_id_gtex in the gbuffer, found again when the gbuffer is resized instead of querying them every frame
     void read_background_img(gl::Texture2D& tex, const std::string img_path);
     void equirectangular2cubemap(gl::CubeMap& cubemap_tex, const gl::Texture2D& equirectangular_tex);
     void radiance2irradiance(gl::CubeMap& irradiance_tex, const gl::CubeMap& radiance_tex); //precomputes the irradiance around a hemisphere given the radiance
     void prefilter(gl::CubeMap& prefilter_tex, const gl::CubeMap& radiance_tex); //prefilter the radiance tex for various levels of roughness. Used for specular IBL
     void integrate_brdf(gl::Texture2D& brdf_lut_tex);
     void blur_img(gl::Texture2D& img, const int start_mip_map_lvl, const int max_mip_map_lvl, const int m_bloom_blur_iters);
+    void blur_img_dual_filter(gl::Texture2D& img, const int start_mip_map_lvl, const int max_mip_map_lvl, const float offset); //at the end only the start_mip_map_lvl contains the bloom, summed over all the levels
     void apply_postprocess(); //grabs the composed_tex and the bloom_tex and sums them together, applies tone mapping and gamme correction
     void blend_bg(); //takes the post_processed image and blends a solid background color into it if needed.
 
@@ -0,0 +1,35 @@
+#version 430 core
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out vec3 normal_out;
+layout(location = 1) out float depth_out;
+
+uniform sampler2D normals_encoded_tex;
+uniform sampler2D depth_tex;
+uniform float projection_a; //for calculating the linear depth according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+uniform float projection_b;
+
+
+//encode as xyz https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 normal){
+    return normalize(normal * 2.0 - 1.0);
+}
+
+void main(){
+
+    float depth_raw = texture(depth_tex, uv_in).x;
+
+    //the background gets zeros for both so it's easy to mask out
+    if(depth_raw==1.0){
+        normal_out = vec3(0.0);
+        depth_out = 0.0;
+        return;
+    }
+
+    normal_out = decode_normal(texture(normals_encoded_tex, uv_in).xyz); //in world coordinates
+    depth_out = projection_b / (depth_raw - projection_a);
+
+}
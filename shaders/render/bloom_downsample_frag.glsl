@@ -0,0 +1,28 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+//downsample step of the dual filter blur from "Bandwidth-Efficient Rendering" by Marius Bjorge (Siggraph 2015). Writes the next mip map level with 5 bilinear taps of the current one
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out vec4 downsampled_output;
+
+uniform sampler2D img; //the base and max level are set so that only the level we read from is visible, lod 0 is that level
+uniform float offset; //spread of the taps in texels, higher values make a wider bloom
+
+void main(){
+
+    vec2 half_texel=0.5/vec2(textureSize(img, 0));
+    vec2 o=half_texel*offset;
+
+    vec4 sum = textureLod(img, uv_in, 0)*4.0;
+    sum += textureLod(img, uv_in + vec2(-o.x, -o.y), 0);
+    sum += textureLod(img, uv_in + vec2( o.x,  o.y), 0);
+    sum += textureLod(img, uv_in + vec2( o.x, -o.y), 0);
+    sum += textureLod(img, uv_in + vec2(-o.x,  o.y), 0);
+
+    downsampled_output=sum/8.0;
+
+}
@@ -0,0 +1,31 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+//upsample step of the dual filter blur. Reads a mip map level with 8 bilinear taps and is added with additive blending on top of the level above, so at the end the start level contains the blurred sum of all the levels
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out vec4 upsampled_output;
+
+uniform sampler2D img; //the base and max level are set so that only the level we read from is visible, lod 0 is that level
+uniform float offset;
+
+void main(){
+
+    vec2 half_texel=0.5/vec2(textureSize(img, 0));
+    vec2 o=half_texel*offset;
+
+    vec4 sum = textureLod(img, uv_in + vec2(-o.x*2.0, 0.0), 0);
+    sum += textureLod(img, uv_in + vec2(-o.x, o.y), 0)*2.0;
+    sum += textureLod(img, uv_in + vec2(0.0, o.y*2.0), 0);
+    sum += textureLod(img, uv_in + vec2(o.x, o.y), 0)*2.0;
+    sum += textureLod(img, uv_in + vec2(o.x*2.0, 0.0), 0);
+    sum += textureLod(img, uv_in + vec2(o.x, -o.y), 0)*2.0;
+    sum += textureLod(img, uv_in + vec2(0.0, -o.y*2.0), 0);
+    sum += textureLod(img, uv_in + vec2(-o.x, -o.y), 0)*2.0;
+
+    upsampled_output=sum/12.0;
+
+}
@@ -42,6 +42,8 @@ uniform bool show_background_img;
 uniform bool show_environment_map;
 uniform bool show_prefiltered_environment_map;
 uniform bool enable_ibl;
+uniform bool use_irradiance_sh; //the irradiance comes from the spherical harmonics instead of the irradiance cubemap
+uniform vec3 irradiance_sh[9];
 uniform float projection_a; //for calculating position from depth according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
 uniform float projection_b;
 uniform float exposure;
@@ -63,9 +65,12 @@ struct SpotLight {
     float power; // how much strenght does the light have
     mat4 VP; //projects world coordinates into the light 
     sampler2D shadow_map;
+    int shadow_map_layer; //layer in the shadow_map_array if use_shadow_map_array
     bool create_shadow;
 };
 uniform SpotLight spot_lights[8];
+uniform bool use_shadow_map_array; //the shadow maps of all lights are layers of the shadow_map_array instead of each light having its own
+uniform sampler2DArray shadow_map_array;
 // uniform Light omni_lights[8]; //At the moment I drop support for omni light at least partially until I have a class that can draw shadow maps into a omni light
 uniform int nr_active_spot_lights;
 
@@ -186,6 +191,19 @@ float map(float value, float inMin, float inMax, float outMin, float outMax) {
     return outMin + (outMax - outMin) * (value_clamped - inMin) / (inMax - inMin);
 }
 
+//irradiance/pi from the 9 coefficients of the spherical harmonics, the cosine lobe is already convolved into them on the cpu. Same basis as in SphericalHarmonics.cxx
+vec3 irradiance_from_sh(vec3 n){
+    vec3 e = irradiance_sh[0] * 0.282095
+           + irradiance_sh[1] * 0.488603 * n.y
+           + irradiance_sh[2] * 0.488603 * n.z
+           + irradiance_sh[3] * 0.488603 * n.x
+           + irradiance_sh[4] * 1.092548 * n.x * n.y
+           + irradiance_sh[5] * 1.092548 * n.y * n.z
+           + irradiance_sh[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+           + irradiance_sh[7] * 1.092548 * n.x * n.z
+           + irradiance_sh[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(e, vec3(0.0)); //the truncated series can ring slightly negative for very bright small lights
+}
 
 
 
@@ -520,7 +538,7 @@ void main(){
                 float Factor = 0.0;
                 if(spot_lights[i].create_shadow){
                     // percentage close filtering like in http://ogldev.atspace.co.uk/www/tutorial42/tutorial42.html
-                    ivec2 shadow_map_size=textureSize(spot_lights[i].shadow_map,0);
+                    ivec2 shadow_map_size= use_shadow_map_array ? textureSize(shadow_map_array,0).xy : textureSize(spot_lights[i].shadow_map,0);
                     // ivec2 shadow_map_size=ivec2(1024);
                     float xOffset = 1.0/shadow_map_size.x;
                     float yOffset = 1.0/shadow_map_size.y;
@@ -528,7 +546,7 @@ void main(){
                         for (int x = -1 ; x <= 1 ; x++) {
                             vec2 Offsets = vec2(x * xOffset, y * yOffset);
                             vec2 UV = proj_in_light.xy + Offsets;
-                            float closest_depth = texture(spot_lights[i].shadow_map, UV).x;
+                            float closest_depth = use_shadow_map_array ? texture(shadow_map_array, vec3(UV, spot_lights[i].shadow_map_layer)).x : texture(spot_lights[i].shadow_map, UV).x;
                             float current_depth = proj_in_light.z;  
                             float epsilon = 0.0001;
                             if (closest_depth + epsilon < current_depth){
@@ -601,7 +619,7 @@ void main(){
                 // vec3 kS = F; 
                 // vec3 kD = 1.0 - kS;
                 // kD *= 1.0 - metalness;	  
-                vec3 irradiance = texture(irradiance_cubemap_tex, N).rgb;
+                vec3 irradiance = use_irradiance_sh ? irradiance_from_sh(N) : texture(irradiance_cubemap_tex, N).rgb;
                 // vec3 radiance = radiance(N, V, roughness);
                 vec3 radiance = textureLod(prefilter_cubemap_tex, R,  roughness * prefilter_nr_mipmaps).rgb;    
                 // vec3 diffuse      = irradiance * albedo;
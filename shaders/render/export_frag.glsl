@@ -0,0 +1,58 @@
+#version 430 core
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out vec3 normal_world_out;
+layout(location = 1) out vec3 normal_camera_out;
+layout(location = 2) out float depth_out;
+layout(location = 3) out int mesh_id_out;
+
+uniform sampler2D normals_encoded_tex;
+uniform sampler2D depth_tex;
+uniform isampler2D mesh_id_tex;
+uniform mat4 V;
+uniform float projection_a; //for calculating the linear depth according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+uniform float projection_b;
+uniform bool using_fat_gbuffer;
+uniform bool swap_red_blue;
+
+
+//encode as xyz https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 normal){
+    if(using_fat_gbuffer){
+        return normalize(normal);
+    }else{
+        return normalize(normal * 2.0 - 1.0);
+    }
+}
+
+void main(){
+
+    //flip in y so that the first row in memory is the top of the image, like opencv and numpy expect
+    ivec2 size = textureSize(depth_tex, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    pixel.y = size.y-1-pixel.y;
+
+    float depth_raw = texelFetch(depth_tex, pixel, 0).x;
+
+    //the background gets zeros for the floats and -1 for the id so it's easy to mask out
+    if(depth_raw==1.0){
+        normal_world_out = vec3(0.0);
+        normal_camera_out = vec3(0.0);
+        depth_out = 0.0;
+        mesh_id_out = -1;
+        return;
+    }
+
+    vec3 normal_world = decode_normal(texelFetch(normals_encoded_tex, pixel, 0).xyz);
+    vec3 normal_camera = normalize(mat3(V) * normal_world);
+
+    //opencv wants bgr
+    normal_world_out = swap_red_blue ? normal_world.zyx : normal_world;
+    normal_camera_out = swap_red_blue ? normal_camera.zyx : normal_camera;
+    depth_out = projection_b / (depth_raw - projection_a);
+    mesh_id_out = texelFetch(mesh_id_tex, pixel, 0).x;
+
+}
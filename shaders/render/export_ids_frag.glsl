@@ -0,0 +1,27 @@
+#version 430 core
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out int label_out;
+layout(location = 1) out int instance_id_out;
+
+uniform usampler2D label_tex;
+uniform usampler2D instance_id_tex;
+uniform int no_label; //the max value of the format of the id buffers, as an int so 0xFFFFFFFF comes in as -1
+
+
+void main(){
+
+    //flip in y so that the first row in memory is the top of the image, like opencv and numpy expect
+    ivec2 size = textureSize(label_tex, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    pixel.y = size.y-1-pixel.y;
+
+    //pixels without label get -1 like the background of the mesh id, regardless of the format of the id buffers
+    uint label = texelFetch(label_tex, pixel, 0).x;
+    label_out = label==uint(no_label) ? -1 : int(label);
+    instance_id_out = int(texelFetch(instance_id_tex, pixel, 0).x);
+
+}
@@ -3,8 +3,8 @@
 
 
 //in
-in vec3 position;
-in vec3 color_per_vertex;
+layout(location = 0) in vec3 position; //same locations as the ones set in the vao of the MeshGL
+layout(location = 3) in vec3 color_per_vertex;
 
 
 //out
@@ -0,0 +1,50 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+
+//in
+layout(location = 0) in vec3 normal_in;
+layout(location = 1) in vec3 color_per_vertex_in;
+layout(location = 2) flat in vec2 metalness_and_roughness_in;
+layout(location = 3) flat in int mesh_id_in;
+layout(location = 4) flat in int color_type_in;
+layout(location = 5) flat in int instance_id_in;
+
+//out
+//same outputs as mesh_frag.glsl so that both can draw into the same gbuffer
+layout(location = 1) out vec4 diffuse_out;
+layout(location = 3) out vec3 normal_out;
+layout(location = 4) out vec2 metalness_and_roughness_out;
+layout(location = 5) out int mesh_id_out;
+layout(location = 6) out uint label_id_out; //only written if the gbuffer has the id buffers. Meshes with labels are never batched
+layout(location = 7) out uint instance_id_out;
+layout(location = 2) out uint primitive_id_out; //the face, for picking. Each draw of the multi draw starts again from 0
+
+
+//uniform
+uniform bool using_fat_gbuffer;
+uniform int no_label;
+
+vec3 encode_normal(vec3 normal){
+    if(using_fat_gbuffer){
+        return normal;
+    }else{
+        return normal * 0.5 + 0.5;
+    }
+}
+
+void main(){
+
+    if(color_type_in==5){ //normal vector
+        diffuse_out=vec4( (normal_in+1.0)/2.0, 1.0 );
+    }else{
+        diffuse_out=vec4(color_per_vertex_in,1.0);
+    }
+
+    metalness_and_roughness_out=metalness_and_roughness_in;
+    normal_out=encode_normal(normal_in);
+    mesh_id_out=mesh_id_in;
+    label_id_out=uint(no_label);
+    instance_id_out=uint(instance_id_in);
+    primitive_id_out=uint(gl_PrimitiveID);
+}
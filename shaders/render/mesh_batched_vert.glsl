@@ -0,0 +1,57 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+
+//in
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 color_per_vertex;
+layout(location = 3) in int draw_idx; //has a divisor of 1 so the base instance of each draw command selects which entry of draw_data belongs to this mesh
+
+//out
+layout(location = 0) out vec3 normal_out;
+layout(location = 1) out vec3 color_per_vertex_out;
+layout(location = 2) flat out vec2 metalness_and_roughness_out;
+layout(location = 3) flat out int mesh_id_out;
+layout(location = 4) flat out int color_type_out;
+layout(location = 5) flat out int instance_id_out;
+
+
+//per mesh data, the layout has to match MeshBatcher::DrawData
+struct DrawData{
+    mat4 M;
+    vec4 solid_color;
+    vec4 metalness_roughness;
+    ivec4 mesh_id_color_type; //mesh id, color type, instance id, unused
+};
+layout(std430, binding = 0) readonly buffer DrawDataBuffer{
+    DrawData draw_data[];
+};
+
+//uniforms
+layout(std140, binding = 1) uniform CameraBlock{ //shared with the other gbuffer shaders, updated once per frame
+    mat4 V;
+    mat4 P;
+    mat4 VP;
+};
+
+void main(){
+
+   DrawData data = draw_data[draw_idx];
+
+   gl_Position = VP*data.M*vec4(position, 1.0);
+
+   normal_out=normalize(vec3(data.M*vec4(normal,0.0))); //normals are not affected by translation so the homogenous component is 0
+
+   int color_type=data.mesh_id_color_type.y;
+   if(color_type==1){ //per vert color
+       color_per_vertex_out=color_per_vertex;
+   }else{ //solid. The normal vector color is done in the fragment shader
+       color_per_vertex_out=data.solid_color.xyz;
+   }
+
+   metalness_and_roughness_out=data.metalness_roughness.xy;
+   mesh_id_out=data.mesh_id_color_type.x;
+   color_type_out=color_type;
+   instance_id_out=data.mesh_id_color_type.z;
+}
@@ -10,6 +10,7 @@ layout(location = 3) in vec3 color_per_vertex_in;
 layout(location = 4) in vec2 uv_in;
 layout(location = 5) in vec3 position_world_in;
 layout(location = 6) in mat3 TBN_in;
+layout(location = 9) flat in int label_in;
 
 
 
@@ -21,10 +22,27 @@ layout(location = 1) out vec4 diffuse_out;
 layout(location = 3) out vec3 normal_out;
 layout(location = 4) out vec2 metalness_and_roughness_out;
 layout(location = 5) out int mesh_id_out;
+layout(location = 6) out uint label_id_out; //only written if the gbuffer has the id buffers
+layout(location = 7) out uint instance_id_out;
+layout(location = 2) out uint primitive_id_out; //the face, for picking
 
 
 // //uniform
-uniform int color_type;
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 uniform sampler2D diffuse_tex; 
 uniform sampler2D metalness_tex; 
 uniform sampler2D roughness_tex; 
@@ -33,11 +51,10 @@ uniform bool has_diffuse_tex; //If the texture tex actually exists and can be sa
 uniform bool has_metalness_tex; //If the texture tex actually exists and can be sampled from
 uniform bool has_roughness_tex; //If the texture tex actually exists and can be sampled from
 uniform bool has_normals_tex; //If the texture tex actually exists and can be sampled from
-//only for solid rendering where there is only one value for metaless and roughness instead of a map
-uniform float metalness;
-uniform float roughness;
-uniform int mesh_id;
 uniform bool using_fat_gbuffer;
+uniform bool has_labels; //whether the mesh has the labels that go into the label buffer
+uniform int no_label; //what the label buffer gets for meshes without labels, the max value of the format
+uniform int instance_id;
 
 //encode the normal using the equation from Cry Engine 3 "A bit more deferred" https://www.slideshare.net/guest11b095/a-bit-more-deferred-cry-engine3
 // vec2 encode_normal(vec3 normal){
@@ -146,6 +163,9 @@ void main(){
     normal_out=encode_normal(normal_to_encode);
 
     mesh_id_out=mesh_id;
+    label_id_out= has_labels ? uint(label_in) : uint(no_label);
+    instance_id_out=uint(instance_id);
+    primitive_id_out=uint(gl_PrimitiveID);
 
     // position_out = vec4(position_cam_coords_in, 1.0);
 }
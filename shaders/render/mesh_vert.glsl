@@ -3,16 +3,17 @@
 
 
 //in
-in vec3 position;
-in vec3 normal;
-in vec3 tangent; //T vector fom the TBN. We have already the N and we reconstruct the B with a cross product
-in vec3 color_per_vertex;
-in vec2 uv;
-in int label_pred_per_vertex;
-in int label_gt_per_vertex;
-in float intensity_per_vertex;
-in float metalness;
-in float roughness;
+//the locations are the ones set in the vao of the MeshGL when it gets uploaded
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 tangent; //T vector fom the TBN. We have already the N and we reconstruct the B with a cross product
+layout(location = 3) in vec3 color_per_vertex;
+layout(location = 4) in vec2 uv;
+layout(location = 5) in int label_pred_per_vertex;
+layout(location = 6) in int label_gt_per_vertex;
+layout(location = 7) in float intensity_per_vertex;
+layout(location = 10) in mat4 instance_M; //takes locations 10 to 13. Only valid if is_instanced
+layout(location = 14) in vec3 instance_color;
 
 //out
 layout(location = 0) out vec3 normal_out;
@@ -22,19 +23,38 @@ layout(location = 3) out vec3 color_per_vertex_out;
 layout(location = 4) out vec2 uv_out;
 layout(location = 5) out vec3 position_world_out; //useful for some hacks like when when we want to discard all fragments above a certain height
 layout(location = 6) out mat3 TBN_out;
+layout(location = 9) flat out int label_out; //for the label buffer, takes the location after the 3 of the TBN
 
 
 //uniforms
-uniform mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
-uniform mat4 MV; //project only into camera coordinate, but doesnt project onto the screen
-uniform mat4 MVP;
-uniform int color_type;
-uniform vec3 solid_color;
+layout(std140, binding = 1) uniform CameraBlock{ //shared by all meshes, updated once per frame
+    mat4 V;
+    mat4 P;
+    mat4 VP;
+};
+uniform bool label_from_gt;
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 #define MAX_NR_CLASSES 255
-uniform vec3 color_scheme[MAX_NR_CLASSES];
-uniform vec3 color_scheme_height[256];
-uniform float min_y;
-uniform float max_y;
+layout(std140, binding = 4) uniform ColorSchemeBlock{ //for semantic labels
+    vec4 color_scheme[MAX_NR_CLASSES];
+};
+layout(std140, binding = 3) uniform ColorSchemeHeightBlock{ //for height color type
+    vec4 color_scheme_height[256];
+};
 
 float map(float value, float inMin, float inMax, float outMin, float outMax) {
     float value_clamped=clamp(value, inMin, inMax);  //so the value doesn't get modified by the clamping, because glsl may pass this by referece
@@ -45,28 +65,33 @@ vec3 colorize_height(float x){
     float x_clamped=clamp(x,0.0, 1.0);
     x_clamped*=255;
     int x_int = int(x_clamped);
-    return color_scheme_height[x_int];
+    return color_scheme_height[x_int].xyz;
 }
 
 void main(){
 
+   //with instancing the uniform matrices are the ones of the mesh and each instance is moved by its own matrix before that
+   mat4 M_inst = is_instanced ? instance_M : mat4(1.0);
+   mat4 M_final = M*M_inst;
+   mat4 MV_final = V*M_final;
+   mat4 MVP_final = VP*M_final;
 
-   gl_Position = MVP*vec4(position, 1.0);
+   gl_Position = MVP_final*vec4(position, 1.0);
 
    //tbn matrix 
    vec3 bitangent = cross(normal, tangent);  //calculate the bitgent in the object coordinate system. The tangent and normal are also in the object coordinate system
 
    //get the tbn vectors from the model to the world coordinate system
-   vec3 T = normalize(vec3(M * vec4(tangent,   0.0)));
-   vec3 B = normalize(vec3(M * vec4(bitangent, 0.0)));
-   vec3 N = normalize(vec3(M * vec4(normal,    0.0)));
+   vec3 T = normalize(vec3(M_final * vec4(tangent,   0.0)));
+   vec3 B = normalize(vec3(M_final * vec4(bitangent, 0.0)));
+   vec3 N = normalize(vec3(M_final * vec4(normal,    0.0)));
    mat3 TBN = mat3(T, B, N);
    TBN_out=TBN;
 
 
    //TODO normals also have to be rotated by the model matrix (at the moment it's only identity so its fine)
-   normal_out=normalize(vec3(M*vec4(normal,0.0))); //normals are not affected by translation so the homogenous component is 0
-   position_cam_coords_out= vec3(MV*(vec4(position, 1.0))); //from object to world and from world to view
+   normal_out=normalize(vec3(M_final*vec4(normal,0.0))); //normals are not affected by translation so the homogenous component is 0
+   position_cam_coords_out= vec3(MV_final*(vec4(position, 1.0))); //from object to world and from world to view
 //    normal_cam_coords_out=normalize(vec3(MV*vec4(normal, 0.0)));
 //    normal_cam_coords_out=normalize(vec3(MV*vec4(normal, 0.0)));
 
@@ -74,17 +99,18 @@ void main(){
    uv_out=uv;
 
    position_world_out=position;
+   label_out= label_from_gt ? label_gt_per_vertex : label_pred_per_vertex;
 
     if(color_type==0){ //solid
-        color_per_vertex_out=solid_color;
+        color_per_vertex_out= (is_instanced && has_instance_colors) ? instance_color : solid_color;
     }else if(color_type==1){ //per vert color
        color_per_vertex_out=color_per_vertex;
     }else if(color_type==2){ //texture WILL BE DONE IN THE FRAGMENT SHADER
         // color_per_vertex_out=vec3(0);
     }else if(color_type==3){ //semantic pred
-        color_per_vertex_out=color_scheme[label_pred_per_vertex];
+        color_per_vertex_out=color_scheme[label_pred_per_vertex].xyz;
     }else if(color_type==4){ //semantic gt
-        color_per_vertex_out=color_scheme[label_gt_per_vertex];
+        color_per_vertex_out=color_scheme[label_gt_per_vertex].xyz;
     // }else if(color_type==5){ //normal vector //NORMAL WILL BE OUTPUTTED FROM FRAGMENT SHADER BECAUSE sometime we might want to do normal mapping and only the framgne thas acces to that
         // color_per_vertex_out=(normal_out+1.0)/2.0;
     // }else if(color_type==6){ //SSAO CANNOT BE DONE HERE AS IT CAN ONLY BE DONE BY THE COMPOSE SHADER
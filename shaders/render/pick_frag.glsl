@@ -0,0 +1,34 @@
+#version 430 core
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out uvec4 pick_out; //instance id, primitive id, raw depth as bits, label
+
+uniform usampler2D instance_id_tex;
+uniform usampler2D primitive_id_tex;
+uniform usampler2D label_tex;
+uniform sampler2D depth_tex;
+uniform int region_start_x; //pixel of the gbuffer that goes into the bottom left of the region
+uniform int region_start_y;
+
+
+void main(){
+
+    //no flip, the region keeps the bottom to top order of the gbuffer
+    ivec2 size = textureSize(depth_tex, 0);
+    ivec2 pixel = ivec2(region_start_x, region_start_y) + ivec2(gl_FragCoord.xy);
+
+    //the part of the region that falls outside the gbuffer is background
+    if(any(lessThan(pixel, ivec2(0))) || any(greaterThanEqual(pixel, size))){
+        pick_out = uvec4(0, 0, floatBitsToUint(1.0), 0);
+        return;
+    }
+
+    pick_out.x = texelFetch(instance_id_tex, pixel, 0).x;
+    pick_out.y = texelFetch(primitive_id_tex, pixel, 0).x;
+    pick_out.z = floatBitsToUint(texelFetch(depth_tex, pixel, 0).x);
+    pick_out.w = texelFetch(label_tex, pixel, 0).x;
+
+}
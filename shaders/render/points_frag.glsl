@@ -23,6 +23,7 @@ layout(location = 0) in vec3 normal_in;
 layout(location = 1) in vec3 position_cam_coords_in; //position of the vertex in the camera coordinate system (so the world coordinate is multipled by tf_cam_world or also known as the view matrix)
 layout(location = 2) in vec3 color_per_vertex_in;
 layout(location = 3) in vec2 uv_in;
+layout(location = 4) flat in int label_in;
 // layout(location = 5) in float log_depth_in;
 
 
@@ -32,9 +33,26 @@ layout(location = 3) in vec2 uv_in;
 layout(location = 1) out vec4 diffuse_out;
 layout(location = 2) out vec3 normal_out;
 layout(location = 3) out vec2 metalness_and_roughness_out;
+layout(location = 4) out uint label_id_out; //only written if the gbuffer has the id buffers
+layout(location = 5) out uint instance_id_out;
+layout(location = 6) out uint primitive_id_out; //the point, for picking. The highest bit says that it's a point and not a face
 
 // //uniform
-uniform int color_type;
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 // uniform sampler2D tex; //the rgb tex that is used for coloring
 uniform sampler2D diffuse_tex; 
 uniform sampler2D metalness_tex; 
@@ -43,12 +61,10 @@ uniform sampler2D normals_tex;
 uniform bool has_diffuse_tex; //If the texture tex actually exists and can be sampled from
 uniform bool has_metalness_tex; //If the texture tex actually exists and can be sampled from
 uniform bool has_roughness_tex; //If the texture tex actually exists and can be sampled from
-uniform bool has_normals=false; //if we have normals this will get set to true
-//only for solid rendering where there is only one value for metaless and roughness instead of a map
-uniform float metalness;
-uniform float roughness;
 uniform bool using_fat_gbuffer;
-uniform bool points_as_circle;
+uniform bool has_labels; //whether the mesh has the labels that go into the label buffer
+uniform int no_label; //what the label buffer gets for meshes without labels, the max value of the format
+uniform int instance_id;
 
 //encode the normal using the equation from Cry Engine 3 "A bit more deferred" https://www.slideshare.net/guest11b095/a-bit-more-deferred-cry-engine3
 // vec2 encode_normal(vec3 normal){
@@ -137,6 +153,9 @@ void main(){
 
     normal_out=encode_normal(normal_in);
     metalness_and_roughness_out=vec2(metalness_out, roughness_out);
+    label_id_out= has_labels ? uint(label_in) : uint(no_label);
+    instance_id_out=uint(instance_id);
+    primitive_id_out=uint(gl_PrimitiveID) | 0x80000000u;
   
 }
 
@@ -19,6 +19,9 @@
 
 // void main(){
 
+    mat4 MV = V*M;
+    mat4 MVP = VP*M;
+
 //     gl_Position = MVP*vec4(position, 1.0);
 
 //     if(color_type==0){ //solid
@@ -28,9 +31,9 @@
 //     }else if(color_type==2){ //texture NOT APLICABLE HERE
 //         color_per_vertex_out=vec3(0);
 //     }else if(color_type==3){ //semantic pred
-//         color_per_vertex_out=color_scheme[label_pred_per_vertex];
+//         color_per_vertex_out=color_scheme[label_pred_per_vertex].xyz;
 //     }else if(color_type==4){ //semantic gt
-//         color_per_vertex_out=color_scheme[label_gt_per_vertex];
+//         color_per_vertex_out=color_scheme[label_gt_per_vertex].xyz;
 //     }else if(color_type==5){ //normal vector
 //         color_per_vertex_out=(normal+1.0)/2.0;
 //     }else if(color_type==6){ //SSAO NOT APPLICABLE HERE
@@ -45,13 +48,14 @@
 
 
 //in
-in vec3 position;
-in vec3 normal;
-in vec3 color_per_vertex;
-in float intensity_per_vertex;
-in vec2 uv;
-in int label_pred_per_vertex;
-in int label_gt_per_vertex;
+//the locations are the ones set in the vao of the MeshGL when it gets uploaded
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 3) in vec3 color_per_vertex;
+layout(location = 7) in float intensity_per_vertex;
+layout(location = 4) in vec2 uv;
+layout(location = 5) in int label_pred_per_vertex;
+layout(location = 6) in int label_gt_per_vertex;
 
 //out
 layout(location = 0) out vec3 normal_out;
@@ -59,19 +63,37 @@ layout(location = 1) out vec3 position_cam_coords_out; //position of the vertex
 // layout(location = 2) out vec3 normal_cam_coords_out; //normal of the vertex in the camera coordinate system (so the normal is multipled by the rotation of tf_cam_world or also known as the view matrix)
 layout(location = 2) out vec3 color_per_vertex_out;
 layout(location = 3) out vec2 uv_out;
+layout(location = 4) flat out int label_out; //for the label buffer
 
 //uniforms
-uniform mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
-uniform mat4 MV; //project only into camera coordinate, but doesnt project onto the screen
-uniform mat4 MVP;
-uniform int color_type;
-uniform vec3 point_color;
+layout(std140, binding = 1) uniform CameraBlock{ //shared by all meshes, updated once per frame
+    mat4 V;
+    mat4 P;
+    mat4 VP;
+};
+uniform bool label_from_gt;
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 #define MAX_NR_CLASSES 255
-uniform vec3 color_scheme[MAX_NR_CLASSES];
-uniform vec3 color_scheme_height[256];
-uniform float min_y;
-uniform float max_y;
-uniform bool has_normals=false; //if we have normals this will get set to true
+layout(std140, binding = 4) uniform ColorSchemeBlock{ //for semantic labels
+    vec4 color_scheme[MAX_NR_CLASSES];
+};
+layout(std140, binding = 3) uniform ColorSchemeHeightBlock{ //for height color type
+    vec4 color_scheme_height[256];
+};
 
 float map(float value, float inMin, float inMax, float outMin, float outMax) {
     float value_clamped=clamp(value, inMin, inMax);  //so the value doesn't get modified by the clamping, because glsl may pass this by referece
@@ -82,7 +104,7 @@ vec3 colorize_height(float x){
     float x_clamped=clamp(x,0.0, 1.0);
     x_clamped*=255;
     int x_int = int(x_clamped);
-    return color_scheme_height[x_int];
+    return color_scheme_height[x_int].xyz;
 }
 
 void main(){
@@ -125,6 +147,7 @@ void main(){
 
 //    color_per_vertex_out=color_per_vertex;
     uv_out=uv;
+    label_out= label_from_gt ? label_gt_per_vertex : label_pred_per_vertex;
 
     if(color_type==0){ //solid
         color_per_vertex_out=point_color;
@@ -0,0 +1,23 @@
+#version 430 core
+
+//in
+layout(location=1) in vec2 uv_in;
+
+//out
+layout(location = 0) out vec4 out_color;
+
+uniform sampler2D tex;
+uniform bool swap_red_blue;
+
+
+void main(){
+
+    //flip in y so that the first row in memory is the top of the image, like opencv and numpy expect
+    ivec2 size = textureSize(tex, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 color = texelFetch(tex, ivec2(pixel.x, size.y-1-pixel.y), 0);
+
+    //opencv wants bgr
+    out_color = swap_red_blue ? color.bgra : color;
+
+}
@@ -0,0 +1,31 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+#define MAX_NR_LAYERS 8 //same as LayeredShadowMaps::MAX_NR_LAYERS
+
+//one invocation per light, each one writes the triangle into the layer of its light
+layout(triangles, invocations = MAX_NR_LAYERS) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+//in
+layout(location = 0) in vec4 position_world_in[];
+
+//uniforms
+uniform mat4 light_VP[MAX_NR_LAYERS];
+uniform int nr_layers;
+uniform int layers_mask; //bit i is set if the light i sees this mesh and its shadow map needs to be updated
+
+void main(){
+
+    int layer=gl_InvocationID;
+    if(layer>=nr_layers || (layers_mask & (1<<layer))==0 ){
+        return;
+    }
+
+    for(int i = 0; i < 3; i++){
+        gl_Layer = layer;
+        gl_Position = light_VP[layer]*position_world_in[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -0,0 +1,23 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+
+//in
+layout(location = 0) in vec3 position;
+layout(location = 10) in mat4 instance_M; //takes locations 10 to 13. Only valid if is_instanced
+
+//out
+layout(location = 0) out vec4 position_world_out;
+
+
+//uniforms
+uniform mat4 M;
+uniform bool is_instanced;
+
+void main(){
+
+   //only moves to world, the projection into each light is done in the geometry shader
+   mat4 M_inst = is_instanced ? instance_M : mat4(1.0);
+   position_world_out = M*M_inst*vec4(position, 1.0);
+
+}
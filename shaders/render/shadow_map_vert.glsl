@@ -3,18 +3,21 @@
 
 
 //in
-in vec3 position;
+layout(location = 0) in vec3 position;
+layout(location = 10) in mat4 instance_M; //takes locations 10 to 13. Only valid if is_instanced
 
 //out
 
 
 //uniforms
 uniform mat4 MVP;
+uniform bool is_instanced;
 
 void main(){
 
 
-   gl_Position = MVP*vec4(position, 1.0);
+   mat4 M_inst = is_instanced ? instance_M : mat4(1.0);
+   gl_Position = MVP*M_inst*vec4(position, 1.0);
 
    
 }
\ No newline at end of file
@@ -8,6 +8,7 @@ layout(location = 0) in vec3 position_eye_in;
 layout(location = 1) in vec3 normal_in; 
 layout(location = 2) in vec2 tex_coord_in; 
 layout(location = 3) in vec3 color_per_vertex_in; 
+layout(location = 4) flat in int label_in;
 // layout(location = 4) in vec2 uv_in
 
 
@@ -19,16 +20,33 @@ layout(location = 1) out vec4 diffuse_out;
 // layout(location = 4) out vec4 shininess_out;
 layout(location = 2) out vec3 normal_out;
 layout(location = 3) out vec2 metalness_and_roughness_out;
+layout(location = 4) out uint label_id_out; //only written if the gbuffer has the id buffers. Integer targets are not blended so the last surfel that covers the pixel wins
+layout(location = 5) out uint instance_id_out;
+layout(location = 6) out uint primitive_id_out; //the point, for picking. The highest bit says that it's a point and not a face
 
 // //uniform
-uniform int color_type;
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 uniform bool using_fat_gbuffer;
-uniform vec3 solid_color;
+uniform bool has_labels; //whether the mesh has the labels that go into the label buffer
+uniform int no_label; //what the label buffer gets for meshes without labels, the max value of the format
+uniform int instance_id;
 uniform bool enable_solid_color; // whether to use solid color or color per vertex
 uniform vec3 specular_color;
 uniform float shininess;
-uniform float metalness;
-uniform float roughness;
 uniform bool enable_visibility_test;
 // uniform sampler2D diffuse_tex; 
 // uniform sampler2D metalness_tex; 
@@ -151,6 +169,9 @@ void main(){
         diffuse_out = vec4(color_per_vertex_in*surface_confidence, surface_confidence );
         normal_out = encode_normal( normal_in );
         metalness_and_roughness_out=vec2(metalness_out, roughness_out)*surface_confidence;
+        label_id_out= has_labels ? uint(label_in) : uint(no_label);
+        instance_id_out=uint(instance_id);
+        primitive_id_out=uint(gl_PrimitiveID) | 0x80000000u;
         // normal_out = vec4(  encode_normal( normal_eye_in*surface_confidence ), 1.0, 1.0);
         // position_out = vec4(position_eye_in*surface_confidence, 1.0);
     }
@@ -10,23 +10,45 @@ layout(location = 1) in vec3 v_normal_in[];
 layout(location = 2) in vec3 tangent_u_in[]; 
 layout(location = 3) in float length_v_in[]; 
 layout(location = 4) in vec3 color_per_vertex_in[]; 
+layout(location = 5) flat in int label_in[];
 
 //out
 layout(location=0) out vec3 position_eye_out;
 layout(location=1) out vec3 normal_out;
 layout(location=2) out vec2 tex_coord;
 layout(location=3) out vec3 color_per_vertex_out;
+layout(location=4) flat out int label_out;
 
 
 //uniforms
-uniform mat4 M;
-uniform mat4 MV; //project only into camera coordinate, but doesnt project onto the screen
-uniform mat4 MVP;
+layout(std140, binding = 1) uniform CameraBlock{ //shared by all meshes, updated once per frame
+    mat4 V;
+    mat4 P;
+    mat4 VP;
+};
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 
 
 void main()
 {
 
+    mat4 MV = V*M;
+    mat4 MVP = VP*M;
+
     //make the quad
     //get 2 vectors in the tangent plane
     //first one is the cross product between the normal and any other vector (just ensure it's not paralel to it)
@@ -49,6 +71,8 @@ void main()
     position_eye_out = vec3 (MV * vec4 (pos_quad_corner , 1.0));
     normal_out=normalize(vec3(M*vec4(v_normal_in[0],0.0)));
     color_per_vertex_out=color_per_vertex_in[0];
+    label_out=label_in[0];
+    gl_PrimitiveID=gl_PrimitiveIDIn; //the index of the point, for picking
     EmitVertex();
 
 
@@ -58,6 +82,8 @@ void main()
     position_eye_out = vec3 (MV * vec4 (pos_quad_corner , 1.0));
     normal_out=normalize(vec3(M*vec4(v_normal_in[0],0.0)));
     color_per_vertex_out=color_per_vertex_in[0];
+    label_out=label_in[0];
+    gl_PrimitiveID=gl_PrimitiveIDIn; //the index of the point, for picking
     EmitVertex();
 
 
@@ -67,6 +93,8 @@ void main()
     position_eye_out = vec3 (MV * vec4 (pos_quad_corner , 1.0));
     normal_out=normalize(vec3(M*vec4(v_normal_in[0],0.0)));
     color_per_vertex_out=color_per_vertex_in[0];
+    label_out=label_in[0];
+    gl_PrimitiveID=gl_PrimitiveIDIn; //the index of the point, for picking
     EmitVertex();
 
 
@@ -76,6 +104,8 @@ void main()
     position_eye_out = vec3 (MV * vec4 (pos_quad_corner , 1.0));
     normal_out=normalize(vec3(M*vec4(v_normal_in[0],0.0)));
     color_per_vertex_out=color_per_vertex_in[0];
+    label_out=label_in[0];
+    gl_PrimitiveID=gl_PrimitiveIDIn; //the index of the point, for picking
     EmitVertex();
     EndPrimitive();
 
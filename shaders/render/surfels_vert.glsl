@@ -2,13 +2,14 @@
 #extension GL_ARB_explicit_attrib_location : require
 
 //in
-in vec3 position;
-in vec3 normal;
-in vec3 tangent_u;
-in float lenght_v;
-in vec3 color_per_vertex;
-in int label_pred_per_vertex;
-in int label_gt_per_vertex;
+//the locations are the ones set in the vao of the MeshGL when it gets uploaded
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 tangent_u;
+layout(location = 8) in float lenght_v;
+layout(location = 3) in vec3 color_per_vertex;
+layout(location = 5) in int label_pred_per_vertex;
+layout(location = 6) in int label_gt_per_vertex;
 
 //out
 layout(location = 0) out vec3 v_pos_out; //position in world coords
@@ -16,16 +17,30 @@ layout(location = 1) out vec3 v_normal_out;
 layout(location = 2) out vec3 tangent_u_out; 
 layout(location = 3) out float lenght_v_out; 
 layout(location = 4) out vec3 color_per_vertex_out; 
+layout(location = 5) flat out int label_out; //for the label buffer
 
 
 //uniforms
-uniform mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
-uniform mat4 MV; //project only into camera coordinate, but doesnt project onto the screen
-uniform mat4 MVP;
-uniform int color_type;
-uniform vec3 solid_color;
+uniform bool label_from_gt;
+layout(std140, binding = 2) uniform MeshBlock{ //per mesh, has to match the MeshUniforms in UniformBuffers.h
+    mat4 M; //model matrix which moves from an object centric frame into the world frame. If the mesh is already in the world frame, then this will be an identity
+    vec3 solid_color;
+    float min_y;
+    vec3 point_color;
+    float max_y;
+    float metalness;
+    float roughness;
+    int color_type;
+    int mesh_id;
+    bool is_instanced;
+    bool has_instance_colors;
+    bool has_normals;
+    bool points_as_circle;
+};
 #define MAX_NR_CLASSES 255
-uniform vec3 color_scheme[MAX_NR_CLASSES];
+layout(std140, binding = 4) uniform ColorSchemeBlock{ //for semantic labels
+    vec4 color_scheme[MAX_NR_CLASSES];
+};
 
 void main(){
 
@@ -35,6 +50,8 @@ void main(){
     lenght_v_out=lenght_v;
     // color_per_vertex_out=color_per_vertex;
 
+    label_out= label_from_gt ? label_gt_per_vertex : label_pred_per_vertex;
+
     if(color_type==0){ //solid
         color_per_vertex_out=solid_color;
     }else if(color_type==1){ //per vert color
@@ -42,9 +59,9 @@ void main(){
     }else if(color_type==2){ //texture WILL BE DONE IN THE FRAGMENT SHADER
         // color_per_vertex_out=vec3(0);
     }else if(color_type==3){ //semantic pred
-        color_per_vertex_out=color_scheme[label_pred_per_vertex];
+        color_per_vertex_out=color_scheme[label_pred_per_vertex].xyz;
     }else if(color_type==4){ //semantic gt
-        color_per_vertex_out=color_scheme[label_gt_per_vertex];
+        color_per_vertex_out=color_scheme[label_gt_per_vertex].xyz;
     }else if(color_type==5){ //normal vector
         color_per_vertex_out=(normal+1.0)/2.0;
     }
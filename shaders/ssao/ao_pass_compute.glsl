@@ -1,89 +1,107 @@
 #version 430
 #extension GL_ARB_explicit_attrib_location : require
 
-layout (local_size_x = 16, local_size_y = 16) in;
+//compute version of ao_pass_frag.glsl. The workgroup first loads the linear depth of its tile plus an apron around it into shared memory. The samples of the hemisphere that land inside it are read from there and only the ones that fall further away go to the texture
+#define TILE_SIZE 16
+#define APRON 16
+#define CACHE_SIZE (TILE_SIZE+2*APRON)
+layout (local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
 
-// uniform sampler2D position_cam_coords_tex;
-uniform sampler2D normal_cam_coords_tex;
+//uniforms
 uniform sampler2D normal_tex;
+uniform sampler2D depth_linear_tex; //from depth_linearize_compute.glsl, at the resolution of the ao image and with 0 on the background
 uniform sampler2D rvec_tex;
-// layout(r32f) uniform writeonly image2D ao_img;
-layout(rgba32f) uniform writeonly image2D ao_img;
-uniform mat4 proj;
-
-// const int MAX_KERNEL_SIZE = 128;
-// uniform vec3 gKernel[MAX_KERNEL_SIZE];
-// uniform float gSampleRad;
-
+uniform mat4 P;
+uniform mat4 P_inv;
+uniform mat3 V_rot;
 const int MAX_NR_SAMPLES=256;
 uniform int nr_samples;
 uniform vec3 random_samples[MAX_NR_SAMPLES];
-
 uniform float kernel_radius;
-uniform int pyr_lvl;
+uniform bool using_fat_gbuffer;
+uniform vec2 noise_offset; //changes every frame when the ao is accumulated over time so each frame uses different rotations of the samples
+layout(r8, binding = 0) uniform writeonly image2D ao_img;
 
-float random(vec2 co){
-    return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
-}
+shared float depth_cache[CACHE_SIZE][CACHE_SIZE];
 
-float map(float value, float inMin, float inMax, float outMin, float outMax) {
-    float value_clamped=clamp(value, inMin, inMax);  //so the value doesn't get modified by the clamping, because glsl may pass this by referece
-    return outMin + (outMax - outMin) * (value_clamped - inMin) / (inMax - inMin);
-}
 
-//decode a normal stored in RG texture as explained in the CryEngine 3 talk "A bit more deferred" https://www.slideshare.net/guest11b095/a-bit-more-deferred-cry-engine3
-vec3 decode_normal(vec2 normal){
-    vec3 normal_decoded;
-    normal_decoded.z=dot(normal.xy, normal.xy)*2-1;
-    normal_decoded.xy=normalize(normal.xy)*sqrt(1-normal_decoded.z*normal_decoded.z);
-    return normal_decoded;
+//encode as xyz https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 normal){
+    if(using_fat_gbuffer){
+        return normalize(normal);
+    }else{
+        return normalize(normal * 2.0 - 1.0);
+    }
 }
 
-void main() {
-    ivec2 img_coords = ivec2(gl_GlobalInvocationID.xy);
+vec3 view_ray(vec2 uv){
+    //same as the one interpolated by ao_pass_vert.glsl
+    vec4 ray = P_inv * vec4(uv*2.0-1.0, 0.0, 1.0);
+    return normalize(ray.xyz);
+}
 
-    // //debug 
-    // imageStore(ao_img, img_coords, vec4(0.5, 0.0, 0.0, 1.0) );
+float fetch_depth_linear(ivec2 px, ivec2 img_size, ivec2 cache_origin){
+    ivec2 local=px-cache_origin;
+    if(all(greaterThanEqual(local, ivec2(0))) && all(lessThan(local, ivec2(CACHE_SIZE)))){
+        return depth_cache[local.y][local.x];
+    }
+    return texelFetch(depth_linear_tex, clamp(px, ivec2(0), img_size-1), 0).x;
+}
 
-    //for sampling we need it in range [0,1]
-    ivec2 img_size=textureSize( position_cam_coords_tex, pyr_lvl);
-    vec2 uv_coord=vec2(float(img_coords.x+0.5)/img_size.x, float(img_coords.y+0.5)/img_size.y);
 
-    //if we are on the background then we just store a 1 in the a0 to indicate total visibility and we're done 
-    // vec4 pos= texelFetch(position_cam_coords_tex, img_coords, pyr_lvl);
-    vec4 pos= textureLod(position_cam_coords_tex, uv_coord, pyr_lvl);
-    // vec4 pos= texture(position_cam_coords_tex, uv_coord);
+void main() {
 
-    // //debug 
-    // // imageStore(ao_img, img_coords, vec4(pos.xyz, 1.0) );
-    // imageStore(ao_img, img_coords, vec4(pos.w, 0.0, 0.0, 1.0) );
-        
+    ivec2 img_size = imageSize(ao_img);
+    ivec2 cache_origin = ivec2(gl_WorkGroupID.xy)*TILE_SIZE - APRON;
 
-    // if(pos.w==0.0){ //on the background the alpha value is 0.0, we ensured that in the geometry pass
-    //     imageStore(ao_img, img_coords, vec4(1.0, 0.0, 0.0, 1.0) );
-    //     return;
-    // }
+    //cooperative load of the tile and the apron
+    int thread_idx=int(gl_LocalInvocationIndex);
+    for(int i = thread_idx; i < CACHE_SIZE*CACHE_SIZE; i+=TILE_SIZE*TILE_SIZE){
+        ivec2 local=ivec2(i%CACHE_SIZE, i/CACHE_SIZE);
+        ivec2 px=clamp(cache_origin+local, ivec2(0), img_size-1);
+        depth_cache[local.y][local.x]=texelFetch(depth_linear_tex, px, 0).x;
+    }
+    barrier();
 
+    ivec2 img_coords = ivec2(gl_GlobalInvocationID.xy);
+    if(img_coords.x>=img_size.x || img_coords.y>=img_size.y){
+        return;
+    }
+    vec2 uv=(vec2(img_coords)+0.5)/vec2(img_size);
 
-    
+    float depth_linear=depth_cache[img_coords.y-cache_origin.y][img_coords.x-cache_origin.x];
+    if(depth_linear==0.0){
+        imageStore(ao_img, img_coords, vec4(1.0));
+        return;
+    }
 
+    vec3 normal_encoded=texture(normal_tex, uv).xyz;
+    if(normal_encoded==vec3(0)){ //we have something like a point cloud without normals. so we just it to everything visible
+        imageStore(ao_img, img_coords, vec4(1.0));
+        return;
+    }
+    vec3 normal=decode_normal(normal_encoded);
+    normal=V_rot*normal; //we need the normal in cam coordinates so we have to rotate it with the rotation part of the view matrix
 
-    vec3 origin=pos.xyz;
-    vec3 normal=texture(normal_cam_coords_tex, uv_coord).xyz;
+    //get position in cam coordinates
+    vec3 origin=view_ray(uv)*depth_linear;
 
-    //if the normal is pointing awa from the camera it means we are viewing the face from behind (in the case we have culling turned off). We have to flip the normal 
-    //we take the positiuon of the fragment in cam coords and get the normalized vector so this is the direction from cam to the fragment. All normals dot producted with this direction vector should be negative (pointing towards the camera)
+    //if the normal is pointing awa from the camera it means we are viewing the face from behind (in the case we have culling turned off). We have to flip the normal
     vec3 dir = normalize(origin);
     if(dot(normal, dir)>0.0 ){
         normal=-normal;
     }
 
-    vec2 noise_scale=vec2(img_size)/vec2( textureSize( rvec_tex, 0) );
-    vec3 rvec = texture(rvec_tex, uv_coord * noise_scale).xyz; //scaling the uv coords will make the random vecs tile over the screen in tiles of 4x4 (if the texture is 4x4 of course)
+    ivec2 full_size=textureSize( normal_tex, 0); //we tile the noise over the full resolution like the fragment shader does
+    vec2 noise_scale=vec2(full_size)/vec2( textureSize( rvec_tex, 0) );
+    vec3 rvec = texture(rvec_tex, uv * noise_scale + noise_offset).xyz;
     vec3 tangent = normalize(rvec - normal * dot(rvec, normal));
     vec3 bitangent = cross(normal, tangent);
     mat3 rot = mat3(tangent, bitangent, normal);
 
+    vec4 origin_proj=P*vec4(origin,1.0);
+    origin_proj.xy/=origin_proj.w;
+    origin_proj.xy = origin_proj.xy * 0.5 + 0.5;
 
     float nr_times_visible = 0.0;
     int nr_valid_samples=0;
@@ -93,46 +111,34 @@ void main() {
         sample_point = sample_point * kernel_radius + origin;
 
         // project sample position:
-        vec4 offset = vec4(sample_point, 1.0);
-        offset = proj * offset;
+        vec4 offset = P * vec4(sample_point, 1.0);
         offset.xy /= offset.w;
         offset.xy = offset.xy * 0.5 + 0.5;
 
-        //if offset is too far from the center discard it or the sampling of the texture at such a ig distance will destroy cache coherency 
-        vec4 origin_proj=proj*vec4(origin,1.0);
-        origin_proj.xy/=origin_proj.w;
-        origin_proj.xy = origin_proj.xy * 0.5 + 0.5;
-        float max_pixel_distance=0.08; //it's not actually pixels because the image space is already normalized in [0,1]
+        float max_pixel_distance=0.05; //it's not actually pixels because the image space is already normalized in [0,1]
         if(length(offset.xy-origin_proj.xy)> max_pixel_distance ){
             continue;
-        } 
-        
-        // get sample depth:
-        float sampleDepth = texture(position_cam_coords_tex, offset.xy).z;
-        // float sampleDepth = texelFetch(position_cam_coords_tex, ivec2(offset.xy*img_size ), pyr_lvl  ).z; //A lot faster than the texture version which may also do interpolation 
-        
-        bool is_sample_within_radius=abs(origin.z - sampleDepth) < kernel_radius; 
+        }
+
+        ivec2 sample_px=ivec2(offset.xy*vec2(img_size));
+        float sample_depth_linear=fetch_depth_linear(sample_px, img_size, cache_origin);
+        if(sample_depth_linear==0.0){
+            continue; //background
+        }
+        float sample_z = (view_ray(offset.xy)*sample_depth_linear).z;
+
+        bool is_sample_within_radius=abs(origin.z - sample_z) < kernel_radius;
         if(is_sample_within_radius){ //only consider occlusion for the samples that are actually withing radius, some will project to very far away objects or even the background and should not be considered
-            nr_times_visible += (sampleDepth <= sample_point.z  ? 1.0 : 0.0); //https://learnopengl.com/Advanced-Lighting/SSAO
+            nr_times_visible += (sample_z <= sample_point.z  ? 1.0 : 0.0); //https://learnopengl.com/Advanced-Lighting/SSAO
             nr_valid_samples++;
         }
-        // nr_times_visible += (sampleDepth <= sample_point.z  ? 1.0 : 0.0) * int(is_sample_within_radius) ; 
-        // nr_valid_samples += 1 * int(is_sample_within_radius);
-
     }
 
-    nr_times_visible =  (nr_times_visible / nr_valid_samples);
-    nr_times_visible = clamp(nr_times_visible, 0.0, 1.0); //TODO why are some valued negative? it seems that if i dont clamp I end up with black spots in my ao map whiich when blurred become even bigger so that would indicate that they are negative
-    // occlusion = pow(occlusion,1); //dont do the pow here because it will push values further apart and make blurring more difficult 
-
+    nr_times_visible = nr_valid_samples>0 ? (nr_times_visible / nr_valid_samples) : 1.0;
 
     float confidence=float(nr_valid_samples)/nr_samples; //samples which are near the border of the mesh will have no valid samples because all of them will fall on the background. These low confidence points will be put to fully visible
-    confidence=confidence*pos.w; //because some positions are a blend with the background
-    nr_times_visible=mix(1.0, nr_times_visible, confidence); //low confidencewill go to fully visible, high confidence will retain whaterver occlusion it had before
-
+    nr_times_visible=mix(1.0, nr_times_visible, confidence);
 
     imageStore(ao_img, img_coords, vec4(nr_times_visible, 0.0, 0.0, 1.0) );
 
- 
-
-}
\ No newline at end of file
+}
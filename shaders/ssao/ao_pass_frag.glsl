@@ -25,6 +25,7 @@ uniform vec3 random_samples[MAX_NR_SAMPLES];
 uniform float kernel_radius;
 uniform int pyr_lvl;
 uniform bool using_fat_gbuffer;
+uniform vec2 noise_offset; //changes every frame when the ao is accumulated over time so each frame uses different rotations of the samples
 
 
 float linear_depth(float depth_sample){
@@ -120,7 +121,7 @@ void main() {
 
     ivec2 img_size=textureSize( normal_tex, 0); //we get the image size of the highest mipmap. This way we will tile mode the noise, having more randomness and improving the result
     vec2 noise_scale=vec2(img_size)/vec2( textureSize( rvec_tex, 0) );
-    vec3 rvec = texture(rvec_tex, uv_in * noise_scale).xyz; //scaling the uv coords will make the random vecs tile over the screen in tiles of 4x4 (if the texture is 4x4 of course)
+    vec3 rvec = texture(rvec_tex, uv_in * noise_scale + noise_offset).xyz; //scaling the uv coords will make the random vecs tile over the screen in tiles of 4x4 (if the texture is 4x4 of course)
     vec3 tangent = normalize(rvec - normal * dot(rvec, normal));
     vec3 bitangent = cross(normal, tangent);
     mat3 rot = mat3(tangent, bitangent, normal);
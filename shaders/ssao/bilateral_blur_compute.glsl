@@ -1,72 +1,80 @@
 #version 430
 #extension GL_ARB_explicit_attrib_location : require
 
-layout (local_size_x = 16, local_size_y = 16) in;
-
-
-// uniform float z_near;
-// uniform float z_far;
-uniform sampler2D depth_linear_tex;
-uniform sampler2D ao_raw_tex;
-layout(r32f) uniform writeonly image2D ao_blurred_img;
+//one direction of a separable bilateral blur. It runs once horizontally and once vertically. Each workgroup handles a row (or column) segment and loads it together with the pixels of the kernel radius on both sides into shared memory, so every ao and depth value is read from the texture only once per workgroup
+#define GROUP_SIZE 128
+#define MAX_HALF_SIZE 16
+layout (local_size_x = GROUP_SIZE, local_size_y = 1) in;
+
+//uniforms
+uniform sampler2D ao_tex;
+uniform sampler2D depth_linear_tex; //0 on the background
+uniform ivec2 direction; //(1,0) for the horizontal pass and (0,1) for the vertical one
 uniform float sigma_spacial;
 uniform float sigma_depth;
 uniform int ao_power;
-uniform int pyr_lvl;
-
-
-void main() {
+uniform bool apply_power; //only the last pass applies the power
+layout(r8, binding = 0) uniform writeonly image2D ao_blurred_img;
 
-    ivec2 img_coords = ivec2(gl_GlobalInvocationID.xy);
-
-    //for sampling we need it in range [0,1]
-    ivec2 img_size=textureSize( ao_raw_tex, 0);
-    // ivec2 img_size=textureSize( depth_linear_tex, 0);
-    vec2 uv_coord=vec2(float(img_coords.x+0.5)/img_size.x, float(img_coords.y+0.5)/img_size.y);
-
-    //sample the depth and convert
-    // float depth_linear=texture(depth_linear_tex, uv_coord).x;
-    float depth_linear=textureLod(depth_linear_tex, uv_coord, pyr_lvl).x;
-    // float depth_linear=textureLod(depth_linear_tex, uv_coord, 0).x;
-    float ao_raw=texture(ao_raw_tex, uv_coord).x;
-
-
-    // https://github.com/tranvansang/bilateral-filter/blob/master/fshader.fragA
-    float divisor_s = -1./(2.*sigma_spacial*sigma_spacial); //divisor in the exp function of the spacial component
-    float divisor_l = -1./(2.*sigma_depth*sigma_depth);
+shared float ao_cache[GROUP_SIZE+2*MAX_HALF_SIZE];
+shared float depth_cache[GROUP_SIZE+2*MAX_HALF_SIZE];
 
 
-    float c_total=ao_raw;
-    float w_total=1.0;
-    float half_size = sigma_spacial * 2;
+ivec2 pixel_for(int along, int across){
+    return direction.x==1 ? ivec2(along, across) : ivec2(across, along);
+}
 
-    for(float x=-half_size; x<=half_size; x++){
-        for(float y=-half_size; y<=half_size; y++){
-            vec2 offset=vec2(x,y)/vec2(img_size);
-            float offset_depth = texture(depth_linear_tex, uv_coord + offset).x;
-            float offset_ao = texture(ao_raw_tex, uv_coord + offset).x;
+void main() {
 
-            float dist_spacial = length(vec2(x,y));
-            float dist_depth =offset_depth - depth_linear;
+    ivec2 img_size = imageSize(ao_blurred_img);
+    int length_along = direction.x==1 ? img_size.x : img_size.y;
+    int length_across = direction.x==1 ? img_size.y : img_size.x;
+    int across=int(gl_WorkGroupID.y);
+    int segment_start=int(gl_WorkGroupID.x)*GROUP_SIZE;
+    int half_size=min(int(sigma_spacial*2.0), MAX_HALF_SIZE);
+
+    //load the segment and its apron
+    for(int i = int(gl_LocalInvocationID.x); i < GROUP_SIZE+2*MAX_HALF_SIZE; i+=GROUP_SIZE){
+        int along=clamp(segment_start+i-MAX_HALF_SIZE, 0, length_along-1);
+        ivec2 px=pixel_for(along, min(across, length_across-1));
+        ao_cache[i]=texelFetch(ao_tex, px, 0).x;
+        depth_cache[i]=texelFetch(depth_linear_tex, px, 0).x;
+    }
+    barrier();
 
-            float w_spacial = exp(divisor_s*float(dist_spacial*dist_spacial));
-            float w_d = exp(divisor_l*float(dist_depth*dist_depth));
-            float w = w_spacial*w_d;
+    int along=segment_start+int(gl_LocalInvocationID.x);
+    if(along>=length_along || across>=length_across){
+        return;
+    }
+    ivec2 img_coords=pixel_for(along, across);
 
-            w_total+=w;
-            c_total+=offset_ao*w;
+    int center=int(gl_LocalInvocationID.x)+MAX_HALF_SIZE;
+    float center_d=depth_cache[center];
+    if(center_d==0.0){
+        imageStore(ao_blurred_img, img_coords, vec4(1.0));
+        return;
+    }
 
+    float divisor_s = -1./(2.*sigma_spacial*sigma_spacial); //divisor in the exp function of the spacial component
+    float divisor_d = -1./(2.*sigma_depth*sigma_depth);
+
+    float c_total=0.0;
+    float w_total=0.0;
+    for(int r = -half_size; r <= half_size; r++){
+        float d=depth_cache[center+r];
+        if(d==0.0){
+            continue; //background doesn't contribute
         }
+        float dist_depth=d-center_d;
+        float w = exp(divisor_s*float(r*r)) * exp(divisor_d*dist_depth*dist_depth);
+        c_total+=ao_cache[center+r]*w;
+        w_total+=w;
     }
 
-    float final_ao=c_total/w_total;
-    final_ao = smoothstep(0.0, 0.995, final_ao); //everything above 0.9 gets put to 1. We do this to avoid dampening the bright parts when we use pow
-    final_ao=pow(final_ao, ao_power);
-    // float final_ao=1.0;
-
-
-
-    imageStore(ao_blurred_img, img_coords, vec4(final_ao, 0.0, 0.0, 1.0) );
-
+    float ao=c_total/w_total; //the center always contributes with a weight of 1
+    if(apply_power){
+        ao=pow(ao, ao_power);
+    }
+    imageStore(ao_blurred_img, img_coords, vec4(ao, 0.0, 0.0, 1.0) );
 
-}
\ No newline at end of file
+}
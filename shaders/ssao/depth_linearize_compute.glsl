@@ -1,48 +1,41 @@
 #version 430
 #extension GL_ARB_explicit_attrib_location : require
 
+//compute version of depth_linearize_frag.glsl. One thread per pixel of the downsampled depth
 layout (local_size_x = 16, local_size_y = 16) in;
 
-
-uniform float z_near;
-uniform float z_far;
+//uniforms
 uniform sampler2D depth_tex;
-layout(r16f) uniform writeonly image2D depth_linear_img;
-
+uniform float projection_a; //for calculating position from depth according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+uniform float projection_b;
+uniform int pyr_lvl;
+layout(r32f, binding = 0) uniform writeonly image2D depth_linear_img;
 
 
-//https://stackoverflow.com/a/33465663
-// depthSample from depthTexture.r, for instance
-float linear_depth(float depth_sample)
-{
-    depth_sample = 2.0 * depth_sample - 1.0;
-    float z_linear = 2.0 * z_near * z_far / (z_far + z_near - depth_sample * (z_far - z_near));
-    return z_linear;
-}
-
-// result suitable for assigning to gl_FragDepth
-float depth_sample(float linear_depth)
-{
-    float non_linear_depth = (z_far + z_near - 2.0 * z_near * z_far / linear_depth) / (z_far - z_near);
-    non_linear_depth = (non_linear_depth + 1.0) / 2.0;
-    return non_linear_depth;
+float linear_depth(float depth_sample){
+    // according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+    float linearDepth = projection_b / (depth_sample - projection_a);
+    return linearDepth;
 }
 
 
 void main() {
 
     ivec2 img_coords = ivec2(gl_GlobalInvocationID.xy);
-
-    //for sampling we need it in range [0,1]
-    ivec2 img_size=textureSize( depth_tex, 0);
-    vec2 uv_coord=vec2(float(img_coords.x)/img_size.x, float(img_coords.y)/img_size.y);
+    ivec2 img_size = imageSize(depth_linear_img);
+    if(img_coords.x>=img_size.x || img_coords.y>=img_size.y){
+        return;
+    }
 
     //sample the depth and convert
-    float depth_raw=texture(depth_tex, uv_coord).x;
-    float depth_linear= linear_depth(depth_raw);
+    float depth_raw=texelFetch(depth_tex, img_coords, pyr_lvl).x;
+    float depth_linear;
+    if(depth_raw==1.0){
+        depth_linear=0.0; //background. The linear depth is always at least z_near so 0 cannot be confused with a real surface
+    }else{
+        depth_linear= linear_depth(depth_raw);
+    }
 
-    //TODO we shouldt need to divide by this big number, we only do it in order to visualize the depth map. Also it shouldnt affect the result of the bilaterl blur
     imageStore(depth_linear_img, img_coords, vec4(depth_linear, 0.0, 0.0, 1.0) );
 
-
-}
\ No newline at end of file
+}
@@ -0,0 +1,67 @@
+#version 430 core
+#extension GL_ARB_explicit_attrib_location : require
+
+//accumulates the ao of the current frame, which uses only a few samples, with the ao of the previous frames. Each pixel is reprojected into the previous frame and its history is kept only if the depth there matches the one we expect, otherwise the pixel was just disoccluded and starts again from the current ao
+
+//in
+layout(location=1) in vec2 uv_in;
+layout(location=2) in vec3 view_ray_in;
+
+//out
+layout(location = 0) out vec4 ao_history_out; //r is the accumulated ao and g the nr of frames it contains
+
+//uniforms
+uniform sampler2D ao_tex;
+uniform sampler2D depth_linear_tex;
+uniform sampler2D history_tex;
+uniform sampler2D depth_linear_prev_tex;
+uniform mat4 V_inv; //from the current cam coordinates to world
+uniform mat4 prev_V;
+uniform mat4 prev_VP;
+uniform float background_depth_linear; //the value that the linearize pass writes where there is no mesh
+uniform int max_nr_frames; //the current ao gets a weight of at least 1/max_nr_frames
+uniform bool reset_history;
+
+const float max_relative_depth_difference=0.05;
+
+
+void main() {
+
+    float ao=texture(ao_tex, uv_in).x;
+    float depth_linear=texture(depth_linear_tex, uv_in).x;
+    if(depth_linear==background_depth_linear){
+        ao_history_out=vec4(1.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    if(reset_history){
+        ao_history_out=vec4(ao, 1.0, 0.0, 1.0);
+        return;
+    }
+
+    //the linear depth is along the z axis of the camera so we scale the ray until its z has that length
+    vec3 position_cam_coords=view_ray_in/(-view_ray_in.z)*depth_linear;
+    vec4 position_world=V_inv*vec4(position_cam_coords, 1.0);
+
+    vec4 prev_clip=prev_VP*position_world;
+    vec2 prev_uv=prev_clip.xy/prev_clip.w*0.5+0.5;
+    if(prev_clip.w<=0.0 || any(lessThan(prev_uv, vec2(0.0))) || any(greaterThanEqual(prev_uv, vec2(1.0)))){
+        ao_history_out=vec4(ao, 1.0, 0.0, 1.0); //it was outside of the previous view
+        return;
+    }
+
+    //nearest fetch so that we don't blend the depth of an edge with the one of the background behind it
+    ivec2 prev_px=ivec2(prev_uv*vec2(textureSize(depth_linear_prev_tex, 0)));
+    float prev_depth_linear=texelFetch(depth_linear_prev_tex, prev_px, 0).x;
+    float expected_depth_linear=-(prev_V*position_world).z;
+    if(prev_depth_linear==background_depth_linear || abs(prev_depth_linear-expected_depth_linear) > max_relative_depth_difference*expected_depth_linear ){
+        ao_history_out=vec4(ao, 1.0, 0.0, 1.0); //disoccluded
+        return;
+    }
+
+    vec2 history=texelFetch(history_tex, prev_px, 0).xy;
+    float nr_frames=min(history.y+1.0, float(max_nr_frames));
+    float ao_accumulated=mix(history.x, ao, 1.0/nr_frames);
+
+    ao_history_out=vec4(ao_accumulated, nr_frames, 0.0, 1.0);
+
+}
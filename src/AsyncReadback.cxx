@@ -0,0 +1,180 @@
+#include "easy_pbr/AsyncReadback.h"
+
+//c++
+#include <cstring>
+
+//my stuff
+#include "UtilsGL.h"
+#include "opencv_utils.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+//how many values per pixel glGetTexImage writes for this format, -1 if we don't support it
+static int nr_channels_of_format(const GLenum format){
+    switch(format){
+        case GL_RED: case GL_GREEN: case GL_BLUE: case GL_ALPHA: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: return 1;
+        case GL_RG: case GL_RG_INTEGER: return 2;
+        case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER: return 3;
+        case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER: case GL_BGRA_INTEGER: return 4;
+        default: return -1;
+    }
+}
+
+//the opencv depth whose values have the same layout as this type, -1 if there is none
+static int cv_depth_of_type(const GLenum type){
+    switch(type){
+        case GL_UNSIGNED_BYTE: return CV_8U;
+        case GL_BYTE: return CV_8S;
+        case GL_UNSIGNED_SHORT: return CV_16U;
+        case GL_SHORT: return CV_16S;
+        case GL_HALF_FLOAT: return CV_16U; //opencv has no half float type in all the versions we support so the raw bits go in a 16 bit unsigned mat
+        case GL_UNSIGNED_INT: case GL_INT: return CV_32S;
+        case GL_FLOAT: return CV_32F;
+        default: return -1;
+    }
+}
+
+AsyncReadback::AsyncReadback(const int nr_buffers):
+    m_next_idx(0),
+    m_nr_pending(0),
+    m_nr_stalls(0)
+{
+    CHECK(nr_buffers>0) << "We need at least one buffer but got " << nr_buffers;
+    m_reads.resize(nr_buffers);
+    for(size_t i = 0; i < m_reads.size(); i++){
+        glGenBuffers(1, &m_reads[i].pbo_id);
+        m_reads[i].capacity=0;
+        m_reads[i].fence=nullptr;
+        m_reads[i].flip_y=true;
+    }
+}
+
+AsyncReadback::~AsyncReadback(){
+    finish();
+    for(size_t i = 0; i < m_reads.size(); i++){
+        glDeleteBuffers(1, &m_reads[i].pbo_id);
+    }
+}
+
+void AsyncReadback::read(gl::Texture2D& tex, const GLenum format, const GLenum type, cv::Mat& dst, const bool flip_y, std::function<void(const cv::Mat&)> on_done){
+    CHECK(dst.data) << "The destination has to be allocated before reading into it";
+    CHECK(dst.cols==tex.width() && dst.rows==tex.height()) << "The destination is " << dst.cols << "x" << dst.rows << " but the texture is " << tex.width() << "x" << tex.height();
+    CHECK(dst.isContinuous()) << "The destination has to be continuous";
+    int nr_channels=nr_channels_of_format(format);
+    int depth=cv_depth_of_type(type);
+    CHECK(nr_channels!=-1) << "Unsupported readback format " << format;
+    CHECK(depth!=-1) << "Unsupported readback type " << type;
+    CHECK(dst.channels()==nr_channels && dst.depth()==depth) << "The destination has type " << radu::utils::type2string(dst.type()) << " but reading with this format and type needs " << radu::utils::type2string(CV_MAKETYPE(depth, nr_channels));
+    CHECK(dst.total()*dst.elemSize()==(size_t)tex.width()*tex.height()*nr_channels*CV_ELEM_SIZE1(depth)) << "The destination has " << dst.total()*dst.elemSize() << " bytes which doesn't match the size of the readback";
+
+    //the ring wrapped around and the gpu is still busy with this buffer
+    PendingRead& read=m_reads[m_next_idx];
+    if(read.fence){
+        if(!complete(read, false)){
+            m_nr_stalls++;
+            complete(read, true);
+        }
+    }
+
+    size_t bytes=dst.total()*dst.elemSize();
+    GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo_id) );
+    if(read.capacity<bytes){
+        GL_C( glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ) );
+        read.capacity=bytes;
+    }
+
+    //rows are tightly packed in the cv mat
+    GLint prev_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &prev_alignment);
+    GL_C( glPixelStorei(GL_PACK_ALIGNMENT, 1) );
+    GL_C( glBindTexture(GL_TEXTURE_2D, tex.tex_id()) );
+    GL_C( glGetTexImage(GL_TEXTURE_2D, 0, format, type, 0) ); //with a pack buffer bound the last argument is an offset into it and the call returns right away
+    GL_C( glBindTexture(GL_TEXTURE_2D, 0) );
+    GL_C( glPixelStorei(GL_PACK_ALIGNMENT, prev_alignment) );
+    GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, 0) );
+
+    read.fence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    read.dst=dst;
+    read.flip_y=flip_y;
+    read.on_done=std::move(on_done);
+    m_nr_pending++;
+    m_next_idx=(m_next_idx+1)%m_reads.size();
+}
+
+int AsyncReadback::process_ready(){
+    //go from the oldest so the destinations get filled in the same order as they were read
+    int nr_completed=0;
+    for(size_t i = 0; i < m_reads.size(); i++){
+        int idx=(m_next_idx+i)%m_reads.size();
+        if(m_reads[idx].fence){
+            if(!complete(m_reads[idx], false)){
+                break;
+            }
+            nr_completed++;
+        }
+    }
+    return nr_completed;
+}
+
+void AsyncReadback::finish(){
+    for(size_t i = 0; i < m_reads.size(); i++){
+        int idx=(m_next_idx+i)%m_reads.size();
+        if(m_reads[idx].fence){
+            complete(m_reads[idx], true);
+        }
+    }
+}
+
+int AsyncReadback::nr_pending() const{
+    return m_nr_pending;
+}
+
+int AsyncReadback::nr_buffers() const{
+    return m_reads.size();
+}
+
+int AsyncReadback::nr_stalls() const{
+    return m_nr_stalls;
+}
+
+bool AsyncReadback::complete(PendingRead& read, const bool wait){
+    GLuint64 timeout= wait ? GL_TIMEOUT_IGNORED : 0;
+    GLenum status=glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if(status==GL_TIMEOUT_EXPIRED){
+        return false;
+    }
+    CHECK(status!=GL_WAIT_FAILED) << "Waiting for the readback failed";
+    glDeleteSync(read.fence);
+    read.fence=nullptr;
+
+    size_t row_bytes=read.dst.cols*read.dst.elemSize();
+    size_t bytes=row_bytes*read.dst.rows;
+    GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo_id) );
+    const unsigned char* src=(const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    CHECK(src) << "Could not map the pixel buffer";
+    if(read.flip_y){
+        for(int r = 0; r < read.dst.rows; r++){
+            std::memcpy(read.dst.ptr(read.dst.rows-1-r), src+r*row_bytes, row_bytes);
+        }
+    }else{
+        std::memcpy(read.dst.data, src, bytes);
+    }
+    GL_C( glUnmapBuffer(GL_PIXEL_PACK_BUFFER) );
+    GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, 0) );
+
+    m_nr_pending--;
+    if(read.on_done){
+        std::function<void(const cv::Mat&)> on_done=std::move(read.on_done);
+        read.on_done=nullptr;
+        on_done(read.dst);
+    }
+    read.dst.release(); //drops our reference to the destination
+    return true;
+}
+
+} //namespace easy_pbr
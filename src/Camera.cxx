@@ -30,7 +30,8 @@ Camera::Camera():
     m_is_initialized(false),
     m_position_initialized(false),
     m_lookat_initialized(false),
-    m_rand_gen(new RandGenerator())
+    m_rand_gen(new RandGenerator()),
+    m_has_intrinsics(false)
 {
 
     m_model_matrix.setIdentity();
@@ -51,6 +52,12 @@ Eigen::Affine3f Camera::view_matrix_affine(){
     return Eigen::Affine3f(model_matrix().inverse());
 }
 Eigen::Matrix4f Camera::proj_matrix(const Eigen::Vector2f viewport_size){
+    if(m_has_intrinsics){
+        Eigen::Matrix3f K=m_K;
+        K.row(0)*=viewport_size.x()/m_K_size.x();
+        K.row(1)*=viewport_size.y()/m_K_size.y();
+        return intrinsics_to_opengl_proj(K, viewport_size.x(), viewport_size.y(), m_near, m_far);
+    }
     float aspect=viewport_size.x()/viewport_size.y();
     return compute_projection_matrix(m_fov, aspect, m_near, m_far);
 }
@@ -64,6 +71,9 @@ Eigen::Matrix3f Camera::intrinsics(const float viewport_width, const float viewp
     Eigen::Matrix3f K = opengl_proj_to_intrinsics(P, viewport_width, viewport_height);
     return K;
 }
+Frustum Camera::frustum(const Eigen::Vector2f viewport_size){
+    return Frustum( proj_matrix(viewport_size)*view_matrix() );
+}
 Eigen::Vector3f Camera::position(){
     return m_model_matrix.translation();
 }
@@ -141,6 +151,15 @@ void Camera::set_dist_to_lookat(const float dist){
     m_lookat = position() + cam_axes().col(2) * dist;
     m_lookat_initialized=true;
 }
+void Camera::set_intrinsics(const Eigen::Matrix3f& K, const int width, const int height){
+    CHECK(width>0 && height>0) << "The size of the image the intrinsics refer to has to be positive but it is " << width << "x" << height;
+    m_K=K;
+    m_K_size << width, height;
+    m_has_intrinsics=true;
+}
+void Camera::clear_intrinsics(){
+    m_has_intrinsics=false;
+}
 
 
 //convenicence
@@ -0,0 +1,22 @@
+#include "easy_pbr/GpuTimer.h"
+
+//my stuff
+#include "easy_pbr/Tracer.h"
+
+
+namespace easy_pbr{
+
+GpuTimer::GpuTimer(const std::string& name):
+    m_name(name)
+{
+}
+
+const std::string& GpuTimer::name() const{
+    return m_name;
+}
+
+float GpuTimer::elapsed_ms() const{
+    return Tracer::gpu_time_ms(m_name);
+}
+
+} //namespace easy_pbr
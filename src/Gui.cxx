@@ -31,6 +31,8 @@ namespace fs = boost::filesystem;
 #include "easy_pbr/Camera.h"
 #include "easy_pbr/SpotLight.h"
 #include "easy_pbr/Recorder.h"
+#include "easy_pbr/Picker.h"
+#include "easy_pbr/Tracer.h"
 #include "easy_pbr/LabelMngr.h"
 #include "string_utils.h"
 #include "eigen_utils.h"
@@ -95,7 +97,9 @@ Gui::Gui( const std::string config_file,
     init_params(config_file);
 
     m_imgui_context = ImGui::CreateContext();
-    ImGui_ImplGlfw_InitForOpenGL(window, false);
+    if(window){ //headless there is no window and the gui is never drawn
+        ImGui_ImplGlfw_InitForOpenGL(window, false);
+    }
     const char* glsl_version = "#version 440";
     ImGui_ImplOpenGL3_Init(glsl_version);
 
@@ -528,8 +532,21 @@ void Gui::draw_main_menu(){
         ImGui::Checkbox("Enable LightFollow", &m_view->m_lights_follow_camera);
         ImGui::Checkbox("Enable culling", &m_view->m_enable_culling);
         ImGui::SameLine(); help_marker("Hides the mesh faces that are pointing away from the viewer. Offers a mild increase in performance.");
+        ImGui::Checkbox("Enable frustum culling", &m_view->m_enable_frustum_culling);
+        ImGui::SameLine(); help_marker("Skips the meshes that are fully outside of the view of the camera or of the lights. The nr of culled meshes is shown in the profiler window.");
+        ImGui::Checkbox("Enable mesh batching", &m_view->m_enable_mesh_batching);
+        ImGui::SameLine(); help_marker("Draws all the small meshes that have no textures with a single draw call. Helps when the scene has thousands of meshes and the cpu is the bottleneck.");
+        ImGui::Checkbox("Enable layered shadow maps", &m_view->m_enable_layered_shadow_maps);
+        if(m_view->m_enable_id_buffers){
+            ImGui::Checkbox("Id buffers use gt labels", &m_view->m_id_buffers_label_from_gt);
+            ImGui::SameLine(); help_marker("The label buffer of the gbuffer gets the ground truth labels of the meshes. Otherwise it gets the predicted ones. The id buffers can only be enabled from the config.");
+        }
         ImGui::Checkbox("Enable SSAO", &m_view->m_enable_ssao);
         ImGui::SameLine(); help_marker("Screen Space Ambient Occlusion. Darkens crevices and corners in the mesh in order to better show the details. It has a mild impact on performance.");
+        ImGui::Checkbox("SSAO with compute shaders", &m_view->m_ssao_use_compute);
+        ImGui::SameLine(); help_marker("Computes the ambient occlusion and its blur with compute shaders that keep a tile of the depth in shared memory instead of drawing fullscreen quads. The result is the same, it's usually faster at high resolutions.");
+        ImGui::Checkbox("SSAO temporal accumulation", &m_view->m_ssao_temporal);
+        ImGui::SameLine(); help_marker("Computes only a few ambient occlusion samples each frame and blends them with the previous frames. When nothing moves it stops computing the ambient occlusion once it converged.");
         ImGui::Checkbox("Enable EDL", &m_view->m_enable_edl_lighting);
         ImGui::SameLine(); help_marker("Eye Dome Lighting. Useful for rendering point clouds which are devoid of normal vectors. Darkens the pixels according to aparent change in depth of the neighbouring pixels.");
         if(m_view->m_enable_edl_lighting){
@@ -638,8 +655,14 @@ void Gui::draw_main_menu(){
         ImGui::SliderInt("BloomStartMipMap", &m_view->m_bloom_start_mip_map_lvl, 0, 6);
         ImGui::SliderInt("BloomMaxMipMap", &m_view->m_bloom_max_mip_map_lvl, 0, 6);
         ImGui::SameLine(); help_marker("Bloom is applied hierarchically over multiple mip map levels. We use as many mip maps as specified by this value.");
-        ImGui::SliderInt("BloomBlurIters", &m_view->m_bloom_blur_iters, 0, 10);
-        ImGui::SameLine(); help_marker("Bloom is applied multiple times for each mip map level. The higher the value the more spreaded the bloom is. Has a high impact on performance.");
+        ImGui::Checkbox("BloomDualFilter", &m_view->m_bloom_dual_filter);
+        ImGui::SameLine(); help_marker("Blurs by downsampling each mip map from the previous one and then upsampling them back. Much cheaper than the gaussian blur, specially at high resolution. The gpu time of each pass is shown in the profiler window.");
+        if(m_view->m_bloom_dual_filter){
+            ImGui::SliderFloat("BloomDualFilterOffset", &m_view->m_bloom_dual_filter_offset, 0.5, 4.0);
+        }else{
+            ImGui::SliderInt("BloomBlurIters", &m_view->m_bloom_blur_iters, 0, 10);
+            ImGui::SameLine(); help_marker("Bloom is applied multiple times for each mip map level. The higher the value the more spreaded the bloom is. Has a high impact on performance.");
+        }
     }
 
     ImGui::Separator();
@@ -1032,6 +1055,33 @@ void Gui::draw_main_menu(){
         }
         ImGui::Checkbox("Record GUI", &m_view->m_record_gui);
         ImGui::Checkbox("Record with transparency", &m_view->m_record_with_transparency);
+        //changing the format in the middle of a recording would split it between a video and images
+        if (!m_view->m_recorder->is_recording() && ImGui::BeginCombo("Record format", m_view->m_recorder->m_format._to_string())) {
+            for (size_t n = 0; n < RecorderFormat::_size(); n++) {
+                bool is_selected = ( m_view->m_recorder->m_format == RecorderFormat::_values()[n] );
+                if (ImGui::Selectable( RecorderFormat::_names()[n], is_selected)){
+                    m_view->m_recorder->m_format= RecorderFormat::_values()[n];
+                }
+                if (is_selected)
+                    ImGui::SetItemDefaultFocus();
+            }
+            ImGui::EndCombo();
+        }
+        if (m_view->m_recorder->m_format==+RecorderFormat::Png){
+            ImGui::SliderInt("PNG compression", &m_view->m_recorder->m_png_compression, 0, 9);
+        }
+        ImGui::Checkbox("Export gbuffer", &m_view->m_recorder->m_export_enabled);
+        if (m_view->m_recorder->m_export_enabled){
+            ImGui::Checkbox("Color##export", &m_view->m_recorder->m_export_color); ImGui::SameLine();
+            ImGui::Checkbox("Depth##export", &m_view->m_recorder->m_export_depth); ImGui::SameLine();
+            ImGui::Checkbox("Mesh id##export", &m_view->m_recorder->m_export_mesh_id);
+            ImGui::Checkbox("Normals world##export", &m_view->m_recorder->m_export_normals_world); ImGui::SameLine();
+            ImGui::Checkbox("Normals camera##export", &m_view->m_recorder->m_export_normals_camera);
+            if (m_view->m_enable_id_buffers){
+                ImGui::Checkbox("Labels##export", &m_view->m_recorder->m_export_labels); ImGui::SameLine();
+                ImGui::Checkbox("Instance id##export", &m_view->m_recorder->m_export_instance_id);
+            }
+        }
         // ImGui::SliderFloat("Magnification", &m_view->m_recorder->m_magnification, 1.0f, 5.0f);
 
         //recording
@@ -1049,9 +1099,30 @@ void Gui::draw_main_menu(){
         {
             m_view->m_recorder->pause_recording();
         }
+        RecorderStats recorder_stats=m_view->m_recorder->stats();
+        ImGui::Text("Queue %d (max %d/%d)  written %d  dropped %d", recorder_stats.queue_depth, recorder_stats.max_queue_depth, m_view->m_recorder->m_queue_capacity, recorder_stats.nr_written, recorder_stats.nr_dropped);
+        ImGui::Text("Encode avg %.2f ms  max %.2f ms", recorder_stats.avg_encode_ms, recorder_stats.max_encode_ms);
     }
 
 
+    ImGui::Separator();
+    if (ImGui::CollapsingHeader("Picking")) {
+        if (!m_view->m_enable_id_buffers){
+            ImGui::Text("Needs visualization.enable_id_buffers in the config");
+        }else{
+            ImGui::Text("Alt+click to pick");
+            const PickResult& pick=m_view->m_picker->m_last_result;
+            if (pick.hit){
+                ImGui::Text("Mesh: %s (instance %d)", pick.mesh_name.c_str(), pick.instance_id);
+                ImGui::Text("Face: %d  Vertex: %d  Label: %d", pick.face_idx, pick.vertex_idx, pick.label);
+                ImGui::Text("Position: %.4f %.4f %.4f", pick.position_world.x(), pick.position_world.y(), pick.position_world.z());
+                ImGui::Text("Depth: %.4f", pick.depth);
+            }else{
+                ImGui::Text("Nothing picked");
+            }
+        }
+    }
+
     ImGui::Separator();
     if (ImGui::CollapsingHeader("Profiler")) {
         ImGui::Checkbox("Profile gpu", &Profiler_ns::m_profile_gpu);
@@ -1059,6 +1130,23 @@ void Gui::draw_main_menu(){
         if (ImGui::Button("Print profiling stats")){
             Profiler_ns::Profiler::print_all_stats();
         }
+        bool tracing=Tracer::is_enabled();
+        if (ImGui::Checkbox("Trace frames", &tracing)){
+            Tracer::set_enabled(tracing);
+        }
+        ImGui::SameLine(); help_marker("Records every pass of every frame, with the gpu time measured through timestamp queries that don't block. The trace can be opened in chrome://tracing or ui.perfetto.dev");
+        ImGui::Text("Events: %d  dropped: %d", Tracer::nr_events(), Tracer::nr_dropped());
+        if (ImGui::Button("Write chrome trace")){
+            Tracer::write_chrome_trace("./trace.json");
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Print trace stats")){
+            LOG(INFO) << "Trace stats:\n" << Tracer::stats_string();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear trace")){
+            Tracer::clear();
+        }
     }
 
     ImGui::Separator();
@@ -1130,7 +1218,8 @@ void Gui::draw_profiler(){
 
    if (m_show_profiler_window && Profiler_ns::m_timings.size()>0 ){
         int nr_timings=Profiler_ns::m_timings.size();
-        ImVec2 size(330*m_hidpi_scaling,50*m_hidpi_scaling*nr_timings);
+        std::vector< std::pair<std::string, float> > gpu_times=Tracer::gpu_times();
+        ImVec2 size(330*m_hidpi_scaling,50*m_hidpi_scaling*nr_timings + 150*m_hidpi_scaling + 20*m_hidpi_scaling*gpu_times.size()); //the extra space is for the culling stats and the gpu times
         ImGui::SetNextWindowSize(size, ImGuiCond_Always);
         ImGui::SetNextWindowPos(ImVec2(canvas_size.x -size.x , 0));
         ImGui::Begin("Profiler", nullptr,
@@ -1145,6 +1234,27 @@ void Gui::draw_profiler(){
             );
         ImGui::PushItemWidth(100*m_hidpi_scaling);
 
+        //culling stats
+        ImGui::Text("Meshes drawn: %d culled: %d", m_view->m_nr_meshes_drawn, m_view->m_nr_meshes_culled);
+        ImGui::Text("Triangles drawn: %d culled: %d", m_view->m_nr_triangles_drawn, m_view->m_nr_triangles_culled);
+        ImGui::Text("Shadow meshes drawn: %d culled: %d", m_view->m_nr_shadow_meshes_drawn, m_view->m_nr_shadow_meshes_culled);
+        ImGui::Text("Shadow passes static: %d dynamic: %d skipped: %d", m_view->m_nr_static_shadow_passes, m_view->m_nr_dynamic_shadow_passes, m_view->m_nr_shadow_passes_skipped);
+        ImGui::Text("Shadow draw calls: %d", m_view->m_nr_shadow_draw_calls);
+        if(m_view->m_ssao_temporal){
+            ImGui::Text("SSAO accumulated frames: %d", m_view->m_ssao_nr_accumulated_frames);
+        }
+        if(m_view->m_enable_mesh_batching){
+            ImGui::Text("Batched meshes drawn: %d", m_view->m_nr_batched_draws);
+        }
+        ImGui::Separator();
+
+        //gpu times of the passes that the tracer measures with timestamp queries
+        for(auto& gpu_time : gpu_times){
+            ImGui::Text("GPU %s: %.3f ms", gpu_time.first.c_str(), gpu_time.second);
+        }
+        if(!gpu_times.empty()){
+            ImGui::Separator();
+        }
 
         for (size_t i = 0; i < Profiler_ns::m_ordered_timers.size(); ++i){
             const std::string name = Profiler_ns::m_ordered_timers[i];
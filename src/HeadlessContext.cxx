@@ -0,0 +1,202 @@
+#include "easy_pbr/HeadlessContext.h"
+
+//c++
+#include <cstring>
+
+#ifdef EASYPBR_WITH_EGL
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+    #ifndef EGL_PLATFORM_SURFACELESS_MESA
+        #define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+    #endif
+#endif
+#ifdef EASYPBR_WITH_OSMESA
+    //osmesa.h includes GL/gl.h which is skipped because glad was included already, so we define what it would have defined
+    #ifndef GLAPIENTRY
+        #define GLAPIENTRY APIENTRY
+    #endif
+    #include <GL/osmesa.h>
+#endif
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+//highest versions first so we get the compute shaders whenever the driver has them
+static const int gl_versions[][2]={ {4,6}, {4,5}, {4,3}, {3,3} };
+
+#ifdef EASYPBR_WITH_EGL
+static void* egl_proc(const char* name){
+    return (void*)eglGetProcAddress(name);
+}
+#endif
+#ifdef EASYPBR_WITH_OSMESA
+static void* osmesa_proc(const char* name){
+    return (void*)OSMesaGetProcAddress(name);
+}
+#endif
+
+HeadlessContext::HeadlessContext(const std::string& backend, const int width, const int height):
+    m_backend(backend),
+    m_width(width),
+    m_height(height),
+    m_egl_display(nullptr),
+    m_egl_context(nullptr),
+    m_osmesa_context(nullptr)
+{
+    CHECK(width>0 && height>0) << "The size of a headless context has to be positive but it is " << width << "x" << height;
+    CHECK(is_backend_available(backend)) << "Headless backend " << backend << " is not available. Either it's not a known backend (egl or osmesa) or easy_pbr was compiled without it";
+
+    if(backend=="egl"){
+        init_egl();
+    }else if(backend=="osmesa"){
+        init_osmesa();
+    }
+    make_current();
+}
+
+HeadlessContext::~HeadlessContext(){
+    #ifdef EASYPBR_WITH_EGL
+        if(m_egl_display){
+            eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if(m_egl_context){
+                eglDestroyContext(m_egl_display, m_egl_context);
+            }
+            eglTerminate(m_egl_display);
+        }
+    #endif
+    #ifdef EASYPBR_WITH_OSMESA
+        if(m_osmesa_context){
+            OSMesaDestroyContext((OSMesaContext)m_osmesa_context);
+        }
+    #endif
+}
+
+bool HeadlessContext::is_backend_available(const std::string& backend){
+    #ifdef EASYPBR_WITH_EGL
+        if(backend=="egl") return true;
+    #endif
+    #ifdef EASYPBR_WITH_OSMESA
+        if(backend=="osmesa") return true;
+    #endif
+    return false;
+}
+
+void HeadlessContext::init_egl(){
+    #ifdef EASYPBR_WITH_EGL
+        //the surfaceless platform of mesa needs no display server and falls back to llvmpipe when there is no gpu. The nvidia driver doesn't have it but it exposes the gpu as an egl device
+        EGLDisplay display=EGL_NO_DISPLAY;
+        auto get_platform_display=(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(get_platform_display){
+            display=get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            auto query_devices=(PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+            if(display==EGL_NO_DISPLAY && query_devices){
+                EGLDeviceEXT device;
+                EGLint nr_devices=0;
+                if(query_devices(1, &device, &nr_devices) && nr_devices>0){
+                    display=get_platform_display(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+                }
+            }
+        }
+        if(display==EGL_NO_DISPLAY){
+            display=eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        CHECK(display!=EGL_NO_DISPLAY) << "Could not get an EGL display";
+
+        EGLint major, minor;
+        CHECK(eglInitialize(display, &major, &minor)) << "Could not initialize EGL. Error " << eglGetError();
+        m_egl_display=display;
+        const char* extensions=eglQueryString(display, EGL_EXTENSIONS);
+        CHECK(extensions && std::strstr(extensions, "EGL_KHR_surfaceless_context")) << "EGL " << major << "." << minor << " doesn't support surfaceless contexts";
+
+        CHECK(eglBindAPI(EGL_OPENGL_API)) << "EGL could not bind the OpenGL API. Error " << eglGetError();
+        const EGLint config_attribs[]={
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint nr_configs=0;
+        CHECK(eglChooseConfig(display, config_attribs, &config, 1, &nr_configs) && nr_configs>0) << "Could not find an EGL config for OpenGL. Error " << eglGetError();
+
+        EGLContext context=EGL_NO_CONTEXT;
+        for(const auto& version : gl_versions){
+            const EGLint context_attribs[]={
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            context=eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+            if(context!=EGL_NO_CONTEXT){
+                break;
+            }
+        }
+        CHECK(context!=EGL_NO_CONTEXT) << "Could not create an EGL context with at least OpenGL 3.3. Error " << eglGetError();
+        m_egl_context=context;
+    #endif
+}
+
+void HeadlessContext::init_osmesa(){
+    #ifdef EASYPBR_WITH_OSMESA
+        OSMesaContext context=nullptr;
+        for(const auto& version : gl_versions){
+            const int attribs[]={
+                OSMESA_FORMAT, OSMESA_RGBA,
+                OSMESA_DEPTH_BITS, 24,
+                OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+                OSMESA_CONTEXT_MAJOR_VERSION, version[0],
+                OSMESA_CONTEXT_MINOR_VERSION, version[1],
+                0
+            };
+            context=OSMesaCreateContextAttribs(attribs, nullptr);
+            if(context){
+                break;
+            }
+        }
+        CHECK(context) << "Could not create an OSMesa context with at least OpenGL 3.3";
+        m_osmesa_context=context;
+        m_osmesa_buffer.resize(4, 0);
+    #endif
+}
+
+void HeadlessContext::make_current(){
+    #ifdef EASYPBR_WITH_EGL
+        if(m_egl_context){
+            CHECK(eglMakeCurrent(m_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_egl_context)) << "Could not make the EGL context current. Error " << eglGetError();
+        }
+    #endif
+    #ifdef EASYPBR_WITH_OSMESA
+        if(m_osmesa_context){
+            CHECK(OSMesaMakeCurrent((OSMesaContext)m_osmesa_context, m_osmesa_buffer.data(), GL_UNSIGNED_BYTE, 1, 1)) << "Could not make the OSMesa context current";
+        }
+    #endif
+}
+
+GLADloadproc HeadlessContext::proc_loader() const{
+    #ifdef EASYPBR_WITH_EGL
+        if(m_backend=="egl") return (GLADloadproc)egl_proc;
+    #endif
+    #ifdef EASYPBR_WITH_OSMESA
+        if(m_backend=="osmesa") return (GLADloadproc)osmesa_proc;
+    #endif
+    LOG(FATAL) << "No loader for backend " << m_backend;
+    return nullptr;
+}
+
+std::string HeadlessContext::backend() const{
+    return m_backend;
+}
+
+int HeadlessContext::width() const{
+    return m_width;
+}
+
+int HeadlessContext::height() const{
+    return m_height;
+}
+
+} //namespace easy_pbr
@@ -0,0 +1,241 @@
+#include "easy_pbr/IblCache.h"
+
+//c++
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+
+//my stuff
+#include "UtilsGL.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+//boost
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+
+namespace easy_pbr{
+
+IblCache::IblCache(const std::string& dir){
+    if(dir=="auto"){
+        const char* xdg_cache=std::getenv("XDG_CACHE_HOME");
+        const char* home=std::getenv("HOME");
+        if(xdg_cache && xdg_cache[0]!='\0'){
+            m_dir=(fs::path(xdg_cache) / "easy_pbr" / "ibl").string();
+        }else if(home){
+            m_dir=(fs::path(home) / ".cache" / "easy_pbr" / "ibl").string();
+        }else{
+            m_dir=(fs::temp_directory_path() / "easy_pbr" / "ibl").string();
+        }
+    }else{
+        m_dir=dir;
+    }
+}
+
+std::string IblCache::hash_file(const std::string& path){
+    //64 bit FNV-1a over the whole content
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()){
+        LOG(WARNING) << "Could not open " << path << " for hashing, the ibl cache will not be used for it";
+        return "";
+    }
+    unsigned long long hash=14695981039346656037ULL;
+    std::vector<char> buffer(1<<20);
+    while(file){
+        file.read(buffer.data(), buffer.size());
+        std::streamsize nr_read=file.gcount();
+        for(std::streamsize i = 0; i < nr_read; i++){
+            hash^=(unsigned char)buffer[i];
+            hash*=1099511628211ULL;
+        }
+    }
+    if(file.bad()){
+        LOG(WARNING) << "Could not read " << path << " for hashing, the ibl cache will not be used for it";
+        return "";
+    }
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
+bool IblCache::load_cubemap(gl::CubeMap& tex, const std::string& name, const int resolution, const int nr_levels){
+    return load(tex.tex_id(), GL_TEXTURE_CUBE_MAP, resolution, resolution, 6, nr_levels, GL_RGB, 3, name);
+}
+
+bool IblCache::save_cubemap(gl::CubeMap& tex, const std::string& name, const int resolution, const int nr_levels){
+    return save(tex.tex_id(), GL_TEXTURE_CUBE_MAP, resolution, resolution, 6, nr_levels, GL_RGB, 3, name);
+}
+
+bool IblCache::load_texture(gl::Texture2D& tex, const std::string& name){
+    return load(tex.tex_id(), GL_TEXTURE_2D, tex.width(), tex.height(), 1, 1, GL_RG, 2, name);
+}
+
+bool IblCache::save_texture(gl::Texture2D& tex, const std::string& name){
+    return save(tex.tex_id(), GL_TEXTURE_2D, tex.width(), tex.height(), 1, 1, GL_RG, 2, name);
+}
+
+bool IblCache::load_matrix(Eigen::MatrixXf& mat, const std::string& name, const int rows, const int cols){
+    std::ifstream file(path_for(name), std::ios::binary);
+    if(!file.is_open() || !read_header(file, make_header(rows, 1, 1, 1, cols), name)){
+        return false;
+    }
+    Eigen::MatrixXf mat_read(rows, cols);
+    file.read((char*)mat_read.data(), mat_read.size()*sizeof(float));
+    if(!file){
+        LOG(WARNING) << "Ignoring the ibl cache entry " << path_for(name) << " because it is truncated";
+        return false;
+    }
+    mat=mat_read;
+    return true;
+}
+
+bool IblCache::save_matrix(const Eigen::MatrixXf& mat, const std::string& name){
+    std::string tmp_path=tmp_path_for(name);
+    std::ofstream file(tmp_path, std::ios::binary);
+    if(tmp_path.empty() || !file.is_open()){
+        LOG(WARNING) << "Could not write the ibl cache entry " << path_for(name);
+        return false;
+    }
+    Header header=make_header(mat.rows(), 1, 1, 1, mat.cols());
+    file.write((const char*)&header, sizeof(Header));
+    file.write((const char*)mat.data(), mat.size()*sizeof(float));
+    return commit(file, tmp_path, name);
+}
+
+std::string IblCache::dir() const{
+    return m_dir;
+}
+
+bool IblCache::load(const GLuint tex_id, const GLenum target, const int width, const int height, const int nr_faces, const int nr_levels, const GLenum format, const int nr_channels, const std::string& name){
+    std::ifstream file(path_for(name), std::ios::binary);
+    if(!file.is_open() || !read_header(file, make_header(width, height, nr_faces, nr_levels, nr_channels), name)){
+        return false;
+    }
+
+    //read everything before touching the texture so a truncated file leaves it as it was
+    std::vector< std::vector<unsigned short> > levels(nr_levels*nr_faces);
+    for(int lvl = 0; lvl < nr_levels; lvl++){
+        int w=std::max(1, width>>lvl);
+        int h=std::max(1, height>>lvl);
+        for(int face = 0; face < nr_faces; face++){
+            std::vector<unsigned short>& data=levels[lvl*nr_faces+face];
+            data.resize((size_t)w*h*nr_channels);
+            file.read((char*)data.data(), data.size()*sizeof(unsigned short));
+        }
+    }
+    if(!file){
+        LOG(WARNING) << "Ignoring the ibl cache entry " << path_for(name) << " because it is truncated";
+        return false;
+    }
+
+    GL_C( glBindTexture(target, tex_id) );
+    GL_C( glPixelStorei(GL_UNPACK_ALIGNMENT, 1) ); //the rows of RGB half floats are not a multiple of 4 bytes for the smallest levels
+    for(int lvl = 0; lvl < nr_levels; lvl++){
+        int w=std::max(1, width>>lvl);
+        int h=std::max(1, height>>lvl);
+        for(int face = 0; face < nr_faces; face++){
+            GLenum face_target= target==GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X+face : target;
+            GL_C( glTexSubImage2D(face_target, lvl, 0, 0, w, h, format, GL_HALF_FLOAT, levels[lvl*nr_faces+face].data()) );
+        }
+    }
+    GL_C( glPixelStorei(GL_UNPACK_ALIGNMENT, 4) );
+    GL_C( glBindTexture(target, 0) );
+
+    return true;
+}
+
+bool IblCache::save(const GLuint tex_id, const GLenum target, const int width, const int height, const int nr_faces, const int nr_levels, const GLenum format, const int nr_channels, const std::string& name){
+    std::string tmp_path=tmp_path_for(name);
+    std::ofstream file(tmp_path, std::ios::binary);
+    if(tmp_path.empty() || !file.is_open()){
+        LOG(WARNING) << "Could not write the ibl cache entry " << path_for(name);
+        return false;
+    }
+    Header header=make_header(width, height, nr_faces, nr_levels, nr_channels);
+    file.write((const char*)&header, sizeof(Header));
+
+    GL_C( glBindTexture(target, tex_id) );
+    GL_C( glPixelStorei(GL_PACK_ALIGNMENT, 1) );
+    std::vector<unsigned short> data;
+    for(int lvl = 0; lvl < nr_levels; lvl++){
+        int w=std::max(1, width>>lvl);
+        int h=std::max(1, height>>lvl);
+        data.resize((size_t)w*h*nr_channels);
+        for(int face = 0; face < nr_faces; face++){
+            GLenum face_target= target==GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X+face : target;
+            GL_C( glGetTexImage(face_target, lvl, format, GL_HALF_FLOAT, data.data()) );
+            file.write((const char*)data.data(), data.size()*sizeof(unsigned short));
+        }
+    }
+    GL_C( glPixelStorei(GL_PACK_ALIGNMENT, 4) );
+    GL_C( glBindTexture(target, 0) );
+
+    return commit(file, tmp_path, name);
+}
+
+IblCache::Header IblCache::make_header(const int width, const int height, const int nr_faces, const int nr_levels, const int nr_channels) const{
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::strncpy(header.magic, "EPBRIBL", 8);
+    header.version=CACHE_VERSION;
+    header.width=width;
+    header.height=height;
+    header.nr_faces=nr_faces;
+    header.nr_levels=nr_levels;
+    header.nr_channels=nr_channels;
+    return header;
+}
+
+bool IblCache::read_header(std::ifstream& file, const Header& expected, const std::string& name) const{
+    Header header;
+    file.read((char*)&header, sizeof(Header));
+    if(!file || std::memcmp(&header, &expected, sizeof(Header))!=0){
+        LOG(WARNING) << "Ignoring the ibl cache entry " << path_for(name) << " because it doesn't match the texture";
+        return false;
+    }
+    return true;
+}
+
+bool IblCache::commit(std::ofstream& file, const std::string& tmp_path, const std::string& name){
+    boost::system::error_code ec;
+    file.close();
+    if(!file){
+        fs::remove(tmp_path, ec);
+        LOG(WARNING) << "Could not write the ibl cache entry " << path_for(name);
+        return false;
+    }
+    //renaming is atomic so another viewer starting at the same time never reads a half written entry
+    fs::rename(tmp_path, path_for(name), ec);
+    if(ec){
+        fs::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+std::string IblCache::tmp_path_for(const std::string& name){
+    boost::system::error_code ec;
+    fs::create_directories(m_dir, ec);
+    if(ec){
+        LOG(WARNING) << "Could not create the ibl cache directory " << m_dir << ": " << ec.message();
+        return "";
+    }
+    //unique across the viewers writing into the same directory (pid) and across the entries written by this one (counter)
+    static std::atomic<unsigned long long> nr_tmp_files(0);
+    return path_for(name)+".tmp"+std::to_string(getpid())+"_"+std::to_string(nr_tmp_files++);
+}
+
+std::string IblCache::path_for(const std::string& name) const{
+    return (fs::path(m_dir) / (name+".bin")).string();
+}
+
+} //namespace easy_pbr
@@ -0,0 +1,175 @@
+#include "easy_pbr/LayeredShadowMaps.h"
+
+//c++
+#include <algorithm>
+
+//my stuff
+#include "easy_pbr/MeshGL.h"
+#include "easy_pbr/Mesh.h"
+#include "UtilsGL.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+LayeredShadowMaps::LayeredShadowMaps():
+    m_tex_id(0),
+    m_static_tex_id(0),
+    m_fbo_id(0),
+    m_resolution(0),
+    m_nr_layers(0),
+    m_texture_unit(0)
+{
+    m_mesh_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/shadow_map_layered_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/shadow_map_frag.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/shadow_map_layered_geom.glsl" );
+    m_points_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/shadow_map_layered_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/shadow_map_frag.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/shadow_map_layered_points_geom.glsl" );
+
+    //depth only so there is nothing to draw into or read from except the depth attachment
+    glGenFramebuffers(1, &m_fbo_id);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo_id);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    //the texture units are handed out by the shaders starting from 0 so we keep the last one for the array
+    GLint max_units=0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_units);
+    m_texture_unit=max_units-1;
+}
+
+LayeredShadowMaps::~LayeredShadowMaps(){
+    glDeleteTextures(1, &m_tex_id);
+    glDeleteTextures(1, &m_static_tex_id);
+    glDeleteFramebuffers(1, &m_fbo_id);
+}
+
+bool LayeredShadowMaps::resize(const int resolution, const int nr_layers){
+    CHECK(nr_layers<=MAX_NR_LAYERS) << "We support at most " << MAX_NR_LAYERS << " layers but got " << nr_layers;
+    if(resolution==m_resolution && nr_layers==m_nr_layers && m_tex_id){
+        return false;
+    }
+    m_resolution=resolution;
+    m_nr_layers=nr_layers;
+    m_light_VP.resize(nr_layers, Eigen::Matrix4f::Identity());
+
+    GLuint* textures[2]={&m_tex_id, &m_static_tex_id};
+    for(int i = 0; i < 2; i++){
+        glDeleteTextures(1, textures[i]);
+        GL_C( glGenTextures(1, textures[i]) );
+        GL_C( glBindTexture(GL_TEXTURE_2D_ARRAY, *textures[i]) );
+        GL_C( glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, m_resolution, m_resolution, std::max(m_nr_layers,1)) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE) );
+    }
+    GL_C( glBindTexture(GL_TEXTURE_2D_ARRAY, 0) );
+
+    //everything starts at the far plane
+    clear_layers( (1<<m_nr_layers)-1, true );
+    clear_layers( (1<<m_nr_layers)-1, false );
+
+    return true;
+}
+
+bool LayeredShadowMaps::is_initialized() const{
+    return m_tex_id!=0;
+}
+
+int LayeredShadowMaps::resolution() const{
+    return m_resolution;
+}
+
+int LayeredShadowMaps::nr_layers() const{
+    return m_nr_layers;
+}
+
+void LayeredShadowMaps::clear_layers(const int layers_mask, const bool static_layer){
+    GLuint tex= static_layer ? m_static_tex_id : m_tex_id;
+    GL_C( glBindFramebuffer(GL_FRAMEBUFFER, m_fbo_id) );
+    GL_C( glViewport(0, 0, m_resolution, m_resolution) );
+    GL_C( glDepthMask(GL_TRUE) );
+    GL_C( glClearDepth(1.0) );
+    for(int l = 0; l < m_nr_layers; l++){
+        if(layers_mask & (1<<l)){
+            GL_C( glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0, l) );
+            GL_C( glClear(GL_DEPTH_BUFFER_BIT) );
+        }
+    }
+    GL_C( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+}
+
+void LayeredShadowMaps::copy_static_layers(const int layers_mask){
+    for(int l = 0; l < m_nr_layers; l++){
+        if(layers_mask & (1<<l)){
+            GL_C( glCopyImageSubData(m_static_tex_id, GL_TEXTURE_2D_ARRAY, 0, 0, 0, l,
+                                     m_tex_id, GL_TEXTURE_2D_ARRAY, 0, 0, 0, l,
+                                     m_resolution, m_resolution, 1) );
+        }
+    }
+}
+
+void LayeredShadowMaps::set_light_view_projections(const std::vector<Eigen::Matrix4f>& light_VP){
+    CHECK((int)light_VP.size()==m_nr_layers) << "Expected one view projection per layer. Layers: " << m_nr_layers << " matrices: " << light_VP.size();
+    m_light_VP=light_VP;
+}
+
+void LayeredShadowMaps::render_mesh(const std::shared_ptr<MeshGL>& mesh, const int layers_mask, const bool static_layer){
+    begin_draw(m_mesh_shader, mesh, layers_mask, static_layer);
+    m_mesh_shader.uniform_bool(mesh->nr_instances()>0, "is_instanced");
+
+    GL_C( mesh->vao.bind() );
+    if(mesh->nr_instances()){
+        GL_C( glDrawElementsInstanced(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0, mesh->nr_instances()) );
+    }else{
+        GL_C( glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0) );
+    }
+    end_draw();
+}
+
+void LayeredShadowMaps::render_points(const std::shared_ptr<MeshGL>& mesh, const int layers_mask, const bool static_layer){
+    begin_draw(m_points_shader, mesh, layers_mask, static_layer);
+    m_points_shader.uniform_bool(false, "is_instanced"); //points are never instanced
+
+    GL_C( mesh->vao.bind() );
+    glPointSize(mesh->m_core->m_vis.m_point_size);
+    GL_C( glDrawArrays(GL_POINTS, 0, mesh->m_core->V.rows()) );
+    end_draw();
+}
+
+GLuint LayeredShadowMaps::tex_id() const{
+    return m_tex_id;
+}
+
+void LayeredShadowMaps::bind(gl::Shader& shader, const std::string& sampler_name){
+    GL_C( glActiveTexture(GL_TEXTURE0+m_texture_unit) );
+    GL_C( glBindTexture(GL_TEXTURE_2D_ARRAY, m_tex_id) );
+    GL_C( glActiveTexture(GL_TEXTURE0) );
+    shader.uniform_int(m_texture_unit, sampler_name);
+}
+
+void LayeredShadowMaps::begin_draw(gl::Shader& shader, const std::shared_ptr<MeshGL>& mesh, const int layers_mask, const bool static_layer){
+    CHECK(is_initialized()) << "The layered shadow maps need to be resized before drawing into them";
+
+    //attaching the whole array makes the fbo layered and the geometry shader selects the layer with gl_Layer
+    GLuint tex= static_layer ? m_static_tex_id : m_tex_id;
+    GL_C( glBindFramebuffer(GL_FRAMEBUFFER, m_fbo_id) );
+    GL_C( glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0) );
+    GL_C( glViewport(0, 0, m_resolution, m_resolution) );
+
+    Eigen::Matrix4f M=mesh->m_core->model_matrix().cast<float>().matrix();
+    shader.use();
+    shader.uniform_4x4(M, "M");
+    shader.uniform_int(layers_mask, "layers_mask");
+    shader.uniform_int(m_nr_layers, "nr_layers");
+    GLint VP_loc=shader.get_uniform_location("light_VP");
+    GL_C( glUniformMatrix4fv(VP_loc, m_nr_layers, GL_FALSE, m_light_VP[0].data()) );
+}
+
+void LayeredShadowMaps::end_draw(){
+    GL_C( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
+}
+
+} //namespace easy_pbr
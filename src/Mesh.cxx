@@ -8,6 +8,7 @@
 //my stuff
 // #include "MiscUtils.h"
 #include "easy_pbr/LabelMngr.h"
+#include "easy_pbr/ThreadPool.h"
 
 //libigl 
 #include "igl/per_face_normals.h"
@@ -59,13 +60,19 @@ Mesh::Mesh():
         id(0),
         m_is_dirty(true),
         m_is_shadowmap_dirty(true),
+        m_is_dynamic(false),
+        m_is_instances_dirty(false),
         m_model_matrix(Eigen::Affine3d::Identity()),
         m_cur_pose(Eigen::Affine3d::Identity()),
         m_width(0),
         m_height(0),
         m_view_direction(-1),
         m_force_vis_update(false),
-        m_rand_gen(new RandGenerator())
+        m_rand_gen(new RandGenerator()),
+        m_max_surfel_radius(0),
+        m_local_aabb_dirty(true),
+        m_world_aabb_model_matrix(Eigen::Affine3d::Identity()),
+        m_world_aabb_dirty(true)
     {   
     clear();
 
@@ -83,6 +90,7 @@ Mesh Mesh::clone(){
 
     cloned.m_is_dirty=true;
     cloned.m_is_shadowmap_dirty=true;
+    cloned.m_is_dynamic=m_is_dynamic;
     cloned.m_vis=m_vis;
     cloned.m_force_vis_update=m_force_vis_update;
     cloned.m_model_matrix=m_model_matrix;
@@ -100,6 +108,9 @@ Mesh Mesh::clone(){
     cloned.L_pred=L_pred;
     cloned.L_gt=L_gt;
     cloned.I=I;
+    cloned.m_instance_transforms=m_instance_transforms;
+    cloned.m_instance_colors=m_instance_colors;
+    cloned.m_is_instances_dirty=nr_instances()>0;
     cloned.m_seg_label_pred=m_seg_label_pred;
     cloned.m_seg_label_gt=m_seg_label_gt;
     // cloned.m_rgb_tex_cpu=m_rgb_tex_cpu.clone();
@@ -107,6 +118,14 @@ Mesh Mesh::clone(){
     cloned.m_metalness_mat.mat=m_metalness_mat.mat.clone();
     cloned.m_roughness_mat.mat=m_roughness_mat.mat.clone();
     cloned.m_normals_mat.mat=m_normals_mat.mat.clone();
+    cloned.m_diffuse_mat.mips=m_diffuse_mat.mips; //the mips are never modified after they are created so a shallow copy is enough
+    cloned.m_metalness_mat.mips=m_metalness_mat.mips;
+    cloned.m_roughness_mat.mips=m_roughness_mat.mips;
+    cloned.m_normals_mat.mips=m_normals_mat.mips;
+    cloned.m_diffuse_mat.pending=m_diffuse_mat.pending;
+    cloned.m_metalness_mat.pending=m_metalness_mat.pending;
+    cloned.m_roughness_mat.pending=m_roughness_mat.pending;
+    cloned.m_normals_mat.pending=m_normals_mat.pending;
     cloned.m_diffuse_mat.is_dirty=true;
     cloned.m_metalness_mat.is_dirty=true;
     cloned.m_roughness_mat.is_dirty=true;
@@ -364,6 +383,111 @@ void Mesh::apply_model_matrix_to_cpu(const bool transform_points_at_zero){
     m_is_shadowmap_dirty=true;
 }
 
+Eigen::AlignedBox3f Mesh::local_aabb(){
+    if(m_local_aabb_dirty){
+        m_local_aabb.setEmpty();
+        if(V.rows() && V.cols()==3){
+            m_local_aabb.extend( V.colwise().minCoeff().transpose().cast<float>() );
+            m_local_aabb.extend( V.colwise().maxCoeff().transpose().cast<float>() );
+        }
+        m_max_surfel_radius=0;
+        if(V_tangent_u.rows()==V.rows() && V_tangent_u.cols()==3){
+            m_max_surfel_radius=V_tangent_u.rowwise().norm().maxCoeff();
+        }
+        if(V_length_v.rows()==V.rows() && V_length_v.size()){
+            m_max_surfel_radius=std::max<float>(m_max_surfel_radius, V_length_v.cwiseAbs().maxCoeff());
+        }
+        m_local_aabb_dirty=false;
+        m_world_aabb_dirty=true;
+    }
+    return m_local_aabb;
+}
+
+Eigen::AlignedBox3f Mesh::world_aabb(const bool include_children){
+    Eigen::AlignedBox3f local=local_aabb();
+
+    //the model matrix can be modified from outside through model_matrix_ref() so we compare against the one we used last time
+    if(m_world_aabb_dirty || m_world_aabb_model_matrix.matrix()!=m_model_matrix.matrix()){
+        m_world_aabb.setEmpty();
+        if(!local.isEmpty()){
+            Eigen::Affine3f tf=m_model_matrix.cast<float>();
+            if(m_instance_transforms.empty()){
+                for(int i = 0; i < 8; i++){
+                    m_world_aabb.extend( tf*local.corner( (Eigen::AlignedBox3f::CornerType)i ) );
+                }
+            }else{
+                //the box has to contain all the instances
+                for(size_t inst = 0; inst < m_instance_transforms.size(); inst++){
+                    Eigen::Affine3f tf_inst=tf*Eigen::Affine3f( m_instance_transforms[inst].cast<float>() );
+                    for(int i = 0; i < 8; i++){
+                        m_world_aabb.extend( tf_inst*local.corner( (Eigen::AlignedBox3f::CornerType)i ) );
+                    }
+                }
+            }
+        }
+        m_world_aabb_model_matrix=m_model_matrix;
+        m_world_aabb_dirty=false;
+    }
+
+    Eigen::AlignedBox3f box=m_world_aabb;
+    if(include_children){
+        for(size_t i = 0; i < m_child_meshes.size(); i++){
+            box.extend( m_child_meshes[i]->world_aabb(true) );
+        }
+    }
+    return box;
+}
+
+Eigen::Vector4f Mesh::world_bounding_sphere(const bool include_children){
+    Eigen::AlignedBox3f box=world_aabb(include_children);
+    Eigen::Vector4f sphere;
+    if(box.isEmpty()){
+        sphere.setZero();
+    }else{
+        sphere << box.center(), 0.5*box.diagonal().norm();
+    }
+    return sphere;
+}
+
+float Mesh::max_surfel_radius(){
+    local_aabb(); //recomputes the radius if the bounds are dirty
+    return m_max_surfel_radius;
+}
+
+void Mesh::invalidate_bounds(){
+    m_local_aabb_dirty=true;
+    m_world_aabb_dirty=true;
+}
+
+void Mesh::set_instances(const std::vector<Eigen::Matrix4d>& transforms, const Eigen::MatrixXd& colors){
+    if(colors.size()){
+        CHECK(colors.rows()==(int)transforms.size()) << named("We need one color per instance but we have ") << colors.rows() << " colors and " << transforms.size() << " transforms";
+        CHECK(colors.cols()==3) << named("The instance colors should have 3 columns but they have ") << colors.cols();
+    }
+
+    m_instance_transforms=transforms;
+    m_instance_colors=colors;
+    m_is_instances_dirty=true;
+    m_is_shadowmap_dirty=true;
+    m_world_aabb_dirty=true;
+}
+
+void Mesh::clear_instances(){
+    set_instances( std::vector<Eigen::Matrix4d>() );
+}
+
+int Mesh::nr_instances() const{
+    return m_instance_transforms.size();
+}
+
+const std::vector<Eigen::Matrix4d>& Mesh::instance_transforms() const{
+    return m_instance_transforms;
+}
+
+const Eigen::MatrixXd& Mesh::instance_colors() const{
+    return m_instance_colors;
+}
+
 // void Mesh::set_model_matrix(const Eigen::VectorXd& xyz_q){
 //     m_model_matrix.translation().x() = xyz_q[0];
 //     m_model_matrix.translation().y() = xyz_q[1];
@@ -2007,84 +2131,88 @@ Eigen::MatrixXd Mesh::compute_distance_to_mesh(const MeshSharedPtr& target_mesh)
 }
 
 void Mesh::set_diffuse_tex(const std::string file_path, const int subsample){
-    cv::Mat mat = cv::imread(file_path);
-    set_diffuse_tex(mat, subsample);
+    set_tex_async(m_diffuse_mat, [file_path](){ return cv::imread(file_path); }, file_path, subsample, false);
+    m_vis.set_color_texture(); //if we have diffuse we might as well just switch to actually display it
 }
 void Mesh::set_metalness_tex(const std::string file_path, const int subsample){
-    cv::Mat mat = cv::imread(file_path);
-    set_metalness_tex(mat, subsample);
+    set_tex_async(m_metalness_mat, [file_path](){ return cv::imread(file_path); }, file_path, subsample, false);
 }
 void Mesh::set_roughness_tex(const std::string file_path, const int subsample){
-    cv::Mat mat = cv::imread(file_path);
-    set_roughness_tex(mat, subsample);
+    set_tex_async(m_roughness_mat, [file_path](){ return cv::imread(file_path); }, file_path, subsample, false);
 }
 void Mesh::set_gloss_tex(const std::string file_path, const int subsample){
-    cv::Mat gloss = cv::imread(file_path);
-    set_gloss_tex(gloss, subsample);
+    set_tex_async(m_roughness_mat, [file_path](){ return cv::imread(file_path); }, file_path, subsample, true); //gloss is the inverse of roughness
 }
 void Mesh::set_normals_tex(const std::string file_path, const int subsample){
-    cv::Mat mat = cv::imread(file_path);
-    set_normals_tex(mat, subsample);
+    set_tex_async(m_normals_mat, [file_path](){ return cv::imread(file_path); }, file_path, subsample, false);
 }
 //using a mat directly
 void Mesh::set_diffuse_tex(const cv::Mat& mat, const int subsample){
     CHECK(mat.data) << "Diffuse mat is empty";
-    CHECK(subsample>=1) << "Expected the subsample to be 1 or above";
-    cv::Mat mat_internal=mat; //it's just a shallow copy, so a pointer assignment. This is in order to make the mat_internal point towards the original input mat or a resized version of it if necessary
-    //resize if necessary
-    if(subsample>1){
-        cv::Mat resized;
-        cv::resize(mat_internal, resized, cv::Size(), 1.0/subsample, 1.0/subsample, cv::INTER_AREA );
-        mat_internal=resized;
-    }
-    cv::flip(mat_internal, m_diffuse_mat.mat, 0); //opencv mat has origin of the texture on the upper left but opengl expect it to be on the lower left so we flip the texture. https://gamedev.stackexchange.com/questions/26175/how-do-i-load-a-texture-in-opengl-where-the-origin-of-the-texture0-0-isnt-in
-    m_diffuse_mat.is_dirty=true;
+    cv::Mat mat_copy=mat.clone(); //the mat may come from python and be modified after this call returns so we keep our own copy for the worker
+    set_tex_async(m_diffuse_mat, [mat_copy](){ return mat_copy; }, "cv mat", subsample, false);
     m_vis.set_color_texture(); //if we have diffuse we might as well just switch to actually display it
 }
 void Mesh::set_metalness_tex(const cv::Mat& mat, const int subsample){
     CHECK(mat.data) << "Metalness mat is empty";
-    CHECK(subsample>=1) << "Expected the subsample to be 1 or above";
-    cv::Mat mat_internal=mat; //it's just a shallow copy, so a pointer assignment. This is in order to make the mat_internal point towards the original input mat or a resized version of it if necessary
-    //resize if necessary
-    if(subsample>1){
-        cv::Mat resized;
-        cv::resize(mat_internal, resized, cv::Size(), 1.0/subsample, 1.0/subsample, cv::INTER_AREA );
-        mat_internal=resized;
-    }
-    cv::flip(mat_internal, m_metalness_mat.mat, 0);
-    m_metalness_mat.is_dirty=true;
+    cv::Mat mat_copy=mat.clone();
+    set_tex_async(m_metalness_mat, [mat_copy](){ return mat_copy; }, "cv mat", subsample, false);
 }
 void Mesh::set_roughness_tex(const cv::Mat& mat, const int subsample){
     CHECK(mat.data) << "Roughness mat is empty";
-    CHECK(subsample>=1) << "Expected the subsample to be 1 or above";
-    cv::Mat mat_internal=mat; //it's just a shallow copy, so a pointer assignment. This is in order to make the mat_internal point towards the original input mat or a resized version of it if necessary
-    //resize if necessary
-    if(subsample>1){
-        cv::Mat resized;
-        cv::resize(mat_internal, resized, cv::Size(), 1.0/subsample, 1.0/subsample, cv::INTER_AREA );
-        mat_internal=resized;
-    }
-    cv::flip(mat_internal, m_roughness_mat.mat, 0);
-    m_roughness_mat.is_dirty=true;
+    cv::Mat mat_copy=mat.clone();
+    set_tex_async(m_roughness_mat, [mat_copy](){ return mat_copy; }, "cv mat", subsample, false);
 }
 void Mesh::set_gloss_tex(const cv::Mat& mat, const int subsample){
     CHECK(mat.data) << "Gloss mat is empty"; 
-    CHECK(subsample>=1) << "Expected the subsample to be 1 or above";
-    cv::Mat mat_internal=mat; //it's just a shallow copy, so a pointer assignment. This is in order to make the mat_internal point towards the original input mat or a resized version of it if necessary
-    //resize if necessary
-    if(subsample>1){
-        cv::Mat resized;
-        cv::resize(mat_internal, resized, cv::Size(), 1.0/subsample, 1.0/subsample, cv::INTER_AREA );
-        mat_internal=resized;
-    }
-    cv::Mat rough;
-    cv::subtract(cv::Scalar::all(255),mat_internal,rough);
-    cv::flip(rough, m_roughness_mat.mat, 0);
-    m_roughness_mat.is_dirty=true;
+    cv::Mat mat_copy=mat.clone();
+    set_tex_async(m_roughness_mat, [mat_copy](){ return mat_copy; }, "cv mat", subsample, true);
 }
 void Mesh::set_normals_tex(const cv::Mat& mat, const int subsample){
     CHECK(mat.data) << "Normals mat is empty";
+    cv::Mat mat_copy=mat.clone();
+    set_tex_async(m_normals_mat, [mat_copy](){ return mat_copy; }, "cv mat", subsample, false);
+}
+bool Mesh::is_any_texture_dirty(){
+    collect_pending_tex(m_diffuse_mat);
+    collect_pending_tex(m_normals_mat);
+    collect_pending_tex(m_metalness_mat);
+    collect_pending_tex(m_roughness_mat);
+
+    return  m_diffuse_mat.is_dirty || m_normals_mat.is_dirty || m_metalness_mat.is_dirty || m_roughness_mat.is_dirty;
+
+}
+bool Mesh::is_any_texture_pending(){
+    return  m_diffuse_mat.pending.valid() || m_normals_mat.pending.valid() || m_metalness_mat.pending.valid() || m_roughness_mat.pending.valid();
+}
+void Mesh::wait_for_textures(){
+    for(CvMatCpu* tex : {&m_diffuse_mat, &m_normals_mat, &m_metalness_mat, &m_roughness_mat}){
+        if(tex->pending.valid()){
+            tex->pending.wait();
+        }
+        collect_pending_tex(*tex);
+    }
+}
+
+void Mesh::set_tex_async(CvMatCpu& tex, std::function<cv::Mat()> read_func, const std::string source, const int subsample, const bool invert){
     CHECK(subsample>=1) << "Expected the subsample to be 1 or above";
+
+    //all the meshes share the same pool. We don't use all the cores because mesh loading may also be running at the same time
+    static ThreadPool pool( std::max(2, (int)std::thread::hardware_concurrency()/2) );
+
+    //if there was a previous texture that is still decoding we just drop it, the new one overwrites it
+    //a texture that fails to read must not abort the worker, we return no mips instead and the render thread keeps showing whatever texture it had before
+    tex.pending=pool.enqueue( [read_func, source, subsample, invert](){
+        cv::Mat mat=read_func();
+        if(!mat.data){
+            LOG(ERROR) << "Could not read texture from " << source << ", keeping the previous texture";
+            return std::vector<cv::Mat>();
+        }
+        return prepare_tex(mat, subsample, invert);
+    } ).share();
+}
+
+std::vector<cv::Mat> Mesh::prepare_tex(const cv::Mat& mat, const int subsample, const bool invert){
     cv::Mat mat_internal=mat; //it's just a shallow copy, so a pointer assignment. This is in order to make the mat_internal point towards the original input mat or a resized version of it if necessary
     //resize if necessary
     if(subsample>1){
@@ -2092,12 +2220,46 @@ void Mesh::set_normals_tex(const cv::Mat& mat, const int subsample){
         cv::resize(mat_internal, resized, cv::Size(), 1.0/subsample, 1.0/subsample, cv::INTER_AREA );
         mat_internal=resized;
     }
-    cv::flip(mat_internal, m_normals_mat.mat, 0);
-    m_normals_mat.is_dirty=true;
+    if(invert){
+        cv::Mat inverted;
+        cv::subtract(cv::Scalar::all(255),mat_internal,inverted);
+        mat_internal=inverted;
+    }
+    cv::Mat flipped;
+    cv::flip(mat_internal, flipped, 0); //opencv mat has origin of the texture on the upper left but opengl expect it to be on the lower left so we flip the texture. https://gamedev.stackexchange.com/questions/26175/how-do-i-load-a-texture-in-opengl-where-the-origin-of-the-texture0-0-isnt-in
+
+    //mip chain down to 1x1, each level is half the size of the previous one rounded down like opengl does it
+    std::vector<cv::Mat> mips;
+    mips.push_back(flipped);
+    while(mips.back().cols>1 || mips.back().rows>1){
+        const cv::Mat& prev=mips.back();
+        cv::Mat next;
+        cv::resize(prev, next, cv::Size( std::max(1, prev.cols/2), std::max(1, prev.rows/2) ), 0, 0, cv::INTER_AREA );
+        mips.push_back(next);
+    }
+
+    return mips;
 }
-bool Mesh::is_any_texture_dirty(){
-    return  m_diffuse_mat.is_dirty || m_normals_mat.is_dirty || m_metalness_mat.is_dirty || m_roughness_mat.is_dirty;
 
+bool Mesh::collect_pending_tex(CvMatCpu& tex){
+    if(!tex.pending.valid()){
+        return false;
+    }
+    if(tex.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+        return false;
+    }
+
+    std::vector<cv::Mat> mips=tex.pending.get();
+    tex.pending=std::shared_future< std::vector<cv::Mat> >();
+    if(mips.empty()){ //reading failed on the worker, it was already logged there
+        return false;
+    }
+
+    tex.mips=mips;
+    tex.mat=tex.mips[0];
+    tex.is_dirty=true;
+
+    return true;
 }
 
 
@@ -0,0 +1,261 @@
+#include "easy_pbr/MeshBatcher.h"
+
+//c++
+#include <numeric>
+
+//my stuff
+#include "easy_pbr/MeshGL.h"
+#include "easy_pbr/Mesh.h"
+#include "UtilsGL.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+MeshBatcher::MeshBatcher(const int max_nr_vertices):
+    m_max_nr_vertices(max_nr_vertices),
+    m_nr_vertices(0),
+    m_nr_rebuilds(0),
+    m_vao_id(0),
+    m_V_buf_id(0),
+    m_NV_buf_id(0),
+    m_C_buf_id(0),
+    m_F_buf_id(0),
+    m_draw_idx_buf_id(0),
+    m_indirect_buf_id(0),
+    m_draw_data_buf_id(0)
+{
+    glGenVertexArrays(1, &m_vao_id);
+    glGenBuffers(1, &m_V_buf_id);
+    glGenBuffers(1, &m_NV_buf_id);
+    glGenBuffers(1, &m_C_buf_id);
+    glGenBuffers(1, &m_F_buf_id);
+    glGenBuffers(1, &m_draw_idx_buf_id);
+    glGenBuffers(1, &m_indirect_buf_id);
+    glGenBuffers(1, &m_draw_data_buf_id);
+
+    //the layout of the vao never changes, only the content of the buffers
+    glBindVertexArray(m_vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, m_V_buf_id);
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, m_NV_buf_id);
+    glEnableVertexAttribArray(NORMAL_LOCATION);
+    glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, m_C_buf_id);
+    glEnableVertexAttribArray(COLOR_LOCATION);
+    glVertexAttribPointer(COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, m_draw_idx_buf_id);
+    glEnableVertexAttribArray(DRAW_IDX_LOCATION);
+    glVertexAttribIPointer(DRAW_IDX_LOCATION, 1, GL_INT, 0, 0);
+    glVertexAttribDivisor(DRAW_IDX_LOCATION, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_F_buf_id); //the vao remembers the element buffer
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+MeshBatcher::~MeshBatcher(){
+    glDeleteVertexArrays(1, &m_vao_id);
+    glDeleteBuffers(1, &m_V_buf_id);
+    glDeleteBuffers(1, &m_NV_buf_id);
+    glDeleteBuffers(1, &m_C_buf_id);
+    glDeleteBuffers(1, &m_F_buf_id);
+    glDeleteBuffers(1, &m_draw_idx_buf_id);
+    glDeleteBuffers(1, &m_indirect_buf_id);
+    glDeleteBuffers(1, &m_draw_data_buf_id);
+}
+
+bool MeshBatcher::is_batchable(const std::shared_ptr<MeshGL>& mesh) const{
+    const std::shared_ptr<Mesh>& core=mesh->m_core;
+    const VisOptions& vis=core->m_vis;
+
+    if(!vis.m_show_mesh || vis.m_use_custom_shader || core->F.rows()==0 || core->V.cols()!=3){
+        return false;
+    }
+    if(core->V.rows()>m_max_nr_vertices || core->NV.rows()!=core->V.rows()){
+        return false;
+    }
+    if(mesh->nr_instances()>0){
+        return false;
+    }
+    //the batched shader has no label attributes so meshes with labels go through the normal path to end up in the label buffer
+    if(core->L_gt.rows()!=0 || core->L_pred.rows()!=0){
+        return false;
+    }
+    //the batched shader has no samplers
+    if(mesh->m_diffuse_tex.storage_initialized() || mesh->m_metalness_tex.storage_initialized() || mesh->m_roughness_tex.storage_initialized() || mesh->m_normals_tex.storage_initialized()){
+        return false;
+    }
+
+    const MeshColorType color_type=vis.m_color_type;
+    if(color_type==+MeshColorType::PerVertColor){
+        return core->C.rows()==core->V.rows();
+    }
+    return color_type==+MeshColorType::Solid || color_type==+MeshColorType::NormalVector;
+}
+
+void MeshBatcher::update(const std::vector< std::shared_ptr<MeshGL> >& meshes){
+    std::vector< std::shared_ptr<MeshGL> > batchable;
+    for(size_t i = 0; i < meshes.size(); i++){
+        if(is_batchable(meshes[i])){
+            batchable.push_back(meshes[i]);
+        }
+    }
+
+    if(needs_rebuild(batchable)){
+        rebuild(batchable);
+    }
+}
+
+bool MeshBatcher::contains(const std::shared_ptr<MeshGL>& mesh) const{
+    return m_entry_idx.find(mesh.get())!=m_entry_idx.end();
+}
+
+void MeshBatcher::add_draw(const std::shared_ptr<MeshGL>& mesh){
+    auto it=m_entry_idx.find(mesh.get());
+    CHECK(it!=m_entry_idx.end()) << "The mesh " << mesh->m_core->name << " is not in the batch";
+    const Entry& entry=m_entries[it->second];
+    const VisOptions& vis=mesh->m_core->m_vis;
+
+    DrawCommand cmd;
+    cmd.count=entry.nr_indices;
+    cmd.instance_count=1;
+    cmd.first_index=entry.first_index;
+    cmd.base_vertex=entry.base_vertex;
+    cmd.base_instance=m_commands.size(); //selects the draw data of this command through the draw_idx attribute
+    m_commands.push_back(cmd);
+
+    //the model matrix and the vis options can change without the mesh being dirty so we gather them every frame
+    DrawData data;
+    data.M=mesh->m_core->model_matrix().cast<float>().matrix();
+    data.solid_color << vis.m_solid_color, 1.0;
+    data.metalness_roughness << vis.m_metalness, vis.m_roughness, 0.0, 0.0;
+    data.mesh_id_color_type << mesh->m_core->id, vis.m_color_type._to_integral(), mesh->m_instance_id, 0;
+    m_draw_data.push_back(data);
+}
+
+int MeshBatcher::draw(){
+    const int nr_draws=m_commands.size();
+    if(!nr_draws){
+        return 0;
+    }
+
+    GL_C( glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_draw_data_buf_id) );
+    GL_C( glBufferData(GL_SHADER_STORAGE_BUFFER, m_draw_data.size()*sizeof(DrawData), m_draw_data.data(), GL_STREAM_DRAW) );
+    GL_C( glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, m_draw_data_buf_id) );
+
+    GL_C( glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirect_buf_id) );
+    GL_C( glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size()*sizeof(DrawCommand), m_commands.data(), GL_STREAM_DRAW) );
+
+    GL_C( glBindVertexArray(m_vao_id) );
+    GL_C( glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, nr_draws, 0) );
+    GL_C( glBindVertexArray(0) );
+    GL_C( glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0) );
+    GL_C( glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0) );
+
+    m_commands.clear();
+    m_draw_data.clear();
+
+    return nr_draws;
+}
+
+int MeshBatcher::nr_meshes() const{
+    return m_entries.size();
+}
+
+int MeshBatcher::nr_vertices() const{
+    return m_nr_vertices;
+}
+
+int MeshBatcher::nr_rebuilds() const{
+    return m_nr_rebuilds;
+}
+
+bool MeshBatcher::needs_rebuild(const std::vector< std::shared_ptr<MeshGL> >& batchable) const{
+    if(batchable.size()!=m_entries.size()){
+        return true;
+    }
+    for(size_t i = 0; i < batchable.size(); i++){
+        const Entry& entry=m_entries[i];
+        if(batchable[i].get()!=entry.mesh_ptr || entry.mesh.expired() || batchable[i]->m_buffers_version!=entry.buffers_version){
+            return true;
+        }
+    }
+    return false;
+}
+
+void MeshBatcher::rebuild(const std::vector< std::shared_ptr<MeshGL> >& batchable){
+    m_entries.clear();
+    m_entry_idx.clear();
+    m_commands.clear();
+    m_draw_data.clear();
+    m_nr_rebuilds++;
+
+    //get the size of the arenas first so we allocate only once
+    int nr_verts=0;
+    int nr_indices=0;
+    for(size_t i = 0; i < batchable.size(); i++){
+        nr_verts+=batchable[i]->m_core->V.rows();
+        nr_indices+=batchable[i]->m_core->F.size();
+    }
+    m_nr_vertices=nr_verts;
+    VLOG(1) << "Repacking mesh batch with " << batchable.size() << " meshes, " << nr_verts << " vertices and " << nr_indices/3 << " faces";
+
+    typedef Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixXf;
+    typedef Eigen::Matrix<unsigned,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixXi;
+    RowMatrixXf V_f(nr_verts, 3);
+    RowMatrixXf NV_f(nr_verts, 3);
+    RowMatrixXf C_f(nr_verts, 3);
+    RowMatrixXi F_i(nr_indices/3, 3);
+    C_f.setZero();
+
+    int vert_offset=0;
+    int face_offset=0;
+    for(size_t i = 0; i < batchable.size(); i++){
+        const std::shared_ptr<Mesh>& core=batchable[i]->m_core;
+        const int nr_v=core->V.rows();
+        const int nr_f=core->F.rows();
+        V_f.block(vert_offset, 0, nr_v, 3)=core->V.cast<float>();
+        NV_f.block(vert_offset, 0, nr_v, 3)=core->NV.cast<float>();
+        if(core->C.rows()==nr_v){
+            C_f.block(vert_offset, 0, nr_v, 3)=core->C.cast<float>();
+        }
+        F_i.block(face_offset, 0, nr_f, 3)=core->F.cast<unsigned>(); //the indices stay local to the mesh because the base vertex of the draw command offsets them
+
+        Entry entry;
+        entry.mesh=batchable[i];
+        entry.mesh_ptr=batchable[i].get();
+        entry.buffers_version=batchable[i]->m_buffers_version;
+        entry.first_index=face_offset*3;
+        entry.nr_indices=nr_f*3;
+        entry.base_vertex=vert_offset;
+        m_entry_idx[entry.mesh_ptr]=m_entries.size();
+        m_entries.push_back(entry);
+
+        vert_offset+=nr_v;
+        face_offset+=nr_f;
+    }
+
+    std::vector<int> draw_idx(batchable.size());
+    std::iota(draw_idx.begin(), draw_idx.end(), 0);
+
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, m_V_buf_id) );
+    GL_C( glBufferData(GL_ARRAY_BUFFER, V_f.size()*sizeof(float), V_f.data(), GL_STATIC_DRAW) );
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, m_NV_buf_id) );
+    GL_C( glBufferData(GL_ARRAY_BUFFER, NV_f.size()*sizeof(float), NV_f.data(), GL_STATIC_DRAW) );
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, m_C_buf_id) );
+    GL_C( glBufferData(GL_ARRAY_BUFFER, C_f.size()*sizeof(float), C_f.data(), GL_STATIC_DRAW) );
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, m_draw_idx_buf_id) );
+    GL_C( glBufferData(GL_ARRAY_BUFFER, draw_idx.size()*sizeof(int), draw_idx.data(), GL_STATIC_DRAW) );
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+    //the element buffer is bound through the vao so we don't disturb whatever vao is bound right now
+    GL_C( glBindVertexArray(m_vao_id) );
+    GL_C( glBufferData(GL_ELEMENT_ARRAY_BUFFER, F_i.size()*sizeof(unsigned), F_i.data(), GL_STATIC_DRAW) );
+    GL_C( glBindVertexArray(0) );
+}
+
+
+} //namespace easy_pbr
@@ -3,14 +3,22 @@
 //c++
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <atomic>
 
 //my stuff 
 #include "easy_pbr/Mesh.h"
+#include "easy_pbr/TextureUploader.h"
+#include "easy_pbr/LabelMngr.h"
 
 namespace easy_pbr{
 
+static std::atomic<unsigned long long> nr_meshes_gl_created(0);
+
 MeshGL::MeshGL():
     m_first_core_assignment(true),
+    m_uid(nr_meshes_gl_created++),
+    m_buffers_version(0),
     V_buf("V_buf"),
     F_buf("F_buf"),
     C_buf("C_buf"),
@@ -25,7 +33,15 @@ MeshGL::MeshGL():
     // m_thermal_tex(new gl::Texture2D("thermal_tex")),
     // m_thermal_colored_tex(new gl::Texture2D("thermal_colored_tex")),
     // m_cur_tex_ptr(m_rgb_tex),
-    m_core(new Mesh)
+    m_core(new Mesh),
+    m_instance_id(0),
+    m_instance_buf_id(0),
+    m_nr_instances(0),
+    m_has_instance_colors(false),
+    m_mesh_ubo_id(0),
+    m_color_scheme_ubo_id(0),
+    m_mesh_ubo_valid(false),
+    m_nr_ubo_uploads(0)
     {   
 
     //Set the parameters for the buffers
@@ -55,6 +71,12 @@ MeshGL::MeshGL():
 
 }
 
+MeshGL::~MeshGL(){
+    glDeleteBuffers(1, &m_instance_buf_id); //silently ignores the 0 if the mesh was never instanced
+    glDeleteBuffers(1, &m_mesh_ubo_id);
+    glDeleteBuffers(1, &m_color_scheme_ubo_id);
+}
+
 void MeshGL::assign_core(std::shared_ptr<Mesh> mesh_core){
     if(m_first_core_assignment || mesh_core->m_force_vis_update ){
         //asign the whole core together with all the options like m_show_points and so on
@@ -73,8 +95,22 @@ void MeshGL::sanity_check() const{
 }
 
 
-void MeshGL::upload_to_gpu(){
+void MeshGL::upload_to_gpu(const std::shared_ptr<TextureUploader>& tex_uploader){
+
+    //pbr textures
+    upload_tex(m_diffuse_tex, m_core->m_diffuse_mat, tex_uploader);
+    upload_tex(m_metalness_tex, m_core->m_metalness_mat, tex_uploader);
+    upload_tex(m_roughness_tex, m_core->m_roughness_mat, tex_uploader);
+    upload_tex(m_normals_tex, m_core->m_normals_mat, tex_uploader);
+
+    if(m_core->m_is_instances_dirty){
+        upload_instances();
+    }
 
+    //we may be here only because a texture finished decoding or the instances changed, in which case the buffers are still valid
+    if(!m_core->m_is_dirty){
+        return;
+    }
 
     // Temporary copy of the content of each VBO. need to make it float and row major
     typedef Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixXf;
@@ -124,34 +160,180 @@ void MeshGL::upload_to_gpu(){
     L_gt_buf.upload_data(L_gt_i.size()*sizeof(unsigned), L_gt_i.data(), GL_DYNAMIC_DRAW); 
     I_buf.upload_data(I_f.size()*sizeof(float), I_f.data(), GL_DYNAMIC_DRAW); 
 
-    // if(m_core->m_rgb_tex_cpu.data){
-        // GL_C(m_rgb_tex->upload_from_cv_mat(m_core->m_rgb_tex_cpu) );
-    // }
+    setup_vao();
 
-    //pbr textures
-    if (m_core->m_diffuse_mat.mat.data && m_core->m_diffuse_mat.is_dirty){
-        m_core->m_diffuse_mat.is_dirty=false;
-        GL_C(m_diffuse_tex.upload_from_cv_mat(m_core->m_diffuse_mat.mat) );
-        m_diffuse_tex.generate_mipmap_full();
+    m_core->m_is_dirty=false;
+    m_buffers_version++;
+}
+
+
+int MeshGL::nr_instances() const{
+    return m_nr_instances;
+}
+
+bool MeshGL::has_instance_colors() const{
+    return m_has_instance_colors;
+}
+
+void MeshGL::upload_instances(){
+    m_core->m_is_instances_dirty=false;
+
+    const std::vector<Eigen::Matrix4d>& transforms=m_core->instance_transforms();
+    const Eigen::MatrixXd& colors=m_core->instance_colors();
+    m_nr_instances=transforms.size();
+    m_has_instance_colors=colors.size()>0;
+    if(!m_nr_instances){
+        if(m_instance_buf_id){ //it was instanced before
+            vao.bind();
+            for(int loc = INSTANCE_MATRIX_LOCATION; loc <= INSTANCE_COLOR_LOCATION; loc++){
+                GL_C( glDisableVertexAttribArray(loc) );
+            }
+            GL_C( glBindVertexArray(0) );
+        }
+        return;
     }
-    if (m_core->m_metalness_mat.mat.data && m_core->m_metalness_mat.is_dirty){
-        m_core->m_metalness_mat.is_dirty=false;
-        GL_C(m_metalness_tex.upload_from_cv_mat(m_core->m_metalness_mat.mat) );
-        m_metalness_tex.generate_mipmap_full();
+
+    //interleave the model matrix (column major as glsl expects it) and the color of each instance
+    const int floats_per_instance=16+3;
+    std::vector<float> data(m_nr_instances*floats_per_instance, 0.0);
+    for(int i = 0; i < m_nr_instances; i++){
+        float* ptr=data.data()+i*floats_per_instance;
+        Eigen::Map<Eigen::Matrix4f>(ptr)=transforms[i].cast<float>();
+        if(m_has_instance_colors){
+            Eigen::Map<Eigen::Vector3f>(ptr+16)=colors.row(i).transpose().cast<float>();
+        }
     }
-    if (m_core->m_roughness_mat.mat.data && m_core->m_roughness_mat.is_dirty){
-        m_core->m_roughness_mat.is_dirty=false;
-        GL_C(m_roughness_tex.upload_from_cv_mat(m_core->m_roughness_mat.mat) );
-        m_roughness_tex.generate_mipmap_full();
+
+    if(!m_instance_buf_id){
+        GL_C( glGenBuffers(1, &m_instance_buf_id) );
     }
-    if (m_core->m_normals_mat.mat.data && m_core->m_normals_mat.is_dirty){
-        m_core->m_normals_mat.is_dirty=false;
-        GL_C(m_normals_tex.upload_from_cv_mat(m_core->m_normals_mat.mat) );
-        m_normals_tex.generate_mipmap_full();
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, m_instance_buf_id) );
+    GL_C( glBufferData(GL_ARRAY_BUFFER, data.size()*sizeof(float), data.data(), GL_DYNAMIC_DRAW) );
+
+    //the vao remembers this so we only do it when the instances are uploaded and not on every draw
+    const GLsizei stride=floats_per_instance*sizeof(float);
+    vao.bind();
+    for(int c = 0; c < 4; c++){
+        GL_C( glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION+c) );
+        GL_C( glVertexAttribPointer(INSTANCE_MATRIX_LOCATION+c, 4, GL_FLOAT, GL_FALSE, stride, (void*)(c*4*sizeof(float)) ) );
+        GL_C( glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION+c, 1) );
     }
+    GL_C( glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION) );
+    GL_C( glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, stride, (void*)(16*sizeof(float)) ) );
+    GL_C( glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1) );
+    GL_C( glBindVertexArray(0) );
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+}
 
-    m_core->m_is_dirty=false;
+void MeshGL::update_uniform_buffers(){
+    const VisOptions& vis=m_core->m_vis;
+
+    MeshUniforms uniforms;
+    std::memset(&uniforms, 0, sizeof(uniforms)); //so that the padding also compares equal
+    uniforms.M=m_core->model_matrix().cast<float>().matrix();
+    uniforms.solid_color=vis.m_solid_color;
+    uniforms.point_color=vis.m_point_color;
+    uniforms.min_y=m_core->min_y();
+    uniforms.max_y=m_core->max_y();
+    uniforms.metalness=vis.m_metalness;
+    uniforms.roughness=vis.m_roughness;
+    uniforms.color_type=vis.m_color_type._to_integral();
+    uniforms.mesh_id=m_core->id;
+    uniforms.is_instanced=m_nr_instances>0;
+    uniforms.has_instance_colors=m_has_instance_colors;
+    uniforms.has_normals=m_core->NV.size()>0;
+    uniforms.points_as_circle=vis.m_points_as_circle;
+
+    if(!m_mesh_ubo_valid || std::memcmp(&uniforms, &m_mesh_uniforms, sizeof(MeshUniforms))!=0 ){
+        if(!m_mesh_ubo_id){
+            GL_C( glGenBuffers(1, &m_mesh_ubo_id) );
+        }
+        GL_C( glBindBuffer(GL_UNIFORM_BUFFER, m_mesh_ubo_id) );
+        GL_C( glBufferData(GL_UNIFORM_BUFFER, sizeof(MeshUniforms), &uniforms, GL_DYNAMIC_DRAW) );
+        GL_C( glBindBuffer(GL_UNIFORM_BUFFER, 0) );
+        m_mesh_uniforms=uniforms;
+        m_mesh_ubo_valid=true;
+        m_nr_ubo_uploads++;
+    }
+
+    //the label colors are only needed for the semantic color types
+    if(m_core->m_label_mngr && (vis.m_color_type==+MeshColorType::SemanticPred || vis.m_color_type==+MeshColorType::SemanticGT) ){
+        Eigen::MatrixXf color_scheme=m_core->m_label_mngr->color_scheme().cast<float>();
+        if(!m_color_scheme_ubo_id || color_scheme.rows()!=m_color_scheme.rows() || color_scheme!=m_color_scheme){
+            if(!m_color_scheme_ubo_id){
+                GL_C( glGenBuffers(1, &m_color_scheme_ubo_id) );
+            }
+            std::vector<Eigen::Vector4f> packed=pack_colors_std140(color_scheme, MAX_NR_CLASSES);
+            GL_C( glBindBuffer(GL_UNIFORM_BUFFER, m_color_scheme_ubo_id) );
+            GL_C( glBufferData(GL_UNIFORM_BUFFER, packed.size()*sizeof(Eigen::Vector4f), packed.data(), GL_DYNAMIC_DRAW) );
+            GL_C( glBindBuffer(GL_UNIFORM_BUFFER, 0) );
+            m_color_scheme=color_scheme;
+        }
+    }
+}
+
+void MeshGL::bind_uniform_buffers(){
+    CHECK(m_mesh_ubo_valid) << "The uniform buffer of mesh " << m_core->name << " was never uploaded. Call update_uniform_buffers() first";
+    GL_C( glBindBufferBase(GL_UNIFORM_BUFFER, MESH_UBO_BINDING, m_mesh_ubo_id) );
+    if(m_color_scheme_ubo_id){
+        GL_C( glBindBufferBase(GL_UNIFORM_BUFFER, COLOR_SCHEME_UBO_BINDING, m_color_scheme_ubo_id) );
+    }
+}
+
+unsigned long long MeshGL::nr_uniform_buffer_uploads() const{
+    return m_nr_ubo_uploads;
+}
+
+void MeshGL::setup_vao(){
+    vao.bind();
+    attribute_to_location(V_buf, POSITION_LOCATION, 3, false, m_core->V.size());
+    attribute_to_location(NV_buf, NORMAL_LOCATION, 3, false, m_core->NV.size());
+    attribute_to_location(V_tangent_u_buf, TANGENT_LOCATION, 3, false, m_core->V_tangent_u.size());
+    attribute_to_location(C_buf, COLOR_LOCATION, 3, false, m_core->C.size());
+    attribute_to_location(UV_buf, UV_LOCATION, 2, false, m_core->UV.size());
+    attribute_to_location(L_pred_buf, LABEL_PRED_LOCATION, 1, true, m_core->L_pred.size());
+    attribute_to_location(L_gt_buf, LABEL_GT_LOCATION, 1, true, m_core->L_gt.size());
+    attribute_to_location(I_buf, INTENSITY_LOCATION, 1, false, m_core->I.size());
+    attribute_to_location(V_lenght_v_buf, LENGTH_V_LOCATION, 1, false, m_core->V_length_v.size());
+    if(m_core->F.size()){
+        F_buf.bind(); //the element buffer binding is part of the vao state
+    }
+    GL_C( glBindVertexArray(0) );
+    GL_C( glBindBuffer(GL_ARRAY_BUFFER, 0) );
+}
+
+void MeshGL::attribute_to_location(gl::Buf& buf, const int location, const int nr_components, const bool is_integer, const bool enable){
+    //attributes that have no data are disabled so the shaders read a constant zero instead of whatever was in the buffer before
+    if(!enable){
+        GL_C( glDisableVertexAttribArray(location) );
+        return;
+    }
+    buf.bind();
+    if(is_integer){
+        GL_C( glVertexAttribIPointer(location, nr_components, GL_INT, 0, 0) );
+    }else{
+        GL_C( glVertexAttribPointer(location, nr_components, GL_FLOAT, GL_FALSE, 0, 0) );
+    }
+    GL_C( glEnableVertexAttribArray(location) );
+}
+
+void MeshGL::upload_tex(gl::Texture2D& tex, CvMatCpu& mat, const std::shared_ptr<TextureUploader>& tex_uploader){
+    if (!mat.mat.data || !mat.is_dirty){
+        return;
+    }
+    mat.is_dirty=false;
+
+    if(tex_uploader && !mat.mips.empty()){
+        tex_uploader->enqueue(shared_from_this(), tex, mat.mips);
+    }else{
+        GL_C( tex.upload_from_cv_mat(mat.mat) );
+        //a previous streamed upload may have left the base level somewhere else
+        GL_C( glBindTexture(GL_TEXTURE_2D, tex.tex_id()) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000) );
+        tex.generate_mipmap_full();
+    }
 }
 
 
-} //namespace easy_pbr
\ No newline at end of file
+} //namespace easy_pbr
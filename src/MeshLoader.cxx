@@ -0,0 +1,127 @@
+#include "easy_pbr/MeshLoader.h"
+
+//c++
+#include <thread>
+#include <chrono>
+
+//my stuff
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/Scene.h"
+#include "easy_pbr/ThreadPool.h"
+#include "easy_pbr/Tracer.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+//boost
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+
+namespace easy_pbr{
+
+bool MeshLoadHandle::is_ready() const{
+    CHECK(future.valid()) << "The handle for " << file_path << " has no valid future";
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::shared_ptr<Mesh> MeshLoadHandle::get() const{
+    CHECK(future.valid()) << "The handle for " << file_path << " has no valid future";
+    return future.get();
+}
+
+
+
+MeshLoader::MeshLoader(const int nr_threads):
+    m_pool(new ThreadPool( nr_threads>0 ? nr_threads : std::thread::hardware_concurrency() ))
+{
+    VLOG(1) << "Created mesh loader with " << m_pool->nr_threads() << " threads";
+}
+
+MeshLoader::~MeshLoader(){
+    //the pool finishes the queued meshes before joining the threads
+    m_pool.reset();
+}
+
+MeshLoadHandle MeshLoader::load(const std::string file_path, const std::string name, const bool add_to_scene, std::function<void(const std::shared_ptr<Mesh>&)> on_added){
+    std::string name_mesh=name;
+    if(name_mesh.empty()){
+        name_mesh=fs::path(file_path).stem().string();
+    }
+
+    MeshLoadHandle handle;
+    handle.file_path=file_path;
+    handle.name=name_mesh;
+    handle.future=m_pool->enqueue( [this, file_path, name_mesh, add_to_scene, on_added](){ return load_mesh_threaded(file_path, name_mesh, add_to_scene, on_added); } ).share();
+
+    return handle;
+}
+
+std::vector<MeshLoadHandle> MeshLoader::load(const std::vector<std::string>& file_paths, const std::vector<std::string>& names, const bool add_to_scene){
+    CHECK(names.empty() || names.size()==file_paths.size()) << "The nr of names should be either zero or the same as the nr of files. Nr files is " << file_paths.size() << " nr names is " << names.size();
+
+    std::vector<MeshLoadHandle> handles;
+    handles.reserve(file_paths.size());
+    for(size_t i = 0; i < file_paths.size(); i++){
+        std::string name = names.empty() ? "" : names[i];
+        handles.push_back( load(file_paths[i], name, add_to_scene) );
+    }
+
+    return handles;
+}
+
+int MeshLoader::update(){
+    std::vector<FinishedMesh> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_finished_mutex);
+        finished.swap(m_finished);
+    }
+    for(size_t i = 0; i < finished.size(); i++){
+        Scene::add_mesh(finished[i].mesh, finished[i].mesh->name);
+        if(finished[i].on_added){
+            finished[i].on_added(finished[i].mesh);
+        }
+    }
+    return finished.size();
+}
+
+void MeshLoader::wait_all(){
+    m_pool->wait_idle();
+    update();
+}
+
+int MeshLoader::nr_pending(){
+    return m_pool->nr_jobs_in_flight();
+}
+
+int MeshLoader::nr_threads(){
+    return m_pool->nr_threads();
+}
+
+std::shared_ptr<Mesh> MeshLoader::load_mesh_threaded(const std::string file_path, const std::string name, const bool add_to_scene, std::function<void(const std::shared_ptr<Mesh>&)> on_added){
+    Tracer::set_thread_name("mesh_loader");
+    TRACE_SCOPE("load_mesh");
+
+    //load_from_file already computes the normals, tangents and the min max height so all of that gets done here and not on the render thread
+    std::shared_ptr<Mesh> mesh = Mesh::create();
+    bool success=mesh->load_from_file(file_path);
+    if(!success){
+        LOG(WARNING) << "Could not load mesh from " << file_path;
+        return nullptr;
+    }
+    mesh->name=name;
+
+    //the render thread adds it to the scene in update() and uploads it to the gpu in the same frame
+    if(add_to_scene){
+        std::lock_guard<std::mutex> lock(m_finished_mutex);
+        m_finished.push_back( {mesh, on_added} );
+    }
+
+    VLOG(1) << "Finished loading " << file_path << " with " << mesh->V.rows() << " vertices";
+
+    return mesh;
+}
+
+
+} //namespace easy_pbr
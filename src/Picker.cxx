@@ -0,0 +1,211 @@
+#include "easy_pbr/Picker.h"
+
+//c++
+#include <limits>
+#include <cstring>
+
+//my stuff
+#include "UtilsGL.h"
+#include "easy_pbr/Viewer.h"
+#include "easy_pbr/Camera.h"
+#include "easy_pbr/MeshGL.h"
+#include "easy_pbr/Mesh.h"
+#include "easy_pbr/AsyncReadback.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+//set by the points and surfel shaders in the primitive id so that we know if it's a vertex or a face
+static const unsigned int POINT_BIT=0x80000000u;
+
+Picker::Picker(Viewer* view):
+    m_view(view),
+    m_pick_shader("pick"),
+    m_region_tex("pick_region_tex"),
+    m_readback( AsyncReadback::create(4) )
+{
+    m_pick_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/pick_frag.glsl"  );
+}
+
+Picker::~Picker(){
+    finish();
+}
+
+void Picker::pick_async(const int x, const int y, std::function<void(const PickResult&)> on_done, const int radius){
+    CHECK(radius>=0) << "The radius cannot be negative but it is " << radius;
+    if(!m_view->m_enable_id_buffers){
+        LOG(WARNING) << "Picking needs the id buffers of the gbuffer. Set visualization.enable_id_buffers in the config";
+        if(on_done){
+            on_done(PickResult());
+        }
+        return;
+    }
+
+    gl::GBuffer& gbuffer=m_view->m_gbuffer;
+    std::shared_ptr<Camera> cam=m_view->m_camera;
+
+    PickRequest request;
+    request.subsample_factor=m_view->m_subsample_factor;
+    request.gbuffer_size << gbuffer.width(), gbuffer.height();
+    request.center << (int)(x/request.subsample_factor), gbuffer.height()-1-(int)(y/request.subsample_factor); //the gbuffer starts at the bottom
+    request.radius=radius;
+    request.region_start=request.center-Eigen::Vector2i::Constant(radius);
+    request.V=cam->view_matrix();
+    request.VP_inv=(cam->proj_matrix(gbuffer.width(), gbuffer.height())*request.V).inverse();
+    request.meshes_gl_version=m_view->m_meshes_gl_version;
+
+    //copy only the region around the pixel from the gbuffer
+    int region_size=2*radius+1;
+    m_region_tex.allocate_or_resize(GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT, region_size, region_size);
+
+    GLint prev_viewport[4];
+    GLint prev_draw_fbo;
+    glGetIntegerv(GL_VIEWPORT, prev_viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fbo);
+    glDepthMask(false);
+    glDisable(GL_DEPTH_TEST);
+
+    std::shared_ptr<MeshGL> quad=m_view->m_fullscreen_quad;
+    GL_C( quad->vao.vertex_attribute(m_pick_shader, "position", quad->V_buf, 3) );
+    GL_C( quad->vao.vertex_attribute(m_pick_shader, "uv", quad->UV_buf, 2) );
+    quad->vao.indices(quad->F_buf);
+
+    GL_C( m_pick_shader.use() );
+    m_pick_shader.bind_texture(gbuffer.tex_with_name("instance_id_gtex"), "instance_id_tex");
+    m_pick_shader.bind_texture(gbuffer.tex_with_name("primitive_id_gtex"), "primitive_id_tex");
+    m_pick_shader.bind_texture(gbuffer.tex_with_name("label_gtex"), "label_tex");
+    m_pick_shader.bind_texture(gbuffer.tex_with_name("depth_gtex"), "depth_tex");
+    m_pick_shader.uniform_int(request.region_start.x(), "region_start_x");
+    m_pick_shader.uniform_int(request.region_start.y(), "region_start_y");
+    m_pick_shader.draw_into(m_region_tex, "pick_out");
+    glViewport(0, 0, region_size, region_size);
+    quad->vao.bind();
+    glDrawElements(GL_TRIANGLES, quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+
+    glDepthMask(true);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fbo);
+    glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+
+    //the request travels with the read so it's resolved with the camera of this frame
+    cv::Mat region(region_size, region_size, CV_32SC4);
+    m_readback->read(m_region_tex, GL_RGBA_INTEGER, GL_UNSIGNED_INT, region, false, [this, request, on_done](const cv::Mat& downloaded){
+        PickResult result=resolve(request, downloaded);
+        m_last_result=result;
+        if(on_done){
+            on_done(result);
+        }
+    });
+}
+
+PickResult Picker::pick(const int x, const int y, const int radius){
+    PickResult result;
+    pick_async(x, y, [&result](const PickResult& r){ result=r; }, radius);
+    finish();
+    return result;
+}
+
+void Picker::update(){
+    m_readback->process_ready();
+}
+
+void Picker::finish(){
+    m_readback->finish();
+}
+
+int Picker::nr_pending() const{
+    return m_readback->nr_pending();
+}
+
+PickResult Picker::resolve(const PickRequest& request, const cv::Mat& region){
+    PickResult result;
+
+    //the hit closest to the center of the region, the depth decides between the ones at the same distance
+    int best_dist=std::numeric_limits<int>::max();
+    float best_depth=1.0;
+    int best_row=-1;
+    int best_col=-1;
+    for(int r = 0; r < region.rows; r++){
+        for(int c = 0; c < region.cols; c++){
+            const cv::Vec4i& texel=region.at<cv::Vec4i>(r, c);
+            if(texel[0]==0){ //background
+                continue;
+            }
+            float depth_raw;
+            std::memcpy(&depth_raw, &texel[2], sizeof(float));
+            int dist=(r-request.radius)*(r-request.radius) + (c-request.radius)*(c-request.radius);
+            if(dist<best_dist || (dist==best_dist && depth_raw<best_depth)){
+                best_dist=dist;
+                best_depth=depth_raw;
+                best_row=r;
+                best_col=c;
+            }
+        }
+    }
+    if(best_row<0){
+        return result;
+    }
+
+    //a mesh got removed since the pick was asked so the instance ids now point to other meshes
+    if(request.meshes_gl_version!=m_view->m_meshes_gl_version){
+        LOG(WARNING) << "The meshes of the viewer changed before the pick finished so we discard it";
+        return result;
+    }
+    const cv::Vec4i& texel=region.at<cv::Vec4i>(best_row, best_col);
+    unsigned int instance_id=texel[0];
+    if(instance_id>m_view->m_meshes_gl.size()){
+        return result;
+    }
+    std::shared_ptr<MeshGL> mesh=m_view->m_meshes_gl[instance_id-1];
+    std::shared_ptr<Mesh> core=mesh->m_core;
+
+    //position from the depth with the camera of the frame of the pick
+    Eigen::Vector2i pixel=request.region_start+Eigen::Vector2i(best_col, best_row);
+    Eigen::Vector4f ndc;
+    ndc << (pixel.x()+0.5)/request.gbuffer_size.x()*2.0-1.0,
+           (pixel.y()+0.5)/request.gbuffer_size.y()*2.0-1.0,
+           best_depth*2.0-1.0,
+           1.0;
+    Eigen::Vector4f position_world=request.VP_inv*ndc;
+    position_world/=position_world.w();
+
+    result.hit=true;
+    result.mesh_name=core->name;
+    result.instance_id=instance_id;
+    result.position_world=position_world.head<3>().cast<double>();
+    result.depth=-(request.V*position_world).z();
+    result.pixel << (int)(pixel.x()*request.subsample_factor), (int)((request.gbuffer_size.y()-1-pixel.y())*request.subsample_factor);
+    unsigned int label=texel[3];
+    result.label= label==m_view->id_buffers_no_label() ? -1 : (int)label;
+
+    unsigned int primitive_id=texel[1];
+    if(primitive_id&POINT_BIT){
+        int vertex_idx=primitive_id&~POINT_BIT;
+        if(vertex_idx<core->V.rows()){
+            result.vertex_idx=vertex_idx;
+        }
+    }else if((int)primitive_id<core->F.rows()){
+        result.face_idx=primitive_id;
+        //the closest corner of the face, in the coordinates of the mesh
+        if(!mesh->nr_instances()){
+            Eigen::Vector3d position_obj=core->model_matrix().inverse()*result.position_world;
+            double best_vertex_dist=std::numeric_limits<double>::max();
+            for(int i = 0; i < core->F.cols(); i++){
+                int v_idx=core->F(result.face_idx, i);
+                double dist=(core->V.row(v_idx).transpose()-position_obj).squaredNorm();
+                if(dist<best_vertex_dist){
+                    best_vertex_dist=dist;
+                    result.vertex_idx=v_idx;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+} //namespace easy_pbr
@@ -0,0 +1,799 @@
+#include "easy_pbr/PointCloudOctree.h"
+
+//c++
+#include <fstream>
+#include <sstream>
+#include <queue>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+//my stuff
+#include "easy_pbr/MeshGL.h"
+#include "easy_pbr/Camera.h"
+#include "easy_pbr/Frustum.h"
+#include "easy_pbr/ThreadPool.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+//boost
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+
+namespace easy_pbr{
+
+PointCloudOctree::PointCloudOctree(const std::string octree_dir, const int nr_loader_threads):
+    m_point_budget(5000000),
+    m_min_screen_error(1.0),
+    m_max_uploads_per_frame(16),
+    m_cache_max_points(20000000),
+    m_octree_dir(octree_dir),
+    m_has_color(false),
+    m_nr_points_visible(0),
+    m_nr_points_resident(0),
+    m_loader_pool(new ThreadPool(nr_loader_threads))
+{
+    read_hierarchy(octree_dir);
+
+    m_vis.m_show_points=true;
+    m_vis.m_show_mesh=false;
+    if(m_has_color){
+        m_vis.set_color_pervertcolor();
+    }
+    name=fs::path(octree_dir).filename().string();
+}
+
+PointCloudOctree::~PointCloudOctree(){
+    m_loader_pool.reset(); //finish the tiles being read before the nodes get destroyed
+}
+
+//a point as it gets spilled to disk while building the octree. Same precision as the tiles so nothing is lost on the way
+struct SpillPoint{
+    float xyz[3];
+    uint8_t rgb[3];
+};
+
+//reads the points of a ply or pcd a chunk at a time so that convert() never has the whole cloud in memory. Only the positions and the colors are read.
+//Files it can't stream (big endian ply, compressed pcd, ply with other elements before the vertices or other formats) get loaded fully with Mesh::load_from_file and are then handed out in chunks as well
+class PointReader{
+public:
+    PointReader(const std::string path):
+        m_path(path),
+        m_is_binary(false),
+        m_record_size(0),
+        m_nr_values(0),
+        m_nr_points(0),
+        m_nr_read(0),
+        m_has_color(false),
+        m_packed_rgb(false),
+        m_idx_x(-1), m_idx_y(-1), m_idx_z(-1), m_idx_r(-1), m_idx_g(-1), m_idx_b(-1)
+    {
+        m_file.open(path, std::ios::binary);
+        CHECK(m_file.is_open()) << "Could not open point cloud " << path;
+
+        std::string ext=fs::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        bool can_stream=false;
+        if(ext==".ply"){
+            can_stream=parse_ply_header();
+        }else if(ext==".pcd"){
+            can_stream=parse_pcd_header();
+        }
+        can_stream= can_stream && m_idx_x!=-1 && m_idx_y!=-1 && m_idx_z!=-1;
+
+        if(!can_stream){
+            LOG(WARNING) << "Can't stream the points of " << path << ", reading it fully into memory instead";
+            m_file.close();
+            m_mesh=Mesh::create();
+            CHECK(m_mesh->load_from_file(path)) << "Could not read point cloud from " << path;
+            m_nr_points=m_mesh->V.rows();
+            m_has_color= m_mesh->C.rows()==m_mesh->V.rows();
+        }else{
+            m_has_color= m_packed_rgb || (m_idx_r!=-1 && m_idx_g!=-1 && m_idx_b!=-1);
+        }
+    }
+
+    //replaces the content of points with at most max_points of the next ones from the file. Returns how many were read, 0 once the file is finished
+    size_t read(std::vector<SpillPoint>& points, const size_t max_points){
+        size_t nr_to_read=std::min(max_points, m_nr_points-m_nr_read);
+        points.resize(nr_to_read);
+        if(nr_to_read==0){
+            return 0;
+        }
+
+        if(m_mesh){
+            for(size_t i = 0; i < nr_to_read; i++){
+                for(int d = 0; d < 3; d++){
+                    points[i].xyz[d]=m_mesh->V(m_nr_read+i, d);
+                    points[i].rgb[d]= m_has_color ? to_color( m_mesh->C(m_nr_read+i, d), true ) : 0;
+                }
+            }
+        }else if(m_is_binary){
+            m_buffer.resize(nr_to_read*m_record_size);
+            m_file.read(m_buffer.data(), m_buffer.size());
+            CHECK(m_file) << "The point cloud " << m_path << " is truncated";
+            for(size_t i = 0; i < nr_to_read; i++){
+                const char* record=m_buffer.data()+i*m_record_size;
+                parse_point(points[i], [&](const int idx){ return binary_value(record, m_props[idx]); }, [&](const int idx){ uint32_t v=0; std::memcpy(&v, record+m_props[idx].offset, 4); return v; } );
+            }
+        }else{
+            std::string line;
+            std::vector<double> values;
+            for(size_t i = 0; i < nr_to_read; i++){
+                //skip the empty lines
+                do{
+                    CHECK(std::getline(m_file, line)) << "The point cloud " << m_path << " is truncated";
+                }while(line.find_first_not_of(" \t\r")==std::string::npos);
+                std::istringstream line_stream(line);
+                values.clear();
+                double val;
+                while(line_stream >> val){
+                    values.push_back(val);
+                }
+                CHECK(values.size()>=m_nr_values) << "Line " << line << " of " << m_path << " has too few values";
+                parse_point(points[i], [&](const int idx){ return values[m_props[idx].value_idx]; }, [&](const int idx){
+                    //pcd stores the packed rgb as the float with the same bits, or directly as the integer
+                    if(m_props[idx].type=='f'){
+                        float f=values[m_props[idx].value_idx]; uint32_t v; std::memcpy(&v, &f, 4); return v;
+                    }
+                    return (uint32_t)values[m_props[idx].value_idx];
+                } );
+            }
+        }
+
+        m_nr_read+=nr_to_read;
+        return nr_to_read;
+    }
+
+    size_t nr_points() const { return m_nr_points; }
+    bool has_color() const { return m_has_color; }
+
+private:
+    struct Property{
+        std::string name;
+        char type; //'i' signed int, 'u' unsigned int, 'f' floating point
+        int size; //in bytes
+        int offset; //in bytes inside the binary record
+        int value_idx; //index of the value inside the line of an ascii file
+    };
+
+    bool parse_ply_header(){
+        std::string line, token;
+        std::getline(m_file, line);
+        if(line.compare(0,3,"ply")!=0){
+            return false;
+        }
+        bool in_vertex=false, seen_vertex=false;
+        while(std::getline(m_file, line)){
+            std::istringstream line_stream(line);
+            line_stream >> token;
+            if(token=="format"){
+                line_stream >> token;
+                if(token=="binary_little_endian"){
+                    m_is_binary=true;
+                }else if(token!="ascii"){
+                    return false;
+                }
+            }else if(token=="element"){
+                std::string name;
+                size_t count=0;
+                line_stream >> name >> count;
+                if(!seen_vertex && name!="vertex"){
+                    return false; //the vertices are not the first ones in the data so we would need to parse the other elements to get to them
+                }
+                in_vertex= name=="vertex";
+                if(in_vertex){
+                    seen_vertex=true;
+                    m_nr_points=count;
+                }
+            }else if(token=="property" && in_vertex){
+                std::string type, name;
+                line_stream >> type;
+                if(type=="list"){
+                    return false;
+                }
+                line_stream >> name;
+                Property prop;
+                prop.name=name;
+                if(type=="char" || type=="int8"){ prop.type='i'; prop.size=1; }
+                else if(type=="uchar" || type=="uint8"){ prop.type='u'; prop.size=1; }
+                else if(type=="short" || type=="int16"){ prop.type='i'; prop.size=2; }
+                else if(type=="ushort" || type=="uint16"){ prop.type='u'; prop.size=2; }
+                else if(type=="int" || type=="int32"){ prop.type='i'; prop.size=4; }
+                else if(type=="uint" || type=="uint32"){ prop.type='u'; prop.size=4; }
+                else if(type=="float" || type=="float32"){ prop.type='f'; prop.size=4; }
+                else if(type=="double" || type=="float64"){ prop.type='f'; prop.size=8; }
+                else{ return false; }
+                add_property(prop, 1);
+            }else if(token=="end_header"){
+                return seen_vertex;
+            }
+        }
+        return false;
+    }
+
+    bool parse_pcd_header(){
+        std::string line, token;
+        std::vector<std::string> fields, types;
+        std::vector<int> sizes, counts;
+        while(std::getline(m_file, line)){
+            std::istringstream line_stream(line);
+            if(!(line_stream >> token) || token[0]=='#'){
+                continue;
+            }
+            std::string val;
+            if(token=="FIELDS"){
+                while(line_stream >> val){ fields.push_back(val); }
+            }else if(token=="SIZE"){
+                while(line_stream >> val){ sizes.push_back(std::stoi(val)); }
+            }else if(token=="TYPE"){
+                while(line_stream >> val){ types.push_back(val); }
+            }else if(token=="COUNT"){
+                while(line_stream >> val){ counts.push_back(std::stoi(val)); }
+            }else if(token=="POINTS"){
+                line_stream >> m_nr_points;
+            }else if(token=="DATA"){
+                line_stream >> val;
+                if(val=="binary"){
+                    m_is_binary=true;
+                }else if(val!="ascii"){
+                    return false;
+                }
+                break;
+            }
+        }
+        if(fields.empty() || sizes.size()!=fields.size() || types.size()!=fields.size()){
+            return false;
+        }
+        for(size_t i = 0; i < fields.size(); i++){
+            Property prop;
+            prop.name=fields[i];
+            prop.type= types[i]=="F" ? 'f' : (types[i]=="U" ? 'u' : 'i');
+            prop.size=sizes[i];
+            add_property(prop, counts.size()==fields.size() ? counts[i] : 1);
+        }
+        return true;
+    }
+
+    void add_property(Property prop, const int count){
+        int idx=m_props.size();
+        if(prop.name=="x"){ m_idx_x=idx; }
+        else if(prop.name=="y"){ m_idx_y=idx; }
+        else if(prop.name=="z"){ m_idx_z=idx; }
+        else if(prop.name=="red"){ m_idx_r=idx; }
+        else if(prop.name=="green"){ m_idx_g=idx; }
+        else if(prop.name=="blue"){ m_idx_b=idx; }
+        else if( (prop.name=="rgb" || prop.name=="rgba") && prop.size==4 ){ m_idx_r=idx; m_packed_rgb=true; }
+        prop.offset=m_record_size;
+        prop.value_idx=m_nr_values;
+        m_props.push_back(prop);
+        m_record_size+=prop.size*count;
+        m_nr_values+=count;
+    }
+
+    template <class T>
+    static double read_as(const char* ptr){
+        T val;
+        std::memcpy(&val, ptr, sizeof(T));
+        return val;
+    }
+
+    static double binary_value(const char* record, const Property& prop){
+        const char* ptr=record+prop.offset;
+        if(prop.type=='f'){
+            return prop.size==4 ? read_as<float>(ptr) : read_as<double>(ptr);
+        }else if(prop.type=='u'){
+            switch(prop.size){
+                case 1: return read_as<uint8_t>(ptr);
+                case 2: return read_as<uint16_t>(ptr);
+                case 4: return read_as<uint32_t>(ptr);
+                default: return read_as<uint64_t>(ptr);
+            }
+        }else{
+            switch(prop.size){
+                case 1: return read_as<int8_t>(ptr);
+                case 2: return read_as<int16_t>(ptr);
+                case 4: return read_as<int32_t>(ptr);
+                default: return read_as<int64_t>(ptr);
+            }
+        }
+    }
+
+    static uint8_t to_color(const double val, const bool is_normalized){
+        return std::round( std::min(std::max( is_normalized ? val*255.0 : val, 0.0), 255.0) );
+    }
+
+    template <class ValueFunc, class PackedFunc>
+    void parse_point(SpillPoint& point, ValueFunc value, PackedFunc packed){
+        point.xyz[0]=value(m_idx_x);
+        point.xyz[1]=value(m_idx_y);
+        point.xyz[2]=value(m_idx_z);
+        if(!m_has_color){
+            point.rgb[0]=point.rgb[1]=point.rgb[2]=0;
+        }else if(m_packed_rgb){
+            uint32_t rgb=packed(m_idx_r);
+            point.rgb[0]=(rgb>>16)&0xff;
+            point.rgb[1]=(rgb>>8)&0xff;
+            point.rgb[2]=rgb&0xff;
+        }else{
+            //colors stored as floats are in [0,1], the integer ones in [0,255]
+            point.rgb[0]=to_color( value(m_idx_r), m_props[m_idx_r].type=='f' );
+            point.rgb[1]=to_color( value(m_idx_g), m_props[m_idx_g].type=='f' );
+            point.rgb[2]=to_color( value(m_idx_b), m_props[m_idx_b].type=='f' );
+        }
+    }
+
+    std::string m_path;
+    std::ifstream m_file;
+    bool m_is_binary;
+    std::vector<Property> m_props;
+    int m_record_size;
+    size_t m_nr_values;
+    size_t m_nr_points;
+    size_t m_nr_read;
+    bool m_has_color;
+    bool m_packed_rgb;
+    int m_idx_x, m_idx_y, m_idx_z, m_idx_r, m_idx_g, m_idx_b;
+    std::vector<char> m_buffer;
+    std::shared_ptr<Mesh> m_mesh; //only used for the files that can't be streamed
+};
+
+//writes the tile of one node while its points stream through. The file has all the positions before all the colors so the colors wait in a side file until finish()
+class NodeWriter{
+public:
+    NodeWriter(const std::string path, const bool has_color):
+        m_path(path),
+        m_has_color(has_color),
+        m_nr_points(0)
+    {
+        m_file.open(path, std::ios::binary);
+        CHECK(m_file.is_open()) << "Could not open for writing " << path;
+        int32_t nr_points=0;
+        uint8_t has_color_byte=has_color;
+        m_file.write( (const char*)&nr_points, sizeof(nr_points) ); //gets overwritten in finish() once we know how many there are
+        m_file.write( (const char*)&has_color_byte, sizeof(has_color_byte) );
+        if(has_color){
+            m_rgb_file.open(path+".rgb", std::ios::binary);
+            CHECK(m_rgb_file.is_open()) << "Could not open for writing " << path+".rgb";
+        }
+    }
+
+    void add(const SpillPoint& point){
+        m_file.write( (const char*)point.xyz, sizeof(point.xyz) );
+        if(m_has_color){
+            m_rgb_file.write( (const char*)point.rgb, sizeof(point.rgb) );
+        }
+        m_nr_points++;
+    }
+
+    int finish(){
+        if(m_has_color){
+            m_rgb_file.close();
+            std::ifstream rgb_file(m_path+".rgb", std::ios::binary);
+            if(m_nr_points>0){ //inserting an empty buffer would set the failbit
+                m_file << rgb_file.rdbuf();
+            }
+            rgb_file.close();
+            fs::remove(m_path+".rgb");
+        }
+        m_file.seekp(0);
+        m_file.write( (const char*)&m_nr_points, sizeof(m_nr_points) );
+        m_file.close();
+        CHECK(m_file) << "Could not write octree node " << m_path;
+        return m_nr_points;
+    }
+
+private:
+    std::string m_path;
+    bool m_has_color;
+    int32_t m_nr_points;
+    std::ofstream m_file;
+    std::ofstream m_rgb_file;
+};
+
+void PointCloudOctree::convert(const std::string input_path, const std::string output_dir, const int max_points_per_node, const int grid_resolution, const int max_depth){
+    CHECK(max_points_per_node>0) << "max_points_per_node should be positive";
+    CHECK(grid_resolution>0) << "grid_resolution should be positive";
+
+    //the cloud is never fully in memory. It gets read in chunks and the points of each node wait in spill files on disk until that node is processed
+    const size_t chunk_size=1000000;
+    fs::create_directories(output_dir);
+    fs::path spill_dir=fs::path(output_dir)/"tmp";
+    fs::create_directories(spill_dir);
+    std::vector<SpillPoint> chunk;
+
+    //first pass finds the bounding box. The root is a cube so all the nodes are cubes too
+    Eigen::Vector3d root_min=Eigen::Vector3d::Constant( std::numeric_limits<double>::max() );
+    Eigen::Vector3d root_max=Eigen::Vector3d::Constant( std::numeric_limits<double>::lowest() );
+    size_t nr_points=0;
+    bool has_color=false;
+    {
+        PointReader reader(input_path);
+        has_color=reader.has_color();
+        while(reader.read(chunk, chunk_size)>0){
+            for(size_t i = 0; i < chunk.size(); i++){
+                Eigen::Vector3d p( chunk[i].xyz[0], chunk[i].xyz[1], chunk[i].xyz[2] );
+                root_min=root_min.cwiseMin(p);
+                root_max=root_max.cwiseMax(p);
+            }
+            nr_points+=chunk.size();
+        }
+    }
+    CHECK(nr_points>0) << "The point cloud in " << input_path << " is empty";
+    double root_size=(root_max-root_min).maxCoeff();
+    root_size=std::max(root_size, 1e-6);
+
+    //second pass shuffles the points so that the subsample of each node is spread uniformly and not biased by the scan order of the file. The points get scattered into random buckets on disk, each bucket is small enough to be shuffled in memory and then they are concatenated into the spill file of the root
+    std::mt19937 rng(0);
+    const int nr_buckets=std::min<size_t>( std::max<size_t>(1, (nr_points+chunk_size-1)/chunk_size), 256); //bounded so we don't run out of file handles
+    std::string root_spill_path=(spill_dir/"r.spill").string();
+    {
+        std::vector<std::ofstream> buckets(nr_buckets);
+        for(int b = 0; b < nr_buckets; b++){
+            buckets[b].open( (spill_dir/("bucket_"+std::to_string(b)+".spill")).string(), std::ios::binary );
+            CHECK(buckets[b].is_open()) << "Could not open spill file in " << spill_dir.string();
+        }
+        std::uniform_int_distribution<int> bucket_distrib(0, nr_buckets-1);
+        PointReader reader(input_path);
+        while(reader.read(chunk, chunk_size)>0){
+            for(size_t i = 0; i < chunk.size(); i++){
+                buckets[bucket_distrib(rng)].write( (const char*)&chunk[i], sizeof(SpillPoint) );
+            }
+        }
+    }
+    {
+        std::ofstream root_spill(root_spill_path, std::ios::binary);
+        CHECK(root_spill.is_open()) << "Could not open for writing " << root_spill_path;
+        for(int b = 0; b < nr_buckets; b++){
+            std::string bucket_path=(spill_dir/("bucket_"+std::to_string(b)+".spill")).string();
+            chunk.resize( fs::file_size(bucket_path)/sizeof(SpillPoint) );
+            std::ifstream bucket(bucket_path, std::ios::binary);
+            bucket.read( (char*)chunk.data(), chunk.size()*sizeof(SpillPoint) );
+            CHECK(bucket) << "Could not read spill file " << bucket_path;
+            bucket.close();
+            std::shuffle(chunk.begin(), chunk.end(), rng);
+            root_spill.write( (const char*)chunk.data(), chunk.size()*sizeof(SpillPoint) );
+            fs::remove(bucket_path);
+        }
+        CHECK(root_spill) << "Could not write spill file " << root_spill_path;
+    }
+
+    struct Task{
+        std::string name;
+        std::string spill_path;
+        size_t nr_points;
+        Eigen::Vector3d min;
+        double size;
+        int depth;
+    };
+    std::vector<Task> tasks;
+    tasks.push_back( Task{"r", root_spill_path, nr_points, root_min, root_size, 0} );
+
+    std::stringstream hierarchy;
+    int nr_nodes=0;
+    while(!tasks.empty()){
+        Task task=std::move(tasks.back());
+        tasks.pop_back();
+
+        NodeWriter node_writer( (fs::path(output_dir)/(task.name+".bin")).string(), has_color );
+        std::ofstream child_spills[8];
+        size_t child_nr_points[8]={0};
+        bool is_leaf= task.nr_points<=(size_t)max_points_per_node || task.depth>=max_depth;
+        std::unordered_set<int64_t> occupied_cells; //at most grid_resolution^3 so it stays bounded no matter how many points go through this node
+
+        std::ifstream spill(task.spill_path, std::ios::binary);
+        CHECK(spill.is_open()) << "Could not open spill file " << task.spill_path;
+        size_t nr_left=task.nr_points;
+        while(nr_left>0){
+            chunk.resize( std::min(nr_left, chunk_size) );
+            spill.read( (char*)chunk.data(), chunk.size()*sizeof(SpillPoint) );
+            CHECK(spill) << "Could not read spill file " << task.spill_path;
+            nr_left-=chunk.size();
+
+            for(size_t i = 0; i < chunk.size(); i++){
+                const SpillPoint& point=chunk[i];
+                if(is_leaf){
+                    node_writer.add(point);
+                    continue;
+                }
+                //keep the first point that falls in each cell of the grid, the rest go to the children
+                Eigen::Vector3d rel=(Eigen::Vector3d(point.xyz[0], point.xyz[1], point.xyz[2])-task.min)/task.size;
+                int64_t gx=std::min(std::max( (int)(rel.x()*grid_resolution), 0), grid_resolution-1);
+                int64_t gy=std::min(std::max( (int)(rel.y()*grid_resolution), 0), grid_resolution-1);
+                int64_t gz=std::min(std::max( (int)(rel.z()*grid_resolution), 0), grid_resolution-1);
+                int64_t cell=(gx*grid_resolution + gy)*grid_resolution + gz;
+                if(occupied_cells.insert(cell).second){
+                    node_writer.add(point);
+                }else{
+                    int octant= (rel.x()>=0.5) | (rel.y()>=0.5)<<1 | (rel.z()>=0.5)<<2;
+                    if(!child_spills[octant].is_open()){
+                        std::string child_spill_path=(spill_dir/(task.name+std::to_string(octant)+".spill")).string();
+                        child_spills[octant].open(child_spill_path, std::ios::binary);
+                        CHECK(child_spills[octant].is_open()) << "Could not open for writing " << child_spill_path;
+                    }
+                    child_spills[octant].write( (const char*)&point, sizeof(SpillPoint) );
+                    child_nr_points[octant]++;
+                }
+            }
+        }
+        spill.close();
+        fs::remove(task.spill_path);
+
+        int nr_kept=node_writer.finish();
+        hierarchy << task.name << " " << nr_kept << " " << task.size/grid_resolution << "\n";
+        nr_nodes++;
+
+        for(int c = 0; c < 8; c++){
+            if(child_nr_points[c]==0){
+                continue;
+            }
+            child_spills[c].close();
+            CHECK(child_spills[c]) << "Could not write spill file for child " << c << " of node " << task.name;
+            double child_size=task.size/2;
+            Eigen::Vector3d child_min=task.min + Eigen::Vector3d( c&1, (c>>1)&1, (c>>2)&1 )*child_size;
+            std::string child_name=task.name+std::to_string(c);
+            tasks.push_back( Task{child_name, (spill_dir/(child_name+".spill")).string(), child_nr_points[c], child_min, child_size, task.depth+1} );
+        }
+    }
+    fs::remove_all(spill_dir);
+
+    //the hierarchy is written in depth first order so the parents always come before the children
+    std::ofstream file( (fs::path(output_dir)/"hierarchy.txt").string() );
+    CHECK(file.is_open()) << "Could not open for writing " << (fs::path(output_dir)/"hierarchy.txt").string();
+    file << "easypbr_octree 1\n";
+    file << "bbox " << root_min.x() << " " << root_min.y() << " " << root_min.z() << " " << root_size << "\n";
+    file << "has_color " << (has_color ? 1 : 0) << "\n";
+    file << "nr_nodes " << nr_nodes << "\n";
+    file << hierarchy.str();
+
+    VLOG(1) << "Converted " << input_path << " with " << nr_points << " points into an octree with " << nr_nodes << " nodes in " << output_dir;
+}
+
+void PointCloudOctree::update(const std::shared_ptr<Camera>& cam, const Eigen::Vector2f& viewport_size){
+
+    //move the tiles that finished reading to the gpu
+    int nr_uploads=0;
+    for(size_t i = 0; i < m_nodes.size() && nr_uploads<m_max_uploads_per_frame; i++){
+        Node& node=m_nodes[i];
+        if(!node.pending.valid() || node.pending.wait_for(std::chrono::seconds(0))!=std::future_status::ready){
+            continue;
+        }
+        std::shared_ptr<Mesh> mesh=node.pending.get();
+        node.pending=std::shared_future< std::shared_ptr<Mesh> >();
+        if(!mesh){
+            LOG(ERROR) << "Could not read the tile of octree node " << node.name << " from " << m_octree_dir << ", it is missing or truncated. Skipping the node and its children";
+            node.failed=true;
+            continue;
+        }
+        mesh->m_vis=m_vis;
+        std::shared_ptr<MeshGL> mesh_gl=MeshGL::create();
+        mesh_gl->assign_core(mesh);
+        mesh_gl->upload_to_gpu();
+        node.mesh_gl=mesh_gl;
+        m_nr_points_resident+=node.nr_points;
+        nr_uploads++;
+    }
+
+    //select the nodes, the ones with the biggest screen-space error get refined first
+    Frustum frustum=cam->frustum(viewport_size);
+    Eigen::Vector3f cam_pos=cam->position();
+    float pixels_per_unit=viewport_size.x() / (2.0*std::tan(0.5*cam->m_fov*M_PI/180.0)); //at a distance of 1 from the camera
+
+    auto screen_error=[&](const Node& node){
+        Eigen::Vector3f closest=cam_pos.cwiseMax(node.min).cwiseMin(node.max);
+        float dist=std::max( (closest-cam_pos).norm(), 1e-4f );
+        return node.spacing*pixels_per_unit/dist;
+    };
+
+    std::vector<bool> is_needed(m_nodes.size(), false);
+    std::priority_queue< std::pair<float,int> > queue;
+    m_visible_nodes.clear();
+    m_nr_points_visible=0;
+    if(!m_nodes.empty() && frustum.intersects_aabb(m_nodes[0].min, m_nodes[0].max)){
+        queue.push( {screen_error(m_nodes[0]), 0} );
+    }
+    while(!queue.empty()){
+        int idx=queue.top().second;
+        queue.pop();
+        Node& node=m_nodes[idx];
+        if(node.failed){
+            continue;
+        }
+        if(m_nr_points_visible+node.nr_points > m_point_budget){
+            break;
+        }
+
+        is_needed[idx]=true;
+        touch(idx);
+        if(!node.mesh_gl){
+            if(!node.pending.valid()){
+                std::string path=(fs::path(m_octree_dir)/(node.name+".bin")).string();
+                node.pending=m_loader_pool->enqueue( [this, path](){ return read_node(path); } ).share();
+            }
+            continue; //the children only add points on top of this node so there is no point in going further until this one is loaded
+        }
+
+        node.mesh_gl->m_core->m_vis=m_vis;
+        m_visible_nodes.push_back(idx);
+        m_nr_points_visible+=node.nr_points;
+
+        for(int c = 0; c < 8; c++){
+            int child_idx=node.children[c];
+            if(child_idx==-1){
+                continue;
+            }
+            const Node& child=m_nodes[child_idx];
+            if(!frustum.intersects_aabb(child.min, child.max)){
+                continue;
+            }
+            float error=screen_error(child);
+            if(error>m_min_screen_error){
+                queue.push( {error, child_idx} );
+            }
+        }
+    }
+
+    evict(is_needed);
+}
+
+std::vector< std::shared_ptr<MeshGL> > PointCloudOctree::visible_nodes(){
+    std::vector< std::shared_ptr<MeshGL> > meshes;
+    meshes.reserve(m_visible_nodes.size());
+    for(size_t i = 0; i < m_visible_nodes.size(); i++){
+        meshes.push_back( m_nodes[m_visible_nodes[i]].mesh_gl );
+    }
+    return meshes;
+}
+
+int PointCloudOctree::nr_nodes(){
+    return m_nodes.size();
+}
+
+int PointCloudOctree::nr_nodes_resident(){
+    int nr=0;
+    for(size_t i = 0; i < m_nodes.size(); i++){
+        if(m_nodes[i].mesh_gl){
+            nr++;
+        }
+    }
+    return nr;
+}
+
+int PointCloudOctree::nr_points_visible(){
+    return m_nr_points_visible;
+}
+
+Eigen::Vector3f PointCloudOctree::bbox_min(){
+    CHECK(!m_nodes.empty()) << "The octree has no nodes";
+    return m_nodes[0].min;
+}
+
+Eigen::Vector3f PointCloudOctree::bbox_max(){
+    CHECK(!m_nodes.empty()) << "The octree has no nodes";
+    return m_nodes[0].max;
+}
+
+void PointCloudOctree::read_hierarchy(const std::string octree_dir){
+    std::string path=(fs::path(octree_dir)/"hierarchy.txt").string();
+    std::ifstream file(path);
+    CHECK(file.is_open()) << "Could not open octree hierarchy " << path << ". Did you create it with PointCloudOctree.convert()?";
+
+    std::string token;
+    int version=0;
+    file >> token >> version;
+    CHECK(token=="easypbr_octree" && version==1) << "The file " << path << " is not an octree hierarchy we can read";
+    Eigen::Vector3f root_min;
+    float root_size;
+    int has_color, nr_nodes;
+    file >> token >> root_min.x() >> root_min.y() >> root_min.z() >> root_size;
+    file >> token >> has_color;
+    file >> token >> nr_nodes;
+    m_has_color=has_color;
+
+    std::unordered_map<std::string, int> name2idx;
+    m_nodes.resize(nr_nodes);
+    for(int i = 0; i < nr_nodes; i++){
+        Node& node=m_nodes[i];
+        file >> node.name >> node.nr_points >> node.spacing;
+        CHECK(file) << "Could not read node " << i << " from " << path;
+
+        //the bounding box follows from the path of octants from the root
+        node.min=root_min;
+        float size=root_size;
+        for(size_t c = 1; c < node.name.size(); c++){
+            int octant=node.name[c]-'0';
+            size/=2;
+            node.min+=Eigen::Vector3f( octant&1, (octant>>1)&1, (octant>>2)&1 )*size;
+        }
+        node.max=node.min+Eigen::Vector3f::Constant(size);
+
+        std::fill(node.children, node.children+8, -1);
+        node.parent=-1;
+        node.in_lru=false;
+        node.failed=false;
+        if(node.name.size()>1){
+            std::string parent_name=node.name.substr(0, node.name.size()-1);
+            auto got=name2idx.find(parent_name);
+            CHECK(got!=name2idx.end()) << "Node " << node.name << " comes before its parent in " << path;
+            node.parent=got->second;
+            m_nodes[node.parent].children[node.name.back()-'0']=i;
+        }
+        name2idx[node.name]=i;
+    }
+
+    VLOG(1) << "Read octree from " << octree_dir << " with " << m_nodes.size() << " nodes";
+}
+
+std::shared_ptr<Mesh> PointCloudOctree::read_node(const std::string path){
+    //runs on the loader threads so it doesn't abort on a bad tile, it returns nullptr and update() skips the node
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()){
+        return nullptr;
+    }
+
+    int32_t nr_points=0;
+    uint8_t has_color=0;
+    file.read( (char*)&nr_points, sizeof(nr_points) );
+    file.read( (char*)&has_color, sizeof(has_color) );
+    if(!file || nr_points<0){
+        return nullptr;
+    }
+    std::vector<float> xyz(nr_points*3);
+    file.read( (char*)xyz.data(), xyz.size()*sizeof(float) );
+    std::vector<uint8_t> rgb;
+    if(has_color){
+        rgb.resize(nr_points*3);
+        file.read( (char*)rgb.data(), rgb.size() );
+    }
+    if(!file){ //truncated
+        return nullptr;
+    }
+
+    std::shared_ptr<Mesh> mesh=Mesh::create();
+    mesh->V=Eigen::Map< Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> >(xyz.data(), nr_points, 3).cast<double>();
+    if(has_color){
+        mesh->C=Eigen::Map< Eigen::Matrix<uint8_t, Eigen::Dynamic, 3, Eigen::RowMajor> >(rgb.data(), nr_points, 3).cast<double>()/255.0;
+    }
+    mesh->name=fs::path(path).stem().string();
+    mesh->m_is_dirty=true;
+
+    return mesh;
+}
+
+void PointCloudOctree::touch(const int node_idx){
+    Node& node=m_nodes[node_idx];
+    if(node.in_lru){
+        m_lru.erase(node.lru_it);
+    }
+    m_lru.push_front(node_idx);
+    node.lru_it=m_lru.begin();
+    node.in_lru=true;
+}
+
+void PointCloudOctree::evict(const std::vector<bool>& is_needed){
+    //the nodes needed for this frame were just touched so they are all at the front of the list
+    while(!m_lru.empty() && m_nr_points_resident>m_cache_max_points){
+        int idx=m_lru.back();
+        if(is_needed[idx]){
+            break;
+        }
+        Node& node=m_nodes[idx];
+        if(node.mesh_gl){
+            node.mesh_gl.reset();
+            m_nr_points_resident-=node.nr_points;
+        }
+        node.pending=std::shared_future< std::shared_ptr<Mesh> >(); //if it's still being read we just drop the result
+        m_lru.pop_back();
+        node.in_lru=false;
+    }
+}
+
+
+} //namespace easy_pbr
@@ -11,6 +11,7 @@
 // #include "pybind11_tests.h"
 // #include "constructor_stats.h"
 #include <pybind11/operators.h>
+#include <pybind11/functional.h>
 #include <functional>
 
 //my stuff 
@@ -20,6 +21,10 @@
 #include "easy_pbr/Scene.h"
 #include "easy_pbr/LabelMngr.h"
 #include "easy_pbr/Recorder.h"
+#include "easy_pbr/Picker.h"
+#include "easy_pbr/Tracer.h"
+#include "easy_pbr/MeshLoader.h"
+#include "easy_pbr/PointCloudOctree.h"
 #include "easy_pbr/Camera.h"
 #include "easy_pbr/SpotLight.h"
 #include "easy_pbr/Frame.h"
@@ -95,7 +100,21 @@ void eigen_affine_bindings(py::module &m, const std::string typestr) {
 
 PYBIND11_MODULE(easypbr, m) {
 
-    py::class_<cv::Mat> (m, "Mat")
+    //exposes the memory of the mat so numpy can view it without copying with np.array(mat, copy=False)
+    py::class_<cv::Mat> (m, "Mat", py::buffer_protocol())
+    .def_buffer([](cv::Mat& mat) -> py::buffer_info {
+        std::string format;
+        switch(mat.depth()){
+            case CV_8U: format=py::format_descriptor<unsigned char>::format(); break;
+            case CV_16U: format=py::format_descriptor<unsigned short>::format(); break;
+            case CV_32S: format=py::format_descriptor<int>::format(); break;
+            case CV_32F: format=py::format_descriptor<float>::format(); break;
+            default: throw std::runtime_error("Mat depth "+std::to_string(mat.depth())+" cannot be exposed as a buffer");
+        }
+        return py::buffer_info(mat.data, mat.elemSize1(), format, 3,
+                               { (size_t)mat.rows, (size_t)mat.cols, (size_t)mat.channels() },
+                               { mat.step[0], mat.elemSize(), mat.elemSize1() });
+    })
     .def_readonly("rows", &cv::Mat::rows )
     .def_readonly("cols", &cv::Mat::cols )
     // .def("rows", [](const cv::Mat &m) {  return m.rows;  }  )
@@ -226,22 +245,66 @@ PYBIND11_MODULE(easypbr, m) {
         m.def("cuda_clear_cache", &cuda_clear_cache);
     #endif
  
+    //BatchRenderOutputs
+    py::class_<BatchRenderOutputs> (m, "BatchRenderOutputs")
+    .def(py::init<>())
+    .def("allocate", &BatchRenderOutputs::allocate, py::arg("nr_images"), py::arg("width"), py::arg("height"), py::arg("with_color")=true, py::arg("with_depth")=false, py::arg("with_normals")=false )
+    .def_readonly("color", &BatchRenderOutputs::color )
+    .def_readonly("depth", &BatchRenderOutputs::depth )
+    .def_readonly("normals", &BatchRenderOutputs::normals )
+    ;
+
     //Viewer
     py::class_<Viewer, std::shared_ptr<Viewer>> (m, "Viewer")
     // .def(py::init<const std::string>())
     .def_static("create",  &Viewer::create<const std::string>, py::arg("config_file") = DEFAULT_CONFIG ) //for templated methods like this one we need to explicitly instantiate one of the arguments
     .def("update", &Viewer::update, py::arg("fbo_id") = 0)
+    .def("is_headless", &Viewer::is_headless )
     .def("draw", &Viewer::draw, py::arg("fbo_id") = 0)
+    .def("render_batch", &Viewer::render_batch, py::arg("poses"), py::arg("intrinsics"), py::arg("outputs") )
+    .def("pick", &Viewer::pick, py::arg("x"), py::arg("y"), py::arg("radius") = 0 )
+    .def("pick_async", &Viewer::pick_async, py::arg("x"), py::arg("y"), py::arg("on_done"), py::arg("radius") = 0 )
     .def("load_environment_map", &Viewer::load_environment_map )
+    .def("add_point_cloud_octree", &Viewer::add_point_cloud_octree )
     .def("spotlight_with_idx", &Viewer::spotlight_with_idx )
     .def_readwrite("m_kernel_radius", &Viewer::m_kernel_radius )
+    .def_readwrite("m_ssao_use_compute", &Viewer::m_ssao_use_compute )
+    .def_readwrite("m_bloom_dual_filter", &Viewer::m_bloom_dual_filter )
+    .def_readwrite("m_use_irradiance_sh", &Viewer::m_use_irradiance_sh )
+    .def_readonly("m_irradiance_sh", &Viewer::m_irradiance_sh )
+    .def_readwrite("m_bloom_dual_filter_offset", &Viewer::m_bloom_dual_filter_offset )
+    .def_readwrite("m_ssao_temporal", &Viewer::m_ssao_temporal )
+    .def_readwrite("m_ssao_temporal_nr_samples", &Viewer::m_ssao_temporal_nr_samples )
+    .def_readwrite("m_ssao_temporal_max_frames", &Viewer::m_ssao_temporal_max_frames )
+    .def_readwrite("m_ssao_temporal_max_frames_static", &Viewer::m_ssao_temporal_max_frames_static )
+    .def_readonly("m_ssao_nr_accumulated_frames", &Viewer::m_ssao_nr_accumulated_frames )
+    .def("gpu_time_ms", &Viewer::gpu_time_ms )
     .def_readwrite("m_enable_culling", &Viewer::m_enable_culling )
+    .def_readwrite("m_enable_frustum_culling", &Viewer::m_enable_frustum_culling )
+    .def_readonly("m_nr_meshes_drawn", &Viewer::m_nr_meshes_drawn )
+    .def_readonly("m_nr_meshes_culled", &Viewer::m_nr_meshes_culled )
+    .def_readonly("m_nr_triangles_drawn", &Viewer::m_nr_triangles_drawn )
+    .def_readonly("m_nr_triangles_culled", &Viewer::m_nr_triangles_culled )
+    .def_readonly("m_nr_shadow_passes_skipped", &Viewer::m_nr_shadow_passes_skipped )
+    .def_readonly("m_nr_static_shadow_passes", &Viewer::m_nr_static_shadow_passes )
+    .def_readonly("m_nr_dynamic_shadow_passes", &Viewer::m_nr_dynamic_shadow_passes )
+    .def_readonly("m_nr_shadow_draw_calls", &Viewer::m_nr_shadow_draw_calls )
+    .def_readwrite("m_enable_layered_shadow_maps", &Viewer::m_enable_layered_shadow_maps )
+    .def_readwrite("m_layered_shadow_map_max_resolution", &Viewer::m_layered_shadow_map_max_resolution )
+    .def_readwrite("m_enable_mesh_batching", &Viewer::m_enable_mesh_batching )
+    .def_readwrite("m_mesh_batching_max_nr_vertices", &Viewer::m_mesh_batching_max_nr_vertices )
+    .def_readonly("m_nr_batched_draws", &Viewer::m_nr_batched_draws )
+    .def_readonly("m_enable_id_buffers", &Viewer::m_enable_id_buffers )
+    .def_readonly("m_id_buffers_32bit", &Viewer::m_id_buffers_32bit )
+    .def_readwrite("m_id_buffers_label_from_gt", &Viewer::m_id_buffers_label_from_gt )
+    .def("id_buffers_no_label", &Viewer::id_buffers_no_label )
     .def_readwrite("m_enable_edl_lighting", &Viewer::m_enable_edl_lighting )
     // .def("print_pointers", &Viewer::print_pointers )
     // .def("set_position", &Viewer::set_position )
     // .def("check_position", &Viewer::check_position )
     .def_readwrite("m_camera", &Viewer::m_camera )
     .def_readwrite("m_recorder", &Viewer::m_recorder )
+    .def_readwrite("m_mesh_loader", &Viewer::m_mesh_loader )
     .def_readwrite("m_viewport_size", &Viewer::m_viewport_size )
     .def_readwrite("m_nr_drawn_frames", &Viewer::m_nr_drawn_frames )
     ;
@@ -269,6 +332,8 @@ PYBIND11_MODULE(easypbr, m) {
     .def("set_position", &Camera::set_position )
     .def("set_lookat", &Camera::set_lookat )
     .def("set_dist_to_lookat", &Camera::set_dist_to_lookat )
+    .def("set_intrinsics", &Camera::set_intrinsics )
+    .def("clear_intrinsics", &Camera::clear_intrinsics )
     .def("push_away", &Camera::push_away )
     .def("push_away_by_dist", &Camera::push_away_by_dist )
     .def("orbit_y", &Camera::orbit_y )
@@ -301,6 +366,7 @@ PYBIND11_MODULE(easypbr, m) {
     .def_static("get_mesh_with_idx",  &Scene::get_mesh_with_idx )
     .def_static("does_mesh_with_name_exist",  &Scene::does_mesh_with_name_exist)
     .def_static("add_mesh",  &Scene::add_mesh)
+    .def_static("add_instances",  &Scene::add_instances, py::arg("mesh"), py::arg("name"), py::arg("transforms"), py::arg("colors") = Eigen::MatrixXd() )
     .def_static("set_floor_visible",  &Scene::set_floor_visible)
     .def_static("nr_meshes",  &Scene::nr_meshes)
     ;
@@ -371,6 +437,7 @@ PYBIND11_MODULE(easypbr, m) {
     .def_readwrite("m_vis", &Mesh::m_vis)
     .def_readwrite("m_force_vis_update", &Mesh::m_force_vis_update)
     .def_readwrite("m_is_dirty", &Mesh::m_is_dirty)
+    .def_readwrite("m_is_dynamic", &Mesh::m_is_dynamic)
     .def_readwrite("V", &Mesh::V)
     .def_readwrite("F", &Mesh::F)
     .def_readwrite("C", &Mesh::C)
@@ -444,13 +511,97 @@ PYBIND11_MODULE(easypbr, m) {
     .def("set_roughness_tex", py::overload_cast<const cv::Mat&, const int > (&Mesh::set_roughness_tex), py::arg().noconvert(),  py::arg("subsample") = 1  )
     .def("set_gloss_tex", py::overload_cast<const cv::Mat&, const int > (&Mesh::set_gloss_tex), py::arg().noconvert(),  py::arg("subsample") = 1  )
     .def("set_normals_tex", py::overload_cast<const cv::Mat&, const int > (&Mesh::set_normals_tex), py::arg().noconvert(),  py::arg("subsample") = 1  )
+    .def("is_any_texture_pending", &Mesh::is_any_texture_pending )
+    .def("world_aabb_min", [](Mesh &m, const bool include_children) {  return m.world_aabb(include_children).min();  }, py::arg("include_children") = true )
+    .def("world_aabb_max", [](Mesh &m, const bool include_children) {  return m.world_aabb(include_children).max();  }, py::arg("include_children") = true )
+    .def("world_bounding_sphere", &Mesh::world_bounding_sphere, py::arg("include_children") = true )
+    .def("invalidate_bounds", &Mesh::invalidate_bounds )
+    .def("set_instances", &Mesh::set_instances, py::arg("transforms"), py::arg("colors") = Eigen::MatrixXd() )
+    .def("clear_instances", &Mesh::clear_instances )
+    .def("nr_instances", &Mesh::nr_instances )
+    .def("wait_for_textures", &Mesh::wait_for_textures, py::call_guard<py::gil_scoped_release>() )
+    ;
+
+    //Picker
+    py::class_<PickResult> (m, "PickResult")
+    .def_readonly("hit", &PickResult::hit )
+    .def_readonly("mesh_name", &PickResult::mesh_name )
+    .def_readonly("instance_id", &PickResult::instance_id )
+    .def_readonly("face_idx", &PickResult::face_idx )
+    .def_readonly("vertex_idx", &PickResult::vertex_idx )
+    .def_readonly("label", &PickResult::label )
+    .def_readonly("position_world", &PickResult::position_world )
+    .def_readonly("depth", &PickResult::depth )
+    .def_readonly("pixel", &PickResult::pixel )
     ;
 
     //Recorder
+    py::class_<RecorderStats> (m, "RecorderStats")
+    .def_readonly("queue_depth", &RecorderStats::queue_depth )
+    .def_readonly("max_queue_depth", &RecorderStats::max_queue_depth )
+    .def_readonly("nr_written", &RecorderStats::nr_written )
+    .def_readonly("nr_dropped", &RecorderStats::nr_dropped )
+    .def_readonly("avg_encode_ms", &RecorderStats::avg_encode_ms )
+    .def_readonly("max_encode_ms", &RecorderStats::max_encode_ms )
+    ;
     py::class_<Recorder, std::shared_ptr<Recorder>> (m, "Recorder")
     // .def(py::init<>())
     .def("record", py::overload_cast<const std::string, const std::string >(&Recorder::record) )
     .def("snapshot", py::overload_cast<const std::string, const std::string >(&Recorder::snapshot) )
+    .def("flush", &Recorder::flush, py::call_guard<py::gil_scoped_release>() )
+    .def("stats", &Recorder::stats )
+    .def("start_recording", &Recorder::start_recording )
+    .def("stop_recording", &Recorder::stop_recording, py::call_guard<py::gil_scoped_release>() )
+    .def_property("format", [](Recorder &r) { return std::string(r.m_format._to_string()); }, [](Recorder &r, const std::string& format) { r.m_format=RecorderFormat::_from_string(format.c_str()); } )
+    .def_readwrite("png_compression", &Recorder::m_png_compression )
+    .def_readwrite("video_fps", &Recorder::m_video_fps )
+    .def_readwrite("video_codec", &Recorder::m_video_codec )
+    .def_readwrite("video_name", &Recorder::m_video_name )
+    .def("export_frame", &Recorder::export_frame )
+    .def_readwrite("export_enabled", &Recorder::m_export_enabled )
+    .def_property("export_format", [](Recorder &r) { return std::string(r.m_export_format._to_string()); }, [](Recorder &r, const std::string& format) { r.m_export_format=RecorderFormat::_from_string(format.c_str()); } )
+    .def_readwrite("export_color", &Recorder::m_export_color )
+    .def_readwrite("export_depth", &Recorder::m_export_depth )
+    .def_readwrite("export_normals_world", &Recorder::m_export_normals_world )
+    .def_readwrite("export_normals_camera", &Recorder::m_export_normals_camera )
+    .def_readwrite("export_mesh_id", &Recorder::m_export_mesh_id )
+    .def_readwrite("export_labels", &Recorder::m_export_labels )
+    .def_readwrite("export_instance_id", &Recorder::m_export_instance_id )
+    ;
+
+    //MeshLoader
+    //the calls that can block release the GIL so that other python threads (or the viewer loop) can run while the meshes are loading
+    py::class_<MeshLoadHandle> (m, "MeshLoadHandle")
+    .def("is_ready", &MeshLoadHandle::is_ready )
+    .def("get", &MeshLoadHandle::get, py::call_guard<py::gil_scoped_release>() )
+    .def_readonly("file_path", &MeshLoadHandle::file_path )
+    .def_readonly("name", &MeshLoadHandle::name )
+    ;
+    py::class_<MeshLoader, std::shared_ptr<MeshLoader>> (m, "MeshLoader")
+    .def_static("create",  &MeshLoader::create<const int>, py::arg("nr_threads") = 0 )
+    .def("load", [](MeshLoader& loader, const std::string file_path, const std::string name, const bool add_to_scene){ return loader.load(file_path, name, add_to_scene); }, py::arg("file_path"), py::arg("name") = "", py::arg("add_to_scene") = true, py::call_guard<py::gil_scoped_release>() ) //the on_added callback is not exposed because update() may run without the GIL, use the returned handle instead
+    .def("load", py::overload_cast<const std::vector<std::string>&, const std::vector<std::string>&, const bool >(&MeshLoader::load), py::arg("file_paths"), py::arg("names") = std::vector<std::string>(), py::arg("add_to_scene") = true, py::call_guard<py::gil_scoped_release>() )
+    .def("update", &MeshLoader::update )
+    .def("wait_all", &MeshLoader::wait_all, py::call_guard<py::gil_scoped_release>() )
+    .def("nr_pending", &MeshLoader::nr_pending )
+    .def("nr_threads", &MeshLoader::nr_threads )
+    ;
+
+    //PointCloudOctree
+    py::class_<PointCloudOctree, std::shared_ptr<PointCloudOctree>> (m, "PointCloudOctree")
+    .def_static("create",  &PointCloudOctree::create<const std::string, const int>, py::arg("octree_dir"), py::arg("nr_loader_threads") = 4 )
+    .def_static("convert", &PointCloudOctree::convert, py::arg("input_path"), py::arg("output_dir"), py::arg("max_points_per_node") = 20000, py::arg("grid_resolution") = 128, py::arg("max_depth") = 20, py::call_guard<py::gil_scoped_release>() )
+    .def("nr_nodes", &PointCloudOctree::nr_nodes )
+    .def("nr_nodes_resident", &PointCloudOctree::nr_nodes_resident )
+    .def("nr_points_visible", &PointCloudOctree::nr_points_visible )
+    .def("bbox_min", &PointCloudOctree::bbox_min )
+    .def("bbox_max", &PointCloudOctree::bbox_max )
+    .def_readwrite("name", &PointCloudOctree::name )
+    .def_readwrite("m_vis", &PointCloudOctree::m_vis )
+    .def_readwrite("m_point_budget", &PointCloudOctree::m_point_budget )
+    .def_readwrite("m_min_screen_error", &PointCloudOctree::m_min_screen_error )
+    .def_readwrite("m_max_uploads_per_frame", &PointCloudOctree::m_max_uploads_per_frame )
+    .def_readwrite("m_cache_max_points", &PointCloudOctree::m_cache_max_points )
     ;
 
     //Profiler
@@ -466,6 +617,31 @@ PYBIND11_MODULE(easypbr, m) {
     // .def_static("scope",  []( std::string name ) { TIME_SCOPE(name); }) //DOESNT work because scoping in python doesnt work like that. Rather the scope will die as soon as this function is finished
     ;
 
+    //Tracer
+    py::class_<TraceStats> (m, "TraceStats")
+    .def_readonly("name", &TraceStats::name )
+    .def_readonly("is_gpu", &TraceStats::is_gpu )
+    .def_readonly("count", &TraceStats::count )
+    .def_readonly("mean_ms", &TraceStats::mean_ms )
+    .def_readonly("p50_ms", &TraceStats::p50_ms )
+    .def_readonly("p90_ms", &TraceStats::p90_ms )
+    .def_readonly("p99_ms", &TraceStats::p99_ms )
+    .def_readonly("max_ms", &TraceStats::max_ms )
+    ;
+    //begin and end are not exposed since the tracer keeps only the pointer to the name, which would not outlive the python string
+    py::class_<Tracer> (m, "Tracer")
+    .def_static("set_enabled", &Tracer::set_enabled )
+    .def_static("is_enabled", &Tracer::is_enabled )
+    .def_static("set_thread_name", &Tracer::set_thread_name )
+    .def_static("set_max_events_per_thread", &Tracer::set_max_events_per_thread )
+    .def_static("clear", &Tracer::clear )
+    .def_static("write_chrome_trace", &Tracer::write_chrome_trace )
+    .def_static("stats", &Tracer::stats )
+    .def_static("stats_string", &Tracer::stats_string )
+    .def_static("nr_events", &Tracer::nr_events )
+    .def_static("nr_dropped", &Tracer::nr_dropped )
+    ;
+
     //Recorder
     py::class_<radu::utils::ColorMngr, std::shared_ptr<radu::utils::ColorMngr>> (m, "ColorMngr")
     .def(py::init<>())
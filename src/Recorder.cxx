@@ -1,9 +1,19 @@
 #include "easy_pbr/Recorder.h"
 
 //c++
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+
+//opencv
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 //my stuff
 #include "easy_pbr/Viewer.h"
+#include "easy_pbr/MeshGL.h"
+#include "easy_pbr/Camera.h"
+#include "easy_pbr/Tracer.h"
 // #include "opencv_utils.h" //only for debugging
 #define ENABLE_GL_PROFILING 1
 #include "Profiler.h"
@@ -16,10 +26,111 @@ namespace fs = boost::filesystem;
 
 namespace easy_pbr{
 
+//the texture in which we flip a tex of this format before reading it back. Float textures are read as 32 bit floats so that opencv and numpy can use them directly. Video frames are always 8 bit rgb
+static void readback_format(const GLint internal_format, const bool for_video, GLint& dst_internal_format, GLenum& dst_format, GLenum& dst_type){
+    int nr_channels=0;
+    bool is_float=false;
+    switch(internal_format){
+        case GL_R8: nr_channels=1; break;
+        case GL_RG8: nr_channels=2; break;
+        case GL_RGB8: nr_channels=3; break;
+        case GL_RGBA8: nr_channels=4; break;
+        case GL_R16F: case GL_R32F: nr_channels=1; is_float=true; break;
+        case GL_RG16F: case GL_RG32F: nr_channels=2; is_float=true; break;
+        case GL_RGB16F: case GL_RGB32F: nr_channels=3; is_float=true; break;
+        case GL_RGBA16F: case GL_RGBA32F: nr_channels=4; is_float=true; break;
+        default: LOG(FATAL) << "The recorder cannot read back a texture with internal format " << internal_format;
+    }
+    if(for_video){
+        nr_channels=3;
+        is_float=false;
+    }
+
+    const GLint internal_formats_8bit[]={GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+    const GLint internal_formats_float[]={GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F};
+    const GLenum formats[]={GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    dst_internal_format= is_float ? internal_formats_float[nr_channels-1] : internal_formats_8bit[nr_channels-1];
+    dst_format=formats[nr_channels-1];
+    dst_type= is_float ? GL_FLOAT : GL_UNSIGNED_BYTE;
+}
+
+static std::string format_extension(const RecorderFormat format){
+    switch(format){
+        case RecorderFormat::Png: return ".png";
+        case RecorderFormat::Npy: return ".npy";
+        case RecorderFormat::Exr: return ".exr";
+        default: LOG(FATAL) << "Format " << format._to_string() << " doesn't write one file per frame";
+    }
+    return "";
+}
+
+//version 1.0 of the npy format, a magic string, the length of the header, a python dict with the dtype and shape and then the raw data https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+static void write_npy(const cv::Mat& mat, const std::string& file_path){
+    CHECK(mat.isContinuous()) << "We can only write continuous mats to npy";
+    std::string descr;
+    switch(mat.depth()){
+        case CV_8U: descr="|u1"; break;
+        case CV_16U: descr="<u2"; break;
+        case CV_32S: descr="<i4"; break;
+        case CV_32F: descr="<f4"; break;
+        default: LOG(FATAL) << "We cannot write mats of depth " << mat.depth() << " to npy";
+    }
+    std::string shape="(" + std::to_string(mat.rows) + ", " + std::to_string(mat.cols) + ( mat.channels()>1 ? ", "+std::to_string(mat.channels()) : "" ) + ")";
+    std::string header="{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shape + ", }";
+    //the data has to start at a multiple of 64 bytes and the header ends with a newline
+    const size_t preamble_size=10;
+    header.append( 63-(preamble_size+header.size())%64, ' ');
+    header.push_back('\n');
+
+    std::ofstream file(file_path, std::ios::binary);
+    CHECK(file.is_open()) << "Could not open " << file_path;
+    const char magic[]={ (char)0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+    file.write(magic, sizeof(magic));
+    const unsigned char header_len[]={ (unsigned char)(header.size()&0xff), (unsigned char)(header.size()>>8) };
+    file.write((const char*)header_len, sizeof(header_len));
+    file.write(header.data(), header.size());
+    file.write((const char*)mat.data, mat.total()*mat.elemSize());
+}
+
 Recorder::Recorder(Viewer* view):
     m_is_recording(false),
     m_view(view),
-    m_nr_images_recorded(0)
+    m_nr_images_recorded(0),
+    m_nr_writer_threads(8),
+    m_queue_capacity(100),
+    m_queue_policy(RecorderQueuePolicy::Block),
+    m_format(RecorderFormat::Png),
+    m_png_compression(1),
+    m_video_fps(30),
+    m_video_codec("mp4v"),
+    m_video_name("recording.mp4"),
+    m_export_enabled(false),
+    m_export_format(RecorderFormat::Npy),
+    m_export_color(true),
+    m_export_depth(true),
+    m_export_normals_world(true),
+    m_export_normals_camera(false),
+    m_export_mesh_id(true),
+    m_export_labels(true),
+    m_export_instance_id(true),
+    m_readback_shader("recorder_readback"),
+    m_readback_tex("recorder_readback_tex"),
+    m_video_readback_tex("recorder_video_readback_tex"),
+    m_snapshot_tex("recorder_snapshot_tex"),
+    m_snapshot_readback( AsyncReadback::create(8) ), //enough for all the textures of a gbuffer dump without waiting
+    m_export_shader("recorder_export"),
+    m_export_ids_shader("recorder_export_ids"),
+    m_export_color_tex("recorder_export_color_tex"),
+    m_export_readback( AsyncReadback::create(24) ), //3 frames in flight with the recorded image and all 7 channels
+    m_threads_are_running(false),
+    m_nr_writes_in_progress(0),
+    m_max_queue_depth(0),
+    m_nr_written(0),
+    m_nr_dropped(0),
+    m_total_encode_ms(0),
+    m_max_encode_ms(0),
+    m_nr_video_frames_queued(0),
+    m_next_video_frame(0)
     // m_recording_path("./recordings/"),
     // m_snapshot_name("img.png")
 {
@@ -33,56 +144,84 @@ Recorder::Recorder(Viewer* view):
     // m_idx_pbo_write=0;
     // m_idx_pbo_read=1; //just one in front of the writing one so it will take one full loop of all pbos for it to catch up
 
-    m_writer_threads.resize(8);
-    m_threads_are_running=true;
-    for(size_t i = 0; i < m_writer_threads.size(); i++){
-        m_writer_threads[i]=std::thread( &Recorder::write_to_file_threaded, this);
-    }
+    //the writer threads are started on the first write so that the viewer can set the params from the config before
+
+    m_readback_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/recorder_readback_frag.glsl"  );
+    m_export_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/export_frag.glsl"  );
+    m_export_ids_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/export_ids_frag.glsl"  );
+
+    //the size is set to the one of the gbuffer on the first export
+    GL_C( m_export_fbo.set_size(1, 1) );
+    GL_C( m_export_fbo.add_texture("normal_world_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) );
+    GL_C( m_export_fbo.add_texture("normal_camera_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) );
+    GL_C( m_export_fbo.add_texture("depth_gtex", GL_R32F, GL_RED, GL_FLOAT) );
+    GL_C( m_export_fbo.add_texture("mesh_id_gtex", GL_R32I, GL_RED_INTEGER, GL_INT) );
+    GL_C( m_export_fbo.add_texture("label_gtex", GL_R32I, GL_RED_INTEGER, GL_INT) );
+    GL_C( m_export_fbo.add_texture("instance_id_gtex", GL_R32I, GL_RED_INTEGER, GL_INT) );
+    m_export_fbo.sanity_check();
 
 }
 
 Recorder::~Recorder(){
-    //wait for the threads to write all the rest of the images
-    while(m_cv_mats_queue.size_approx()!=0){
-        VLOG(1) << "waiting for recording to finish";
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    //the snapshots that are still downloading are queued before the writers are told to stop
+    m_snapshot_readback->finish();
+    m_export_readback->finish();
+
+    //the writers only stop once the queue is empty so every image that was queued gets written
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_threads_are_running=false;
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
-
-    m_threads_are_running=false;
+    m_queue_not_empty_cv.notify_all();
     for(size_t i = 0; i < m_writer_threads.size(); i++){
         m_writer_threads[i].join();
     }
 }
 
 bool Recorder::record(gl::Texture2D& tex, const std::string name, const std::string path){
-    tex.download_to_pbo();
+    //video frames go through their own texture because they have a different format and the pbos of a texture are read a couple of frames later
+    bool is_video= m_format==+RecorderFormat::Video;
+    gl::Texture2D& readback_tex= is_video ? m_video_readback_tex : m_readback_tex;
+    prepare_for_readback(tex, readback_tex, m_format!=+RecorderFormat::Npy, is_video);
+
+    //the pbos give back the image of a couple of frames ago while the exported channels are decoded from the gbuffer of this frame. So when exporting, the image goes through the same readback as the channels and the writers get all of them at once, or none if the Drop policy skips the frame
+    if(m_export_enabled){
+        std::shared_ptr<ExportedFrame> frame=std::make_shared<ExportedFrame>();
+        frame->nr_channels=1+nr_export_channels();
+        GLint internal_format;
+        GLenum format, type;
+        readback_format(tex.internal_format(), is_video, internal_format, format, type);
+        std::string file_path= is_video ? ( fs::path(path)/m_video_name ).string() : ( fs::path(path)/fs::path(name).replace_extension(format_extension(m_format)) ).string();
+        read_async(readback_tex, format, type, gl_internal_format2cv_type(internal_format), file_path, true, m_export_readback, frame, is_video);
+        queue_export(frame, name, path);
+        //the index is used even if the frame ends up dropped, since that is only known once it's downloaded. The names in the recording path can then have gaps but the image and the channels of a frame always share it
+        if (is_recording()){
+            m_nr_images_recorded++;
+        }
+        return true;
+    }
 
-    if( m_cv_mats_queue.size_approx()>100)
-        VLOG(1) << "Enqueued too many cv_mats approx mats in queue: " << m_cv_mats_queue.size_approx();
+    readback_tex.download_to_pbo();
 
-    if(tex.cur_pbo_download().storage_initialized() ){
-        int cv_type=gl_internal_format2cv_type(tex.internal_format());
-        cv::Mat cv_mat = cv::Mat::zeros(cv::Size(tex.cur_pbo_download().width(), tex.cur_pbo_download().height()), cv_type); //the size of the texture is not the same as the pbo we ae downloading from because the pbo is delayed a couple of frames so a resizing of texture takes a while to take effect
+    if(readback_tex.cur_pbo_download().storage_initialized() ){
+        int cv_type=gl_internal_format2cv_type(readback_tex.internal_format());
+        cv::Mat cv_mat = cv::Mat::zeros(cv::Size(readback_tex.cur_pbo_download().width(), readback_tex.cur_pbo_download().height()), cv_type); //the size of the texture is not the same as the pbo we ae downloading from because the pbo is delayed a couple of frames so a resizing of texture takes a while to take effect
         // VLOG(1) <<"writing mat of type " << easy_pbr::utils::type2string(cv_mat.type());
 
-        tex.download_from_oldest_pbo(cv_mat.data);
-
-        // //increment the nr of times we have written a tex with this name and create the path where we will write the mat
-        // auto got = m_times_written_for_tex.find (name);
-        // int nr_times_written=0;
-        // if ( got == m_times_written_for_tex.end() ){
-        //     m_times_written_for_tex[name]=0;
-        // }else{
-        //     nr_times_written=m_times_written_for_tex[name];
-        //     m_times_written_for_tex[name]++;
-        // }
+        readback_tex.download_from_oldest_pbo(cv_mat.data);
 
         MatWithFilePath mat_with_file;
         mat_with_file.cv_mat=cv_mat;
-        mat_with_file.file_path= ( fs::path(path)/name ).string();
-        m_cv_mats_queue.enqueue(mat_with_file);
+        if(is_video){
+            mat_with_file.file_path= ( fs::path(path)/m_video_name ).string();
+            mat_with_file.video_frame_idx=0; //the actual index is given when it's queued
+        }else{
+            mat_with_file.file_path= ( fs::path(path)/fs::path(name).replace_extension(format_extension(m_format)) ).string();
+            mat_with_file.imwrite_params={cv::IMWRITE_PNG_COMPRESSION, m_png_compression};
+        }
+        if(!enqueue(std::move(mat_with_file), true)){
+            return false; //dropped because the writers can't keep up
+        }
 
         if (is_recording()){
             m_nr_images_recorded++;
@@ -94,26 +233,17 @@ bool Recorder::record(gl::Texture2D& tex, const std::string name, const std::str
         return false;
     }
 
-    if( m_cv_mats_queue.size_approx()>100){
-        LOG(FATAL) << "Enqueued too many cv_mats and couldn't write all of them in time. Consider adding more threads for writing or slowing down the enqueueing";
-    }
-
 }
 
 void Recorder::write_without_buffering(gl::Texture2D& tex, const std::string name, const std::string path){
+    //the snapshot is written with whatever extension the name has
+    bool is_npy= fs::path(name).extension()==".npy";
+    prepare_for_readback(tex, m_snapshot_tex, !is_npy, false);
 
-
-    cv::Mat cv_mat;
-    cv_mat=tex.download_to_cv_mat();
-
-    MatWithFilePath mat_with_file;
-    mat_with_file.cv_mat=cv_mat;
-    mat_with_file.file_path= ( fs::path(path)/name ).string();
-    m_cv_mats_queue.enqueue(mat_with_file);
-
-    if( m_cv_mats_queue.size_approx()>100){
-        LOG(FATAL) << "Enqueued too many cv_mats and couldn't write all of them in time. Consider adding more threads for writing or slowing down the enqueueing";
-    }
+    GLint internal_format;
+    GLenum format, type;
+    readback_format(tex.internal_format(), false, internal_format, format, type);
+    read_async(m_snapshot_tex, format, type, gl_internal_format2cv_type(internal_format), ( fs::path(path)/name ).string(), false, m_snapshot_readback);
 
 }
 
@@ -240,41 +370,362 @@ void Recorder::snapshot(const std::string name, const std::string path){
 
 // }
 
+bool Recorder::enqueue(MatWithFilePath&& mat_with_file, const bool can_drop){
+    std::vector<MatWithFilePath> mats;
+    mats.push_back(std::move(mat_with_file));
+    return enqueue(std::move(mats), can_drop);
+}
+
+bool Recorder::enqueue(std::vector<MatWithFilePath>&& mats, const bool can_drop){
+    const int nr_mats=mats.size();
+    {
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        if(m_writer_threads.empty()){
+            m_threads_are_running=true;
+            int nr_threads=std::max(1, m_nr_writer_threads);
+            for(int i = 0; i < nr_threads; i++){
+                m_writer_threads.emplace_back( &Recorder::write_to_file_threaded, this);
+            }
+        }
+
+        //a group larger than the whole capacity only needs an empty queue, otherwise Block would wait forever
+        auto fits=[this, nr_mats]{ return (int)m_queue.size()+nr_mats<=m_queue_capacity || m_queue.empty(); };
+        if( !fits() ){
+            if(m_queue_policy==+RecorderQueuePolicy::Drop && can_drop){
+                m_nr_dropped+=nr_mats;
+                return false;
+            }else if(m_queue_policy==+RecorderQueuePolicy::Block){
+                m_queue_not_full_cv.wait(lock, fits);
+            }
+            //with Grow, or a snapshot with Drop, it just goes over the capacity
+        }
+
+        for(size_t i = 0; i < mats.size(); i++){
+            if(mats[i].video_frame_idx>=0){
+                mats[i].video_frame_idx=m_nr_video_frames_queued++;
+            }
+            m_queue.push_back(std::move(mats[i]));
+        }
+        m_max_queue_depth=std::max(m_max_queue_depth, (int)m_queue.size());
+    }
+    if(nr_mats==1){
+        m_queue_not_empty_cv.notify_one();
+    }else{
+        m_queue_not_empty_cv.notify_all();
+    }
+    return true;
+}
+
 void Recorder::write_to_file_threaded(){
 
+    Tracer::set_thread_name("recorder_writer");
 
-    while(m_threads_are_running){
+    while(true){
 
         MatWithFilePath mat_with_file;
-        bool found = m_cv_mats_queue.try_dequeue(mat_with_file);
-        if(!found){
-            std::this_thread::sleep_for(std::chrono::milliseconds(3));
-            continue;
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_queue_not_empty_cv.wait(lock, [this]{ return !m_threads_are_running || !m_queue.empty(); });
+            if(m_queue.empty()){
+                return; //only happens when shutting down, after everything was written
+            }
+            mat_with_file=std::move(m_queue.front());
+            m_queue.pop_front();
+            m_nr_writes_in_progress++;
         }
+        m_queue_not_full_cv.notify_one();
+
 
+        auto start=std::chrono::steady_clock::now();
 
-        TIME_START("write_to_file");
 
+        {
+            TRACE_SCOPE("encode");
+            encode(mat_with_file);
+        }
+
+        double encode_ms=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+        {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            m_nr_writes_in_progress--;
+            m_nr_written++;
+            m_total_encode_ms+=encode_ms;
+            m_max_encode_ms=std::max(m_max_encode_ms, encode_ms);
+        }
+        m_idle_cv.notify_all();
+
+    }
+
+}
 
-        //create folder
+void Recorder::export_frame(const std::string name, const std::string path){
+    std::shared_ptr<ExportedFrame> frame=std::make_shared<ExportedFrame>();
+    frame->nr_channels=nr_export_channels();
+    if(frame->nr_channels==0){
+        return;
+    }
+    queue_export(frame, name, path);
+}
+
+int Recorder::nr_export_channels(){
+    bool export_ids= (m_export_labels || m_export_instance_id) && m_view->m_enable_id_buffers;
+    return m_export_color + m_export_depth + m_export_normals_world + m_export_normals_camera + m_export_mesh_id + (export_ids && m_export_labels) + (export_ids && m_export_instance_id);
+}
+
+void Recorder::queue_export(const std::shared_ptr<ExportedFrame>& frame, const std::string name, const std::string path){
+    CHECK(m_export_format==+RecorderFormat::Npy || m_export_format==+RecorderFormat::Exr) << "The gbuffer can only be exported as Npy or Exr but the format is " << m_export_format._to_string();
+    bool swap_red_blue= m_export_format==+RecorderFormat::Exr;
+    std::string prefix=( fs::path(path)/fs::path(name).stem() ).string()+"_";
+    std::string extension=format_extension(m_export_format);
+
+    bool export_ids= (m_export_labels || m_export_instance_id) && m_view->m_enable_id_buffers;
+
+    if(m_export_color){
+        prepare_for_readback(m_view->m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex"), m_export_color_tex, swap_red_blue, false);
+        read_async(m_export_color_tex, GL_RGBA, GL_UNSIGNED_BYTE, CV_8UC4, prefix+"color"+extension, true, m_export_readback, frame);
+    }
+
+    if(!m_export_depth && !m_export_normals_world && !m_export_normals_camera && !m_export_mesh_id && !export_ids){
+        return;
+    }
+
+    //decode the gbuffer of this frame into float and int textures that are flipped already
+    gl::GBuffer& gbuffer=m_view->m_gbuffer;
+    if(m_export_fbo.width()!=gbuffer.width() || m_export_fbo.height()!=gbuffer.height()){
+        m_export_fbo.set_size(gbuffer.width(), gbuffer.height());
+    }
+    std::shared_ptr<Camera> cam=m_view->m_camera;
+
+    GLint prev_viewport[4];
+    GLint prev_draw_fbo;
+    glGetIntegerv(GL_VIEWPORT, prev_viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fbo);
+    glViewport(0, 0, gbuffer.width(), gbuffer.height());
+    glDepthMask(false);
+    glDisable(GL_DEPTH_TEST);
+
+    gl::Shader& shader=m_export_shader;
+    std::shared_ptr<MeshGL> quad=m_view->m_fullscreen_quad;
+    GL_C( quad->vao.vertex_attribute(shader, "position", quad->V_buf, 3) );
+    GL_C( quad->vao.vertex_attribute(shader, "uv", quad->UV_buf, 2) );
+    quad->vao.indices(quad->F_buf);
+    GL_C( shader.use() );
+    shader.bind_texture(gbuffer.tex_with_name("normal_gtex"), "normals_encoded_tex");
+    shader.bind_texture(gbuffer.tex_with_name("depth_gtex"), "depth_tex");
+    shader.bind_texture(gbuffer.tex_with_name("mesh_id_gtex"), "mesh_id_tex");
+    shader.uniform_4x4(cam->view_matrix(), "V");
+    shader.uniform_float( cam->m_far / (cam->m_far - cam->m_near), "projection_a");
+    shader.uniform_float( (-cam->m_far * cam->m_near) / (cam->m_far - cam->m_near) , "projection_b");
+    shader.uniform_bool(m_view->using_fat_gbuffer(), "using_fat_gbuffer");
+    shader.uniform_bool(swap_red_blue, "swap_red_blue");
+    m_export_fbo.bind_for_draw();
+    shader.draw_into(m_export_fbo,
+                    {
+                    std::make_pair("normal_world_out", "normal_world_gtex"),
+                    std::make_pair("normal_camera_out", "normal_camera_gtex"),
+                    std::make_pair("depth_out", "depth_gtex"),
+                    std::make_pair("mesh_id_out", "mesh_id_gtex"),
+                    }
+                    );
+    quad->vao.bind();
+    glDrawElements(GL_TRIANGLES, quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+
+    //the id buffers only exist in the gbuffer if the viewer enabled them so they get their own pass
+    if(export_ids){
+        gl::Shader& ids_shader=m_export_ids_shader;
+        GL_C( quad->vao.vertex_attribute(ids_shader, "position", quad->V_buf, 3) );
+        GL_C( quad->vao.vertex_attribute(ids_shader, "uv", quad->UV_buf, 2) );
+        quad->vao.indices(quad->F_buf);
+        GL_C( ids_shader.use() );
+        ids_shader.bind_texture(gbuffer.tex_with_name("label_gtex"), "label_tex");
+        ids_shader.bind_texture(gbuffer.tex_with_name("instance_id_gtex"), "instance_id_tex");
+        ids_shader.uniform_int((int)m_view->id_buffers_no_label(), "no_label");
+        m_export_fbo.bind_for_draw();
+        ids_shader.draw_into(m_export_fbo,
+                        {
+                        std::make_pair("label_out", "label_gtex"),
+                        std::make_pair("instance_id_out", "instance_id_gtex"),
+                        }
+                        );
+        quad->vao.bind();
+        glDrawElements(GL_TRIANGLES, quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    }
+
+    glDepthMask(true);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fbo);
+    glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+
+    if(m_export_depth){
+        read_async(m_export_fbo.tex_with_name("depth_gtex"), GL_RED, GL_FLOAT, CV_32FC1, prefix+"depth"+extension, true, m_export_readback, frame);
+    }
+    if(m_export_normals_world){
+        read_async(m_export_fbo.tex_with_name("normal_world_gtex"), GL_RGB, GL_FLOAT, CV_32FC3, prefix+"normals_world"+extension, true, m_export_readback, frame);
+    }
+    if(m_export_normals_camera){
+        read_async(m_export_fbo.tex_with_name("normal_camera_gtex"), GL_RGB, GL_FLOAT, CV_32FC3, prefix+"normals_camera"+extension, true, m_export_readback, frame);
+    }
+    if(m_export_mesh_id){
+        read_async(m_export_fbo.tex_with_name("mesh_id_gtex"), GL_RED_INTEGER, GL_INT, CV_32SC1, prefix+"mesh_id"+extension, true, m_export_readback, frame);
+    }
+    if(export_ids && m_export_labels){
+        read_async(m_export_fbo.tex_with_name("label_gtex"), GL_RED_INTEGER, GL_INT, CV_32SC1, prefix+"label"+extension, true, m_export_readback, frame);
+    }
+    if(export_ids && m_export_instance_id){
+        read_async(m_export_fbo.tex_with_name("instance_id_gtex"), GL_RED_INTEGER, GL_INT, CV_32SC1, prefix+"instance_id"+extension, true, m_export_readback, frame);
+    }
+}
+
+void Recorder::read_async(gl::Texture2D& tex, const GLenum format, const GLenum type, const int cv_type, const std::string file_path, const bool can_drop, std::shared_ptr<AsyncReadback>& readback, std::shared_ptr<ExportedFrame> frame, const bool is_video_frame){
+    //the tex can be drawn into again right away because the gpu copies it into the pbo before any later draw
+    cv::Mat cv_mat(tex.height(), tex.width(), cv_type);
+    std::vector<int> imwrite_params={cv::IMWRITE_PNG_COMPRESSION, m_png_compression};
+    readback->read(tex, format, type, cv_mat, false, [this, file_path, imwrite_params, can_drop, frame, is_video_frame](const cv::Mat& downloaded){
+        MatWithFilePath mat_with_file;
+        mat_with_file.cv_mat=downloaded;
+        mat_with_file.file_path=file_path;
+        mat_with_file.imwrite_params=imwrite_params;
+        if(is_video_frame){
+            mat_with_file.video_frame_idx=0; //the actual index is given when it's queued
+        }
+        if(!frame){
+            enqueue(std::move(mat_with_file), can_drop);
+            return;
+        }
+        //the readbacks complete on the render thread so the frame needs no lock
+        frame->mats.push_back(std::move(mat_with_file));
+        if((int)frame->mats.size()==frame->nr_channels){
+            enqueue(std::move(frame->mats), can_drop);
+        }
+    });
+}
+
+void Recorder::prepare_for_readback(gl::Texture2D& tex, gl::Texture2D& dst, const bool swap_red_blue, const bool for_video){
+    GLint internal_format;
+    GLenum format, type;
+    readback_format(tex.internal_format(), for_video, internal_format, format, type);
+    dst.allocate_or_resize(internal_format, format, type, tex.width(), tex.height() );
+
+    //store the state that we change so that the rest of the frame is not affected
+    GLint prev_viewport[4];
+    GLint prev_draw_fbo;
+    glGetIntegerv(GL_VIEWPORT, prev_viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_draw_fbo);
+    glDepthMask(false);
+    glDisable(GL_DEPTH_TEST);
+
+    std::shared_ptr<MeshGL> quad=m_view->m_fullscreen_quad;
+    GL_C( quad->vao.vertex_attribute(m_readback_shader, "position", quad->V_buf, 3) );
+    GL_C( quad->vao.vertex_attribute(m_readback_shader, "uv", quad->UV_buf, 2) );
+    quad->vao.indices(quad->F_buf);
+
+    GL_C( m_readback_shader.use() );
+    m_readback_shader.bind_texture(tex, "tex");
+    m_readback_shader.uniform_bool(swap_red_blue, "swap_red_blue");
+    m_readback_shader.draw_into(dst, "out_color");
+    glViewport(0, 0, dst.width(), dst.height());
+    quad->vao.bind();
+    glDrawElements(GL_TRIANGLES, quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+
+    //restore the state
+    glDepthMask(true);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, prev_draw_fbo);
+    glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+}
+
+void Recorder::encode(MatWithFilePath& mat_with_file){
+    if(mat_with_file.video_frame_idx>=0){
+        write_video_frame(mat_with_file);
+        return;
+    }
+
+    //create folder
+    fs::path folder=fs::path(mat_with_file.file_path).parent_path();
+    if (!fs::exists(folder)){
+        fs::create_directories(folder);
+    }
+
+    //the mat is already flipped and in bgr order, the only thing left is to convert to a depth that the format can store
+    std::string extension=fs::path(mat_with_file.file_path).extension().string();
+    if(extension==".npy"){
+        write_npy(mat_with_file.cv_mat, mat_with_file.file_path);
+    }else{
+        cv::Mat cv_mat=mat_with_file.cv_mat;
+        if(extension==".exr" && cv_mat.depth()!=CV_32F){
+            cv_mat.convertTo(cv_mat, CV_32F, cv_mat.depth()==CV_8U ? 1.0/255.0 : 1.0); //ids are stored as floats which is exact up to 2^24
+        }else if(extension==".png" && cv_mat.depth()==CV_32F){
+            cv_mat.convertTo(cv_mat, CV_16U, 65535.0); //saturates so anything above 1.0 is clamped
+        }
+        cv::imwrite(mat_with_file.file_path, cv_mat, mat_with_file.imwrite_params);
+    }
+}
+
+void Recorder::write_video_frame(MatWithFilePath& mat_with_file){
+    std::unique_lock<std::mutex> lock(m_video_mutex);
+    m_video_cv.wait(lock, [&]{ return m_next_video_frame==mat_with_file.video_frame_idx; });
+
+    if(!m_video_writer.isOpened() && mat_with_file.video_frame_idx==0){
         fs::path folder=fs::path(mat_with_file.file_path).parent_path();
         if (!fs::exists(folder)){
             fs::create_directories(folder);
         }
+        CHECK(m_video_codec.size()==4) << "The video codec has to be a fourcc of 4 characters but it is " << m_video_codec;
+        int fourcc=cv::VideoWriter::fourcc(m_video_codec[0], m_video_codec[1], m_video_codec[2], m_video_codec[3]);
+        m_video_size=mat_with_file.cv_mat.size();
+        m_video_writer.open(mat_with_file.file_path, fourcc, m_video_fps, m_video_size, true);
+        LOG_IF(ERROR, !m_video_writer.isOpened()) << "Could not open the video " << mat_with_file.file_path << " with codec " << m_video_codec << ". The frames will be skipped";
+    }
 
-        cv::Mat cv_mat_flipped;
-        cv::flip(mat_with_file.cv_mat, cv_mat_flipped, 0);
-        if(cv_mat_flipped.channels()==4){
-            cv::cvtColor(cv_mat_flipped, cv_mat_flipped, cv::COLOR_BGRA2RGBA);
-        }else if(cv_mat_flipped.channels()==3){
-            cv::cvtColor(cv_mat_flipped, cv_mat_flipped, cv::COLOR_BGR2RGB);
+    if(m_video_writer.isOpened()){
+        //the video has the size of the first frame so if the viewer got resized we scale the frames back to it
+        cv::Mat frame=mat_with_file.cv_mat;
+        if(frame.size()!=m_video_size){
+            cv::resize(frame, frame, m_video_size);
         }
-        VLOG(1) << "writen image to " << mat_with_file.file_path;
-        cv::imwrite(mat_with_file.file_path, cv_mat_flipped);
-        TIME_END("write_to_file");
+        m_video_writer.write(frame);
+    }
+
+    m_next_video_frame++;
+    lock.unlock();
+    m_video_cv.notify_all();
+}
 
+void Recorder::close_video(){
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_nr_video_frames_queued=0;
     }
+    std::lock_guard<std::mutex> lock(m_video_mutex);
+    if(m_video_writer.isOpened()){
+        m_video_writer.release();
+    }
+    m_next_video_frame=0;
+}
+
+void Recorder::update(){
+    m_snapshot_readback->process_ready();
+    m_export_readback->process_ready();
+}
+
+void Recorder::flush(){
+    m_snapshot_readback->finish();
+    m_export_readback->finish();
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+    m_idle_cv.wait(lock, [this]{ return m_queue.empty() && m_nr_writes_in_progress==0; });
+}
 
+RecorderStats Recorder::stats(){
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    RecorderStats stats;
+    stats.queue_depth=m_queue.size();
+    stats.max_queue_depth=m_max_queue_depth;
+    stats.nr_written=m_nr_written;
+    stats.nr_dropped=m_nr_dropped;
+    stats.avg_encode_ms= m_nr_written>0 ? m_total_encode_ms/m_nr_written : 0.0;
+    stats.max_encode_ms=m_max_encode_ms;
+    return stats;
 }
 
 
@@ -287,6 +738,7 @@ void Recorder::start_recording(){
 void Recorder::stop_recording(){
     m_is_recording=false;
     m_nr_images_recorded=0;
+    close_video(); //the next recording starts a new video
 }
 void Recorder::pause_recording(){
     m_is_recording=false;
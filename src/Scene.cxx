@@ -89,6 +89,11 @@ void Scene::add_mesh(const std::shared_ptr<Mesh> mesh, const std::string name){
     
 }
 
+void Scene::add_instances(const std::shared_ptr<Mesh> mesh, const std::string name, const std::vector<Eigen::Matrix4d>& transforms, const Eigen::MatrixXd& colors){
+    mesh->set_instances(transforms, colors);
+    add_mesh(mesh, name);
+}
+
 void Scene::clear(){
     std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
     m_meshes.clear();
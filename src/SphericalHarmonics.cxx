@@ -0,0 +1,100 @@
+#include "easy_pbr/SphericalHarmonics.h"
+
+//c++
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+Eigen::Matrix<float,9,1> sh9_basis(const Eigen::Vector3f& dir){
+    float x=dir.x(), y=dir.y(), z=dir.z();
+    Eigen::Matrix<float,9,1> basis;
+    basis(0)=0.282095;
+    basis(1)=0.488603*y;
+    basis(2)=0.488603*z;
+    basis(3)=0.488603*x;
+    basis(4)=1.092548*x*y;
+    basis(5)=1.092548*y*z;
+    basis(6)=0.315392*(3.0*z*z-1.0);
+    basis(7)=1.092548*x*z;
+    basis(8)=0.546274*(x*x-y*y);
+    return basis;
+}
+
+Eigen::MatrixXf irradiance_sh9_from_equirectangular(const cv::Mat& img, const int max_width, const int nr_threads){
+    CHECK(img.data) << "The environment map is empty";
+    CHECK(img.channels()>=3) << "Expected an environment map with at least 3 channels but it has " << img.channels();
+
+    cv::Mat img_float;
+    if(img.cols>max_width){
+        //area interpolation averages the pixels so no bright spot gets lost
+        cv::resize(img, img_float, cv::Size(max_width, std::max(1, img.rows*max_width/img.cols)), 0, 0, cv::INTER_AREA);
+    }else{
+        img_float=img;
+    }
+    img_float.convertTo(img_float, CV_32F);
+
+    const int W=img_float.cols;
+    const int H=img_float.rows;
+    const int nr_channels=img_float.channels();
+    int nr_workers= nr_threads>0 ? nr_threads : std::max(1, (int)std::thread::hardware_concurrency());
+    nr_workers=std::min(nr_workers, H);
+
+    //each worker accumulates a block of rows into its own coefficients and we sum them at the end
+    std::vector< Eigen::Matrix<double,9,3> > partial(nr_workers, Eigen::Matrix<double,9,3>::Zero());
+    auto project_rows=[&](const int worker_idx, const int row_start, const int row_end){
+        Eigen::Matrix<double,9,3>& coeffs=partial[worker_idx];
+        for(int r = row_start; r < row_end; r++){
+            //same mapping as SampleSphericalMap in equirectangular2cubemap_frag.glsl. The image gets flipped when uploaded so the first row is the top of the sphere
+            float v=1.0-(r+0.5)/H;
+            float lat=(v-0.5)*M_PI;
+            float cos_lat=std::cos(lat);
+            float solid_angle=(2.0*M_PI/W)*(M_PI/H)*cos_lat;
+            const float* row=img_float.ptr<float>(r);
+            for(int c = 0; c < W; c++){
+                float u=(c+0.5)/W;
+                float phi=(u-0.5)*2.0*M_PI;
+                Eigen::Vector3f dir(cos_lat*std::cos(phi), std::sin(lat), cos_lat*std::sin(phi));
+                Eigen::Matrix<float,9,1> basis=sh9_basis(dir)*solid_angle;
+                const float* px=row+c*nr_channels;
+                Eigen::Vector3f rgb(px[2], px[1], px[0]); //opencv stores BGR
+                coeffs+=(basis*rgb.transpose()).cast<double>();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    int rows_per_worker=(H+nr_workers-1)/nr_workers;
+    for(int i = 0; i < nr_workers; i++){
+        int row_start=i*rows_per_worker;
+        int row_end=std::min(H, row_start+rows_per_worker);
+        workers.emplace_back(project_rows, i, row_start, row_end);
+    }
+    for(size_t i = 0; i < workers.size(); i++){
+        workers[i].join();
+    }
+
+    Eigen::Matrix<double,9,3> radiance_coeffs=Eigen::Matrix<double,9,3>::Zero();
+    for(int i = 0; i < nr_workers; i++){
+        radiance_coeffs+=partial[i];
+    }
+
+    //convolve with the clamped cosine, the factors for each band are pi, 2pi/3 and pi/4. We also divide by pi because the compose shader multiplies the irradiance directly with the albedo
+    Eigen::MatrixXf irradiance_coeffs(9,3);
+    for(int i = 0; i < 9; i++){
+        double band_factor= i==0 ? 1.0 : (i<4 ? 2.0/3.0 : 1.0/4.0);
+        irradiance_coeffs.row(i)=(radiance_coeffs.row(i)*band_factor).cast<float>();
+    }
+    return irradiance_coeffs;
+}
+
+} //namespace easy_pbr
@@ -16,7 +16,10 @@ SpotLight::SpotLight(const configuru::Config& config):
     // m_fov(90),
     // m_near(0.01)
     // m_far(5000)
-    m_power(0)
+    m_power(0),
+    m_is_static_shadow_map_dirty(true),
+    m_static_resolution(0),
+    m_static_view_proj(Eigen::Matrix4f::Zero())
 {
     init_params(config);
 
@@ -47,22 +50,14 @@ void SpotLight::set_power_for_point(const Eigen::Vector3f& point, const float po
 }
 
 // void PointLight::render_to_shadow_map(const MeshCore& mesh){
-void SpotLight::render_mesh_to_shadow_map(MeshGLSharedPtr& mesh){
+void SpotLight::render_mesh_to_shadow_map(MeshGLSharedPtr& mesh, const bool static_layer){
 
-    //add a depth texture to the framebuffer of the shadow map
-    if(!m_shadow_map_fbo.is_initialized() || m_shadow_map_fbo.width()!=m_shadow_map_resolution || m_shadow_map_fbo.height()!=m_shadow_map_resolution ){
-        m_shadow_map_fbo.set_size(m_shadow_map_resolution, m_shadow_map_resolution);
-        m_shadow_map_fbo.add_depth("shadow_map_depth");
-        //make the depth map have nearest sampling because that will work best for shadow mapping
-        // m_shadow_map_fbo.tex_with_name("shadow_map_depth").set_filter_mode(GL_NEAREST);
-
-        m_shadow_map_fbo.sanity_check();
-    } 
+    gl::GBuffer& fbo= static_layer ? m_static_shadow_map_fbo : m_shadow_map_fbo;
+    init_shadow_map_fbo(fbo);
+    add_to_shadow_map(mesh.get(), static_layer);
 
 
-    // Set attributes that the vao will pulll from buffers
-    GL_C( mesh->vao.vertex_attribute(m_shadow_map_shader, "position", mesh->V_buf, 3) );
-    GL_C( mesh->vao.indices(mesh->F_buf) ); //Says the indices with we refer to vertices, this gives us the triangles
+    //the vao already has the position at location 0 and the faces as indices since the mesh got uploaded
 
     //matrices setup
     Eigen::Vector2f viewport_size;
@@ -76,34 +71,31 @@ void SpotLight::render_mesh_to_shadow_map(MeshGLSharedPtr& mesh){
     GL_C( glViewport(0,0,m_shadow_map_resolution,m_shadow_map_resolution) );
     GL_C( m_shadow_map_shader.use() );
     m_shadow_map_shader.uniform_4x4(MVP, "MVP");
-    m_shadow_map_shader.draw_into(m_shadow_map_fbo, {} ); //makes the shaders draw into the buffers we defines in the gbuffer
+    m_shadow_map_shader.uniform_bool(mesh->nr_instances()>0, "is_instanced");
+    m_shadow_map_shader.draw_into(fbo, {} ); //makes the shaders draw into the buffers we defines in the gbuffer
 
     // draw
     GL_C( mesh->vao.bind() ); 
-    GL_C( glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0) );
+    if(mesh->nr_instances()){
+        GL_C( glDrawElementsInstanced(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0, mesh->nr_instances()) );
+    }else{
+        GL_C( glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0) );
+    }
 
     GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
     GL_C( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
 
 }
 
-void SpotLight::render_points_to_shadow_map(MeshGLSharedPtr& mesh){
-
+void SpotLight::render_points_to_shadow_map(MeshGLSharedPtr& mesh, const bool static_layer){
 
-    //add a depth texture to the framebuffer of the shadow map
-    if(!m_shadow_map_fbo.is_initialized() || m_shadow_map_fbo.width()!=m_shadow_map_resolution || m_shadow_map_fbo.height()!=m_shadow_map_resolution ){
-        m_shadow_map_fbo.set_size(m_shadow_map_resolution, m_shadow_map_resolution);
-        m_shadow_map_fbo.add_depth("shadow_map_depth");
-        //make the depth map have nearest sampling because that will work best for shadow mapping
-        // m_shadow_map_fbo.tex_with_name("shadow_map_depth").set_filter_mode(GL_NEAREST);
 
-        m_shadow_map_fbo.sanity_check();
-    } 
+    gl::GBuffer& fbo= static_layer ? m_static_shadow_map_fbo : m_shadow_map_fbo;
+    init_shadow_map_fbo(fbo);
+    add_to_shadow_map(mesh.get(), static_layer);
 
 
-    // Set attributes that the vao will pulll from buffers
-    GL_C( mesh->vao.vertex_attribute(m_shadow_map_shader, "position", mesh->V_buf, 3) );
-    GL_C( mesh->vao.indices(mesh->F_buf) ); //Says the indices with we refer to vertices, this gives us the triangles
+    //the vao already has the position at location 0 and the faces as indices since the mesh got uploaded
 
     //matrices setup
     Eigen::Vector2f viewport_size;
@@ -117,7 +109,8 @@ void SpotLight::render_points_to_shadow_map(MeshGLSharedPtr& mesh){
     GL_C( glViewport(0,0,m_shadow_map_resolution,m_shadow_map_resolution) );
     GL_C( m_shadow_map_shader.use() );
     m_shadow_map_shader.uniform_4x4(MVP, "MVP");
-    m_shadow_map_shader.draw_into(m_shadow_map_fbo, {} ); //makes the shaders draw into the buffers we defines in the gbuffer
+    m_shadow_map_shader.uniform_bool(false, "is_instanced"); //points are never instanced
+    m_shadow_map_shader.draw_into(fbo, {} ); //makes the shaders draw into the buffers we defines in the gbuffer
 
     // draw
     GL_C( mesh->vao.bind() ); 
@@ -130,10 +123,106 @@ void SpotLight::render_points_to_shadow_map(MeshGLSharedPtr& mesh){
 
 }
 
+Frustum SpotLight::shadow_map_frustum(){
+    Eigen::Vector2f viewport_size;
+    viewport_size<< m_shadow_map_resolution, m_shadow_map_resolution;
+    return frustum(viewport_size);
+}
+
 void SpotLight::clear_shadow_map(){
     if (has_shadow_map()){
         m_shadow_map_fbo.clear();
     }
+    m_dynamic_meshes.clear();
+    invalidate_static_shadow_map();
+}
+
+bool SpotLight::is_static_shadow_map_stale(const std::unordered_set<unsigned long long>& meshes_in_scene){
+    if(m_is_static_shadow_map_dirty || m_static_resolution!=m_shadow_map_resolution){
+        return true;
+    }
+
+    Eigen::Vector2f viewport_size;
+    viewport_size<< m_shadow_map_resolution, m_shadow_map_resolution;
+    Eigen::Matrix4f view_proj=proj_matrix(viewport_size)*view_matrix();
+    if(view_proj!=m_static_view_proj){
+        return true;
+    }
+
+    for(const unsigned long long mesh_uid : m_static_meshes){
+        if(!meshes_in_scene.count(mesh_uid)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SpotLight::is_dynamic_shadow_map_stale(const std::unordered_set<unsigned long long>& meshes_in_scene){
+    //a removed mesh is not in the scene anymore so the loop over the dirty meshes never sees it, we have to look for it here
+    for(const unsigned long long mesh_uid : m_dynamic_meshes){
+        if(!meshes_in_scene.count(mesh_uid)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SpotLight::is_in_shadow_map(const MeshGL* mesh, const bool static_layer){
+    return static_layer ? m_static_meshes.count(mesh->m_uid)>0 : m_dynamic_meshes.count(mesh->m_uid)>0;
+}
+
+void SpotLight::begin_static_shadow_map(){
+    init_shadow_map_fbo(m_static_shadow_map_fbo);
+    m_static_shadow_map_fbo.clear();
+    reset_static_layer();
+}
+
+void SpotLight::begin_dynamic_shadow_map(){
+    CHECK(m_static_shadow_map_fbo.is_initialized()) << "The static layer of the shadow map has to be rendered before the dynamic one";
+    init_shadow_map_fbo(m_shadow_map_fbo);
+    reset_dynamic_layer();
+
+    GL_C( glCopyImageSubData(m_static_shadow_map_fbo.tex_with_name("shadow_map_depth").tex_id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                             m_shadow_map_fbo.tex_with_name("shadow_map_depth").tex_id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                             m_shadow_map_resolution, m_shadow_map_resolution, 1) );
+}
+
+void SpotLight::invalidate_static_shadow_map(){
+    m_is_static_shadow_map_dirty=true;
+}
+
+void SpotLight::reset_static_layer(){
+    m_static_meshes.clear();
+
+    Eigen::Vector2f viewport_size;
+    viewport_size<< m_shadow_map_resolution, m_shadow_map_resolution;
+    m_static_view_proj=proj_matrix(viewport_size)*view_matrix();
+    m_static_resolution=m_shadow_map_resolution;
+    m_is_static_shadow_map_dirty=false;
+}
+
+void SpotLight::reset_dynamic_layer(){
+    m_dynamic_meshes.clear();
+}
+
+void SpotLight::add_to_shadow_map(const MeshGL* mesh, const bool static_layer){
+    if(static_layer){
+        m_static_meshes.insert(mesh->m_uid);
+    }else{
+        m_dynamic_meshes.insert(mesh->m_uid);
+    }
+}
+
+void SpotLight::init_shadow_map_fbo(gl::GBuffer& fbo){
+    //add a depth texture to the framebuffer of the shadow map
+    if(!fbo.is_initialized() || fbo.width()!=m_shadow_map_resolution || fbo.height()!=m_shadow_map_resolution ){
+        fbo.set_size(m_shadow_map_resolution, m_shadow_map_resolution);
+        fbo.add_depth("shadow_map_depth");
+        //make the depth map have nearest sampling because that will work best for shadow mapping
+        // fbo.tex_with_name("shadow_map_depth").set_filter_mode(GL_NEAREST);
+
+        fbo.sanity_check();
+    }
 }
 
 void SpotLight::set_shadow_map_resolution(const int shadow_map_resolution){
@@ -0,0 +1,179 @@
+#include "easy_pbr/TextureUploader.h"
+
+//c++
+#include <algorithm>
+#include <cstring>
+
+//my stuff
+#include "easy_pbr/MeshGL.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+//same conventions as Texture2D::upload_from_cv_mat, the mats come from opencv so they are bgr and we swap red and blue when uploading
+static void cv_type2gl_formats(GLint& internal_format, GLenum& format, GLenum& type, const int cv_type){
+    const int depth=CV_MAT_DEPTH(cv_type);
+    const int nr_channels=CV_MAT_CN(cv_type);
+
+    if(depth==CV_8U){
+        type=GL_UNSIGNED_BYTE;
+        const GLint internal_formats[4]={GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+        internal_format=internal_formats[nr_channels-1];
+    }else if(depth==CV_16U){
+        type=GL_UNSIGNED_SHORT;
+        const GLint internal_formats[4]={GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+        internal_format=internal_formats[nr_channels-1];
+    }else if(depth==CV_32F){
+        type=GL_FLOAT;
+        const GLint internal_formats[4]={GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F};
+        internal_format=internal_formats[nr_channels-1];
+    }else{
+        LOG(FATAL) << "Texture uploader does not support cv mats with depth " << depth;
+    }
+
+    const GLenum formats[4]={GL_RED, GL_RG, GL_BGR, GL_BGRA};
+    format=formats[nr_channels-1];
+}
+
+
+TextureUploader::TextureUploader():
+    m_pbo_id(0)
+{
+    glGenBuffers(1, &m_pbo_id);
+}
+
+TextureUploader::~TextureUploader(){
+    glDeleteBuffers(1, &m_pbo_id);
+}
+
+void TextureUploader::enqueue(const std::shared_ptr<MeshGL>& owner, gl::Texture2D& tex, const std::vector<cv::Mat>& mips){
+    CHECK(!mips.empty()) << "Trying to upload a texture with no mip levels";
+
+    //if the same texture still has an upload going on, we discard it because the new data overwrites it anyway
+    m_jobs.erase( std::remove_if(m_jobs.begin(), m_jobs.end(), [&tex](const UploadJob& job){ return job.tex==&tex; } ), m_jobs.end() );
+
+    UploadJob job;
+    job.owner=owner;
+    job.tex=&tex;
+    job.mips=mips;
+    job.cur_lvl=mips.size()-1;
+    job.cur_row=0;
+    job.storage_allocated=false;
+    m_jobs.push_back(job);
+}
+
+size_t TextureUploader::upload(const size_t budget_bytes){
+    size_t bytes_uploaded=0;
+
+    GL_C( glPixelStorei(GL_UNPACK_ALIGNMENT, 1) ); //the rows of the mats are tightly packed
+
+    while(!m_jobs.empty() && bytes_uploaded<budget_bytes){
+        UploadJob& job=m_jobs.front();
+
+        //the mesh got deleted in the meantime so there is nothing to upload to
+        if(job.owner.expired()){
+            m_jobs.pop_front();
+            continue;
+        }
+
+        if(!job.storage_allocated){
+            allocate_storage(job);
+        }
+        if(job.cur_lvl<0){ //allocating can already upload all the levels if the texture is tiny
+            m_jobs.pop_front();
+            continue;
+        }
+
+        const cv::Mat& mip=job.mips[job.cur_lvl];
+        const size_t row_bytes=mip.cols*mip.elemSize();
+        const int rows_left=mip.rows-job.cur_row;
+        const int rows_in_budget=std::max<size_t>(1, (budget_bytes-bytes_uploaded)/row_bytes );
+        const int nr_rows=std::min(rows_left, rows_in_budget);
+
+        upload_rows(job, nr_rows);
+        bytes_uploaded+=nr_rows*row_bytes;
+
+        if(job.cur_lvl<0){
+            m_jobs.pop_front();
+        }
+    }
+
+    GL_C( glPixelStorei(GL_UNPACK_ALIGNMENT, 4) );
+
+    return bytes_uploaded;
+}
+
+int TextureUploader::nr_pending() const{
+    return m_jobs.size();
+}
+
+size_t TextureUploader::nr_bytes_pending() const{
+    size_t nr_bytes=0;
+    for(size_t i = 0; i < m_jobs.size(); i++){
+        const UploadJob& job=m_jobs[i];
+        for(int lvl = 0; lvl <= job.cur_lvl; lvl++){
+            const cv::Mat& mip=job.mips[lvl];
+            int nr_rows= lvl==job.cur_lvl ? mip.rows-job.cur_row : mip.rows;
+            nr_bytes+=nr_rows*mip.cols*mip.elemSize();
+        }
+    }
+    return nr_bytes;
+}
+
+void TextureUploader::allocate_storage(UploadJob& job){
+    GLint internal_format;
+    GLenum format, type;
+    cv_type2gl_formats(internal_format, format, type, job.mips[0].type());
+
+    //level 0 goes through the texture so that it knows about its size and format, the rest of the levels we allocate ourselves
+    gl::Texture2D& tex=*job.tex;
+    tex.allocate_or_resize(internal_format, format, type, job.mips[0].cols, job.mips[0].rows);
+    GL_C( glBindTexture(GL_TEXTURE_2D, tex.tex_id()) );
+    for(size_t lvl = 1; lvl < job.mips.size(); lvl++){
+        GL_C( glTexImage2D(GL_TEXTURE_2D, lvl, internal_format, job.mips[lvl].cols, job.mips[lvl].rows, 0, format, type, nullptr) );
+    }
+    GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job.mips.size()-1) );
+    GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.mips.size()-1) );
+    job.storage_allocated=true;
+
+    //the coarsest level is a single pixel and it has to be there right away so that the texture is complete when it gets sampled in this frame
+    upload_rows(job, job.mips[job.cur_lvl].rows);
+}
+
+void TextureUploader::upload_rows(UploadJob& job, const int nr_rows){
+    const cv::Mat& mip=job.mips[job.cur_lvl];
+    CHECK(mip.isContinuous()) << "The mip level " << job.cur_lvl << " is not continuous";
+    const size_t row_bytes=mip.cols*mip.elemSize();
+    const size_t nr_bytes=nr_rows*row_bytes;
+
+    GLint internal_format;
+    GLenum format, type;
+    cv_type2gl_formats(internal_format, format, type, mip.type());
+
+    //orphan the previous storage of the pbo so we don't wait for the previous transfer to finish
+    GL_C( glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo_id) );
+    GL_C( glBufferData(GL_PIXEL_UNPACK_BUFFER, nr_bytes, nullptr, GL_STREAM_DRAW) );
+    void* ptr=glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, nr_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    CHECK(ptr) << "Could not map the pixel unpack buffer";
+    std::memcpy(ptr, mip.ptr(job.cur_row), nr_bytes);
+    GL_C( glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) );
+
+    GL_C( glBindTexture(GL_TEXTURE_2D, job.tex->tex_id()) );
+    GL_C( glTexSubImage2D(GL_TEXTURE_2D, job.cur_lvl, 0, job.cur_row, mip.cols, nr_rows, format, type, nullptr) ); //reads from offset 0 of the bound pbo
+    GL_C( glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0) );
+
+    job.cur_row+=nr_rows;
+    if(job.cur_row>=mip.rows){
+        //this level is finished so we can start sampling from it
+        GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.cur_lvl) );
+        job.cur_lvl--;
+        job.cur_row=0;
+    }
+}
+
+
+} //namespace easy_pbr
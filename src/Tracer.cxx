@@ -0,0 +1,421 @@
+#include "easy_pbr/Tracer.h"
+
+//c++
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+//my stuff
+#include "UtilsGL.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+std::atomic<bool> Tracer::m_enabled(false);
+std::atomic<bool> Tracer::m_gpu_timing_enabled(false);
+
+namespace{
+
+struct TraceEvent{
+    const char* name;
+    int64_t start_ns; //since the epoch of the tracer
+    int64_t dur_ns;
+};
+
+struct OpenScope{
+    const char* name;
+    int64_t start_ns;
+};
+
+//events of one thread. The mutex is only contended while exporting so recording stays cheap
+struct ThreadTrace{
+    std::mutex mutex;
+    int tid;
+    std::string name;
+    std::vector<TraceEvent> events;
+    std::vector<OpenScope> open_scopes;
+};
+
+struct GpuScope{
+    const char* name;
+    GLuint start_query;
+    GLuint end_query;
+    bool is_traced; //if tracing was enabled when it began, otherwise we only keep its duration
+};
+
+struct TracerState{
+    std::chrono::steady_clock::time_point epoch=std::chrono::steady_clock::now();
+    std::mutex mutex; //for the list of threads and the gpu events
+    std::vector< std::shared_ptr<ThreadTrace> > threads; //kept after the threads exit so that their events can still be exported
+    std::atomic<int> max_events_per_thread{1000000};
+    std::atomic<int> nr_dropped{0};
+
+    //only touched from the thread with the gl context
+    std::vector<GLuint> free_queries;
+    std::vector<GpuScope> open_gpu_scopes;
+    std::deque<GpuScope> pending_gpu_scopes; //in the order in which they were issued so the gpu finishes them in this order too
+    int64_t gpu_to_cpu_offset_ns=0;
+    int nr_frames_since_calibration=-1; //-1 means never calibrated
+    std::vector<TraceEvent> gpu_events;
+    std::map<std::string, float> last_gpu_ms; //most recent duration of each gpu scope
+};
+
+//the gpu and cpu clocks drift a bit so we realign them every once in a while
+const int CALIBRATION_INTERVAL_FRAMES=120;
+//if new_frame() is never called the queries would pile up so past this many we drop the oldest
+const size_t MAX_PENDING_GPU_SCOPES=1024;
+
+TracerState& state(){
+    static TracerState s;
+    return s;
+}
+
+int64_t now_ns(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-state().epoch).count();
+}
+
+ThreadTrace& this_thread_trace(){
+    thread_local std::shared_ptr<ThreadTrace> trace;
+    if(!trace){
+        trace=std::make_shared<ThreadTrace>();
+        TracerState& s=state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        trace->tid=s.threads.size();
+        trace->name="thread_"+std::to_string(trace->tid);
+        s.threads.push_back(trace);
+    }
+    return *trace;
+}
+
+bool add_event(std::vector<TraceEvent>& events, const TraceEvent& event){
+    if((int)events.size()>=state().max_events_per_thread.load(std::memory_order_relaxed)){
+        state().nr_dropped++;
+        return false;
+    }
+    events.push_back(event);
+    return true;
+}
+
+GLuint get_query(){
+    TracerState& s=state();
+    if(s.free_queries.empty()){
+        GLuint query;
+        GL_C( glGenQueries(1, &query) );
+        return query;
+    }
+    GLuint query=s.free_queries.back();
+    s.free_queries.pop_back();
+    return query;
+}
+
+//returns the queries of the gpu scopes that are still open or not read yet so that they can be reused
+void drop_gpu_scopes(){
+    TracerState& s=state();
+    for(const GpuScope& scope : s.open_gpu_scopes){
+        s.free_queries.push_back(scope.start_query);
+    }
+    for(const GpuScope& scope : s.pending_gpu_scopes){
+        s.free_queries.push_back(scope.start_query);
+        s.free_queries.push_back(scope.end_query);
+    }
+    s.open_gpu_scopes.clear();
+    s.pending_gpu_scopes.clear();
+}
+
+void calibrate_gpu_clock(){
+    TracerState& s=state();
+    GLint64 gpu_ns=0;
+    GL_C( glGetInteger64v(GL_TIMESTAMP, &gpu_ns) );
+    s.gpu_to_cpu_offset_ns=now_ns()-gpu_ns;
+    s.nr_frames_since_calibration=0;
+}
+
+std::string escape_json(const std::string& str){
+    std::string escaped;
+    for(char c : str){
+        if(c=='"' || c=='\\'){
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+double percentile(const std::vector<double>& sorted, const double p){
+    return sorted[ (size_t)std::round(p*(sorted.size()-1)) ];
+}
+
+} //namespace
+
+
+void Tracer::set_enabled(const bool enabled){
+    if(enabled==is_enabled()){
+        return;
+    }
+    m_enabled.store(enabled);
+    //scopes that are open while it gets toggled would be closed by a different end() than the one that matches them
+    TracerState& s=state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for(size_t i = 0; i < s.threads.size(); i++){
+            std::lock_guard<std::mutex> thread_lock(s.threads[i]->mutex);
+            s.threads[i]->open_scopes.clear();
+        }
+    }
+    if(enabled){
+        s.nr_frames_since_calibration=-1;
+    }else{
+        drop_gpu_scopes();
+    }
+}
+
+void Tracer::set_gpu_timing_enabled(const bool enabled){
+    m_gpu_timing_enabled.store(enabled);
+}
+
+void Tracer::set_thread_name(const std::string& name){
+    ThreadTrace& trace=this_thread_trace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.name=name;
+}
+
+void Tracer::set_max_events_per_thread(const int max_events){
+    CHECK(max_events>0) << "The max nr of events per thread has to be positive but it is " << max_events;
+    state().max_events_per_thread=max_events;
+}
+
+void Tracer::begin(const char* name){
+    if(!is_enabled()){
+        return;
+    }
+    ThreadTrace& trace=this_thread_trace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.open_scopes.push_back( {name, now_ns()} );
+}
+
+void Tracer::end(){
+    if(!is_enabled()){
+        return;
+    }
+    int64_t end_ns=now_ns();
+    ThreadTrace& trace=this_thread_trace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    if(trace.open_scopes.empty()){ //it got enabled while the scope was open
+        return;
+    }
+    OpenScope scope=trace.open_scopes.back();
+    trace.open_scopes.pop_back();
+    add_event(trace.events, {scope.name, scope.start_ns, end_ns-scope.start_ns} );
+}
+
+void Tracer::begin_gpu(const char* name){
+    if(!is_gpu_timing_active()){
+        return;
+    }
+    begin(name);
+    GpuScope scope;
+    scope.name=name;
+    scope.start_query=get_query();
+    scope.end_query=0;
+    scope.is_traced=is_enabled();
+    GL_C( glQueryCounter(scope.start_query, GL_TIMESTAMP) );
+    state().open_gpu_scopes.push_back(scope);
+}
+
+void Tracer::end_gpu(){
+    if(!is_gpu_timing_active()){
+        return;
+    }
+    TracerState& s=state();
+    if(!s.open_gpu_scopes.empty()){
+        GpuScope scope=s.open_gpu_scopes.back();
+        s.open_gpu_scopes.pop_back();
+        scope.end_query=get_query();
+        GL_C( glQueryCounter(scope.end_query, GL_TIMESTAMP) );
+        s.pending_gpu_scopes.push_back(scope);
+        if(s.pending_gpu_scopes.size()>MAX_PENDING_GPU_SCOPES){
+            GpuScope oldest=s.pending_gpu_scopes.front();
+            s.pending_gpu_scopes.pop_front();
+            s.free_queries.push_back(oldest.start_query);
+            s.free_queries.push_back(oldest.end_query);
+            s.nr_dropped++;
+        }
+    }
+    end();
+}
+
+void Tracer::new_frame(){
+    TracerState& s=state();
+    if(!is_gpu_timing_active() && s.pending_gpu_scopes.empty()){
+        return;
+    }
+    //the clock offset is only needed to place the events in the trace
+    if(is_enabled()){
+        if(s.nr_frames_since_calibration<0 || s.nr_frames_since_calibration>=CALIBRATION_INTERVAL_FRAMES){
+            calibrate_gpu_clock();
+        }
+        s.nr_frames_since_calibration++;
+    }
+
+    while(!s.pending_gpu_scopes.empty()){
+        GpuScope& scope=s.pending_gpu_scopes.front();
+        GLint available=0;
+        GL_C( glGetQueryObjectiv(scope.end_query, GL_QUERY_RESULT_AVAILABLE, &available) );
+        if(!available){
+            break; //the ones after it were issued later so they are not done either
+        }
+        GLuint64 start_ns=0, end_ns=0;
+        GL_C( glGetQueryObjectui64v(scope.start_query, GL_QUERY_RESULT, &start_ns) );
+        GL_C( glGetQueryObjectui64v(scope.end_query, GL_QUERY_RESULT, &end_ns) );
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.last_gpu_ms[scope.name]=(end_ns-start_ns)/1e6;
+            if(scope.is_traced){
+                add_event(s.gpu_events, {scope.name, (int64_t)start_ns+s.gpu_to_cpu_offset_ns, (int64_t)(end_ns-start_ns)} );
+            }
+        }
+        s.free_queries.push_back(scope.start_query);
+        s.free_queries.push_back(scope.end_query);
+        s.pending_gpu_scopes.pop_front();
+    }
+}
+
+float Tracer::gpu_time_ms(const std::string& name){
+    TracerState& s=state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it=s.last_gpu_ms.find(name);
+    if(it==s.last_gpu_ms.end()){
+        return -1;
+    }
+    return it->second;
+}
+
+std::vector< std::pair<std::string, float> > Tracer::gpu_times(){
+    TracerState& s=state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return std::vector< std::pair<std::string, float> >(s.last_gpu_ms.begin(), s.last_gpu_ms.end());
+}
+
+void Tracer::clear(){
+    TracerState& s=state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for(size_t i = 0; i < s.threads.size(); i++){
+        std::lock_guard<std::mutex> thread_lock(s.threads[i]->mutex);
+        s.threads[i]->events.clear();
+    }
+    s.gpu_events.clear();
+    s.nr_dropped=0;
+}
+
+void Tracer::write_chrome_trace(const std::string& path){
+    std::ofstream file(path);
+    CHECK(file.is_open()) << "Could not open " << path;
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"cpu\"}},\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"gpu\"}}";
+
+    auto write_events=[&file](const std::vector<TraceEvent>& events, const int pid, const int tid){
+        for(size_t i = 0; i < events.size(); i++){
+            const TraceEvent& e=events[i];
+            file << ",\n{\"name\":\"" << escape_json(e.name) << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid
+                 << ",\"ts\":" << e.start_ns/1e3 << ",\"dur\":" << e.dur_ns/1e3 << "}";
+        }
+    };
+
+    TracerState& s=state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for(size_t i = 0; i < s.threads.size(); i++){
+        ThreadTrace& trace=*s.threads[i];
+        std::lock_guard<std::mutex> thread_lock(trace.mutex);
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << trace.tid << ",\"args\":{\"name\":\"" << escape_json(trace.name) << "\"}}";
+        write_events(trace.events, 0, trace.tid);
+    }
+    write_events(s.gpu_events, 1, 0);
+    file << "\n]}\n";
+    VLOG(1) << "Wrote trace to " << path;
+}
+
+std::vector<TraceStats> Tracer::stats(){
+    //gather the durations of each name, the cpu and gpu side of a pass are kept apart
+    std::map< std::pair<std::string, bool>, std::vector<double> > durations_ms;
+    {
+        TracerState& s=state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for(size_t i = 0; i < s.threads.size(); i++){
+            std::lock_guard<std::mutex> thread_lock(s.threads[i]->mutex);
+            for(const TraceEvent& e : s.threads[i]->events){
+                durations_ms[ std::make_pair(std::string(e.name), false) ].push_back(e.dur_ns/1e6);
+            }
+        }
+        for(const TraceEvent& e : s.gpu_events){
+            durations_ms[ std::make_pair(std::string(e.name), true) ].push_back(e.dur_ns/1e6);
+        }
+    }
+
+    std::vector<TraceStats> stats;
+    for(auto& entry : durations_ms){
+        std::vector<double>& durations=entry.second;
+        std::sort(durations.begin(), durations.end());
+        TraceStats stat;
+        stat.name=entry.first.first;
+        stat.is_gpu=entry.first.second;
+        stat.count=durations.size();
+        double sum=0;
+        for(double d : durations){
+            sum+=d;
+        }
+        stat.mean_ms=sum/durations.size();
+        stat.p50_ms=percentile(durations, 0.5);
+        stat.p90_ms=percentile(durations, 0.9);
+        stat.p99_ms=percentile(durations, 0.99);
+        stat.max_ms=durations.back();
+        stats.push_back(stat);
+    }
+    return stats;
+}
+
+std::string Tracer::stats_string(){
+    std::vector<TraceStats> all_stats=stats();
+    std::sort(all_stats.begin(), all_stats.end(), [](const TraceStats& a, const TraceStats& b){ return a.mean_ms*a.count > b.mean_ms*b.count; });
+
+    std::stringstream ss;
+    ss << std::left << std::setw(32) << "name" << std::setw(5) << "" << std::right << std::setw(8) << "count"
+       << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max" << "  (ms)\n";
+    ss << std::fixed << std::setprecision(3);
+    for(const TraceStats& stat : all_stats){
+        ss << std::left << std::setw(32) << stat.name << std::setw(5) << (stat.is_gpu ? "gpu" : "cpu") << std::right << std::setw(8) << stat.count
+           << std::setw(10) << stat.mean_ms << std::setw(10) << stat.p50_ms << std::setw(10) << stat.p90_ms << std::setw(10) << stat.p99_ms << std::setw(10) << stat.max_ms << "\n";
+    }
+    return ss.str();
+}
+
+int Tracer::nr_events(){
+    TracerState& s=state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    size_t nr_events=s.gpu_events.size();
+    for(size_t i = 0; i < s.threads.size(); i++){
+        std::lock_guard<std::mutex> thread_lock(s.threads[i]->mutex);
+        nr_events+=s.threads[i]->events.size();
+    }
+    return nr_events;
+}
+
+int Tracer::nr_dropped(){
+    return state().nr_dropped.load();
+}
+
+} //namespace easy_pbr
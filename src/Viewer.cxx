@@ -10,6 +10,9 @@
 
 #include <string> //find_last_of
 #include <limits> //signaling_nan
+#include <algorithm>
+#include <unordered_set>
+#include <future>
 
 //loguru
 #define LOGURU_IMPLEMENTATION 1
@@ -30,6 +33,19 @@
 #include "easy_pbr/Gui.h"
 #include "easy_pbr/SpotLight.h"
 #include "easy_pbr/Recorder.h"
+#include "easy_pbr/Picker.h"
+#include "easy_pbr/Tracer.h"
+#include "easy_pbr/MeshLoader.h"
+#include "easy_pbr/TextureUploader.h"
+#include "easy_pbr/MeshBatcher.h"
+#include "easy_pbr/LayeredShadowMaps.h"
+#include "easy_pbr/GpuTimer.h"
+#include "easy_pbr/IblCache.h"
+#include "easy_pbr/SphericalHarmonics.h"
+#include "easy_pbr/HeadlessContext.h"
+#include "easy_pbr/AsyncReadback.h"
+#include "easy_pbr/UniformBuffers.h"
+#include "easy_pbr/PointCloudOctree.h"
 #include "easy_pbr/LabelMngr.h"
 #include "RandGenerator.h"
 #include "opencv_utils.h"
@@ -60,8 +76,8 @@ using namespace radu::utils;
 namespace easy_pbr{
 
 Viewer::Viewer(const std::string config_file):
-   dummy( init_context() ),
-   dummy_glad(gladLoadGL() ),
+   dummy( init_context(config_file) ),
+   dummy_glad( m_headless_context ? true : gladLoadGL() ), //the headless context already loaded the functions from its own library
     #ifdef EASYPBR_WITH_DIR_WATCHER
         dir_watcher( new  emilib::DelayedDirWatcher( std::string(PROJECT_SOURCE_DIR)+"/shaders/",5)  ),
     #endif
@@ -69,17 +85,28 @@ Viewer::Viewer(const std::string config_file):
     // m_gui(new Gui(this, m_window )),
     m_default_camera(new Camera),
     m_recorder(new Recorder( this )),
+    m_picker( Picker::create(this) ),
+    m_mesh_loader( MeshLoader::create() ),
+    m_texture_uploader( TextureUploader::create() ),
+    m_mesh_batcher( MeshBatcher::create() ),
+    m_layered_shadow_maps( LayeredShadowMaps::create() ),
+    m_batch_readback( AsyncReadback::create(9) ), //3 frames in flight with up to 3 images each
     m_rand_gen(new RandGenerator()),
     m_timer(new Timer()),
     m_nr_drawn_frames(0),
+    m_meshes_gl_version(0),
     m_viewport_size(1920, 1080),
     m_background_color(0.2, 0.2, 0.2),
     // m_background_color(21.0/255.0, 21.0/255.0, 21.0/255.0),
     m_draw_points_shader("draw_points"),
     m_draw_lines_shader("draw_lines"),
     m_draw_mesh_shader("draw_mesh"),
+    m_draw_mesh_batched_shader("draw_mesh_batched"),
+    m_camera_ubo_id(0),
+    m_color_scheme_height_ubo_id(0),
     m_draw_wireframe_shader("draw_wireframe"),
     m_rvec_tex("rvec_tex"),
+    m_ao_history_idx(0),
     m_fullscreen_quad(MeshGL::create()),
     m_ssao_downsample(1),
     m_nr_samples(64),
@@ -90,17 +117,52 @@ Viewer::Viewer(const std::string config_file):
     m_ambient_color( 71.0/255.0, 70.0/255.0, 66.3/255.0  ),
     m_ambient_color_power(0.05),
     m_enable_culling(false),
+    m_texture_upload_budget_mb(32),
+    m_enable_frustum_culling(true),
+    m_nr_meshes_drawn(0),
+    m_nr_meshes_culled(0),
+    m_nr_triangles_drawn(0),
+    m_nr_triangles_culled(0),
+    m_nr_shadow_meshes_drawn(0),
+    m_nr_shadow_meshes_culled(0),
+    m_nr_shadow_passes_skipped(0),
+    m_nr_static_shadow_passes(0),
+    m_nr_dynamic_shadow_passes(0),
+    m_nr_shadow_draw_calls(0),
+    m_enable_layered_shadow_maps(false),
+    m_layered_shadow_map_max_resolution(2048),
+    m_enable_mesh_batching(false),
+    m_mesh_batching_max_nr_vertices(10000),
+    m_nr_batched_draws(0),
+    m_enable_id_buffers(false),
+    m_id_buffers_32bit(false),
+    m_id_buffers_label_from_gt(true),
     m_enable_ssao(true),
+    m_ssao_use_compute(false),
+    m_ssao_temporal(false),
+    m_ssao_temporal_nr_samples(8),
+    m_ssao_temporal_max_frames(8),
+    m_ssao_temporal_max_frames_static(64),
+    m_ssao_nr_accumulated_frames(0),
+    m_ssao_reset_history(true),
+    m_ssao_history_valid(false),
+    m_ssao_prev_V(Eigen::Matrix4f::Identity()),
+    m_ssao_prev_P(Eigen::Matrix4f::Identity()),
+    m_scene_changed(true),
     m_enable_bloom(true),
     m_bloom_threshold(0.85),
     m_bloom_start_mip_map_lvl(1),
     m_bloom_max_mip_map_lvl(5),
     m_bloom_blur_iters(3),
+    m_bloom_dual_filter(false),
+    m_bloom_dual_filter_offset(1.0),
     m_lights_follow_camera(false),
     m_environment_cubemap_resolution(512),
     m_irradiance_cubemap_resolution(32),
     m_prefilter_cubemap_resolution(128),
     m_brdf_lut_resolution(512),
+    m_use_irradiance_sh(false),
+    m_irradiance_cubemap_is_computed(false),
     m_environment_map_blur(0),
     m_using_fat_gbuffer(false),
     m_surfel_blend_factor(-10.0),
@@ -114,7 +176,10 @@ Viewer::Viewer(const std::string config_file):
     m_snapshot_name("img.png"),
     m_record_gui(false),
     m_record_with_transparency(true),
-    m_first_draw(true)
+    m_first_draw(true),
+    m_shadow_maps_were_layered(false),
+    m_warned_too_many_shadow_layers(false),
+    m_nr_dropped_meshes(0)
     {
         #ifdef EASYPBR_WITH_DIR_WATCHER
             VLOG(1) << "created viewer with dirwatcher";
@@ -125,6 +190,10 @@ Viewer::Viewer(const std::string config_file):
         // m_old_time=m_timer->elapsed_ms();
         m_camera=m_default_camera;
         init_params(config_file); //tries to get the configurations and if not present it will get them from the default cfg
+        if(m_headless_context){
+            m_viewport_size << m_headless_context->width(), m_headless_context->height();
+            m_show_gui=false;
+        }
 
         compile_shaders(); 
         init_opengl();                     
@@ -134,6 +203,11 @@ Viewer::Viewer(const std::string config_file):
 
 Viewer::~Viewer(){
     // LOG(WARNING) << "Destroying viewer";
+    if(!m_chrome_trace_path.empty() && Tracer::nr_events()>0){
+        Tracer::write_chrome_trace(m_chrome_trace_path);
+    }
+    glDeleteBuffers(1, &m_camera_ubo_id);
+    glDeleteBuffers(1, &m_color_scheme_height_ubo_id);
 }
 
 void Viewer::init_params(const std::string config_file){
@@ -159,6 +233,9 @@ void Viewer::init_params(const std::string config_file){
     Config default_bg_cfg=default_cfg["visualization"]["background"];
     Config default_ibl_cfg=default_cfg["visualization"]["ibl"];
     Config default_lights_cfg=default_cfg["visualization"]["lights"];
+    Config default_recorder_cfg=default_cfg["visualization"]["recorder"];
+    Config default_core_cfg=default_cfg["core"];
+    Config default_tracing_cfg=default_cfg["core"]["tracing"];
 
     //get the current config and if the section is not available, fallback to the default one
     Config cfg = configuru::parse_file(config_file_abs, CFG);
@@ -170,6 +247,9 @@ void Viewer::init_params(const std::string config_file){
     Config bg_cfg=vis_cfg.get_or("background",default_vis_cfg);
     Config ibl_cfg=vis_cfg.get_or("ibl",default_vis_cfg);
     Config lights_cfg=vis_cfg.get_or("lights",default_vis_cfg);
+    Config core_cfg=cfg.get_or("core", default_cfg);
+    Config tracing_cfg=core_cfg.get_or("tracing", default_core_cfg);
+    Config recorder_cfg=vis_cfg.get_or("recorder",default_vis_cfg);
 
     // //general
     // m_show_gui = vis_config.get_or("show_gui", default_vis_config);
@@ -233,10 +313,30 @@ void Viewer::init_params(const std::string config_file){
 
     //attempt 2
 
+    //tracing
+    Tracer::set_max_events_per_thread( tracing_cfg.get_or("max_events_per_thread", default_tracing_cfg) );
+    m_chrome_trace_path = (std::string)tracing_cfg.get_or("chrome_trace_path", default_tracing_cfg);
+    Tracer::set_thread_name("render");
+    Tracer::set_enabled( tracing_cfg.get_or("enable", default_tracing_cfg) );
+    Tracer::set_gpu_timing_enabled(true); //the profiler window and gpu_time_ms() show the gpu time of the passes even when nothing is traced
+
     // general
     m_show_gui = vis_cfg.get_or("show_gui", default_vis_cfg);
     m_subsample_factor = vis_cfg.get_or("subsample_factor", default_vis_cfg);
     m_enable_culling = vis_cfg.get_or("enable_culling", default_vis_cfg);
+    m_texture_upload_budget_mb = vis_cfg.get_or("texture_upload_budget_mb", default_vis_cfg);
+    m_enable_frustum_culling = vis_cfg.get_or("enable_frustum_culling", default_vis_cfg);
+    m_enable_mesh_batching = vis_cfg.get_or("enable_mesh_batching", default_vis_cfg);
+    m_enable_layered_shadow_maps = vis_cfg.get_or("enable_layered_shadow_maps", default_vis_cfg);
+    m_layered_shadow_map_max_resolution = vis_cfg.get_or("layered_shadow_map_max_resolution", default_vis_cfg);
+    m_mesh_batching_max_nr_vertices = vis_cfg.get_or("mesh_batching_max_nr_vertices", default_vis_cfg);
+    m_enable_id_buffers = vis_cfg.get_or("enable_id_buffers", default_vis_cfg);
+    std::string id_buffers_format = (std::string)vis_cfg.get_or("id_buffers_format", default_vis_cfg);
+    CHECK(id_buffers_format=="R16UI" || id_buffers_format=="R32UI") << "id_buffers_format should be R16UI or R32UI but it is " << id_buffers_format;
+    m_id_buffers_32bit = id_buffers_format=="R32UI";
+    std::string id_buffers_label_source = (std::string)vis_cfg.get_or("id_buffers_label_source", default_vis_cfg);
+    CHECK(id_buffers_label_source=="gt" || id_buffers_label_source=="pred") << "id_buffers_label_source should be gt or pred but it is " << id_buffers_label_source;
+    m_id_buffers_label_from_gt = id_buffers_label_source=="gt";
 
     //cam
     m_camera->m_fov=cam_cfg.get_float_else_default_else_nan("fov", default_cam_cfg)  ;
@@ -253,6 +353,11 @@ void Viewer::init_params(const std::string config_file){
     m_ao_power = ssao_cfg.get_or("ao_power", default_ssao_cfg);
     m_sigma_spacial = ssao_cfg.get_or("ao_blur_sigma_spacial", default_ssao_cfg);
     m_sigma_depth = ssao_cfg.get_or("ao_blur_sigma_depth", default_ssao_cfg);
+    m_ssao_use_compute = ssao_cfg.get_or("use_compute", default_ssao_cfg);
+    m_ssao_temporal = ssao_cfg.get_or("temporal_accumulation", default_ssao_cfg);
+    m_ssao_temporal_nr_samples = ssao_cfg.get_or("temporal_nr_samples", default_ssao_cfg);
+    m_ssao_temporal_max_frames = ssao_cfg.get_or("temporal_max_frames", default_ssao_cfg);
+    m_ssao_temporal_max_frames_static = ssao_cfg.get_or("temporal_max_frames_static", default_ssao_cfg);
 
     // //bloom
     m_enable_bloom = bloom_cfg.get_or("enable_bloom", default_bloom_cfg);
@@ -260,6 +365,8 @@ void Viewer::init_params(const std::string config_file){
     m_bloom_start_mip_map_lvl = bloom_cfg.get_or("start_mip_map_lvl", default_bloom_cfg);
     m_bloom_max_mip_map_lvl = bloom_cfg.get_or("max_mip_map_lvl", default_bloom_cfg);
     m_bloom_blur_iters = bloom_cfg.get_or("blur_iters", default_bloom_cfg);
+    m_bloom_dual_filter = bloom_cfg.get_or("dual_filter", default_bloom_cfg);
+    m_bloom_dual_filter_offset = bloom_cfg.get_or("dual_filter_offset", default_bloom_cfg);
 
     // //edl
     m_auto_edl= edl_cfg.get_or("auto_settings", default_edl_cfg);
@@ -280,6 +387,32 @@ void Viewer::init_params(const std::string config_file){
     m_irradiance_cubemap_resolution = ibl_cfg.get_or("irradiance_cubemap_resolution", default_ibl_cfg);
     m_prefilter_cubemap_resolution = ibl_cfg.get_or("prefilter_cubemap_resolution", default_ibl_cfg);
     m_brdf_lut_resolution = ibl_cfg.get_or("brdf_lut_resolution", default_ibl_cfg);
+    m_use_irradiance_sh = ibl_cfg.get_or("irradiance_sh", default_ibl_cfg);
+    bool enable_ibl_cache = ibl_cfg.get_or("enable_cache", default_ibl_cfg);
+    if(enable_ibl_cache){
+        m_ibl_cache=IblCache::create( (std::string)ibl_cfg.get_or("cache_dir", default_ibl_cfg) );
+    }
+
+    //recorder
+    m_recorder->m_nr_writer_threads = recorder_cfg.get_or("nr_writer_threads", default_recorder_cfg);
+    m_recorder->m_queue_capacity = recorder_cfg.get_or("queue_capacity", default_recorder_cfg);
+    m_recorder->m_queue_policy = RecorderQueuePolicy::_from_string( ((std::string)recorder_cfg.get_or("queue_policy", default_recorder_cfg)).c_str() );
+    m_recorder->m_format = RecorderFormat::_from_string( ((std::string)recorder_cfg.get_or("format", default_recorder_cfg)).c_str() );
+    m_recorder->m_png_compression = recorder_cfg.get_or("png_compression", default_recorder_cfg);
+    m_recorder->m_video_fps = recorder_cfg.get_or("video_fps", default_recorder_cfg);
+    m_recorder->m_video_codec = (std::string)recorder_cfg.get_or("video_codec", default_recorder_cfg);
+    m_recorder->m_video_name = (std::string)recorder_cfg.get_or("video_name", default_recorder_cfg);
+    Config default_export_cfg=default_recorder_cfg["export"];
+    Config export_cfg=recorder_cfg.get_or("export", default_recorder_cfg);
+    m_recorder->m_export_enabled = export_cfg.get_or("enable", default_export_cfg);
+    m_recorder->m_export_format = RecorderFormat::_from_string( ((std::string)export_cfg.get_or("format", default_export_cfg)).c_str() );
+    m_recorder->m_export_color = export_cfg.get_or("color", default_export_cfg);
+    m_recorder->m_export_depth = export_cfg.get_or("depth", default_export_cfg);
+    m_recorder->m_export_normals_world = export_cfg.get_or("normals_world", default_export_cfg);
+    m_recorder->m_export_normals_camera = export_cfg.get_or("normals_camera", default_export_cfg);
+    m_recorder->m_export_mesh_id = export_cfg.get_or("mesh_id", default_export_cfg);
+    m_recorder->m_export_labels = export_cfg.get_or("labels", default_export_cfg);
+    m_recorder->m_export_instance_id = export_cfg.get_or("instance_id", default_export_cfg);
 
     //create the spot lights
     int nr_spot_lights = lights_cfg.get_or("nr_spot_lights", default_lights_cfg);
@@ -294,7 +427,33 @@ void Viewer::init_params(const std::string config_file){
 
 }
 
-bool Viewer::init_context(){
+bool Viewer::init_context(const std::string config_file){
+    //the context is created before the rest of the params are read so here we only look at the backend
+    std::string config_file_trim=radu::utils::trim_copy(config_file);
+    std::string config_file_abs;
+    if (fs::path(config_file_trim).is_relative()){
+        config_file_abs=(fs::path(PROJECT_SOURCE_DIR) / config_file_trim).string();
+    }else{
+        config_file_abs=config_file_trim;
+    }
+    Config default_cfg = configuru::parse_file(std::string(DEFAULT_CONFIG), CFG);
+    Config default_core_cfg=default_cfg["core"];
+    Config cfg = configuru::parse_file(config_file_abs, CFG);
+    Config core_cfg=cfg.get_or("core", default_cfg);
+    std::string context_backend = (std::string)core_cfg.get_or("context", default_core_cfg);
+
+    m_window=nullptr;
+    if(context_backend!="glfw"){
+        int headless_width = core_cfg.get_or("headless_width", default_core_cfg);
+        int headless_height = core_cfg.get_or("headless_height", default_core_cfg);
+        m_headless_context=HeadlessContext::create(context_backend, headless_width, headless_height);
+        if (!gladLoadGLLoader(m_headless_context->proc_loader())){
+            LOG(FATAL) << "GLAD failed to load";
+        }
+        VLOG(1) << "Created headless " << context_backend << " context with OpenGL " << glGetString(GL_VERSION) << " on " << glGetString(GL_RENDERER);
+        return true;
+    }
+
     // GLFWwindow* window;
     int window_width, window_height;
     window_width=640;
@@ -391,17 +550,23 @@ void Viewer::compile_shaders(){
     m_draw_points_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/points_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/points_frag.glsl" ) ;
     m_draw_lines_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/lines_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/lines_frag.glsl"  );
     m_draw_mesh_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/mesh_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/mesh_frag.glsl"  );
+    m_draw_mesh_batched_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/mesh_batched_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/mesh_batched_frag.glsl"  );
     m_draw_wireframe_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/wireframe_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/wireframe_frag.glsl"  );
     m_draw_surfels_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/render/surfels_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/surfels_frag.glsl" , std::string(EASYPBR_SHADERS_PATH)+"/render/surfels_geom.glsl" );
     m_compose_final_quad_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/compose_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/compose_frag.glsl"  );
     m_blur_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/blur_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/blur_frag.glsl"  );
+    m_bloom_downsample_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/blur_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/bloom_downsample_frag.glsl"  );
+    m_bloom_upsample_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/blur_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/bloom_upsample_frag.glsl"  );
     m_apply_postprocess_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/apply_postprocess_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/apply_postprocess_frag.glsl"  );
     m_blend_bg_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/render/blend_bg_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/blend_bg_frag.glsl"  );
 
     m_ssao_ao_pass_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/ao_pass_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/ssao/ao_pass_frag.glsl" );
-    // m_depth_linearize_shader.compile(std::string(PROJECT_SOURCE_DIR)+"/shaders/ssao/depth_linearize_compute.glsl");
     m_depth_linearize_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/depth_linearize_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/ssao/depth_linearize_frag.glsl");
     m_bilateral_blur_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/bilateral_blur_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/ssao/bilateral_blur_frag.glsl");
+    m_depth_linearize_compute_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/depth_linearize_compute.glsl");
+    m_ssao_ao_pass_compute_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/ao_pass_compute.glsl");
+    m_bilateral_blur_compute_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/bilateral_blur_compute.glsl");
+    m_ssao_temporal_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ssao/ao_pass_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/ssao/temporal_accumulation_frag.glsl");
 
     m_equirectangular2cubemap_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ibl/equirectangular2cubemap_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/ibl/equirectangular2cubemap_frag.glsl");
     m_radiance2irradiance_shader.compile(std::string(EASYPBR_SHADERS_PATH)+"/ibl/radiance2irradiance_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/ibl/radiance2irradiance_frag.glsl");
@@ -410,6 +575,7 @@ void Viewer::compile_shaders(){
 
     //debugging shaders 
     m_decode_gbuffer_debugging.compile( std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_frag.glsl"  );
+    m_batch_outputs_shader.compile( std::string(EASYPBR_SHADERS_PATH)+"/debug/decode_gbuffer_vert.glsl", std::string(EASYPBR_SHADERS_PATH)+"/render/batch_outputs_frag.glsl"  );
 }
 
 void Viewer::init_opengl(){
@@ -420,6 +586,12 @@ void Viewer::init_opengl(){
     GL_C( m_gbuffer.add_texture("normal_gtex", GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE) );  
     GL_C( m_gbuffer.add_texture("metalness_and_roughness_gtex", GL_RG8, GL_RG, GL_UNSIGNED_BYTE) ); 
     GL_C( m_gbuffer.add_texture("mesh_id_gtex", GL_R8I, GL_RED_INTEGER, GL_INT) ); 
+    if(m_enable_id_buffers){
+        GLint id_format= m_id_buffers_32bit ? GL_R32UI : GL_R16UI;
+        GL_C( m_gbuffer.add_texture("label_gtex", id_format, GL_RED_INTEGER, GL_UNSIGNED_INT) ); 
+        GL_C( m_gbuffer.add_texture("instance_id_gtex", id_format, GL_RED_INTEGER, GL_UNSIGNED_INT) ); 
+        GL_C( m_gbuffer.add_texture("primitive_id_gtex", GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT) ); //meshes can have more faces than R16UI can count. It's not cleared since the instance id of 0 already says that it's background
+    }
     GL_C( m_gbuffer.add_depth("depth_gtex") );
     m_gbuffer.sanity_check();
 
@@ -439,6 +611,11 @@ void Viewer::init_opengl(){
     GL_C( m_final_fbo_with_gui.set_size(m_viewport_size.x(), m_viewport_size.y() ) ); //established what will be the size of the textures attached to this framebuffer
     GL_C( m_final_fbo_with_gui.add_texture("color_gtex", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE) ); 
     m_final_fbo_with_gui.sanity_check();
+    //outputs of render_batch
+    GL_C( m_batch_outputs_fbo.set_size(m_gbuffer.width(), m_gbuffer.height() ) );
+    GL_C( m_batch_outputs_fbo.add_texture("normal_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) );
+    GL_C( m_batch_outputs_fbo.add_texture("depth_gtex", GL_R32F, GL_RED, GL_FLOAT) );
+    m_batch_outputs_fbo.sanity_check();
 
 
 
@@ -481,6 +658,16 @@ void Viewer::init_opengl(){
     //make some random samples in a hemisphere 
     create_random_samples_hemisphere();
 
+    //uniform buffers shared by the shaders that draw into the gbuffer
+    GL_C( glGenBuffers(1, &m_camera_ubo_id) );
+    GL_C( glBindBuffer(GL_UNIFORM_BUFFER, m_camera_ubo_id) );
+    GL_C( glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), nullptr, GL_DYNAMIC_DRAW) );
+    std::vector<Eigen::Vector4f> viridis=pack_colors_std140( m_colormngr.viridis_colormap().cast<float>(), 256 );
+    GL_C( glGenBuffers(1, &m_color_scheme_height_ubo_id) );
+    GL_C( glBindBuffer(GL_UNIFORM_BUFFER, m_color_scheme_height_ubo_id) );
+    GL_C( glBufferData(GL_UNIFORM_BUFFER, viridis.size()*sizeof(Eigen::Vector4f), viridis.data(), GL_STATIC_DRAW) );
+    GL_C( glBindBuffer(GL_UNIFORM_BUFFER, 0) );
+
 
 
     //create a fullscreen quad which we will use for composing the final image after the deffrred render pass
@@ -495,7 +682,14 @@ void Viewer::init_opengl(){
 
 
     //initialize a cubemap 
-    integrate_brdf(m_brdf_lut_tex); //we leave it outside the if because when we drag some hdr map into the viewer we don't want to integrate the brdf every time
+    //we leave it outside the if because when we drag some hdr map into the viewer we don't want to integrate the brdf every time
+    std::string brdf_lut_cache_name="brdf_lut_"+std::to_string(m_brdf_lut_resolution);
+    if(!m_ibl_cache || !m_ibl_cache->load_texture(m_brdf_lut_tex, brdf_lut_cache_name)){
+        integrate_brdf(m_brdf_lut_tex);
+        if(m_ibl_cache){
+            m_ibl_cache->save_texture(m_brdf_lut_tex, brdf_lut_cache_name);
+        }
+    }
     if(m_enable_ibl){ 
         load_environment_map(m_environment_map_path);
     }
@@ -726,13 +920,17 @@ void Viewer::update(const GLuint fbo_id){
     }
 
     post_draw();
-    switch_callbacks(m_window);
+    if(m_window){
+        switch_callbacks(m_window);
+    }
 
     m_nr_drawn_frames++;
 }
 
 void Viewer::pre_draw(){
-    glfwPollEvents();
+    if(m_window){
+        glfwPollEvents();
+    }
     if(m_show_gui){
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -766,28 +964,34 @@ void Viewer::post_draw(){
     glBlitFramebuffer(0, 0, m_final_fbo_no_gui.width(), m_final_fbo_no_gui.height(), 0, 0, m_final_fbo_with_gui.width(),  m_final_fbo_with_gui.height(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
 
     if(m_show_gui){
+        TRACE_GPU_SCOPE("gui");
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
     }
 
     
-    // finally just blit the final fbo to the default framebuffer
-    glViewport(0.0f , 0.0f, m_viewport_size.x(), m_viewport_size.y() );
-    // m_final_fbo_no_gui.bind_for_read();
-    m_final_fbo_with_gui.bind_for_read();
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-    glDrawBuffer(GL_BACK);
-    // glBlitFramebuffer(0, 0, m_final_fbo_no_gui.width(), m_final_fbo_no_gui.height(), 0, 0, m_viewport_size.x(), m_viewport_size.y(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
-    glBlitFramebuffer(0, 0, m_final_fbo_with_gui.width(), m_final_fbo_with_gui.height(), 0, 0, m_viewport_size.x(), m_viewport_size.y(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    // finally just blit the final fbo to the default framebuffer. Headless there is no window to present to so the image stays in the final fbos
+    if(m_window){
+        glViewport(0.0f , 0.0f, m_viewport_size.x(), m_viewport_size.y() );
+        // m_final_fbo_no_gui.bind_for_read();
+        m_final_fbo_with_gui.bind_for_read();
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glDrawBuffer(GL_BACK);
+        // glBlitFramebuffer(0, 0, m_final_fbo_no_gui.width(), m_final_fbo_no_gui.height(), 0, 0, m_viewport_size.x(), m_viewport_size.y(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBlitFramebuffer(0, 0, m_final_fbo_with_gui.width(), m_final_fbo_with_gui.height(), 0, 0, m_viewport_size.x(), m_viewport_size.y(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
 
 
-    glfwSwapBuffers(m_window);
+        glfwSwapBuffers(m_window);
+    }
 
-    // m_recorder->update();
+    m_recorder->update();
+    m_picker->update();
     if (m_recorder->is_recording()){
+        TRACE_SCOPE("record");
         std::string next_img = std::to_string(m_recorder->nr_images_recorded()) +".png";
         // m_recorder->record(next_img, m_gui->m_recording_path);
 
+            //with m_export_enabled the recorder also exports the channels of this same frame under the same index
             if(m_record_gui){
                 m_recorder->record(m_final_fbo_with_gui.tex_with_name("color_gtex"), next_img, m_recording_path);
             }else{
@@ -805,6 +1009,8 @@ void Viewer::post_draw(){
 void Viewer::draw(const GLuint fbo_id){
 
     TIME_SCOPE("draw");
+    Tracer::new_frame(); //the gpu passes of a few frames ago should be done by now
+    TRACE_SCOPE("draw");
     hotload_shaders();
 
     //GL PARAMS--------------
@@ -815,110 +1021,130 @@ void Viewer::draw(const GLuint fbo_id){
         glDisable(GL_CULL_FACE);
     }
     glBindFramebuffer(GL_FRAMEBUFFER,fbo_id);
-    clear_framebuffers();
+    if(fbo_id!=0 || m_window){ //a surfaceless context has no default framebuffer to clear
+        clear_framebuffers();
+    }
     glViewport(0.0f , 0.0f, m_viewport_size.x()/m_subsample_factor, m_viewport_size.y()/m_subsample_factor );
     glEnable(GL_DEPTH_TEST);
     
 
-    //set the camera to that it sees the whole scene 
-    if(m_first_draw && !m_scene->is_empty() ){
-        m_first_draw=false;
-        configure_auto_params(); //automatically sets parameters that were left as "auto" in the config file
-    }
+    prepare_scene_for_draw();
 
 
     TIME_START("update_meshes");
+    Tracer::begin("update_meshes");
     update_meshes_gl();
+    Tracer::end();
     TIME_END("update_meshes");
 
 
-    TIME_START("shadow_pass");
-    //check if any of the objects has moved, and if it has we need to clear all shadow maps and redo them. We need to redo them from scratch because an object moving may have revealed what is behind another object
-    bool need_shadow_map_update=false;
-    for(size_t i=0; i<m_meshes_gl.size(); i++){
-        MeshGLSharedPtr mesh=m_meshes_gl[i];
-        if (mesh->m_core->m_is_shadowmap_dirty){
-            need_shadow_map_update=true;
-            break;
-        }
-    }
-    //loop through all the light and each mesh into their shadow maps as a depth map
-    if(!m_enable_edl_lighting && need_shadow_map_update){
-        for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
-            if(m_spot_lights[l_idx]->m_create_shadow){
-                m_spot_lights[l_idx]->clear_shadow_map();
-
-                //loop through all the meshes
-                for(size_t i=0; i<m_meshes_gl.size(); i++){
-                    MeshGLSharedPtr mesh=m_meshes_gl[i];
-                    if(mesh->m_core->m_vis.m_is_visible && !mesh->m_core->is_empty() ){
-
-                        if(mesh->m_core->m_vis.m_show_mesh){
-                            m_spot_lights[l_idx]->render_mesh_to_shadow_map(mesh);
-                        }
-                        if(mesh->m_core->m_vis.m_show_points){
-                            m_spot_lights[l_idx]->render_points_to_shadow_map(mesh);
-                        }
-
-                        //if we use a custom shader we try to make an educated guess weather we should render this mesh as a mesh or as point cloud in the shadow map 
-                        if(mesh->m_core->m_vis.m_use_custom_shader && mesh->m_core->custom_render_func ){
-                            if(mesh->m_core->F.size()){
-                                m_spot_lights[l_idx]->render_mesh_to_shadow_map(mesh);
-                            }else{
-                                m_spot_lights[l_idx]->render_points_to_shadow_map(mesh);
-                            }
-                        }
+    m_scene_changed=has_scene_changed(); //needs to be checked before the shadow pass clears the dirty flags of the meshes
 
 
-                    }
-                    mesh->m_core->m_is_shadowmap_dirty=false;
-                }
-            }
-        }
+    TIME_START("shadow_pass");
+    Tracer::begin_gpu("shadow_pass");
+    //loop through all the light and each mesh into their shadow maps as a depth map
+    if(!m_enable_edl_lighting){
+        update_shadow_maps();
     }
+    Tracer::end_gpu();
     TIME_END("shadow_pass");
 
 
 
     TIME_START("gbuffer");
+    Tracer::begin_gpu("gbuffer");
     //set the gbuffer size in case it changed 
     if(m_viewport_size.x()/m_subsample_factor!=m_gbuffer.width() || m_viewport_size.y()/m_subsample_factor!=m_gbuffer.height()){
         m_gbuffer.set_size(m_viewport_size.x()/m_subsample_factor, m_viewport_size.y()/m_subsample_factor);
+        m_id_buffers_attachments.clear();
     }
     m_gbuffer.bind_for_draw();
     m_gbuffer.clear();
+    if(m_enable_id_buffers){
+        if(m_id_buffers_attachments.empty()){
+            find_id_buffers_attachments();
+        }
+        clear_id_buffers();
+    }
+    Tracer::end_gpu();
     TIME_END("gbuffer");
 
 
     TIME_START("geom_pass");
+    Tracer::begin_gpu("geom_pass");
     glViewport(0.0f , 0.0f, m_viewport_size.x()/m_subsample_factor, m_viewport_size.y()/m_subsample_factor ); //set the viewport again because rendering the shadow maps, changed it
+    update_camera_ubo();
     //render every mesh into the gbuffer
+    Frustum cam_frustum=m_camera->frustum( Eigen::Vector2f(m_gbuffer.width(), m_gbuffer.height()) );
+    m_nr_meshes_drawn=0;
+    m_nr_meshes_culled=0;
+    m_nr_triangles_drawn=0;
+    m_nr_triangles_culled=0;
     for(size_t i=0; i<m_meshes_gl.size(); i++){
         MeshGLSharedPtr mesh=m_meshes_gl[i];
         if(mesh->m_core->m_vis.m_is_visible && !mesh->m_core->is_empty() ){
+            int nr_triangles= mesh->m_core->m_vis.m_show_mesh ? mesh->m_core->F.rows()*std::max(1, mesh->nr_instances()) : 0;
+            if(is_culled(mesh, cam_frustum, m_camera, m_gbuffer.width())){
+                m_nr_meshes_culled++;
+                m_nr_triangles_culled+=nr_triangles;
+                continue;
+            }
+            m_nr_meshes_drawn++;
+            m_nr_triangles_drawn+=nr_triangles;
+
             if(mesh->m_core->m_vis.m_show_mesh){
-                render_mesh_to_gbuffer(mesh);
+                if(m_enable_mesh_batching && m_mesh_batcher->contains(mesh)){
+                    m_mesh_batcher->add_draw(mesh); //drawn together with the other batched meshes after this loop
+                }else{
+                    render_mesh_to_gbuffer(mesh);
+                }
             }
-            if(mesh->m_core->m_vis.m_show_surfels){
+            if(mesh->m_core->m_vis.m_show_surfels && !skip_instanced(mesh, "surfels")){
                 render_surfels_to_gbuffer(mesh);
             }
-            if(mesh->m_core->m_vis.m_show_points){
+            if(mesh->m_core->m_vis.m_show_points && !skip_instanced(mesh, "points")){
                 render_points_to_gbuffer(mesh);
             }
 
             //renders to the gbuffer by calling whatever function the user defined. T
             if(mesh->m_core->m_vis.m_use_custom_shader){
                 mesh->m_core->custom_render_func( mesh, shared_from_this() );
+                mesh->setup_vao(); //the custom function may have bound the attributes by name to other locations of the shared vao so we put back the fixed ones for the rest of the passes
             }
 
         }
     }
+    m_nr_batched_draws=0;
+    if(m_enable_mesh_batching){
+        render_batched_meshes_to_gbuffer();
+    }
+    //the octrees choose which of their nodes are needed for this view and we draw them like any other point cloud
+    for(size_t i=0; i<m_point_cloud_octrees.size(); i++){
+        std::shared_ptr<PointCloudOctree> octree=m_point_cloud_octrees[i];
+        octree->update(m_camera, Eigen::Vector2f(m_gbuffer.width(), m_gbuffer.height()) );
+        if(!octree->m_vis.m_is_visible){
+            continue;
+        }
+        std::vector<MeshGLSharedPtr> nodes=octree->visible_nodes();
+        for(size_t n=0; n<nodes.size(); n++){
+            render_points_to_gbuffer(nodes[n]);
+        }
+    }
+    Tracer::end_gpu();
     TIME_END("geom_pass");
     
     //ao_pass
     if(m_enable_ssao){
-        ssao_pass();
+        if(ssao_needs_update()){
+            if(m_ssao_use_compute){
+                ssao_pass_compute();
+            }else{
+                ssao_pass();
+            }
+        }
     }else{
+        m_ssao_history_valid=false;
         // m_gbuffer.tex_with_name("position_gtex").generate_mipmap(m_ssao_downsample); //kinda hacky thing to account for possible resizes of the gbuffer and the fact that we might not have mipmaps in it. This solves the black background issue
     }
     // glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo_id);
@@ -934,7 +1160,13 @@ void Viewer::draw(const GLuint fbo_id){
 
     //blur the bloom image if we do have it
     if (m_enable_bloom){
-        blur_img(m_composed_fbo.tex_with_name("bloom_gtex"), m_bloom_start_mip_map_lvl, m_bloom_max_mip_map_lvl, m_bloom_blur_iters);
+        Tracer::begin_gpu("bloom");
+        if(m_bloom_dual_filter){
+            blur_img_dual_filter(m_composed_fbo.tex_with_name("bloom_gtex"), m_bloom_start_mip_map_lvl, m_bloom_max_mip_map_lvl, m_bloom_dual_filter_offset);
+        }else{
+            blur_img(m_composed_fbo.tex_with_name("bloom_gtex"), m_bloom_start_mip_map_lvl, m_bloom_max_mip_map_lvl, m_bloom_blur_iters);
+        }
+        Tracer::end_gpu();
     }
 
     apply_postprocess(); //read the composed_fbo and writes into m_final_fbo_no_gui
@@ -944,26 +1176,30 @@ void Viewer::draw(const GLuint fbo_id){
 
     //attempt 3 at forward rendering 
     TIME_START("blit");
+    Tracer::begin_gpu("blit");
     glViewport(0.0f , 0.0f, m_viewport_size.x()/m_subsample_factor, m_viewport_size.y()/m_subsample_factor );
     //blit the depth from the gbuffer to the final_fbo_no_gui so that we can forward render stuff into it
     m_gbuffer.bind_for_read();
     m_final_fbo_no_gui.bind_for_draw();
     glBlitFramebuffer( 0, 0, m_gbuffer.width(), m_gbuffer.height(), 0, 0, m_final_fbo_no_gui.width(), m_final_fbo_no_gui.height(), GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+    Tracer::end_gpu();
     TIME_END("blit");
 
     //forward render the lines and edges 
     TIME_START("forward_render");
+    Tracer::begin_gpu("forward_render");
     for(size_t i=0; i<m_meshes_gl.size(); i++){
         MeshGLSharedPtr mesh=m_meshes_gl[i];
         if(mesh->m_core->m_vis.m_is_visible){
-            if(mesh->m_core->m_vis.m_show_lines){
+            if(mesh->m_core->m_vis.m_show_lines && !skip_instanced(mesh, "lines")){
                 render_lines(mesh);
             }
-            if(mesh->m_core->m_vis.m_show_wireframe){
+            if(mesh->m_core->m_vis.m_show_wireframe && !skip_instanced(mesh, "wireframe")){
                 render_wireframe(mesh);
             }
         }
     }
+    Tracer::end_gpu();
     TIME_END("forward_render");
 
     blend_bg();
@@ -985,7 +1221,10 @@ void Viewer::update_meshes_gl(){
     //Check if we need to upload to gpu
     for(int i=0; i<m_scene->nr_meshes(); i++){
         MeshSharedPtr mesh_core=m_scene->get_mesh_with_idx(i);
-        if(mesh_core->m_is_dirty || mesh_core->is_any_texture_dirty() ) { //the mesh gl needs updating
+        if(mesh_core->m_is_dirty || mesh_core->m_is_instances_dirty || mesh_core->is_any_texture_dirty() ) { //the mesh gl needs updating
+            if(mesh_core->m_is_dirty){
+                mesh_core->invalidate_bounds(); //V may have changed
+            }
 
             //find the meshgl  with the same name
             bool found=false;
@@ -1001,13 +1240,13 @@ void Viewer::update_meshes_gl(){
 
             if(found){
                 m_meshes_gl[idx_found]->assign_core(mesh_core);
-                m_meshes_gl[idx_found]->upload_to_gpu();
+                m_meshes_gl[idx_found]->upload_to_gpu(m_texture_uploader);
                 m_meshes_gl[idx_found]->sanity_check(); //check that we have for sure all the normals for all the vertices and faces and that everything is correct
             }else{
                 MeshGLSharedPtr mesh_gpu=MeshGL::create();
                 mesh_gpu->assign_core(mesh_core); //GPU implementation points to the cpu data
                 mesh_core->assign_mesh_gpu(mesh_gpu); // cpu data points to the gpu implementation
-                mesh_gpu->upload_to_gpu();
+                mesh_gpu->upload_to_gpu(m_texture_uploader);
                 mesh_gpu->sanity_check(); //check that we have for sure all the normals for all the vertices and faces and that everything is correct
                 m_meshes_gl.push_back(mesh_gpu);
             }
@@ -1042,11 +1281,134 @@ void Viewer::update_meshes_gl(){
             //the mesh_gl has no corresponding mesh_core in the scene which means we discard this mesh_gl which will in turn also garbage collect whatever shared ptr if has over the mesh_core
         }
     }
+    if(meshes_gl_filtered.size()!=m_meshes_gl.size()){
+        m_meshes_gl_version++;
+    }
     m_meshes_gl=meshes_gl_filtered;
+    for(size_t i=0; i<m_meshes_gl.size(); i++){
+        m_meshes_gl[i]->m_instance_id=i+1; //0 is the background
+    }
+
+
+    //the batch keeps a copy of the buffers so it needs to know if any of them changed
+    if(m_enable_mesh_batching){
+        TIME_START("update_mesh_batch");
+        Tracer::begin("update_mesh_batch");
+        m_mesh_batcher->m_max_nr_vertices=m_mesh_batching_max_nr_vertices;
+        m_mesh_batcher->update(m_meshes_gl);
+        Tracer::end();
+        TIME_END("update_mesh_batch");
+    }
 
+    //stream a bit of the pending textures, the rest goes in the next frames
+    TIME_START("upload_textures");
+    Tracer::begin("upload_textures");
+    m_texture_uploader->upload( m_texture_upload_budget_mb*1024*1024 );
+    Tracer::end();
+    TIME_END("upload_textures");
 
 }
 
+void BatchRenderOutputs::allocate(const int nr_images, const int width, const int height, const bool with_color, const bool with_depth, const bool with_normals){
+    color.clear();
+    depth.clear();
+    normals.clear();
+    for(int i = 0; i < nr_images; i++){
+        if(with_color) color.push_back( cv::Mat(height, width, CV_8UC4) );
+        if(with_depth) depth.push_back( cv::Mat(height, width, CV_32FC1) );
+        if(with_normals) normals.push_back( cv::Mat(height, width, CV_32FC3) );
+    }
+}
+
+void Viewer::prepare_scene_for_draw(){
+    //add the meshes that finished loading on the worker threads. Only this thread modifies the scene while drawing
+    m_mesh_loader->update();
+
+    //set the camera to that it sees the whole scene 
+    if(m_first_draw && !m_scene->is_empty() ){
+        m_first_draw=false;
+        configure_auto_params(); //automatically sets parameters that were left as "auto" in the config file
+    }
+}
+
+void Viewer::render_batch(const std::vector<Eigen::Matrix4f>& poses, const std::vector<Eigen::Matrix3f>& intrinsics, BatchRenderOutputs& outputs){
+    CHECK(intrinsics.empty() || intrinsics.size()==1 || intrinsics.size()==poses.size()) << "Expected no intrinsics, one for all poses or one per pose but got " << intrinsics.size() << " for " << poses.size() << " poses";
+    CHECK(outputs.color.empty() || outputs.color.size()==poses.size()) << "Expected one color image per pose. Poses: " << poses.size() << " images: " << outputs.color.size();
+    CHECK(outputs.depth.empty() || outputs.depth.size()==poses.size()) << "Expected one depth image per pose. Poses: " << poses.size() << " images: " << outputs.depth.size();
+    CHECK(outputs.normals.empty() || outputs.normals.size()==poses.size()) << "Expected one normal image per pose. Poses: " << poses.size() << " images: " << outputs.normals.size();
+
+    TIME_SCOPE("render_batch");
+    TRACE_SCOPE("render_batch");
+    int width=m_viewport_size.x()/m_subsample_factor;
+    int height=m_viewport_size.y()/m_subsample_factor;
+    bool needs_decode= !outputs.depth.empty() || !outputs.normals.empty();
+
+    //the auto params of the first draw move the camera to look at the scene so they have to be set before we copy it, otherwise they would move the batch camera away from the first pose
+    prepare_scene_for_draw();
+
+    //render through a copy of the camera so the one the user sees is not touched
+    std::shared_ptr<Camera> prev_camera=m_camera;
+    std::shared_ptr<Camera> batch_camera=m_camera->clone();
+    m_camera=batch_camera;
+
+    for(size_t i = 0; i < poses.size(); i++){
+        batch_camera->m_model_matrix=Eigen::Affine3f(poses[i]);
+        if(!intrinsics.empty()){
+            batch_camera->set_intrinsics(intrinsics[ intrinsics.size()==1 ? 0 : i ], width, height);
+        }
+
+        draw();
+        CHECK(batch_camera->m_model_matrix.matrix()==poses[i]) << "The camera of pose " << i << " was moved while drawing so the image doesn't show the requested pose";
+
+        if(!outputs.color.empty()){
+            m_batch_readback->read(m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex"), GL_BGRA, GL_UNSIGNED_BYTE, outputs.color[i]);
+        }
+        if(needs_decode){
+            if(m_batch_outputs_fbo.width()!=m_gbuffer.width() || m_batch_outputs_fbo.height()!=m_gbuffer.height()){
+                m_batch_outputs_fbo.set_size(m_gbuffer.width(), m_gbuffer.height());
+            }
+            glViewport(0.0f , 0.0f, m_gbuffer.width(), m_gbuffer.height() );
+            glDepthMask(false);
+            glDisable(GL_DEPTH_TEST);
+
+            gl::Shader& shader=m_batch_outputs_shader;
+            GL_C( m_fullscreen_quad->vao.vertex_attribute(shader, "position", m_fullscreen_quad->V_buf, 3) );
+            GL_C( m_fullscreen_quad->vao.vertex_attribute(shader, "uv", m_fullscreen_quad->UV_buf, 2) );
+            m_fullscreen_quad->vao.indices(m_fullscreen_quad->F_buf);
+            GL_C( shader.use() );
+            shader.bind_texture(m_gbuffer.tex_with_name("normal_gtex"), "normals_encoded_tex");
+            shader.bind_texture(m_gbuffer.tex_with_name("depth_gtex"), "depth_tex");
+            shader.uniform_float( m_camera->m_far / (m_camera->m_far - m_camera->m_near), "projection_a");
+            shader.uniform_float( (-m_camera->m_far * m_camera->m_near) / (m_camera->m_far - m_camera->m_near) , "projection_b");
+            m_batch_outputs_fbo.bind_for_draw();
+            shader.draw_into(m_batch_outputs_fbo,
+                            {
+                            std::make_pair("normal_out", "normal_gtex"),
+                            std::make_pair("depth_out", "depth_gtex"),
+                            }
+                            );
+            m_fullscreen_quad->vao.bind();
+            glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+
+            glDepthMask(true);
+            glEnable(GL_DEPTH_TEST);
+
+            if(!outputs.normals.empty()){
+                m_batch_readback->read(m_batch_outputs_fbo.tex_with_name("normal_gtex"), GL_RGB, GL_FLOAT, outputs.normals[i]);
+            }
+            if(!outputs.depth.empty()){
+                m_batch_readback->read(m_batch_outputs_fbo.tex_with_name("depth_gtex"), GL_RED, GL_FLOAT, outputs.depth[i]);
+            }
+        }
+
+        m_batch_readback->process_ready(); //copies whatever the gpu finished so far without waiting for the rest
+        m_nr_drawn_frames++;
+    }
+    m_batch_readback->finish();
+
+    m_camera=prev_camera;
+}
+
 void Viewer::clear_framebuffers(){
     glClearColor(m_background_color[0],
                m_background_color[1],
@@ -1065,58 +1427,12 @@ void Viewer::render_points_to_gbuffer(const MeshGLSharedPtr mesh){
 
     gl::Shader& shader= m_draw_points_shader;
 
-    // Set attributes that the vao will pulll from buffers
-    if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(shader, "position", mesh->V_buf, 3);
-    }
-    if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(shader, "normal", mesh->NV_buf, 3);
-        shader.uniform_bool(true, "has_normals");
-    }else{
-        shader.uniform_bool(false, "has_normals");
-    }
-    if(mesh->m_core->C.size()){
-        GL_C(mesh->vao.vertex_attribute(shader, "color_per_vertex", mesh->C_buf, 3) );
-    }
-    if(mesh->m_core->UV.size()){
-        GL_C(mesh->vao.vertex_attribute(shader, "uv", mesh->UV_buf, 2) );
-    }
-    if(mesh->m_core->I.size()){
-        GL_C(mesh->vao.vertex_attribute(shader, "intensity_per_vertex", mesh->I_buf, 1) );
-    }
-    if(mesh->m_core->L_pred.size()){
-        mesh->vao.vertex_attribute(shader, "label_pred_per_vertex", mesh->L_pred_buf, 1);
-    } 
-    if(mesh->m_core->L_gt.size()){
-        mesh->vao.vertex_attribute(shader, "label_gt_per_vertex", mesh->L_gt_buf, 1);
-    } 
-
+    mesh->update_uniform_buffers();
+    mesh->bind_uniform_buffers();
 
-    //matrices setuo
-    // Eigen::Matrix4f M = Eigen::Matrix4f::Identity();
-    Eigen::Matrix4f M=mesh->m_core->model_matrix().cast<float>().matrix();
-    Eigen::Matrix4f V = m_camera->view_matrix();
-    Eigen::Matrix4f P = m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
-    Eigen::Matrix4f MV = V*M;
-    Eigen::Matrix4f MVP = P*V*M;
- 
     //shader setup
     shader.use();
-    shader.uniform_4x4(M, "M");
-    shader.uniform_4x4(MV, "MV");
-    shader.uniform_4x4(MVP, "MVP");
     shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
-    shader.uniform_bool(mesh->m_core->m_vis.m_points_as_circle , "points_as_circle");
-    shader.uniform_int(mesh->m_core->m_vis.m_color_type._to_integral() , "color_type");
-    shader.uniform_v3_float(mesh->m_core->m_vis.m_point_color , "point_color");
-    shader.uniform_float(mesh->m_core->m_vis.m_metalness , "metalness");
-    shader.uniform_float(mesh->m_core->m_vis.m_roughness , "roughness");
-    shader.uniform_array_v3_float(m_colormngr.viridis_colormap(), "color_scheme_height"); //for height color type
-    shader.uniform_float(mesh->m_core->min_y(), "min_y");
-    shader.uniform_float(mesh->m_core->max_y(), "max_y");
-    if(mesh->m_core->m_label_mngr){
-        shader.uniform_array_v3_float(mesh->m_core->m_label_mngr->color_scheme().cast<float>(), "color_scheme"); //for semantic labels
-    }
 
     //pbr textures
     // if(mesh->m_cur_tex_ptr->storage_initialized() ){ 
@@ -1131,16 +1447,30 @@ void Viewer::render_points_to_gbuffer(const MeshGLSharedPtr mesh){
     shader.uniform_bool(mesh->m_diffuse_tex.storage_initialized(), "has_diffuse_tex");
     shader.uniform_bool(mesh->m_metalness_tex.storage_initialized(), "has_metalness_tex");
     shader.uniform_bool(mesh->m_roughness_tex.storage_initialized(), "has_roughness_tex");
+    set_id_buffer_uniforms(shader, mesh);
 
 
     m_gbuffer.bind_for_draw();
-    shader.draw_into(m_gbuffer,
-                    {
-                    std::make_pair("normal_out", "normal_gtex"),
-                    std::make_pair("diffuse_out", "diffuse_gtex"),
-                    std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
-                    }
-                    ); //makes the shaders draw into the buffers we defines in the gbuffer
+    if(m_enable_id_buffers){
+        shader.draw_into(m_gbuffer,
+                        {
+                        std::make_pair("normal_out", "normal_gtex"),
+                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                        std::make_pair("label_id_out", "label_gtex"),
+                        std::make_pair("instance_id_out", "instance_id_gtex"),
+                        std::make_pair("primitive_id_out", "primitive_id_gtex"),
+                        }
+                        );
+    }else{
+        shader.draw_into(m_gbuffer,
+                        {
+                        std::make_pair("normal_out", "normal_gtex"),
+                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                        }
+                        ); //makes the shaders draw into the buffers we defines in the gbuffer
+    }
 
     float point_size=std::max(1.0f, mesh->m_core->m_vis.m_point_size); //need to cap the point size at a minimum of 1 because something like 0.5 will break opengl :(
     glPointSize(point_size);
@@ -1162,13 +1492,7 @@ void Viewer::render_lines(const MeshGLSharedPtr mesh){
 
     // glEnable( GL_LINE_SMOOTH ); //draw lines antialiased (destroys performance)
 
-    // Set attributes that the vao will pulll from buffers
-    if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_lines_shader, "position", mesh->V_buf, 3);
-    }
-    if(mesh->m_core->C.size()){
-        mesh->vao.vertex_attribute(m_draw_lines_shader, "color_per_vertex", mesh->C_buf, 3);
-    }
+    //the positions and colors are already in the vao at the fixed locations of the MeshGL, only the indices change to the edges
     if(mesh->m_core->E.size()){
         mesh->vao.indices(mesh->E_buf); //Says the indices with we refer to vertices, this gives us the triangles
     }
@@ -1202,6 +1526,11 @@ void Viewer::render_lines(const MeshGLSharedPtr mesh){
     }
     glDrawElements(GL_LINES, mesh->m_core->E.size(), GL_UNSIGNED_INT, 0);
 
+    //the vao of the mesh is configured only once at upload time so we give back the faces as indices for the passes that draw triangles
+    if(mesh->m_core->F.size()){
+        mesh->vao.indices(mesh->F_buf);
+    }
+
     glLineWidth( 1.0f );
     glDepthFunc(GL_LESS);
     
@@ -1209,13 +1538,7 @@ void Viewer::render_lines(const MeshGLSharedPtr mesh){
 
 void Viewer::render_wireframe(const MeshGLSharedPtr mesh){
 
-     // Set attributes that the vao will pulll from buffers
-    if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_wireframe_shader, "position", mesh->V_buf, 3);
-    }
-    if(mesh->m_core->F.size()){
-        mesh->vao.indices(mesh->F_buf); //Says the indices with we refer to vertices, this gives us the triangles
-    }
+    //the vao already has the positions at the fixed location of the MeshGL and the faces as indices
 
     Eigen::Matrix4f M=mesh->m_core->model_matrix().cast<float>().matrix();
     Eigen::Matrix4f V = m_camera->view_matrix();
@@ -1257,65 +1580,13 @@ void Viewer::render_mesh_to_gbuffer(const MeshGLSharedPtr mesh){
 
     // bool enable_solid_color=!mesh->m_core->C.size();
 
-    // Set attributes that the vao will pulll from buffers
-    if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_mesh_shader, "position", mesh->V_buf, 3);
-    }
-    if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(m_draw_mesh_shader, "normal", mesh->NV_buf, 3);
-    }
-    if(mesh->m_core->UV.size()){
-        GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "uv", mesh->UV_buf, 2) );
-    }
-    if(mesh->m_core->V_tangent_u.size()){
-        GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "tangent", mesh->V_tangent_u_buf, 3) );
-    }
-    if(mesh->m_core->C.size()){
-        GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "color_per_vertex", mesh->C_buf, 3) );
-    }
-    if(mesh->m_core->I.size()){
-        GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "intensity_per_vertex", mesh->I_buf, 1) );
-    }
-    if(mesh->m_core->L_pred.size()){
-        mesh->vao.vertex_attribute(m_draw_mesh_shader, "label_pred_per_vertex", mesh->L_pred_buf, 1);
-    } 
-    if(mesh->m_core->L_gt.size()){
-        mesh->vao.vertex_attribute(m_draw_mesh_shader, "label_gt_per_vertex", mesh->L_gt_buf, 1);
-    } 
-    if(mesh->m_core->F.size()){
-        mesh->vao.indices(mesh->F_buf); //Says the indices with we refer to vertices, this gives us the triangles
-    }
+    //the vao was configured when the mesh got uploaded and the per mesh uniforms live in a uniform buffer that only gets uploaded when they change. The camera matrices and the color schemes are in uniform buffers shared by all meshes
+    mesh->update_uniform_buffers();
+    mesh->bind_uniform_buffers();
 
-    //matrices setuo
-    // Eigen::Matrix4f M = Eigen::Matrix4f::Identity();
-    Eigen::Matrix4f M=mesh->m_core->model_matrix().cast<float>().matrix();
-    Eigen::Matrix4f V = m_camera->view_matrix();
-    Eigen::Matrix4f P = m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
-    Eigen::Matrix4f MV = V*M;
-    Eigen::Matrix4f MVP = P*V*M;
- 
     //shader setup
     m_draw_mesh_shader.use();
-    m_draw_mesh_shader.uniform_4x4(M, "M");
-    m_draw_mesh_shader.uniform_4x4(MV, "MV");
-    m_draw_mesh_shader.uniform_4x4(MVP, "MVP");
     m_draw_mesh_shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
-    m_draw_mesh_shader.uniform_array_v3_float(m_colormngr.viridis_colormap(), "color_scheme_height"); //for height color type
-    m_draw_mesh_shader.uniform_float(mesh->m_core->min_y(), "min_y");
-    m_draw_mesh_shader.uniform_float(mesh->m_core->max_y(), "max_y");
-    m_draw_mesh_shader.uniform_int(mesh->m_core->m_vis.m_color_type._to_integral() , "color_type");
-    m_draw_mesh_shader.uniform_v3_float(mesh->m_core->m_vis.m_solid_color , "solid_color");
-    m_draw_mesh_shader.uniform_float(mesh->m_core->m_vis.m_metalness , "metalness");
-    m_draw_mesh_shader.uniform_float(mesh->m_core->m_vis.m_roughness , "roughness");
-    m_draw_mesh_shader.uniform_int(mesh->m_core->id , "mesh_id");
-    if(mesh->m_core->m_label_mngr){
-        m_draw_mesh_shader.uniform_array_v3_float(mesh->m_core->m_label_mngr->color_scheme().cast<float>(), "color_scheme"); //for semantic labels
-    }
-    // m_draw_mesh_shader.uniform_bool( enable_solid_color, "enable_solid_color");
-    // m_draw_mesh_shader.uniform_v3_float(mesh->m_ambient_color , "ambient_color");
-    // m_draw_mesh_shader.uniform_v3_float(mesh->m_core->m_vis.m_specular_color , "specular_color");
-    // m_draw_mesh_shader.uniform_float(mesh->m_ambient_color_power , "ambient_color_power");
-    // m_draw_mesh_shader.uniform_float(mesh->m_core->m_vis.m_shininess , "shininess");
 
     //pbr textures
     if(mesh->m_diffuse_tex.storage_initialized() ){  m_draw_mesh_shader.bind_texture(mesh->m_diffuse_tex, "diffuse_tex");   }
@@ -1326,30 +1597,139 @@ void Viewer::render_mesh_to_gbuffer(const MeshGLSharedPtr mesh){
     m_draw_mesh_shader.uniform_bool(mesh->m_metalness_tex.storage_initialized(), "has_metalness_tex");
     m_draw_mesh_shader.uniform_bool(mesh->m_roughness_tex.storage_initialized(), "has_roughness_tex");
     m_draw_mesh_shader.uniform_bool(mesh->m_normals_tex.storage_initialized(), "has_normals_tex");
+    set_id_buffer_uniforms(m_draw_mesh_shader, mesh);
 
     m_gbuffer.bind_for_draw();
-    m_draw_mesh_shader.draw_into(m_gbuffer,
-                                    {
-                                    // std::make_pair("position_out", "position_gtex"),
-                                    std::make_pair("normal_out", "normal_gtex"),
-                                    std::make_pair("diffuse_out", "diffuse_gtex"),
-                                    std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
-                                    std::make_pair("mesh_id_out", "mesh_id_gtex"),
-                                    // std::make_pair("specular_out", "specular_gtex"),
-                                    // std::make_pair("shininess_out", "shininess_gtex")
-                                //   std::make_pair("normal_world_out", "normal_world_gtex")
-                                    }
-                                    ); //makes the shaders draw into the buffers we defines in the gbuffer
+    if(m_enable_id_buffers){
+        m_draw_mesh_shader.draw_into(m_gbuffer,
+                                        {
+                                        std::make_pair("normal_out", "normal_gtex"),
+                                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                                        std::make_pair("mesh_id_out", "mesh_id_gtex"),
+                                        std::make_pair("label_id_out", "label_gtex"),
+                                        std::make_pair("instance_id_out", "instance_id_gtex"),
+                                        std::make_pair("primitive_id_out", "primitive_id_gtex"),
+                                        }
+                                        );
+    }else{
+        m_draw_mesh_shader.draw_into(m_gbuffer,
+                                        {
+                                        // std::make_pair("position_out", "position_gtex"),
+                                        std::make_pair("normal_out", "normal_gtex"),
+                                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                                        std::make_pair("mesh_id_out", "mesh_id_gtex"),
+                                        // std::make_pair("specular_out", "specular_gtex"),
+                                        // std::make_pair("shininess_out", "shininess_gtex")
+                                    //   std::make_pair("normal_world_out", "normal_world_gtex")
+                                        }
+                                        ); //makes the shaders draw into the buffers we defines in the gbuffer
+    }
     // m_draw_mesh_shader.uniform_v2_float(m_viewport_size, "viewport_size");
 
     // draw
     mesh->vao.bind(); 
-    glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    if(mesh->nr_instances()){
+        glDrawElementsInstanced(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0, mesh->nr_instances());
+    }else{
+        glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    }
+
+
+    GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
+
+}
+
+void Viewer::update_camera_ubo(){
+    CameraUniforms uniforms;
+    uniforms.V=m_camera->view_matrix();
+    uniforms.P=m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
+    uniforms.VP=uniforms.P*uniforms.V;
+
+    GL_C( glBindBuffer(GL_UNIFORM_BUFFER, m_camera_ubo_id) );
+    GL_C( glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &uniforms) );
+    GL_C( glBindBuffer(GL_UNIFORM_BUFFER, 0) );
+    GL_C( glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UBO_BINDING, m_camera_ubo_id) );
+    GL_C( glBindBufferBase(GL_UNIFORM_BUFFER, COLOR_SCHEME_HEIGHT_UBO_BINDING, m_color_scheme_height_ubo_id) );
+}
+
+void Viewer::render_batched_meshes_to_gbuffer(){
+
+    //the per mesh uniforms live in the storage buffer of the batch and the camera in the uniform buffer set by update_camera_ubo() so here we only set the ones that are the same for all
+    m_draw_mesh_batched_shader.use();
+    m_draw_mesh_batched_shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
+    m_draw_mesh_batched_shader.uniform_int((int)id_buffers_no_label(), "no_label"); //meshes with labels are never batched. The instance ids come from the storage buffer
 
+    m_gbuffer.bind_for_draw();
+    if(m_enable_id_buffers){
+        m_draw_mesh_batched_shader.draw_into(m_gbuffer,
+                                        {
+                                        std::make_pair("normal_out", "normal_gtex"),
+                                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                                        std::make_pair("mesh_id_out", "mesh_id_gtex"),
+                                        std::make_pair("label_id_out", "label_gtex"),
+                                        std::make_pair("instance_id_out", "instance_id_gtex"),
+                                        std::make_pair("primitive_id_out", "primitive_id_gtex"),
+                                        }
+                                        );
+    }else{
+        m_draw_mesh_batched_shader.draw_into(m_gbuffer,
+                                        {
+                                        std::make_pair("normal_out", "normal_gtex"),
+                                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                                        std::make_pair("mesh_id_out", "mesh_id_gtex"),
+                                        }
+                                        );
+    }
+
+    m_nr_batched_draws=m_mesh_batcher->draw();
 
     GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
+}
 
+void Viewer::find_id_buffers_attachments(){
+    const std::string tex_names[2]={ "label_gtex", "instance_id_gtex" };
+    GLint max_attachments=0;
+    glGetIntegerv(GL_MAX_COLOR_ATTACHMENTS, &max_attachments);
+    m_id_buffers_attachments.clear();
+    for(int t = 0; t < 2; t++){
+        GLuint tex_id=m_gbuffer.tex_with_name(tex_names[t]).tex_id();
+        for(int i = 0; i < max_attachments; i++){
+            GLint attached_id=0;
+            glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &attached_id);
+            if((GLuint)attached_id==tex_id){
+                m_id_buffers_attachments.push_back(GL_COLOR_ATTACHMENT0+i);
+                break;
+            }
+        }
+    }
+    CHECK(m_id_buffers_attachments.size()==2) << "Could not find the id buffers among the attachments of the gbuffer";
 }
+
+void Viewer::clear_id_buffers(){
+    //the gbuffer is bound for drawing. glClearBuffer works on the draw buffers so we point the first one at each id texture in turn. The draw_into of the geometry pass sets them again
+    const GLuint clear_values[2]={ id_buffers_no_label(), 0 };
+    for(size_t t = 0; t < m_id_buffers_attachments.size(); t++){
+        GL_C( glDrawBuffers(1, &m_id_buffers_attachments[t]) );
+        GLuint value[4]={ clear_values[t], 0, 0, 0 };
+        GL_C( glClearBufferuiv(GL_COLOR, 0, value) );
+    }
+}
+
+void Viewer::set_id_buffer_uniforms(gl::Shader& shader, const std::shared_ptr<MeshGL>& mesh){
+    if(!m_enable_id_buffers){
+        return;
+    }
+    const Eigen::MatrixXi& labels= m_id_buffers_label_from_gt ? mesh->m_core->L_gt : mesh->m_core->L_pred;
+    shader.uniform_bool(m_id_buffers_label_from_gt, "label_from_gt");
+    shader.uniform_bool(labels.rows()==mesh->m_core->V.rows(), "has_labels");
+    shader.uniform_int((int)id_buffers_no_label(), "no_label");
+    shader.uniform_int(mesh->m_instance_id, "instance_id");
+}
+
 void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
 
     if (!m_using_fat_gbuffer){
@@ -1384,38 +1764,8 @@ void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
 
     // bool enable_solid_color=!mesh->m_core->C.size();
 
-     // Set attributes that the vao will pulll from buffers
-    if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "position", mesh->V_buf, 3);
-    }
-    if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "normal", mesh->NV_buf, 3);
-    }
-    if(mesh->m_core->V_tangent_u.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "tangent_u", mesh->V_tangent_u_buf, 3);
-    }
-    if(mesh->m_core->V_length_v.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "lenght_v", mesh->V_lenght_v_buf, 1);
-    }
-    if(mesh->m_core->C.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "color_per_vertex", mesh->C_buf, 3);
-    }
-    if(mesh->m_core->L_pred.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "label_pred_per_vertex", mesh->L_pred_buf, 1);
-    } 
-    if(mesh->m_core->L_gt.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "label_gt_per_vertex", mesh->L_gt_buf, 1);
-    }
-    // if(mesh->m_core->UV.size()){
-    //     GL_C(mesh->vao.vertex_attribute(m_draw_surfels_shader, "uv", mesh->UV_buf, 2) );
-    // }
-
-    //matrices setuo
-    Eigen::Matrix4f M=mesh->m_core->model_matrix().cast<float>().matrix();
-    Eigen::Matrix4f V = m_camera->view_matrix();
-    Eigen::Matrix4f P = m_camera->proj_matrix(m_viewport_size);
-    Eigen::Matrix4f MV = V*M;
-    Eigen::Matrix4f MVP = P*V*M;
+    mesh->update_uniform_buffers();
+    mesh->bind_uniform_buffers();
 
     // if(m_enable_surfel_splatting){
         glEnable(GL_BLEND);
@@ -1436,19 +1786,10 @@ void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
     //shader setup
     if(m_gbuffer.width()!= m_viewport_size.x() || m_gbuffer.height()!=m_viewport_size.y() ){
         m_gbuffer.set_size(m_viewport_size.x(), m_viewport_size.y());
+        m_id_buffers_attachments.clear();
     }
     m_draw_surfels_shader.use();
-    m_draw_surfels_shader.uniform_4x4(M, "M");
-    m_draw_surfels_shader.uniform_4x4(MV, "MV");
-    m_draw_surfels_shader.uniform_4x4(MVP, "MVP");
     m_draw_surfels_shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
-    m_draw_surfels_shader.uniform_int(mesh->m_core->m_vis.m_color_type._to_integral() , "color_type");
-    m_draw_surfels_shader.uniform_v3_float(mesh->m_core->m_vis.m_solid_color , "solid_color");
-    m_draw_surfels_shader.uniform_float(mesh->m_core->m_vis.m_metalness , "metalness");
-    m_draw_surfels_shader.uniform_float(mesh->m_core->m_vis.m_roughness , "roughness");
-    if(mesh->m_core->m_label_mngr){
-        m_draw_surfels_shader.uniform_array_v3_float(mesh->m_core->m_label_mngr->color_scheme().cast<float>(), "color_scheme"); //for semantic labels
-    }
     // m_draw_surfels_shader.uniform_bool( enable_solid_color , "enable_solid_color");
     // m_draw_mesh_shader.uniform_v3_float(mesh->m_ambient_color , "ambient_color");
     // m_draw_surfels_shader.uniform_v3_float(m_specular_color , "specular_color");
@@ -1480,17 +1821,31 @@ void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
     glEnable( GL_POLYGON_OFFSET_FILL );
     glPolygonOffset(m_surfel_blend_factor, m_surfel_blend_factor); //offset the depth in the depth buffer a bit further so we can render surfels that are even a bit overlapping
     m_draw_surfels_shader.uniform_bool(false , "enable_visibility_test");
+    set_id_buffer_uniforms(m_draw_surfels_shader, mesh);
     m_gbuffer.bind_for_draw();
-    m_draw_surfels_shader.draw_into(m_gbuffer,
-                                    {
-                                    // std::make_pair("position_out", "position_gtex"),
-                                    std::make_pair("normal_out", "normal_gtex"),
-                                    std::make_pair("diffuse_out", "diffuse_gtex"),
-                                    std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
-                                    // std::make_pair("specular_out", "specular_gtex"),
-                                    // std::make_pair("shininess_out", "shininess_gtex")
-                                    }
-                                    );
+    if(m_enable_id_buffers){
+        m_draw_surfels_shader.draw_into(m_gbuffer,
+                                        {
+                                        std::make_pair("normal_out", "normal_gtex"),
+                                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                                        std::make_pair("label_id_out", "label_gtex"),
+                                        std::make_pair("instance_id_out", "instance_id_gtex"),
+                                        std::make_pair("primitive_id_out", "primitive_id_gtex"),
+                                        }
+                                        );
+    }else{
+        m_draw_surfels_shader.draw_into(m_gbuffer,
+                                        {
+                                        // std::make_pair("position_out", "position_gtex"),
+                                        std::make_pair("normal_out", "normal_gtex"),
+                                        std::make_pair("diffuse_out", "diffuse_gtex"),
+                                        std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                                        // std::make_pair("specular_out", "specular_gtex"),
+                                        // std::make_pair("shininess_out", "shininess_gtex")
+                                        }
+                                        );
+    }
     mesh->vao.bind(); 
     glDrawArrays(GL_POINTS, 0, mesh->m_core->V.rows());
 
@@ -1507,6 +1862,7 @@ void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
 void Viewer::ssao_pass(){
 
     TIME_SCOPE("ssao_pass_full");
+    TRACE_GPU_SCOPE("ssao");
 
     //SSAO needs to perform a lot of accesses to the depth map in order to calculate occlusion. Due to cache coherency it is faster to sampler from a downsampled depth map
     //furthermore we only need the linearized depth map. So we first downsample the depthmap, then we linearize it and we run the ao shader and then the bilateral blurring
@@ -1528,6 +1884,7 @@ void Viewer::ssao_pass(){
 
     //LINEARIZE-------------------------
     TIME_START("depth_linearize_pass");
+    Tracer::begin_gpu("depth_linearize_pass");
     m_depth_linear_tex.allocate_or_resize( GL_R32F, GL_RED, GL_FLOAT, new_viewport_size.x(), new_viewport_size.y() );
     m_depth_linear_tex.clear();
 
@@ -1546,6 +1903,7 @@ void Viewer::ssao_pass(){
 
     // draw
     glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    Tracer::end_gpu();
     TIME_END("depth_linearize_pass");
 
 
@@ -1557,10 +1915,15 @@ void Viewer::ssao_pass(){
 
     //SSAO----------------------------------------
     TIME_START("ao_pass");
+    Tracer::begin_gpu("ao_pass");
     //matrix setup
     Eigen::Matrix3f V_rot = Eigen::Affine3f(m_camera->view_matrix()).linear(); //for rotating the normals from the world coords to the cam_coords
     Eigen::Matrix4f P = m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
     Eigen::Matrix4f P_inv=P.inverse();
+    Eigen::Vector2f noise_offset=Eigen::Vector2f::Zero();
+    if(m_ssao_temporal){
+        noise_offset << m_rand_gen->rand_float(0.0, 1.0), m_rand_gen->rand_float(0.0, 1.0);
+    }
 
 
     // Set attributes that the vao will pulll from buffers
@@ -1574,8 +1937,10 @@ void Viewer::ssao_pass(){
     m_ssao_ao_pass_shader.uniform_4x4(P_inv, "P_inv");
     m_ssao_ao_pass_shader.uniform_3x3(V_rot, "V_rot");
     m_ssao_ao_pass_shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
-    m_ssao_ao_pass_shader.uniform_array_v3_float(m_random_samples,"random_samples");
-    m_ssao_ao_pass_shader.uniform_int(m_random_samples.rows(),"nr_samples");
+    Eigen::MatrixXf samples=ssao_samples_for_frame();
+    m_ssao_ao_pass_shader.uniform_array_v3_float(samples,"random_samples");
+    m_ssao_ao_pass_shader.uniform_int(samples.rows(),"nr_samples");
+    m_ssao_ao_pass_shader.uniform_v2_float(noise_offset,"noise_offset");
     m_ssao_ao_pass_shader.uniform_float(m_kernel_radius,"kernel_radius");
     // m_ssao_ao_pass_shader.uniform_int(m_ssao_downsample, "pyr_lvl"); //no need for pyramid because we only sample from depth_linear_tex which is already downsampled and has no mipmap
     // m_ssao_ao_pass_shader.bind_texture(m_depth_linear_tex,"depth_linear_tex");
@@ -1590,6 +1955,7 @@ void Viewer::ssao_pass(){
 
     // // draw
     glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    Tracer::end_gpu();
     TIME_END("ao_pass");
 
     //restore the state
@@ -1603,8 +1969,14 @@ void Viewer::ssao_pass(){
 
     
 
+    //TEMPORAL----------------------------------------
+    gl::Texture2D& ao_to_blur= m_ssao_temporal ? ssao_temporal_pass(new_viewport_size) : m_ao_tex;
+
+
+
     //dont perform depth checking nor write into the depth buffer 
     TIME_START("blur_pass");
+    Tracer::begin_gpu("blur_pass");
     glDepthMask(false);
     glDisable(GL_DEPTH_TEST);
 
@@ -1636,7 +2008,7 @@ void Viewer::ssao_pass(){
     m_bilateral_blur_shader.uniform_int(m_ao_power, "ao_power");
     m_bilateral_blur_shader.uniform_float(m_sigma_spacial, "sigma_spacial");
     m_bilateral_blur_shader.uniform_float(m_sigma_depth, "sigma_depth");
-    m_bilateral_blur_shader.bind_texture(m_ao_tex, "texSource");
+    m_bilateral_blur_shader.bind_texture(ao_to_blur, "texSource");
     // m_bilateral_blur_shader.bind_texture(m_gbuffer.tex_with_name("depth_gtex"),"texLinearDepth");
     m_bilateral_blur_shader.bind_texture(m_depth_linear_tex,"texLinearDepth");
 
@@ -1648,6 +2020,7 @@ void Viewer::ssao_pass(){
     // m_fullscreen_quad->vao.bind(); 
     glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
     // glColorMask(true, true, true, true);
+    Tracer::end_gpu();
     TIME_END("blur_pass");
 
     //restore the state
@@ -1663,9 +2036,212 @@ void Viewer::ssao_pass(){
 
 }
 
+void Viewer::ssao_pass_compute(){
+
+    TIME_SCOPE("ssao_pass_full");
+    TRACE_GPU_SCOPE("ssao");
+
+    //same three steps as ssao_pass but each one is a compute dispatch that writes directly into the texture. The ao pass keeps the linear depth of its tile in shared memory so the samples around each pixel are read once per workgroup instead of once per pixel, and the blur is split into a horizontal and a vertical pass that each cache their row in shared memory
+
+    Eigen::Vector2i new_viewport_size=calculate_mipmap_size(m_gbuffer.width(), m_gbuffer.height(), m_ssao_downsample);
+    const int tile_size=16; //local size of the linearize and ao shaders
+    const int blur_group_size=128; //local size of the blur shader
+    Eigen::Vector2i nr_tiles( (new_viewport_size.x()+tile_size-1)/tile_size, (new_viewport_size.y()+tile_size-1)/tile_size );
+    m_ao_tex.allocate_or_resize(GL_R8, GL_RED, GL_UNSIGNED_BYTE, new_viewport_size.x(), new_viewport_size.y() );
+    m_gbuffer.tex_with_name("depth_gtex").generate_mipmap(m_ssao_downsample);
+
+
+
+    //LINEARIZE-------------------------
+    TIME_START("depth_linearize_pass");
+    Tracer::begin_gpu("depth_linearize_pass");
+    m_depth_linear_tex.allocate_or_resize( GL_R32F, GL_RED, GL_FLOAT, new_viewport_size.x(), new_viewport_size.y() );
+
+    m_depth_linearize_compute_shader.use();
+    m_depth_linearize_compute_shader.uniform_int(m_ssao_downsample, "pyr_lvl");
+    m_depth_linearize_compute_shader.uniform_float( m_camera->m_far / (m_camera->m_far - m_camera->m_near), "projection_a"); // according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+    m_depth_linearize_compute_shader.uniform_float( (-m_camera->m_far * m_camera->m_near) / (m_camera->m_far - m_camera->m_near) , "projection_b");
+    m_depth_linearize_compute_shader.bind_texture(m_gbuffer.tex_with_name("depth_gtex"), "depth_tex");
+    GL_C( glBindImageTexture(0, m_depth_linear_tex.tex_id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F) );
+    GL_C( glDispatchCompute(nr_tiles.x(), nr_tiles.y(), 1) );
+    GL_C( glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT) ); //the next passes read it as a texture
+    Tracer::end_gpu();
+    TIME_END("depth_linearize_pass");
+
+
+
+    //SSAO----------------------------------------
+    TIME_START("ao_pass");
+    Tracer::begin_gpu("ao_pass");
+    Eigen::Matrix3f V_rot = Eigen::Affine3f(m_camera->view_matrix()).linear(); //for rotating the normals from the world coords to the cam_coords
+    Eigen::Matrix4f P = m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
+    Eigen::Matrix4f P_inv=P.inverse();
+    Eigen::Vector2f noise_offset=Eigen::Vector2f::Zero();
+    if(m_ssao_temporal){
+        noise_offset << m_rand_gen->rand_float(0.0, 1.0), m_rand_gen->rand_float(0.0, 1.0);
+    }
+
+    m_ssao_ao_pass_compute_shader.use();
+    m_ssao_ao_pass_compute_shader.uniform_4x4(P, "P");
+    m_ssao_ao_pass_compute_shader.uniform_4x4(P_inv, "P_inv");
+    m_ssao_ao_pass_compute_shader.uniform_3x3(V_rot, "V_rot");
+    m_ssao_ao_pass_compute_shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
+    Eigen::MatrixXf samples=ssao_samples_for_frame();
+    m_ssao_ao_pass_compute_shader.uniform_array_v3_float(samples,"random_samples");
+    m_ssao_ao_pass_compute_shader.uniform_int(samples.rows(),"nr_samples");
+    m_ssao_ao_pass_compute_shader.uniform_v2_float(noise_offset,"noise_offset");
+    m_ssao_ao_pass_compute_shader.uniform_float(m_kernel_radius,"kernel_radius");
+    m_ssao_ao_pass_compute_shader.bind_texture(m_depth_linear_tex,"depth_linear_tex");
+    m_ssao_ao_pass_compute_shader.bind_texture(m_gbuffer.tex_with_name("normal_gtex"),"normal_tex");
+    m_ssao_ao_pass_compute_shader.bind_texture(m_rvec_tex,"rvec_tex");
+    GL_C( glBindImageTexture(0, m_ao_tex.tex_id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8) );
+    GL_C( glDispatchCompute(nr_tiles.x(), nr_tiles.y(), 1) );
+    GL_C( glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT) );
+    Tracer::end_gpu();
+    TIME_END("ao_pass");
+
+
+
+    //TEMPORAL----------------------------------------
+    gl::Texture2D& ao_to_blur= m_ssao_temporal ? ssao_temporal_pass(new_viewport_size) : m_ao_tex;
+
+
+
+    //BLUR----------------------------------------
+    TIME_START("blur_pass");
+    Tracer::begin_gpu("blur_pass");
+    m_ao_blur_tmp_tex.allocate_or_resize( GL_R8, GL_RED, GL_UNSIGNED_BYTE, new_viewport_size.x(), new_viewport_size.y() );
+    m_ao_blurred_tex.allocate_or_resize( GL_R8, GL_RED, GL_UNSIGNED_BYTE, new_viewport_size.x(), new_viewport_size.y() );
+
+    m_bilateral_blur_compute_shader.use();
+    m_bilateral_blur_compute_shader.uniform_int(m_ao_power, "ao_power");
+    m_bilateral_blur_compute_shader.uniform_float(m_sigma_spacial, "sigma_spacial");
+    m_bilateral_blur_compute_shader.uniform_float(m_sigma_depth, "sigma_depth");
+    m_bilateral_blur_compute_shader.bind_texture(m_depth_linear_tex,"depth_linear_tex");
+    GLint direction_loc=m_bilateral_blur_compute_shader.get_uniform_location("direction");
+
+    //horizontal, one workgroup per segment of a row
+    m_bilateral_blur_compute_shader.uniform_bool(false, "apply_power");
+    GL_C( glUniform2i(direction_loc, 1, 0) );
+    m_bilateral_blur_compute_shader.bind_texture(ao_to_blur, "ao_tex");
+    GL_C( glBindImageTexture(0, m_ao_blur_tmp_tex.tex_id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8) );
+    GL_C( glDispatchCompute( (new_viewport_size.x()+blur_group_size-1)/blur_group_size, new_viewport_size.y(), 1) );
+    GL_C( glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT) );
+
+    //vertical, one workgroup per segment of a column
+    m_bilateral_blur_compute_shader.uniform_bool(true, "apply_power");
+    GL_C( glUniform2i(direction_loc, 0, 1) );
+    m_bilateral_blur_compute_shader.bind_texture(m_ao_blur_tmp_tex, "ao_tex");
+    GL_C( glBindImageTexture(0, m_ao_blurred_tex.tex_id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8) );
+    GL_C( glDispatchCompute( (new_viewport_size.y()+blur_group_size-1)/blur_group_size, new_viewport_size.x(), 1) );
+    GL_C( glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT) ); //compose reads it as a texture
+    Tracer::end_gpu();
+    TIME_END("blur_pass");
+
+    GL_C( glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8) );
+
+}
+
+bool Viewer::ssao_needs_update(){
+    if(!m_ssao_temporal){
+        m_ssao_history_valid=false;
+        m_ssao_nr_accumulated_frames=0;
+        return true;
+    }
+
+    Eigen::Matrix4f V=m_camera->view_matrix();
+    Eigen::Matrix4f P=m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
+    Eigen::VectorXf params(10);
+    params << m_kernel_radius, m_random_samples.rows(), m_ao_power, m_sigma_spacial, m_sigma_depth, m_ssao_downsample, m_ssao_use_compute, m_ssao_temporal_nr_samples, m_gbuffer.width(), m_gbuffer.height();
+
+    m_ssao_reset_history= !m_ssao_history_valid || m_ssao_prev_params.size()!=params.size() || m_ssao_prev_params!=params;
+    bool is_static= !m_ssao_reset_history && !m_scene_changed && V==m_ssao_prev_V && P==m_ssao_prev_P;
+    if(is_static && m_ssao_nr_accumulated_frames>=m_ssao_temporal_max_frames_static){
+        return false; //converged, the blurred ao from the last time is still valid
+    }
+
+    //same count as the one the shader keeps per pixel, for the pixels that are not disoccluded
+    int max_frames= is_static ? m_ssao_temporal_max_frames_static : m_ssao_temporal_max_frames;
+    m_ssao_nr_accumulated_frames= m_ssao_reset_history ? 1 : std::min(m_ssao_nr_accumulated_frames+1, max_frames);
+
+    m_ssao_prev_params=params;
+    return true;
+}
+
+gl::Texture2D& Viewer::ssao_temporal_pass(const Eigen::Vector2i& size){
+    TIME_START("ao_temporal_pass");
+    Tracer::begin_gpu("ao_temporal_pass");
+
+    gl::Texture2D& history_prev=m_ao_history_tex[m_ao_history_idx];
+    m_ao_history_idx=1-m_ao_history_idx;
+    gl::Texture2D& history=m_ao_history_tex[m_ao_history_idx];
+    //allocate also the ones from the previous frame because on the first frame they are still empty, they only get read if the history is valid anyway
+    history_prev.allocate_or_resize(GL_RG16F, GL_RG, GL_HALF_FLOAT, size.x(), size.y() );
+    history.allocate_or_resize(GL_RG16F, GL_RG, GL_HALF_FLOAT, size.x(), size.y() );
+    m_depth_linear_prev_tex.allocate_or_resize( GL_R32F, GL_RED, GL_FLOAT, size.x(), size.y() );
+
+    glDepthMask(false);
+    glDisable(GL_DEPTH_TEST);
+    glViewport(0.0f , 0.0f, size.x(), size.y() );
+
+    Eigen::Matrix4f V=m_camera->view_matrix();
+    Eigen::Matrix4f P=m_camera->proj_matrix(m_gbuffer.width(), m_gbuffer.height());
+    Eigen::Matrix4f P_inv=P.inverse();
+    Eigen::Matrix4f V_inv=V.inverse();
+    Eigen::Matrix4f prev_VP=m_ssao_prev_P*m_ssao_prev_V;
+
+    GL_C( m_fullscreen_quad->vao.vertex_attribute(m_ssao_temporal_shader, "position", m_fullscreen_quad->V_buf, 3) );
+    GL_C( m_fullscreen_quad->vao.vertex_attribute(m_ssao_temporal_shader, "uv", m_fullscreen_quad->UV_buf, 2) );
+    m_fullscreen_quad->vao.indices(m_fullscreen_quad->F_buf);
+
+    m_ssao_temporal_shader.use();
+    m_ssao_temporal_shader.uniform_4x4(P_inv, "P_inv");
+    m_ssao_temporal_shader.uniform_4x4(V_inv, "V_inv");
+    m_ssao_temporal_shader.uniform_4x4(m_ssao_prev_V, "prev_V");
+    m_ssao_temporal_shader.uniform_4x4(prev_VP, "prev_VP");
+    m_ssao_temporal_shader.uniform_float( m_ssao_use_compute ? 0.0 : 1.0, "background_depth_linear"); //the compute linearization writes 0 on the background and the raster one writes 1
+    bool is_static= !m_scene_changed && V==m_ssao_prev_V && P==m_ssao_prev_P;
+    m_ssao_temporal_shader.uniform_int( is_static ? m_ssao_temporal_max_frames_static : m_ssao_temporal_max_frames, "max_nr_frames");
+    m_ssao_temporal_shader.uniform_bool(m_ssao_reset_history, "reset_history");
+    m_ssao_temporal_shader.bind_texture(m_ao_tex, "ao_tex");
+    m_ssao_temporal_shader.bind_texture(m_depth_linear_tex, "depth_linear_tex");
+    m_ssao_temporal_shader.bind_texture(history_prev, "history_tex");
+    m_ssao_temporal_shader.bind_texture(m_depth_linear_prev_tex, "depth_linear_prev_tex");
+    m_ssao_temporal_shader.draw_into(history, "ao_history_out");
+
+    glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+
+    //the depth of this frame becomes the one of the previous frame for the next one
+    GL_C( glCopyImageSubData(m_depth_linear_tex.tex_id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                             m_depth_linear_prev_tex.tex_id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                             size.x(), size.y(), 1) );
+    m_ssao_prev_V=V;
+    m_ssao_prev_P=P;
+    m_ssao_history_valid=true;
+
+    //restore the state. The viewport goes back to the size of the gbuffer which is the one the passes after the ssao draw into
+    GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
+    glDepthMask(true);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0.0f , 0.0f, m_gbuffer.width(), m_gbuffer.height() );
+
+    Tracer::end_gpu();
+    TIME_END("ao_temporal_pass");
+
+    return history;
+}
+
 void Viewer::compose_final_image(const GLuint fbo_id){
 
     TIME_START("compose");
+    Tracer::begin_gpu("compose");
+
+    //the irradiance cubemap is skipped when loading the environment map with spherical harmonics so we make it now if they are not used anymore
+    bool use_irradiance_sh= m_use_irradiance_sh && m_irradiance_sh.rows()==9;
+    if(m_enable_ibl && !use_irradiance_sh && !m_irradiance_cubemap_is_computed){
+        radiance2irradiance(m_irradiance_cubemap_tex, m_environment_cubemap_tex);
+        m_irradiance_cubemap_is_computed=true;
+    }
 
     //create a final image the same size as the framebuffer
     // m_environment_cubemap_tex.allocate_tex_storage(GL_RGB16F, GL_RGB, GL_HALF_FLOAT, m_environment_cubemap_resolution, m_environment_cubemap_resolution);
@@ -1678,6 +2254,8 @@ void Viewer::compose_final_image(const GLuint fbo_id){
     m_composed_fbo.set_size(m_gbuffer.width(), m_gbuffer.height() ); //established what will be the size of the textures attached to this framebuffer
     m_composed_fbo.clear();
     TIME_END("clearing_compose");
+    //the passes before (ssao raster or compute, temporal accumulation, shadow maps) leave different viewports behind so we set our own
+    glViewport(0.0f , 0.0f, m_gbuffer.width(), m_gbuffer.height() );
     // GL_C( m_composed_fbo.tex_with_name("composed_gtex").set_val(m_background_color.x(), m_background_color.y(), m_background_color.z(), 1.0) );
     // GL_C( m_composed_fbo.tex_with_name("bloom_gtex").set_val(m_background_color.x(), m_background_color.y(), m_background_color.z(), 0.0) );
     // GL_C( m_composed_fbo.sanity_check());
@@ -1747,6 +2325,10 @@ void Viewer::compose_final_image(const GLuint fbo_id){
     m_compose_final_quad_shader.uniform_float(m_environment_map_blur, "environment_map_blur");
     m_compose_final_quad_shader.uniform_int(m_prefilter_cubemap_tex.mipmap_nr_lvls(), "prefilter_nr_mipmaps");
     m_compose_final_quad_shader.uniform_bool(m_enable_ibl, "enable_ibl");
+    m_compose_final_quad_shader.uniform_bool(use_irradiance_sh, "use_irradiance_sh");
+    if(use_irradiance_sh){
+        m_compose_final_quad_shader.uniform_array_v3_float(m_irradiance_sh, "irradiance_sh");
+    }
     m_compose_final_quad_shader.uniform_float(m_camera->m_exposure, "exposure");
     m_compose_final_quad_shader.uniform_bool(m_enable_bloom, "enable_bloom");
     m_compose_final_quad_shader.uniform_float(m_bloom_threshold, "bloom_threshold");
@@ -1754,6 +2336,10 @@ void Viewer::compose_final_image(const GLuint fbo_id){
 
     //fill up the vector of spot lights 
     m_compose_final_quad_shader.uniform_int(m_spot_lights.size(), "nr_active_spot_lights");
+    //the array is always bound, even if unused, so that the sampler doesn't point to the same unit as a sampler2D
+    const bool use_shadow_map_array= m_shadow_maps_were_layered && m_layered_shadow_maps->is_initialized(); //the layered ones may be enabled but not used if there are too many lights
+    m_compose_final_quad_shader.uniform_bool(use_shadow_map_array, "use_shadow_map_array");
+    m_layered_shadow_maps->bind(m_compose_final_quad_shader, "shadow_map_array");
     for(size_t i=0; i<m_spot_lights.size(); i++){
 
         Eigen::Matrix4f V_light = m_spot_lights[i]->view_matrix();
@@ -1784,16 +2370,20 @@ void Viewer::compose_final_image(const GLuint fbo_id){
         glUniformMatrix4fv(uniform_VP_loc, 1, GL_FALSE, VP.data());
 
         //sampler for shadow map 
-        if (m_spot_lights[i]->has_shadow_map() ){ //have to check because the light might not yet have a shadow map at the start of the app when no mesh is there to be rendered
+        const int shadow_map_layer= i<m_shadow_map_layer_of_light.size() ? m_shadow_map_layer_of_light[i] : -1;
+        bool has_shadow_map= use_shadow_map_array ? shadow_map_layer>=0 : m_spot_lights[i]->has_shadow_map();
+        if (!use_shadow_map_array && has_shadow_map ){ //have to check because the light might not yet have a shadow map at the start of the app when no mesh is there to be rendered
             std::string sampler_shadow_map_name =  uniform_name +"["+std::to_string(i)+"]"+".shadow_map";
             m_compose_final_quad_shader.bind_texture(m_spot_lights[i]->get_shadow_map_ref(), sampler_shadow_map_name );
         }
+        std::string uniform_layer_name = uniform_name +"["+std::to_string(i)+"]"+".shadow_map_layer";
+        glUniform1i(m_compose_final_quad_shader.get_uniform_location(uniform_layer_name), std::max(shadow_map_layer, 0));
 
         //color
         std::string uniform_create_shadow_name = uniform_name +"["+std::to_string(i)+"]"+".create_shadow";
         GLint uniform_create_shadow_loc=m_compose_final_quad_shader.get_uniform_location(uniform_create_shadow_name);
         //check both if the spotlight creates a shadow AND if the shadow map is actually initialized. It may happen that you have a scene full of surfel meshes which do not project into the light and therefore they will never initialize their shadow maps
-        bool creates_shadow=m_spot_lights[i]->m_create_shadow && m_spot_lights[i]->has_shadow_map();
+        bool creates_shadow=m_spot_lights[i]->m_create_shadow && has_shadow_map;
         glUniform1i(uniform_create_shadow_loc, creates_shadow);
     }
 
@@ -1824,6 +2414,7 @@ void Viewer::compose_final_image(const GLuint fbo_id){
     // draw
     m_fullscreen_quad->vao.bind(); 
     glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    Tracer::end_gpu();
     TIME_END("compose");
 
     //restore the state
@@ -1916,8 +2507,9 @@ void Viewer::blur_img(gl::Texture2D& img, const int start_mip_map_lvl, const int
 
 
     //first mip map the image containing the bright areas
-
+    Tracer::begin_gpu("bloom_mipmap");
     GL_C( img.generate_mipmap(max_mip_map_lvl) );
+    Tracer::end_gpu();
     //the blurred tmp only needs to start allocating from start_mip_map_lvl because we dont blur any map that is bigger
     int max_mip_map_lvl_tmp_buffer=max_mip_map_lvl-start_mip_map_lvl;
     Eigen::Vector2i blurred_tmp_start_size=calculate_mipmap_size(img.width(), img.height(), start_mip_map_lvl);
@@ -1929,6 +2521,7 @@ void Viewer::blur_img(gl::Texture2D& img, const int start_mip_map_lvl, const int
     m_blur_tmp_tex.clear(); //clear also the mip maps
 
     //for each mip map level of the bright image we blur it a bit
+    Tracer::begin_gpu("bloom_gaussian_blur");
     for (int mip = start_mip_map_lvl; mip < max_mip_map_lvl; mip++){
 
         for (int i = 0; i < bloom_blur_iters; i++){
@@ -1995,6 +2588,7 @@ void Viewer::blur_img(gl::Texture2D& img, const int start_mip_map_lvl, const int
     // }
     
 
+    Tracer::end_gpu();
     TIME_END("blur_img");
 
     //restore the state
@@ -2005,9 +2599,113 @@ void Viewer::blur_img(gl::Texture2D& img, const int start_mip_map_lvl, const int
 
 }
 
+void Viewer::blur_img_dual_filter(gl::Texture2D& img, const int start_mip_map_lvl, const int max_mip_map_lvl, const float offset){
+    //dual filter blur from "Bandwidth-Efficient Rendering" by Marius Bjorge. Each level is downsampled from the previous one with a small filter and then upsampled back and added on top. Every pass reads only one level so the cost is dominated by the start level and it doesn't grow with the blur radius like the gaussian does
+
+    TIME_START("blur_img");
+
+    glDepthMask(false);
+    glDisable(GL_DEPTH_TEST);
+
+    //the last level can't go past the 1x1 one of the mip chain
+    const int nr_levels_in_chain=1+(int)std::floor(std::log2( std::max(img.width(), img.height()) ));
+    const int last_lvl=std::min(max_mip_map_lvl, nr_levels_in_chain-1);
+
+    //the mip maps until the start level are made by the driver, the rest are done by our downsample so we only allocate them
+    Tracer::begin_gpu("bloom_mipmap");
+    GL_C( img.generate_mipmap(start_mip_map_lvl) );
+    GL_C( glBindTexture(GL_TEXTURE_2D, img.tex_id()) );
+    for (int lvl = start_mip_map_lvl+1; lvl <= last_lvl; lvl++){
+        Eigen::Vector2i size=calculate_mipmap_size(img.width(), img.height(), lvl);
+        GLint lvl_width=0;
+        GLint lvl_height=0;
+        GL_C( glGetTexLevelParameteriv(GL_TEXTURE_2D, lvl, GL_TEXTURE_WIDTH, &lvl_width) );
+        GL_C( glGetTexLevelParameteriv(GL_TEXTURE_2D, lvl, GL_TEXTURE_HEIGHT, &lvl_height) );
+        if(lvl_width!=size.x() || lvl_height!=size.y()){
+            GL_C( glTexImage2D(GL_TEXTURE_2D, lvl, img.internal_format(), size.x(), size.y(), 0, img.format(), img.type(), nullptr) );
+        }
+    }
+    Tracer::end_gpu();
+
+    //we read from one level and write into another one of the same texture so we restrict the levels visible for sampling to the one we read, otherwise it would be a feedback loop
+    GLint prev_base_level=0;
+    GLint prev_max_level=1000;
+    GL_C( glBindTexture(GL_TEXTURE_2D, img.tex_id()) );
+    GL_C( glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &prev_base_level) );
+    GL_C( glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &prev_max_level) );
+    auto read_only_level=[&](const int lvl){
+        GL_C( glBindTexture(GL_TEXTURE_2D, img.tex_id()) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, lvl) );
+        GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lvl) );
+    };
+
+    //down
+    Tracer::begin_gpu("bloom_downsample");
+    GL_C( m_fullscreen_quad->vao.vertex_attribute(m_bloom_downsample_shader, "position", m_fullscreen_quad->V_buf, 3) );
+    GL_C( m_fullscreen_quad->vao.vertex_attribute(m_bloom_downsample_shader, "uv", m_fullscreen_quad->UV_buf, 2) );
+    m_fullscreen_quad->vao.indices(m_fullscreen_quad->F_buf);
+    m_bloom_downsample_shader.use();
+    m_bloom_downsample_shader.uniform_float(offset, "offset");
+    for (int mip = start_mip_map_lvl; mip < last_lvl; mip++){
+        Eigen::Vector2i size=calculate_mipmap_size(img.width(), img.height(), mip+1);
+        glViewport(0.0f , 0.0f, size.x(), size.y() );
+        read_only_level(mip);
+        m_bloom_downsample_shader.bind_texture(img,"img");
+        m_bloom_downsample_shader.draw_into(img, "downsampled_output", mip+1);
+        m_fullscreen_quad->vao.bind();
+        glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    }
+    Tracer::end_gpu();
+
+    //up, each level gets added to the one above so the bloom of all of them ends up in the start level
+    Tracer::begin_gpu("bloom_upsample");
+    GL_C( m_fullscreen_quad->vao.vertex_attribute(m_bloom_upsample_shader, "position", m_fullscreen_quad->V_buf, 3) );
+    GL_C( m_fullscreen_quad->vao.vertex_attribute(m_bloom_upsample_shader, "uv", m_fullscreen_quad->UV_buf, 2) );
+    m_fullscreen_quad->vao.indices(m_fullscreen_quad->F_buf);
+    m_bloom_upsample_shader.use();
+    m_bloom_upsample_shader.uniform_float(offset, "offset");
+    GLboolean blend_was_enabled=glIsEnabled(GL_BLEND);
+    GLint prev_blend_src_rgb, prev_blend_dst_rgb, prev_blend_src_alpha, prev_blend_dst_alpha;
+    glGetIntegerv(GL_BLEND_SRC_RGB, &prev_blend_src_rgb);
+    glGetIntegerv(GL_BLEND_DST_RGB, &prev_blend_dst_rgb);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &prev_blend_src_alpha);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &prev_blend_dst_alpha);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    for (int mip = last_lvl; mip > start_mip_map_lvl; mip--){
+        Eigen::Vector2i size=calculate_mipmap_size(img.width(), img.height(), mip-1);
+        glViewport(0.0f , 0.0f, size.x(), size.y() );
+        read_only_level(mip);
+        m_bloom_upsample_shader.bind_texture(img,"img");
+        m_bloom_upsample_shader.draw_into(img, "upsampled_output", mip-1);
+        m_fullscreen_quad->vao.bind();
+        glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    }
+    glBlendFuncSeparate(prev_blend_src_rgb, prev_blend_dst_rgb, prev_blend_src_alpha, prev_blend_dst_alpha);
+    if(!blend_was_enabled){
+        glDisable(GL_BLEND);
+    }
+    Tracer::end_gpu();
+
+    //restore the levels so the postprocess can sample the start level
+    GL_C( glBindTexture(GL_TEXTURE_2D, img.tex_id()) );
+    GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, prev_base_level) );
+    GL_C( glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, prev_max_level) );
+    GL_C( glBindTexture(GL_TEXTURE_2D, 0) );
+
+    TIME_END("blur_img");
+
+    //restore the state
+    GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
+    glDepthMask(true);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0.0f , 0.0f, m_viewport_size.x()/m_subsample_factor, m_viewport_size.y()/m_subsample_factor );
+}
+
 void Viewer::apply_postprocess(){
 
     TIME_START("apply_postprocess");
+    Tracer::begin_gpu("apply_postprocess");
 
     //first mip map the image so it's faster to blur it when it's smaller
     // m_blur_tmp_tex.allocate_or_resize( img.internal_format(), img.format(), img.type(), m_posprocessed_tex.width(), blurred_img_size.y() );
@@ -2056,7 +2754,7 @@ void Viewer::apply_postprocess(){
     m_apply_postprocess_shader.uniform_bool(m_show_prefiltered_environment_map, "show_prefiltered_environment_map");
     m_apply_postprocess_shader.uniform_bool(m_enable_bloom, "enable_bloom");
     m_apply_postprocess_shader.uniform_int(m_bloom_start_mip_map_lvl,"bloom_start_mip_map_lvl");
-    m_apply_postprocess_shader.uniform_int(m_bloom_max_mip_map_lvl,"bloom_max_mip_map_lvl");
+    m_apply_postprocess_shader.uniform_int( m_bloom_dual_filter ? std::min(m_bloom_start_mip_map_lvl+1, m_bloom_max_mip_map_lvl) : m_bloom_max_mip_map_lvl,"bloom_max_mip_map_lvl"); //the dual filter already summed all the levels into the start one
     m_apply_postprocess_shader.uniform_float(m_camera->m_exposure, "exposure");
     // m_apply_postprocess_shader.uniform_v3_float(m_background_color, "background_color");
     m_apply_postprocess_shader.uniform_bool(m_enable_multichannel_view, "enable_multichannel_view");
@@ -2072,6 +2770,7 @@ void Viewer::apply_postprocess(){
 
    
 
+    Tracer::end_gpu();
     TIME_END("apply_postprocess");
     //BLEND BACKGROUND -------------------------------------------------------------------------------------------------------------------
     //blend the pure color texture that we just rendered with the bg using the alpha. This is in order to deal with bloom and translucent thing corretly and still have a saved copy of the texture with transparency
@@ -2110,6 +2809,7 @@ void Viewer::apply_postprocess(){
 void Viewer::blend_bg(){
 
     TIME_START("blend_bg");
+    Tracer::begin_gpu("blend_bg");
 
     if(m_viewport_size.x()/m_subsample_factor!=m_final_fbo_no_gui.width() || m_viewport_size.y()/m_subsample_factor!=m_final_fbo_no_gui.height()){
         m_final_fbo_no_gui.set_size(m_viewport_size.x()/m_subsample_factor, m_viewport_size.y()/m_subsample_factor  );
@@ -2147,6 +2847,7 @@ void Viewer::blend_bg(){
     glDepthMask(true);
     glEnable(GL_DEPTH_TEST);
 
+    Tracer::end_gpu();
     TIME_END("blend_bg");
 
 }
@@ -2198,6 +2899,63 @@ void Viewer::create_random_samples_hemisphere(){
     }
 }
 
+std::shared_ptr<GpuTimer> Viewer::gpu_timer(const std::string& name){
+    auto it=m_gpu_timers.find(name);
+    if(it!=m_gpu_timers.end()){
+        return it->second;
+    }
+    std::shared_ptr<GpuTimer> timer=GpuTimer::create(name);
+    m_gpu_timers[name]=timer;
+    return timer;
+}
+
+float Viewer::gpu_time_ms(const std::string& name){
+    return gpu_timer(name)->elapsed_ms();
+}
+
+Eigen::MatrixXf Viewer::ssao_samples_for_frame(){
+    if(!m_ssao_temporal){
+        return m_random_samples;
+    }
+    //the samples are sorted by their distance to the center so we take them with a stride in order for each subset to cover the whole radius
+    int nr_samples=std::min<int>(m_ssao_temporal_nr_samples, m_random_samples.rows());
+    int nr_subsets=(m_random_samples.rows()+nr_samples-1)/nr_samples;
+    int subset=m_ssao_nr_accumulated_frames%nr_subsets;
+    Eigen::MatrixXf samples(nr_samples, 3);
+    for(int i=0; i<nr_samples; i++){
+        samples.row(i)=m_random_samples.row( (i*nr_subsets+subset)%m_random_samples.rows() );
+    }
+    return samples;
+}
+
+bool Viewer::has_scene_changed(){
+    std::unordered_map<unsigned long long, MeshSceneState> states;
+    states.reserve(m_meshes_gl.size());
+    bool changed=!m_point_cloud_octrees.empty(); //the octrees stream their nodes in and out depending on the view
+    for(size_t i=0; i<m_meshes_gl.size(); i++){
+        MeshGLSharedPtr mesh=m_meshes_gl[i];
+        const VisOptions& vis=mesh->m_core->m_vis;
+        MeshSceneState state;
+        state.buffers_version=mesh->m_buffers_version;
+        state.model_matrix=mesh->m_core->model_matrix().matrix();
+        state.vis_flags= vis.m_is_visible | vis.m_show_points<<1 | vis.m_show_lines<<2 | vis.m_show_mesh<<3 | vis.m_show_wireframe<<4 | vis.m_show_surfels<<5;
+        state.point_size=vis.m_point_size;
+
+        //anything that didn't go through a setter doesn't set the dirty flag so we also mark the shadow map dirty here
+        auto prev=m_scene_states.find(mesh->m_uid);
+        if(prev==m_scene_states.end() || !(prev->second==state)){
+            mesh->m_core->m_is_shadowmap_dirty=true;
+        }
+        if(mesh->m_core->m_is_shadowmap_dirty || mesh->m_core->m_is_dynamic){
+            changed=true;
+        }
+        states[mesh->m_uid]=state;
+    }
+    changed = changed || states.size()!=m_scene_states.size(); //a mesh got removed
+    m_scene_states.swap(states);
+    return changed;
+}
+
 gl::Texture2D& Viewer::rendered_tex_no_gui(const bool with_transparency){
     if (with_transparency){
         return m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex");
@@ -2209,6 +2967,22 @@ gl::Texture2D& Viewer::rendered_tex_with_gui(){
     return m_final_fbo_with_gui.tex_with_name("color_gtex");
 }
 
+bool Viewer::using_fat_gbuffer() const{
+    return m_using_fat_gbuffer;
+}
+
+PickResult Viewer::pick(const int x, const int y, const int radius){
+    return m_picker->pick(x, y, radius);
+}
+
+void Viewer::pick_async(const int x, const int y, const std::function<void(const PickResult&)> on_done, const int radius){
+    m_picker->pick_async(x, y, on_done, radius);
+}
+
+unsigned int Viewer::id_buffers_no_label() const{
+    return m_id_buffers_32bit ? std::numeric_limits<uint32_t>::max() : std::numeric_limits<uint16_t>::max();
+}
+
 void Viewer::load_environment_map(const std::string path){
 
     //check if the path is relative 
@@ -2224,12 +2998,61 @@ void Viewer::load_environment_map(const std::string path){
 
 
     m_enable_ibl=true;
+    m_irradiance_cubemap_is_computed=false;
+
+    //the cached textures depend on the content of the hdr and on the resolutions they were computed at
+    std::string env_cache_name, irradiance_cache_name, prefilter_cache_name;
+    std::string hash= m_ibl_cache ? IblCache::hash_file(path_abs) : "";
+    const bool use_ibl_cache= m_ibl_cache && !hash.empty();
+    if(use_ibl_cache){
+        std::string key=hash+"_"+std::to_string(m_environment_cubemap_resolution);
+        env_cache_name="environment_"+key;
+        irradiance_cache_name= m_use_irradiance_sh ? "irradiance_sh9_"+hash : "irradiance_"+key+"_"+std::to_string(m_irradiance_cubemap_resolution);
+        prefilter_cache_name="prefilter_"+key+"_"+std::to_string(m_prefilter_cubemap_resolution);
+        bool irradiance_loaded= m_use_irradiance_sh ? m_ibl_cache->load_matrix(m_irradiance_sh, irradiance_cache_name, 9, 3) : m_ibl_cache->load_cubemap(m_irradiance_cubemap_tex, irradiance_cache_name, m_irradiance_cubemap_resolution, 1);
+        m_irradiance_cubemap_is_computed= !m_use_irradiance_sh && irradiance_loaded;
+        if(irradiance_loaded &&
+           m_ibl_cache->load_cubemap(m_environment_cubemap_tex, env_cache_name, m_environment_cubemap_resolution, 1) &&
+           m_ibl_cache->load_cubemap(m_prefilter_cubemap_tex, prefilter_cache_name, m_prefilter_cubemap_resolution, m_prefilter_cubemap_tex.mipmap_nr_lvls()) ){
+            //only the first level of the environment is stored, the mip maps are used for showing it blurred in the background
+            m_environment_cubemap_tex.set_filter_mode_min(GL_LINEAR_MIPMAP_LINEAR);
+            m_environment_cubemap_tex.set_filter_mode_mag(GL_LINEAR);
+            m_environment_cubemap_tex.generate_mipmap_full();
+            VLOG(1) << "Loaded the ibl textures of " << path_abs << " from the cache in " << m_ibl_cache->dir();
+            return;
+        }
+    }
 
-    read_background_img(m_background_tex, path_abs);
+    cv::Mat img=cv::imread(path_abs, -1); //the -1 is so that it reads the image as floats because we might read a .hdr image which needs high precision
+    CHECK(img.data) << "Could not open environment map " << path_abs;
+    //the spherical harmonics are projected on the cpu while the gpu converts the map and prefilters it
+    std::future<Eigen::MatrixXf> irradiance_sh_future;
+    if(m_use_irradiance_sh){
+        irradiance_sh_future=std::async(std::launch::async, [img](){ return irradiance_sh9_from_equirectangular(img); });
+    }
+    cv::Mat img_flipped;
+    cv::flip(img, img_flipped, 0); //flip around the horizontal axis
+    m_background_tex.upload_from_cv_mat(img_flipped);
     //if it's equirectangular we convert it to cubemap because it is faster to sample
     equirectangular2cubemap(m_environment_cubemap_tex, m_background_tex);
-    radiance2irradiance(m_irradiance_cubemap_tex, m_environment_cubemap_tex);
+    if(!m_use_irradiance_sh){
+        radiance2irradiance(m_irradiance_cubemap_tex, m_environment_cubemap_tex);
+        m_irradiance_cubemap_is_computed=true;
+    }
     prefilter(m_prefilter_cubemap_tex, m_environment_cubemap_tex);
+    if(m_use_irradiance_sh){
+        m_irradiance_sh=irradiance_sh_future.get();
+    }
+
+    if(use_ibl_cache){
+        m_ibl_cache->save_cubemap(m_environment_cubemap_tex, env_cache_name, m_environment_cubemap_resolution, 1);
+        if(m_use_irradiance_sh){
+            m_ibl_cache->save_matrix(m_irradiance_sh, irradiance_cache_name);
+        }else{
+            m_ibl_cache->save_cubemap(m_irradiance_cubemap_tex, irradiance_cache_name, m_irradiance_cubemap_resolution, 1);
+        }
+        m_ibl_cache->save_cubemap(m_prefilter_cubemap_tex, prefilter_cache_name, m_prefilter_cubemap_resolution, m_prefilter_cubemap_tex.mipmap_nr_lvls());
+    }
 
 }
 
@@ -2491,6 +3314,7 @@ void Viewer::prefilter(gl::CubeMap& prefilter_tex, const gl::CubeMap& radiance_t
 void Viewer::integrate_brdf(gl::Texture2D& brdf_lut_tex){
 
     TIME_START("compose");
+    Tracer::begin_gpu("compose");
 
     //dont perform depth checking nor write into the depth buffer 
     glDepthMask(false);
@@ -2516,6 +3340,7 @@ void Viewer::integrate_brdf(gl::Texture2D& brdf_lut_tex){
     // draw
     m_fullscreen_quad->vao.bind(); 
     glDrawElements(GL_TRIANGLES, m_fullscreen_quad->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    Tracer::end_gpu();
     TIME_END("compose");
 
     //restore the state
@@ -2596,39 +3421,14 @@ void Viewer::write_gbuffer_to_folder(){
 
 
 
-    // glFinish();
-    //get all the textures as cv::mats 
-    cv::Mat mat, normal_mat, diffuse_mat, depth_mat, metalness_and_roughness_mat, ao_blurred_mat;
-    //normal
-    mat=debug_gbuffer.tex_with_name("normals_debug_gtex").download_to_cv_mat();
-    cv::flip(mat, normal_mat, 0);
-    cv::cvtColor(normal_mat, normal_mat, cv::COLOR_BGR2RGB);
-    normal_mat*=255;
-    //diffuse
-    mat=m_gbuffer.tex_with_name("diffuse_gtex").download_to_cv_mat();
-    cv::flip(mat, diffuse_mat, 0);
-    cv::cvtColor(diffuse_mat, diffuse_mat, cv::COLOR_BGR2RGB);
-    //depth
-    mat=debug_gbuffer.tex_with_name("depth_debug_gtex").download_to_cv_mat();
-    cv::flip(mat, depth_mat, 0);
-    depth_mat*=255;
-    //metalness_and_roughness
-    mat=debug_gbuffer.tex_with_name("metalness_and_roughness_debug_gtex").download_to_cv_mat();
-    cv::flip(mat, metalness_and_roughness_mat, 0);
-    cv::cvtColor(metalness_and_roughness_mat, metalness_and_roughness_mat, cv::COLOR_BGR2RGB);
-    metalness_and_roughness_mat*=255;
-    //ao
-    mat=m_ao_blurred_tex.download_to_cv_mat();
-    cv::flip(mat, ao_blurred_mat, 0);
-
+    //the recorder flips them and swaps the channels on the gpu and writes them once they finished downloading, so this doesn't wait for the gpu. The float ones are written as 16 bit pngs
     fs::path path = "./debug";
-    fs::create_directories(path);
     VLOG(1) << "Writing debug images in " << path;
-    cv::imwrite( (path/"./g_normal.png").string(), normal_mat );
-    cv::imwrite( (path/"./g_diffuse.png").string(), diffuse_mat );
-    cv::imwrite( (path/"./depth.png").string(), depth_mat );
-    cv::imwrite( (path/"./g_metalness_and_roughness.png").string(), metalness_and_roughness_mat );
-    cv::imwrite( (path/"./ao_blurred.png").string(), ao_blurred_mat );
+    m_recorder->write_without_buffering(debug_gbuffer.tex_with_name("normals_debug_gtex"), "g_normal.png", path.string());
+    m_recorder->write_without_buffering(m_gbuffer.tex_with_name("diffuse_gtex"), "g_diffuse.png", path.string());
+    m_recorder->write_without_buffering(debug_gbuffer.tex_with_name("depth_debug_gtex"), "depth.png", path.string());
+    m_recorder->write_without_buffering(debug_gbuffer.tex_with_name("metalness_and_roughness_debug_gtex"), "g_metalness_and_roughness.png", path.string());
+    m_recorder->write_without_buffering(m_ao_blurred_tex, "ao_blurred.png", path.string());
 
 }
 
@@ -2642,6 +3442,22 @@ void Viewer::glfw_mouse_pressed(GLFWwindow* window, int button, int action, int
     else //if (button == GLFW_MOUSE_BUTTON_3)
         mb = Camera::MouseButton::Middle;
 
+    //alt+click picks what is under the cursor and the gui shows it once it's downloaded
+    if (action == GLFW_PRESS && mb==Camera::MouseButton::Left && modifier==GLFW_MOD_ALT && m_enable_id_buffers){
+        double x, y;
+        glfwGetCursorPos(window, &x, &y);
+        //the cursor is in screen coordinates but the picker wants pixels of the framebuffer, which are more on high dpi screens. The subsample factor is applied by the picker
+        int window_width, window_height, framebuffer_width, framebuffer_height;
+        glfwGetWindowSize(window, &window_width, &window_height);
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+        if(window_width>0 && window_height>0){
+            x*=(double)framebuffer_width/window_width;
+            y*=(double)framebuffer_height/window_height;
+        }
+        m_picker->pick_async(x, y, nullptr, 2);
+        return;
+    }
+
     if (action == GLFW_PRESS){
         m_camera->mouse_pressed(mb,modifier);
         if(m_lights_follow_camera && m_camera==m_default_camera){
@@ -2756,6 +3572,10 @@ void Viewer::glfw_key(GLFWwindow* window, int key, int scancode, int action, int
 void Viewer::glfw_char_mods(GLFWwindow* window, unsigned int codepoint, int modifier){
     
 }
+bool Viewer::is_headless() const{
+    return m_headless_context!=nullptr;
+}
+
 void Viewer::glfw_resize(GLFWwindow* window, int width, int height){
     glfwSetWindowSize(window, width, height);
     // glfwSetWindowAspectRatio(window, width, height);
@@ -2766,6 +3586,283 @@ void Viewer::glfw_resize(GLFWwindow* window, int width, int height){
     // m_viewport_size = Eigen::Vector2f(width/m_subsample_factor, height/m_subsample_factor);
 }
 
+void Viewer::update_shadow_maps(){
+    m_nr_shadow_meshes_drawn=0;
+    m_nr_shadow_meshes_culled=0;
+    m_nr_shadow_passes_skipped=0;
+    m_nr_static_shadow_passes=0;
+    m_nr_dynamic_shadow_passes=0;
+    m_nr_shadow_draw_calls=0;
+
+    std::unordered_set<unsigned long long> meshes_in_scene;
+    for(size_t i=0; i<m_meshes_gl.size(); i++){
+        meshes_in_scene.insert(m_meshes_gl[i]->m_uid);
+    }
+
+    //only the lights that cast shadows get a layer. All the layers share one resolution so we take the biggest one that those lights asked for, clamped so that a single big light doesn't make all the layers huge
+    std::vector<int> prev_layer_of_light=m_shadow_map_layer_of_light;
+    m_shadow_map_layer_of_light.assign(m_spot_lights.size(), -1);
+    int nr_layers=0;
+    int resolution=1;
+    for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
+        if(m_spot_lights[l_idx]->m_create_shadow){
+            m_shadow_map_layer_of_light[l_idx]=nr_layers++;
+            resolution=std::max(resolution, m_spot_lights[l_idx]->shadow_map_resolution());
+        }
+    }
+    resolution=std::min(resolution, std::max(1, m_layered_shadow_map_max_resolution));
+    //the texture array has a limited nr of layers, with more lights we use the shadow map of each light
+    bool use_layered= m_enable_layered_shadow_maps && nr_layers<=LayeredShadowMaps::MAX_NR_LAYERS;
+    if(m_enable_layered_shadow_maps && !use_layered && !m_warned_too_many_shadow_layers){
+        LOG(WARNING) << nr_layers << " lights cast shadows but the layered shadow maps support at most " << LayeredShadowMaps::MAX_NR_LAYERS << ". Using the shadow map of each light instead";
+    }
+    m_warned_too_many_shadow_layers= m_enable_layered_shadow_maps && !use_layered;
+
+    //switching between the layered and the per light shadow maps leaves the other one stale
+    bool layered_changed= use_layered!=m_shadow_maps_were_layered;
+    m_shadow_maps_were_layered=use_layered;
+    if(use_layered){
+        //if the layers got allocated again or moved to other lights, what they contain is not valid anymore
+        if(m_layered_shadow_maps->resize(resolution, nr_layers) || prev_layer_of_light!=m_shadow_map_layer_of_light){
+            layered_changed=true;
+        }
+    }
+    if(layered_changed){
+        for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
+            m_spot_lights[l_idx]->invalidate_static_shadow_map();
+        }
+    }
+
+    std::vector<Frustum> light_frustums(m_spot_lights.size());
+    std::vector<bool> static_dirty(m_spot_lights.size(), false);
+    std::vector<bool> dynamic_dirty(m_spot_lights.size(), false);
+    for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
+        std::shared_ptr<SpotLight> light=m_spot_lights[l_idx];
+        if(!light->m_create_shadow){
+            continue;
+        }
+        light_frustums[l_idx]=light->shadow_map_frustum();
+
+        //a mesh that changed only matters for this light if it is inside its frustum now or if it was drawn in the shadow map before, because moving away may have revealed what is behind it
+        static_dirty[l_idx]=light->is_static_shadow_map_stale(meshes_in_scene);
+        dynamic_dirty[l_idx]=static_dirty[l_idx] || light->is_dynamic_shadow_map_stale(meshes_in_scene); //the dynamic meshes are drawn on top of the static layer so they need to be drawn again whenever it changes or when one of them is gone
+        for(size_t i=0; i<m_meshes_gl.size(); i++){
+            MeshGLSharedPtr mesh=m_meshes_gl[i];
+            if(!mesh->m_core->m_is_shadowmap_dirty){
+                continue;
+            }
+            bool is_dynamic=mesh->m_core->m_is_dynamic;
+            bool casts_shadow= mesh->m_core->m_vis.m_is_visible && !mesh->m_core->is_empty() && !is_culled(mesh, light_frustums[l_idx], light, light->shadow_map_resolution());
+            if(casts_shadow || light->is_in_shadow_map(mesh.get(), !is_dynamic)){
+                if(is_dynamic){
+                    dynamic_dirty[l_idx]=true;
+                }else{
+                    static_dirty[l_idx]=true;
+                }
+            }
+        }
+
+        if(!static_dirty[l_idx] && !dynamic_dirty[l_idx]){
+            m_nr_shadow_passes_skipped++;
+            continue;
+        }
+        if(static_dirty[l_idx]){
+            m_nr_static_shadow_passes++;
+        }
+        m_nr_dynamic_shadow_passes++;
+    }
+
+    if(use_layered){
+        render_layered_shadow_maps(light_frustums, static_dirty, dynamic_dirty);
+    }else{
+        for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
+            std::shared_ptr<SpotLight> light=m_spot_lights[l_idx];
+            if(static_dirty[l_idx]){
+                light->begin_static_shadow_map();
+                render_to_shadow_map(light, light_frustums[l_idx], false);
+            }
+            if(static_dirty[l_idx] || dynamic_dirty[l_idx]){
+                light->begin_dynamic_shadow_map();
+                render_to_shadow_map(light, light_frustums[l_idx], true);
+            }
+        }
+    }
+
+    for(size_t i=0; i<m_meshes_gl.size(); i++){
+        m_meshes_gl[i]->m_core->m_is_shadowmap_dirty=false;
+    }
+}
+
+void Viewer::render_to_shadow_map(const std::shared_ptr<SpotLight>& light, const Frustum& light_frustum, const bool dynamic_meshes){
+    const bool static_layer=!dynamic_meshes;
+    for(size_t i=0; i<m_meshes_gl.size(); i++){
+        MeshGLSharedPtr mesh=m_meshes_gl[i];
+        if(mesh->m_core->m_is_dynamic!=dynamic_meshes || !mesh->m_core->m_vis.m_is_visible || mesh->m_core->is_empty() ){
+            continue;
+        }
+
+        if(is_culled(mesh, light_frustum, light, light->shadow_map_resolution())){
+            m_nr_shadow_meshes_culled++;
+            continue;
+        }
+        m_nr_shadow_meshes_drawn++;
+
+        if(draws_triangles_in_shadow_map(mesh)){
+            light->render_mesh_to_shadow_map(mesh, static_layer);
+            m_nr_shadow_draw_calls++;
+        }
+        if(draws_points_in_shadow_map(mesh)){
+            light->render_points_to_shadow_map(mesh, static_layer);
+            m_nr_shadow_draw_calls++;
+        }
+    }
+}
+
+void Viewer::render_layered_shadow_maps(const std::vector<Frustum>& light_frustums, const std::vector<bool>& static_dirty, const std::vector<bool>& dynamic_dirty){
+    //the bits of the masks are the layers, which are not the same as the light indices because the lights without shadow have no layer
+    int static_mask=0; //layers whose static part is drawn again
+    int redraw_mask=0; //layers whose final shadow map is composed again
+    std::vector<Eigen::Matrix4f> light_VP(m_layered_shadow_maps->nr_layers(), Eigen::Matrix4f::Identity());
+    for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
+        std::shared_ptr<SpotLight> light=m_spot_lights[l_idx];
+        const int layer=m_shadow_map_layer_of_light[l_idx];
+        if(layer<0){
+            continue;
+        }
+        Eigen::Vector2f viewport_size_light;
+        viewport_size_light<< light->shadow_map_resolution(), light->shadow_map_resolution();
+        light_VP[layer]=light->proj_matrix(viewport_size_light)*light->view_matrix();
+        if(static_dirty[l_idx]){
+            static_mask|= 1<<layer;
+            light->reset_static_layer();
+        }
+        if(static_dirty[l_idx] || dynamic_dirty[l_idx]){
+            redraw_mask|= 1<<layer;
+            light->reset_dynamic_layer();
+        }
+    }
+    if(!redraw_mask){
+        return;
+    }
+    m_layered_shadow_maps->set_light_view_projections(light_VP);
+
+    //each mesh is drawn once into all the layers of the lights that see it
+    for(int pass = 0; pass < 2; pass++){
+        const bool static_layer= pass==0;
+        const int pass_mask= static_layer ? static_mask : redraw_mask;
+        if(static_layer){
+            m_layered_shadow_maps->clear_layers(static_mask, true);
+        }else{
+            m_layered_shadow_maps->copy_static_layers(redraw_mask);
+        }
+        if(!pass_mask){
+            continue;
+        }
+
+        for(size_t i=0; i<m_meshes_gl.size(); i++){
+            MeshGLSharedPtr mesh=m_meshes_gl[i];
+            if(mesh->m_core->m_is_dynamic==static_layer || !mesh->m_core->m_vis.m_is_visible || mesh->m_core->is_empty() ){
+                continue;
+            }
+
+            int mesh_mask=0;
+            for(size_t l_idx=0; l_idx<m_spot_lights.size(); l_idx++){
+                const int layer=m_shadow_map_layer_of_light[l_idx];
+                if( layer<0 || !(pass_mask & (1<<layer)) ){
+                    continue;
+                }
+                if(is_culled(mesh, light_frustums[l_idx], m_spot_lights[l_idx], m_spot_lights[l_idx]->shadow_map_resolution())){
+                    m_nr_shadow_meshes_culled++;
+                    continue;
+                }
+                m_nr_shadow_meshes_drawn++;
+                mesh_mask|= 1<<layer;
+                m_spot_lights[l_idx]->add_to_shadow_map(mesh.get(), static_layer);
+            }
+            if(!mesh_mask){
+                continue;
+            }
+
+            if(draws_triangles_in_shadow_map(mesh)){
+                m_layered_shadow_maps->render_mesh(mesh, mesh_mask, static_layer);
+                m_nr_shadow_draw_calls++;
+            }
+            if(draws_points_in_shadow_map(mesh)){
+                m_layered_shadow_maps->render_points(mesh, mesh_mask, static_layer);
+                m_nr_shadow_draw_calls++;
+            }
+        }
+    }
+}
+
+bool Viewer::draws_triangles_in_shadow_map(const MeshGLSharedPtr& mesh){
+    //if we use a custom shader we try to make an educated guess weather we should render this mesh as a mesh or as point cloud in the shadow map 
+    bool custom_as_mesh= mesh->m_core->m_vis.m_use_custom_shader && mesh->m_core->custom_render_func && mesh->m_core->F.size();
+    return mesh->m_core->m_vis.m_show_mesh || custom_as_mesh;
+}
+
+bool Viewer::draws_points_in_shadow_map(const MeshGLSharedPtr& mesh){
+    bool custom_as_points= mesh->m_core->m_vis.m_use_custom_shader && mesh->m_core->custom_render_func && !mesh->m_core->F.size();
+    bool shows_points= mesh->m_core->m_vis.m_show_points && !mesh->nr_instances(); //instanced points are not drawn in the gbuffer either, see skip_instanced()
+    return shows_points || custom_as_points;
+}
+
+bool Viewer::skip_instanced(const MeshGLSharedPtr& mesh, const std::string mode){
+    if(!mesh->nr_instances()){
+        return false;
+    }
+    //drawing a single copy at the model matrix would look like the instances are missing, so we rather draw nothing and say why
+    if(m_warned_instanced.insert(mesh->m_core->name+"/"+mode).second){
+        LOG(WARNING) << "Mesh " << mesh->m_core->name << " has instances but only its triangles can be drawn instanced. Not drawing its " << mode;
+    }
+    return true;
+}
+
+bool Viewer::is_culled(const MeshGLSharedPtr& mesh, const Frustum& frustum, const std::shared_ptr<Camera>& cam, const int viewport_width){
+    if(!m_enable_frustum_culling){
+        return false;
+    }
+    //the custom render functions can draw whatever they want so we cannot know their bounds
+    if(mesh->m_core->m_vis.m_use_custom_shader){
+        return false;
+    }
+    //children are in the scene on their own so we only need the bounds of this mesh
+    Eigen::AlignedBox3f box=mesh->m_core->world_aabb(false);
+    if(box.isEmpty()){
+        return false;
+    }
+
+    //points and surfels stick out of the box of the vertices so a vertex just outside the frustum can still cover pixels inside it
+    const VisOptions& vis=mesh->m_core->m_vis;
+    float margin=0;
+    if(vis.m_show_surfels){
+        float model_scale=mesh->m_core->m_model_matrix.linear().colwise().norm().maxCoeff();
+        margin=std::max(margin, mesh->m_core->max_surfel_radius()*model_scale);
+    }
+    if(vis.m_show_points){
+        //the point size is in pixels so the margin grows with the distance. We use the furthest corner of the box to be conservative
+        Eigen::Vector3f eye=cam->position();
+        float max_dist=(box.center()-eye).norm() + 0.5*box.diagonal().norm();
+        float pixel_size_at_unit_dist=2.0*std::tan(0.5*cam->m_fov*M_PI/180.0)/std::max(1, viewport_width);
+        margin=std::max(margin, 0.5f*std::max(1.0f, vis.m_point_size)*pixel_size_at_unit_dist*max_dist);
+    }
+    if(margin>0){
+        box.min().array()-=margin;
+        box.max().array()+=margin;
+    }
+
+    return !frustum.intersects_aabb(box.min(), box.max());
+}
+
+void Viewer::add_point_cloud_octree(const std::shared_ptr<PointCloudOctree> octree){
+    for(size_t i=0; i<m_point_cloud_octrees.size(); i++){
+        if(m_point_cloud_octrees[i]->name==octree->name){
+            LOG(FATAL) << "There is already an octree with name " << octree->name;
+        }
+    }
+    m_point_cloud_octrees.push_back(octree);
+}
+
 void Viewer::glfw_drop(GLFWwindow* window, int count, const char** paths){
     for(int i=0; i<count; i++){
         VLOG(1) << "loading from path " << paths[i]; 
@@ -2780,14 +3877,14 @@ void Viewer::glfw_drop(GLFWwindow* window, int count, const char** paths){
             // prefilter(m_prefilter_cubemap_tex, m_environment_cubemap_tex);
             load_environment_map(paths[i]);
         }else{
-            MeshSharedPtr mesh = Mesh::create();
-            bool success=mesh->load_from_file(std::string(paths[i]));
-            if (success){
-                std::string name= "mesh_" + std::to_string(m_scene->nr_meshes());
-                m_scene->add_mesh(mesh,name);
-                //select the newest mesh I added 
-                m_gui->select_mesh_with_idx( m_scene->nr_meshes()-1 );
-            }
+            //load on the worker threads and let the loader add it to the scene once it's done, this way dropping big files doesn't freeze the viewer
+            std::string name;
+            do{
+                name= "mesh_" + std::to_string(m_nr_dropped_meshes++);
+            }while(m_scene->does_mesh_with_name_exist(name));
+            m_mesh_loader->load(std::string(paths[i]), name, /*add_to_scene*/ true, [this](const std::shared_ptr<Mesh>& mesh){
+                m_gui->select_mesh_with_idx( m_scene->get_idx_for_name(mesh->name) );
+            });
         }
 
 